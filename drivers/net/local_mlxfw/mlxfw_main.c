@@ -34,6 +34,8 @@
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/version.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
 #include <linux/mlx_sx/device.h>
 #include <linux/mlx_sx/cmd.h>
 #include <linux/mlx_sx/auto_registers/cmd_auto.h>
@@ -45,6 +47,14 @@ char mfa2_file[SX_MLXFW_MFA2_MAX_FILENAME] = "";
 module_param_string(mfa2_file, mfa2_file, SX_MLXFW_MFA2_MAX_FILENAME, 0444);
 MODULE_PARM_DESC(mfa2_file, "mfa2_file: FW file type mfa2");
 
+int fsm_simulate = 0;
+module_param(fsm_simulate, int, 0444);
+MODULE_PARM_DESC(fsm_simulate, "fsm_simulate: run the flash flow against a simulated FSM, the device is not touched");
+
+int fsm_simulate_block_usec = 0;
+module_param(fsm_simulate_block_usec, int, 0444);
+MODULE_PARM_DESC(fsm_simulate_block_usec, "fsm_simulate_block_usec: simulated round trip of a block write (usec)");
+
 struct sx_dev *g_dev = NULL;
 static int sx_mlxfw_component_query(struct mlxfw_dev *mlxfw_dev,
                                     u16               component_index,
@@ -58,6 +68,7 @@ static int sx_mlxfw_component_query(struct mlxfw_dev *mlxfw_dev,
     memset(&reg_mcqi, 0, sizeof(struct ku_access_mcqi_reg));
 
 #define MLXSW_REG_MCQI_CAP_LEN      0x14
+/* MCDA is sent with MLXSW_MCDA_LEN patched to 0x90 (0004_reg_h.patch) - 128 data bytes */
 #define MLXSW_REG_MCDA_MAX_DATA_LEN 0x80
 
     reg_mcqi.dev_id = g_dev->device_id;
@@ -140,7 +151,7 @@ static int sx_mlxfw_fsm_component_update(struct mlxfw_dev *mlxfw_dev,
 
 static int sx_mlxfw_fsm_block_download(struct mlxfw_dev *mlxfw_dev, u32 fwhandle, u8 *data, u16 size, u32 offset)
 {
-    int                       ret = 0, i = 0;
+    int                       ret = 0;
     struct ku_access_mcda_reg reg_mcda;
 
     memset(&reg_mcda, 0, sizeof(struct ku_access_mcda_reg));
@@ -150,9 +161,7 @@ static int sx_mlxfw_fsm_block_download(struct mlxfw_dev *mlxfw_dev, u32 fwhandle
     reg_mcda.mcda_reg.update_handle = fwhandle;
     reg_mcda.mcda_reg.offset = offset;
     reg_mcda.mcda_reg.size = size;
-    for (i = 0; i < size / 4; i++) {
-        reg_mcda.mcda_reg.data[i] = *(u32*)&data[i * 4];
-    }
+    memcpy(reg_mcda.mcda_reg.data, data, min_t(u16, size, sizeof(reg_mcda.mcda_reg.data)));
     ret = sx_ACCESS_REG_MCDA(g_dev, &reg_mcda);
     if (ret) {
         pr_err("sx_ACCESS_REG_MCDA (fsm_block_download) returned with error %d\n", ret);
@@ -160,6 +169,53 @@ static int sx_mlxfw_fsm_block_download(struct mlxfw_dev *mlxfw_dev, u32 fwhandle
     return ret;
 }
 
+static int sx_mlxfw_fsm_block_download_batch(struct mlxfw_dev       *mlxfw_dev,
+                                             u32                     fwhandle,
+                                             struct mlxfw_fsm_block *blocks,
+                                             int                     count)
+{
+    int                        ret = 0, i = 0;
+    struct ku_access_mcda_reg *reg_list;
+    int                       *err_list;
+
+    reg_list = kcalloc(count, sizeof(*reg_list), GFP_KERNEL);
+    err_list = kcalloc(count, sizeof(*err_list), GFP_KERNEL);
+    if (!reg_list || !err_list) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    for (i = 0; i < count; i++) {
+        reg_list[i].dev_id = g_dev->device_id;
+        sx_cmd_set_op_tlv(&reg_list[i].op_tlv, MLXSW_MCDA_ID, EMAD_METHOD_WRITE);
+        reg_list[i].mcda_reg.update_handle = fwhandle;
+        reg_list[i].mcda_reg.offset = blocks[i].offset;
+        reg_list[i].mcda_reg.size = blocks[i].size;
+        memcpy(reg_list[i].mcda_reg.data, blocks[i].data,
+               min_t(u16, blocks[i].size, sizeof(reg_list[i].mcda_reg.data)));
+    }
+
+    ret = sx_ACCESS_REG_MCDA_batch(g_dev, reg_list, err_list, count);
+    if (ret) {
+        pr_err("sx_ACCESS_REG_MCDA_batch (fsm_block_download_batch) returned with error %d\n", ret);
+        goto out;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (err_list[i]) {
+            ret = err_list[i];
+            pr_err("sx_ACCESS_REG_MCDA_batch (fsm_block_download_batch) offset %u returned with error %d\n",
+                   blocks[i].offset, ret);
+            break;
+        }
+    }
+
+out:
+    kfree(err_list);
+    kfree(reg_list);
+    return ret;
+}
+
 static int sx_mlxfw_fsm_component_verify(struct mlxfw_dev *mlxfw_dev, u32 fwhandle, u16 component_index)
 {
     int                      ret = 0;
@@ -268,12 +324,195 @@ static const struct mlxfw_dev_ops sx_mlxfw_dev_ops = {
     .fsm_lock = sx_mlxfw_fsm_lock,
     .fsm_component_update = sx_mlxfw_fsm_component_update,
     .fsm_block_download = sx_mlxfw_fsm_block_download,
+    .fsm_block_download_batch = sx_mlxfw_fsm_block_download_batch,
     .fsm_component_verify = sx_mlxfw_fsm_component_verify,
     .fsm_activate = sx_mlxfw_fsm_activate,
     .fsm_query_state = sx_mlxfw_fsm_query_state,
     .fsm_cancel = sx_mlxfw_fsm_cancel,
     .fsm_release = sx_mlxfw_fsm_release
 };
+
+/*
+ * Simulated FSM (fsm_simulate=1): follows the state machine of the device FSM and checks
+ * the flow the flash lib drives - lock, in order download of the whole component, verify,
+ * activate, release - without accessing the device.
+ */
+#define SX_MLXFW_SIM_HANDLE         0x5a
+#define SX_MLXFW_SIM_MAX_WRITE_SIZE MLXSW_REG_MCDA_MAX_DATA_LEN
+#define SX_MLXFW_SIM_MAX_COMP_SIZE  (16 * (1 << 20))
+
+static struct {
+    enum mlxfw_fsm_state     state;
+    enum mlxfw_fsm_state_err state_err;
+    u16                      component_index;
+    u32                      component_size;
+    u32                      downloaded;
+    u64                      blocks;
+    u64                      batches;
+    u64                      bytes;
+} sim_fsm;
+
+static int sx_mlxfw_sim_check(u32 fwhandle, enum mlxfw_fsm_state state, const char *op)
+{
+    if ((fwhandle != SX_MLXFW_SIM_HANDLE) || (sim_fsm.state != state)) {
+        pr_err("(sim %s) unexpected handle 0x%x / state %d (expected %d)\n", op, fwhandle, sim_fsm.state, state);
+        sim_fsm.state_err = MLXFW_FSM_STATE_ERR_ERROR;
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int sx_mlxfw_sim_component_query(struct mlxfw_dev *mlxfw_dev,
+                                        u16               component_index,
+                                        u32              *p_max_size,
+                                        u8               *p_align_bits,
+                                        u16              *p_max_write_size)
+{
+    *p_max_size = SX_MLXFW_SIM_MAX_COMP_SIZE;
+    *p_align_bits = 2;
+    *p_max_write_size = SX_MLXFW_SIM_MAX_WRITE_SIZE;
+    return 0;
+}
+
+static int sx_mlxfw_sim_fsm_lock(struct mlxfw_dev *mlxfw_dev, u32 *fwhandle)
+{
+    if (sim_fsm.state != MLXFW_FSM_STATE_IDLE) {
+        pr_err("(sim fsm_lock) control state is not idle\n");
+        return -EBUSY;
+    }
+
+    memset(&sim_fsm, 0, sizeof(sim_fsm));
+    sim_fsm.state = MLXFW_FSM_STATE_LOCKED;
+    *fwhandle = SX_MLXFW_SIM_HANDLE;
+    return 0;
+}
+
+static int sx_mlxfw_sim_fsm_component_update(struct mlxfw_dev *mlxfw_dev,
+                                             u32               fwhandle,
+                                             u16               component_index,
+                                             u32               component_size)
+{
+    if (sx_mlxfw_sim_check(fwhandle, MLXFW_FSM_STATE_LOCKED, "fsm_component_update")) {
+        return -EINVAL;
+    }
+
+    sim_fsm.component_index = component_index;
+    sim_fsm.component_size = component_size;
+    sim_fsm.downloaded = 0;
+    sim_fsm.state = MLXFW_FSM_STATE_DOWNLOAD;
+    return 0;
+}
+
+static int sx_mlxfw_sim_block(u32 fwhandle, u16 size, u32 offset)
+{
+    if (sx_mlxfw_sim_check(fwhandle, MLXFW_FSM_STATE_DOWNLOAD, "fsm_block_download")) {
+        return -EINVAL;
+    }
+
+    if ((offset != sim_fsm.downloaded) || (size == 0) || (size > SX_MLXFW_SIM_MAX_WRITE_SIZE) ||
+        (offset + size > sim_fsm.component_size)) {
+        pr_err("(sim fsm_block_download) unexpected block offset %u size %u (downloaded %u of %u)\n",
+               offset, size, sim_fsm.downloaded, sim_fsm.component_size);
+        sim_fsm.state_err = MLXFW_FSM_STATE_ERR_ERROR;
+        return -EINVAL;
+    }
+
+    sim_fsm.downloaded += size;
+    sim_fsm.blocks++;
+    sim_fsm.bytes += size;
+    return 0;
+}
+
+static int sx_mlxfw_sim_fsm_block_download(struct mlxfw_dev *mlxfw_dev, u32 fwhandle, u8 *data, u16 size, u32 offset)
+{
+    if (fsm_simulate_block_usec > 0) {
+        usleep_range(fsm_simulate_block_usec, fsm_simulate_block_usec + 10);
+    }
+
+    sim_fsm.batches++;
+    return sx_mlxfw_sim_block(fwhandle, size, offset);
+}
+
+static int sx_mlxfw_sim_fsm_block_download_batch(struct mlxfw_dev       *mlxfw_dev,
+                                                 u32                     fwhandle,
+                                                 struct mlxfw_fsm_block *blocks,
+                                                 int                     count)
+{
+    int ret = 0, i = 0;
+
+    /* the writes of a batch are in flight together - one round trip for all of them */
+    if (fsm_simulate_block_usec > 0) {
+        usleep_range(fsm_simulate_block_usec, fsm_simulate_block_usec + 10);
+    }
+
+    sim_fsm.batches++;
+    for (i = 0; i < count; i++) {
+        ret = sx_mlxfw_sim_block(fwhandle, blocks[i].size, blocks[i].offset);
+        if (ret) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static int sx_mlxfw_sim_fsm_component_verify(struct mlxfw_dev *mlxfw_dev, u32 fwhandle, u16 component_index)
+{
+    if (sx_mlxfw_sim_check(fwhandle, MLXFW_FSM_STATE_DOWNLOAD, "fsm_component_verify")) {
+        return -EINVAL;
+    }
+
+    if ((component_index != sim_fsm.component_index) || (sim_fsm.downloaded != sim_fsm.component_size)) {
+        pr_err("(sim fsm_component_verify) component %u: downloaded %u of %u\n",
+               component_index, sim_fsm.downloaded, sim_fsm.component_size);
+        sim_fsm.state_err = MLXFW_FSM_STATE_ERR_REJECTED_BAD_FORMAT;
+        return 0; /* reported through the FSM state, like the device does */
+    }
+
+    sim_fsm.state = MLXFW_FSM_STATE_LOCKED;
+    return 0;
+}
+
+static int sx_mlxfw_sim_fsm_activate(struct mlxfw_dev *mlxfw_dev, u32 fwhandle)
+{
+    return sx_mlxfw_sim_check(fwhandle, MLXFW_FSM_STATE_LOCKED, "fsm_activate");
+}
+
+static int sx_mlxfw_sim_fsm_query_state(struct mlxfw_dev         *mlxfw_dev,
+                                        u32                       fwhandle,
+                                        enum mlxfw_fsm_state     *fsm_state,
+                                        enum mlxfw_fsm_state_err *fsm_state_err)
+{
+    *fsm_state = sim_fsm.state;
+    *fsm_state_err = sim_fsm.state_err;
+    return 0;
+}
+
+static void sx_mlxfw_sim_fsm_cancel(struct mlxfw_dev *mlxfw_dev, u32 fwhandle)
+{
+    sim_fsm.state = MLXFW_FSM_STATE_LOCKED;
+}
+
+static void sx_mlxfw_sim_fsm_release(struct mlxfw_dev *mlxfw_dev, u32 fwhandle)
+{
+    pr_info("(sim) %llu blocks, %llu bytes in %llu round trips\n",
+            sim_fsm.blocks, sim_fsm.bytes, sim_fsm.batches);
+    sim_fsm.state = MLXFW_FSM_STATE_IDLE;
+}
+
+static const struct mlxfw_dev_ops sx_mlxfw_sim_dev_ops = {
+    .component_query = sx_mlxfw_sim_component_query,
+    .fsm_lock = sx_mlxfw_sim_fsm_lock,
+    .fsm_component_update = sx_mlxfw_sim_fsm_component_update,
+    .fsm_block_download = sx_mlxfw_sim_fsm_block_download,
+    .fsm_block_download_batch = sx_mlxfw_sim_fsm_block_download_batch,
+    .fsm_component_verify = sx_mlxfw_sim_fsm_component_verify,
+    .fsm_activate = sx_mlxfw_sim_fsm_activate,
+    .fsm_query_state = sx_mlxfw_sim_fsm_query_state,
+    .fsm_cancel = sx_mlxfw_sim_fsm_cancel,
+    .fsm_release = sx_mlxfw_sim_fsm_release
+};
 static int __init sx_mlxfw_init(void)
 {
     int                    ret = 0;
@@ -284,7 +523,10 @@ static int __init sx_mlxfw_init(void)
 
     g_dev = sx_get_dev_context();
 
-    mlxfw_dev.ops = &sx_mlxfw_dev_ops;
+    mlxfw_dev.ops = fsm_simulate ? &sx_mlxfw_sim_dev_ops : &sx_mlxfw_dev_ops;
+    if (fsm_simulate) {
+        pr_info("%s: flashing against a simulated FSM\n", __func__);
+    }
     mlxfw_dev.psid = g_dev->board_id;
     mlxfw_dev.psid_size = strlen(g_dev->board_id);
 
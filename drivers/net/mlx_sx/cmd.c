@@ -64,6 +64,9 @@ extern int               i2c_cmd_dump;
 extern int               i2c_cmd_op;
 extern int               i2c_cmd_reg_id;
 extern int               i2c_cmd_dump_cnt;
+extern int               cmd_mailbox_pool_size;
+extern int               i2c_cmd_poll_min_usec;
+extern int               i2c_cmd_poll_max_usec;
 
 /* for simulator only */
 static int (*cmd_ifc_stub_func)(void *rxbuff, void *txbuf, int size,
@@ -364,16 +367,27 @@ static int cmd_pending(struct sx_dev *dev, int sx_dev_id, int cmd_path, u16 op,
     return status & (1 << HCR_GO_BIT);
 }
 
-static int wait_for_cmd_pending(struct sx_dev *dev, int sx_dev_id, int cmd_path, u16 op, int timeout)
+/*
+ * Over PCI the go bit is polled with cond_resched() in between. Over I2C every poll
+ * is a bus transaction, so the poller sleeps in between, starting at
+ * i2c_cmd_poll_min_usec and doubling up to i2c_cmd_poll_max_usec.
+ */
+static int wait_for_cmd_pending(struct sx_dev *dev, int sx_dev_id, int cmd_path, u16 op, int timeout,
+                                unsigned int *polls)
 {
     int           err = 0;
     unsigned long end = 0;
     unsigned long start = 0;
+    unsigned long delay_usec = max(i2c_cmd_poll_min_usec, 1);
 
     start = jiffies;
     end = msecs_to_jiffies(timeout * 10) + start;
 
     while (cmd_pending(dev, sx_dev_id, cmd_path, op, &err) || (err != 0)) {
+        if (polls) {
+            (*polls)++;
+        }
+
         if (time_after_eq(jiffies, end)) {
 #ifdef INCREASED_TIMEOUT
             end = msecs_to_jiffies(timeout * 4000) + jiffies;
@@ -390,7 +404,13 @@ static int wait_for_cmd_pending(struct sx_dev *dev, int sx_dev_id, int cmd_path,
             return -ETIMEDOUT;
 #endif
         }
-        cond_resched();
+
+        if (cmd_path == DPT_PATH_I2C) {
+            usleep_range(delay_usec, delay_usec * 2);
+            delay_usec = min(delay_usec * 2, (unsigned long)max(i2c_cmd_poll_max_usec, 1));
+        } else {
+            cond_resched();
+        }
     }
 
     return err;
@@ -414,7 +434,7 @@ static int sx_cmd_post_pci(struct sx_dev         *dev,
 
     mutex_lock(&cmd->hcr_mutex);
 
-    err = wait_for_cmd_pending(dev, dev->device_id, DPT_PATH_PCI_E, op, (event ? GO_BIT_TIMEOUT_MSECS : 0));
+    err = wait_for_cmd_pending(dev, dev->device_id, DPT_PATH_PCI_E, op, (event ? GO_BIT_TIMEOUT_MSECS : 0), NULL);
     if (-ETIMEDOUT == err) {
         if (!dev->dev_stuck) {
             printk(KERN_ERR "Device %d is stuck from a previous command. Aborting command %s.\n",
@@ -509,7 +529,7 @@ static int sx_cmd_post_i2c(struct sx_dev         *dev,
 
     mutex_lock(&cmd->hcr_mutex);
 
-    err = wait_for_cmd_pending(dev, sx_dev_id, DPT_PATH_I2C, op, I2C_GO_BIT_TIMEOUT_MSECS);
+    err = wait_for_cmd_pending(dev, sx_dev_id, DPT_PATH_I2C, op, I2C_GO_BIT_TIMEOUT_MSECS, NULL);
     if (-EUNATCH == err) {
         sx_err(dev, "client not ready yet for "
                "sx_dev_id %d\n", sx_dev_id);
@@ -637,6 +657,47 @@ static int sx_cmd_post(struct sx_dev         *dev,
     return err;
 }
 
+static void sx_cmd_i2c_stats_update(struct sx_cmd *cmd, u16 op, int err, unsigned int polls, u64 usec)
+{
+    struct sx_cmd_i2c_op_stats *stats = NULL;
+    int                         i;
+
+    spin_lock(&cmd->i2c_stats_lock);
+    for (i = 0; i < SX_CMD_I2C_OP_STATS; i++) {
+        if ((cmd->i2c_op_stats[i].op == op) || (cmd->i2c_op_stats[i].count == 0)) {
+            stats = &cmd->i2c_op_stats[i];
+            break;
+        }
+    }
+
+    if (stats) {
+        stats->op = op;
+        stats->count++;
+        stats->polls += polls;
+        stats->total_usec += usec;
+        if (err) {
+            stats->errors++;
+        }
+
+        if (usec > stats->max_usec) {
+            stats->max_usec = usec;
+        }
+    }
+    spin_unlock(&cmd->i2c_stats_lock);
+}
+
+static struct semaphore * sx_cmd_poll_sem(struct sx_cmd *cmd, int sx_dev_id, int cmd_path)
+{
+    if (cmd_path != DPT_PATH_I2C) {
+        return &cmd->pci_poll_sem;
+    }
+
+    /* commands of different devices don't wait for each other. MAD and register commands of
+     * the same device do - both go through the device's local mailboxes (in_mb_offset and
+     * out_mb_offset), which are used from the post until the output is read back */
+    return &cmd->i2c_poll_sem[sx_dev_id % SX_CMD_I2C_LANES];
+}
+
 static int sx_cmd_poll(struct sx_dev         *dev,
                        int                    sx_dev_id,
                        struct sx_cmd_mailbox *in_param,
@@ -655,10 +716,12 @@ static int sx_cmd_poll(struct sx_dev         *dev,
     struct semaphore *poll_sem;
     int               i2c_dev_id = 0;
     int               hcr_base = SX_HCR2_BASE;
+    unsigned int      polls = 0;
+    ktime_t           start;
 
-    poll_sem = (cmd_path == DPT_PATH_I2C) ?
-               &priv->cmd.i2c_poll_sem : &priv->cmd.pci_poll_sem;
+    poll_sem = sx_cmd_poll_sem(&priv->cmd, sx_dev_id, cmd_path);
     down(poll_sem);
+    start = ktime_get();
 
     if (cmd_path == DPT_PATH_I2C) {
         err = sx_dpt_get_i2c_dev_by_id(sx_dev_id, &i2c_dev_id);
@@ -700,7 +763,7 @@ static int sx_cmd_poll(struct sx_dev         *dev,
         msleep(100);
     }
 
-    err = wait_for_cmd_pending(dev, sx_dev_id, cmd_path, op, timeout);
+    err = wait_for_cmd_pending(dev, sx_dev_id, cmd_path, op, timeout, &polls);
     if (err) {
         printk(KERN_WARNING "sx_cmd_poll: got err = %d from "
                "cmd_pending\n", err);
@@ -762,6 +825,8 @@ static int sx_cmd_poll(struct sx_dev         *dev,
 out:
     if (cmd_path == DPT_PATH_I2C) {
         sx_glb.sx_i2c.release(i2c_dev_id);
+        sx_cmd_i2c_stats_update(&priv->cmd, op, err, polls,
+                                ktime_to_us(ktime_sub(ktime_get(), start)));
     }
 
 out_sem:
@@ -807,6 +872,53 @@ void sx_cmd_event(struct sx_dev *dev, u16 token, u8 status, u64 out_param)
 }
 EXPORT_SYMBOL(sx_cmd_event);
 
+static struct sx_cmd_context * sx_cmd_context_get(struct sx_cmd *cmd, u16 op)
+{
+    struct sx_cmd_context *context;
+
+    spin_lock(&cmd->context_lock);
+    BUG_ON(cmd->free_head < 0);
+    context = &cmd->context[cmd->free_head];
+    context->token += cmd->token_mask + 1;
+    context->opcode = op;
+    cmd->free_head = context->next;
+    spin_unlock(&cmd->context_lock);
+    init_completion(&context->done);
+
+    return context;
+}
+
+static void sx_cmd_context_put(struct sx_cmd *cmd, struct sx_cmd_context *context)
+{
+    spin_lock(&cmd->context_lock);
+    context->next = cmd->free_head;
+    cmd->free_head = context - cmd->context;
+    spin_unlock(&cmd->context_lock);
+
+    up(&cmd->event_sem);
+}
+
+static int sx_cmd_context_wait(struct sx_dev         *dev,
+                               int                    sx_dev_id,
+                               struct sx_cmd_context *context,
+                               u16                    op,
+                               unsigned long          timeout)
+{
+#ifdef INCREASED_TIMEOUT
+    if (!wait_for_completion_timeout(&context->done, msecs_to_jiffies(timeout * 4000))) {
+#else
+    if (!wait_for_completion_timeout(&context->done, msecs_to_jiffies(timeout))) {
+#endif
+        if (!context->done.done) {
+            sx_err(dev, "command 0x%x (%s) timeout for "
+                   "device %d\n", op, cmd_str(op), sx_dev_id);
+            return -EBUSY;
+        }
+    }
+
+    return context->result;
+}
+
 static int sx_cmd_wait(struct sx_dev         *dev,
                        int                    sx_dev_id,
                        struct sx_cmd_mailbox *in_param,
@@ -823,14 +935,7 @@ static int sx_cmd_wait(struct sx_dev         *dev,
     int                    err = 0;
 
     down(&cmd->event_sem);
-    spin_lock(&cmd->context_lock);
-    BUG_ON(cmd->free_head < 0);
-    context = &cmd->context[cmd->free_head];
-    context->token += cmd->token_mask + 1;
-    context->opcode = op;
-    cmd->free_head = context->next;
-    spin_unlock(&cmd->context_lock);
-    init_completion(&context->done);
+    context = sx_cmd_context_get(cmd, op);
 #ifdef NO_PCI
     if (cmd_ifc_stub_func) {
         void *in_buf = in_param ? in_param->buf : NULL;
@@ -851,20 +956,7 @@ static int sx_cmd_wait(struct sx_dev         *dev,
                 op_modifier, op, context->token, 1, cmd_path, 0);
 #endif
 
-#ifdef INCREASED_TIMEOUT
-    if (!wait_for_completion_timeout(&context->done, msecs_to_jiffies(timeout * 4000))) {
-#else
-    if (!wait_for_completion_timeout(&context->done, msecs_to_jiffies(timeout))) {
-#endif
-        if (!context->done.done) {
-            sx_err(dev, "command 0x%x (%s) timeout for "
-                   "device %d\n", op, cmd_str(op), sx_dev_id);
-            err = -EBUSY;
-            goto out;
-        }
-    }
-
-    err = context->result;
+    err = sx_cmd_context_wait(dev, sx_dev_id, context, op, timeout);
     if (err) {
         goto out;
     }
@@ -874,12 +966,7 @@ static int sx_cmd_wait(struct sx_dev         *dev,
     }
 
 out:
-    spin_lock(&cmd->context_lock);
-    context->next = cmd->free_head;
-    cmd->free_head = context - cmd->context;
-    spin_unlock(&cmd->context_lock);
-
-    up(&cmd->event_sem);
+    sx_cmd_context_put(cmd, context);
     return err;
 }
 
@@ -1067,6 +1154,123 @@ int __sx_cmd(struct sx_dev         *dev,
 }
 EXPORT_SYMBOL(__sx_cmd);
 
+/*
+ * Run a batch of mailbox commands. In event mode over PCI the commands are posted
+ * back to back, each on its own token, with up to max_cmds - 1 of them in flight
+ * (one token is left to other callers), and their completions are collected in
+ * order. Otherwise the commands are run one by one. The result of every command
+ * is returned in its entry, the return value is only about the batch itself.
+ * Entries that already hold an error are skipped.
+ */
+int sx_cmd_box_batch(struct sx_dev              *dev,
+                     int                         sx_dev_id,
+                     struct sx_cmd_batch_entry *entries,
+                     int                         count,
+                     unsigned long               timeout)
+{
+    struct sx_cmd           *cmd = &sx_priv(dev)->cmd;
+    struct sx_cmd_context  **inflight = NULL;
+    struct sx_cmd_batch_entry *entry;
+    int                      cmd_dev_id = sx_dev_id;
+    int                      cmd_path;
+    int                      window;
+    int                      posted = 0;
+    int                      done = 0;
+    int                      err = 0;
+    int                      i;
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    if ((cmd_dev_id == DEFAULT_DEVICE_ID) && is_sgmii_supported()) {
+        err = sgmii_default_dev_id_get(&cmd_dev_id);
+        if (err) {
+            return err;
+        }
+    }
+
+    cmd_path = sx_dpt_get_cmd_path(cmd_dev_id);
+    if (cmd_path == DPT_PATH_INVALID) {
+        printk(KERN_ERR PFX "Command path in DPT for device %d is not valid. "
+               "Aborting a batch of %d commands\n", cmd_dev_id, count);
+
+        for (i = 0; i < count; i++) {
+            entries[i].err = -EINVAL;
+        }
+
+        return -EINVAL;
+    }
+
+#ifndef NO_PCI
+    if (cmd->use_events && (cmd_path == DPT_PATH_PCI_E) && dev->pdev) {
+        inflight = kcalloc(count, sizeof(*inflight), GFP_KERNEL);
+    }
+#endif
+
+    if (!inflight) {
+        for (i = 0; i < count; i++) {
+            entry = &entries[i];
+            if (entry->err) {
+                continue;
+            }
+
+            entry->err = __sx_cmd(dev, sx_dev_id, entry->in_param, entry->out_param, 0,
+                                  entry->in_modifier, entry->op_modifier, entry->op,
+                                  timeout, entry->in_mb_size);
+        }
+
+        return 0;
+    }
+
+    window = max(cmd->max_cmds - 1, 1);
+    while (done < count) {
+        while ((posted < count) && (posted - done < window)) {
+            entry = &entries[posted];
+            if (entry->err) {
+                posted++;
+                continue;
+            }
+
+            /* never block on a token while holding tokens of our own */
+            if (posted == done) {
+                down(&cmd->event_sem);
+            } else if (down_trylock(&cmd->event_sem)) {
+                break;
+            }
+
+            inflight[posted] = sx_cmd_context_get(cmd, entry->op);
+            entry->err = sx_cmd_post(dev, cmd_dev_id, entry->in_param, entry->out_param,
+                                     entry->in_modifier, entry->op_modifier, entry->op,
+                                     inflight[posted]->token, 1, cmd_path, 0);
+            if (entry->err) {
+                sx_cmd_context_put(cmd, inflight[posted]);
+                inflight[posted] = NULL;
+            }
+
+            posted++;
+        }
+
+        entry = &entries[done];
+        if (inflight[done]) {
+            entry->err = sx_cmd_context_wait(dev, cmd_dev_id, inflight[done], entry->op, timeout);
+            sx_cmd_context_put(cmd, inflight[done]);
+
+            if (i2c_cmd_dump) {
+                __dump_cmd(dev, cmd_dev_id, entry->in_param, entry->out_param, 0,
+                           entry->in_modifier, entry->op_modifier, entry->op,
+                           timeout, entry->in_mb_size, cmd_path);
+            }
+        }
+
+        done++;
+    }
+
+    kfree(inflight);
+    return 0;
+}
+EXPORT_SYMBOL(sx_cmd_box_batch);
+
 void sx_cmd_unmap(struct sx_dev *dev)
 {
     struct sx_cmd *cmd = &sx_priv(dev)->cmd;
@@ -1075,6 +1279,58 @@ void sx_cmd_unmap(struct sx_dev *dev)
     cmd->hcr = NULL;
 }
 
+static void sx_cmd_mailbox_pool_destroy(struct sx_cmd *cmd)
+{
+    struct sx_cmd_mailbox_pool *mb_pool = &cmd->mailbox_pool;
+    u32                         i;
+
+    for (i = 0; i < mb_pool->size; i++) {
+        pci_pool_free(cmd->pool, mb_pool->entries[i].buf, mb_pool->entries[i].dma);
+    }
+
+    kfree(mb_pool->free_list);
+    kfree(mb_pool->entries);
+    mb_pool->free_list = NULL;
+    mb_pool->entries = NULL;
+    mb_pool->size = 0;
+    mb_pool->free_count = 0;
+}
+
+/* a pool that could not be filled just has fewer entries, register access falls back to allocation */
+static void sx_cmd_mailbox_pool_init(struct sx_dev *dev, struct sx_cmd *cmd)
+{
+    struct sx_cmd_mailbox_pool *mb_pool = &cmd->mailbox_pool;
+    u32                         size = max(cmd_mailbox_pool_size, 0);
+    u32                         i;
+
+    memset(mb_pool, 0, sizeof(*mb_pool));
+    spin_lock_init(&mb_pool->lock);
+    if (size == 0) {
+        return;
+    }
+
+    mb_pool->entries = kcalloc(size, sizeof(*mb_pool->entries), GFP_KERNEL);
+    mb_pool->free_list = kcalloc(size, sizeof(*mb_pool->free_list), GFP_KERNEL);
+    if (!mb_pool->entries || !mb_pool->free_list) {
+        sx_warn(dev, "Failed to allocate the command mailbox pool\n");
+        sx_cmd_mailbox_pool_destroy(cmd);
+        return;
+    }
+
+    for (i = 0; i < size; i++) {
+        mb_pool->entries[i].buf = pci_pool_alloc(cmd->pool, GFP_KERNEL, &mb_pool->entries[i].dma);
+        if (!mb_pool->entries[i].buf) {
+            sx_warn(dev, "Command mailbox pool is limited to %u mailboxes\n", i);
+            break;
+        }
+
+        mb_pool->free_list[i] = &mb_pool->entries[i];
+    }
+
+    mb_pool->size = i;
+    mb_pool->free_count = i;
+}
+
 int sx_cmd_pool_create(struct sx_dev *dev)
 {
     struct sx_cmd *cmd = &sx_priv(dev)->cmd;
@@ -1086,6 +1342,8 @@ int sx_cmd_pool_create(struct sx_dev *dev)
         return -ENOMEM;
     }
 
+    sx_cmd_mailbox_pool_init(dev, cmd);
+
     return 0;
 }
 
@@ -1093,6 +1351,7 @@ void sx_cmd_pool_destroy(struct sx_dev *dev)
 {
     struct sx_cmd *cmd = &sx_priv(dev)->cmd;
 
+    sx_cmd_mailbox_pool_destroy(cmd);
     pci_pool_destroy(cmd->pool);
     cmd->pool = NULL;
 }
@@ -1100,10 +1359,14 @@ void sx_cmd_pool_destroy(struct sx_dev *dev)
 int sx_cmd_init(struct sx_dev *dev)
 {
     struct sx_cmd *cmd = &sx_priv(dev)->cmd;
+    int            i;
 
     mutex_init(&cmd->hcr_mutex);
     sema_init(&cmd->pci_poll_sem, 1);
-    sema_init(&cmd->i2c_poll_sem, 1);
+    for (i = 0; i < SX_CMD_I2C_LANES; i++) {
+        sema_init(&cmd->i2c_poll_sem[i], 1);
+    }
+    spin_lock_init(&cmd->i2c_stats_lock);
     cmd->use_events = 0;
     cmd->toggle = 1;
     cmd->max_cmds = 10;
@@ -1253,6 +1516,65 @@ void sx_free_cmd_mailbox(struct sx_dev *dev, struct sx_cmd_mailbox *mailbox)
 }
 EXPORT_SYMBOL(sx_free_cmd_mailbox);
 
+/* Same as sx_alloc_cmd_mailbox() but takes a mailbox from the pool of the device when
+ * possible. The buffer is not cleared, the caller clears what it is going to send. */
+struct sx_cmd_mailbox * sx_cmd_mailbox_pool_get(struct sx_dev *dev, int sx_dev_id)
+{
+    struct sx_cmd_mailbox_pool *mb_pool;
+    struct sx_cmd_mailbox      *mailbox = NULL;
+    unsigned long               flags;
+    u32                         in_use;
+
+    if (!dev || !dev->pdev || is_sgmii_device(sx_dev_id) ||
+        !sx_dpt_is_path_valid(dev->device_id, DPT_PATH_PCI_E)) {
+        return sx_alloc_cmd_mailbox(dev, sx_dev_id);
+    }
+
+    mb_pool = &sx_priv(dev)->cmd.mailbox_pool;
+    spin_lock_irqsave(&mb_pool->lock, flags);
+    if (mb_pool->free_count) {
+        mailbox = mb_pool->free_list[--mb_pool->free_count];
+        mb_pool->hit++;
+        in_use = mb_pool->size - mb_pool->free_count;
+        if (in_use > mb_pool->max_in_use) {
+            mb_pool->max_in_use = in_use;
+        }
+    } else {
+        mb_pool->miss++;
+    }
+    spin_unlock_irqrestore(&mb_pool->lock, flags);
+
+    if (!mailbox) {
+        return sx_alloc_cmd_mailbox(dev, sx_dev_id);
+    }
+
+    mailbox->imm_data = 0;
+    mailbox->is_in_param_imm = 0;
+    mailbox->is_out_param_imm = 0;
+
+    return mailbox;
+}
+
+void sx_cmd_mailbox_pool_put(struct sx_dev *dev, struct sx_cmd_mailbox *mailbox)
+{
+    struct sx_cmd_mailbox_pool *mb_pool;
+    unsigned long               flags;
+
+    if (!mailbox || !dev) {
+        return;
+    }
+
+    mb_pool = &sx_priv(dev)->cmd.mailbox_pool;
+    if ((mailbox < mb_pool->entries) || (mailbox >= mb_pool->entries + mb_pool->size)) {
+        sx_free_cmd_mailbox(dev, mailbox);
+        return;
+    }
+
+    spin_lock_irqsave(&mb_pool->lock, flags);
+    mb_pool->free_list[mb_pool->free_count++] = mailbox;
+    spin_unlock_irqrestore(&mb_pool->lock, flags);
+}
+
 
 /************************************************
  *                  EOF                         *
@@ -60,6 +60,7 @@
 #include "sx_proc.h"
 #include "sx_clock.h"
 #include "sgmii.h"
+#include "emad.h"
 
 #define CREATE_TRACE_POINTS
 #include "trace.h"
@@ -107,7 +108,13 @@ extern int               cpu_traffic_priority_disrupt_low_prio_upon_stress;
 extern int               cpu_traffic_priority_disrupt_low_prio_upon_stress_delay;
 extern int               mon_cq_thread_delay_time_usec;
 extern int               enable_monitor_rdq_trace_points;
+extern int               low_prio_cq_thread_cpu;
+extern int               mon_cq_thread_cpu;
 extern int               enable_cpu_port_loopback;
+extern int               cq_moder_max_usec;
+extern int               cq_moder_rate_low;
+extern int               cq_moder_rate_high;
+extern int               cq_busy_poll_usec;
 unsigned int             credit_thread_vals[1001] = {0};
 unsigned int             arr_count = 0;
 atomic_t                 cq_backup_polling_enabled = ATOMIC_INIT(1);
@@ -233,12 +240,14 @@ void sx_fill_params_from_cqe_v2(union sx_cqe *u_cqe,
 
 static u16 get_truncate_size_from_db(struct sx_dev *dev, int dqn)
 {
-    u16           ret = 0;
-    unsigned long flags;
+    struct sx_priv *priv = sx_priv(dev);
+    u16             ret = 0;
+    unsigned        seq;
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    ret = sx_priv(dev)->truncate_size_db[dqn];
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    do {
+        seq = sx_db_read_begin(priv);
+        ret = priv->truncate_size_db[dqn];
+    } while (sx_db_read_retry(priv, seq));
 
     return ret;
 }
@@ -246,39 +255,33 @@ static u16 get_truncate_size_from_db(struct sx_dev *dev, int dqn)
 /* Returns 1 if the port/lag id is found in the trap filter DB and the packet should be dropped */
 static u8 check_trap_port_in_filter_db(struct sx_dev *dev, u16 hw_synd, u8 is_lag, u16 sysport_lag_id)
 {
-    int           i;
-    u8            ret = 0;
-    unsigned long flags;
-
-    if (is_lag) {
-        spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-        for (i = 0; i < MAX_LAG_PORTS_IN_FILTER; i++) {
-            if (sx_priv(dev)->lag_filter_db[hw_synd][i] == sysport_lag_id) {
-                inc_filtered_lag_packets_counter(dev);
-                ret = 1;
-                break;
-            }
-        }
-
-        spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-        return ret;
-    }
+    struct sx_trap_filter *filter;
+    u8                     ret = 0;
 
     /* EMADs can be received with sysport==0 */
-    if (sysport_lag_id == 0) {
+    if (!is_lag && (sysport_lag_id == 0)) {
         return 0;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    for (i = 0; i < MAX_SYSTEM_PORTS_IN_FILTER; i++) {
-        if (sx_priv(dev)->sysport_filter_db[hw_synd][i] == sysport_lag_id) {
+    rcu_read_lock();
+    filter = rcu_dereference(sx_priv(dev)->trap_filter->synd[hw_synd]);
+    if (filter) {
+        if (is_lag) {
+            ret = (sysport_lag_id <= SXD_LAG_ID_MAX) && test_bit(sysport_lag_id, filter->lag_bitmap);
+        } else {
+            ret = test_bit(sysport_lag_id, filter->sysport_bitmap);
+        }
+    }
+    rcu_read_unlock();
+
+    if (ret) {
+        if (is_lag) {
+            inc_filtered_lag_packets_counter(dev);
+        } else {
             inc_filtered_port_packets_counter(dev);
-            ret = 1;
-            break;
         }
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
     return ret;
 }
 
@@ -548,17 +551,18 @@ static void sx_parse_event(struct completion_info *ci)
 
 static u16 get_vid_from_db(struct sx_dev *dev, u8 is_lag, u16 sysport_lag_id)
 {
-    u16           ret = 1;
-    unsigned long flags;
+    struct sx_priv *priv = sx_priv(dev);
+    u16             ret = 1;
+    unsigned        seq;
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        ret = sx_priv(dev)->pvid_lag_db[sysport_lag_id];
-    } else {
-        ret = sx_priv(dev)->pvid_sysport_db[sysport_lag_id];
-    }
-
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    do {
+        seq = sx_db_read_begin(priv);
+        if (is_lag) {
+            ret = priv->pvid_lag_db[sysport_lag_id];
+        } else {
+            ret = priv->pvid_sysport_db[sysport_lag_id];
+        }
+    } while (sx_db_read_retry(priv, seq));
 
     return ret;
 }
@@ -581,7 +585,12 @@ static u32 get_qpn(u16 hw_synd, struct sk_buff *skb)
 
     return qpn;
 }
-static int is_port_Vlan_matching(struct completion_info *ci, struct listener_port_vlan_entry *listener)
+
+/*
+ * The hash key already carries the port/LAG/VLAN value, so a looked-up port/vlan listener
+ * always matches the packet and only the accepted counters are left to update here.
+ */
+static void __count_port_vlan_accepted(struct listener_port_vlan_entry *listener)
 {
     switch (listener->match_crit) {
     case PORT_VLAN_MATCH_GLOBAL:
@@ -589,34 +598,17 @@ static int is_port_Vlan_matching(struct completion_info *ci, struct listener_por
         break;
 
     case PORT_VLAN_MATCH_PORT_VALID:
-        if (ci->sysport != listener->sysport) {
-            COUNTER_INC(&listener->counters.listener_port_vlan.mismtach.sysport);
-            return 0;
-        }
-
         COUNTER_INC(&listener->counters.listener_port_vlan.accepted.sysport);
         break;
 
     case PORT_VLAN_MATCH_LAG_VALID:
-        if (!(ci->is_lag) || (ci->sysport != listener->lag_id)) {
-            COUNTER_INC(&listener->counters.listener_port_vlan.mismtach.lag);
-            return 0;
-        }
-
         COUNTER_INC(&listener->counters.listener_port_vlan.accepted.lag);
         break;
 
     case PORT_VLAN_MATCH_VLAN_VALID:
-        if (ci->vid != listener->vlan) {
-            COUNTER_INC(&listener->counters.listener_port_vlan.mismtach.vlan);
-            return 0;
-        }
-
         COUNTER_INC(&listener->counters.listener_port_vlan.accepted.vlan);
         break;
     }
-
-    return 1;
 }
 
 static int is_matching(struct completion_info          *ci,
@@ -731,20 +723,84 @@ static int is_matching(struct completion_info          *ci,
     return 0;
 }
 
+static int __dispatch_port_vlan_listener(struct completion_info          *ci,
+                                         struct listener_port_vlan_entry *port_vlan_listener,
+                                         int                              num_found,
+                                         u8                               defaults)
+{
+    struct listener_entry *listener;
+    u8                     is_default;
+
+    if (!defaults) {
+        __count_port_vlan_accepted(port_vlan_listener);
+    }
+
+    list_for_each_entry_rcu(listener, &port_vlan_listener->listener.list, list) {
+        if (!!listener->is_default != defaults) {
+            continue;
+        }
+
+        if (listener->is_default && (num_found == 0)) {
+            COUNTER_INC(&port_vlan_listener->counters.listener.accepted.def);
+            is_default = 1;
+        } else {
+            is_default = 0;
+        }
+
+        if (is_default || is_matching(ci, port_vlan_listener, listener)) {
+            listener->handler(ci, listener->context);
+            atomic64_inc(&listener->rx_pkts);
+            ++num_found;
+        }
+    }
+
+    return num_found;
+}
+
+static int __dispatch_by_key(struct completion_info *ci, u64 key, int num_found, u8 defaults)
+{
+    struct listener_port_vlan_entry *port_vlan_listener;
+
+    hash_for_each_possible_rcu(sx_glb.listeners_hash, port_vlan_listener, hash_node, key) {
+        if (port_vlan_listener->hash_key == key) {
+            /* there is at most one port/vlan listener per key */
+            return __dispatch_port_vlan_listener(ci, port_vlan_listener, num_found, defaults);
+        }
+    }
+
+    return num_found;
+}
+
+static int __dispatch_synd(struct completion_info *ci, u16 entry, int num_found, u8 defaults)
+{
+    num_found = __dispatch_by_key(ci,
+                                  sx_listener_hash_key(entry, PORT_VLAN_MATCH_PORT_VALID, ci->sysport),
+                                  num_found, defaults);
+    if (ci->is_lag) {
+        num_found = __dispatch_by_key(ci,
+                                      sx_listener_hash_key(entry, PORT_VLAN_MATCH_LAG_VALID, ci->sysport),
+                                      num_found, defaults);
+    }
+    num_found = __dispatch_by_key(ci,
+                                  sx_listener_hash_key(entry, PORT_VLAN_MATCH_VLAN_VALID, ci->vid),
+                                  num_found, defaults);
+    num_found = __dispatch_by_key(ci,
+                                  sx_listener_hash_key(entry, PORT_VLAN_MATCH_GLOBAL, 0),
+                                  num_found, defaults);
+
+    return num_found;
+}
+
 /*
- * filter the listeners table, and call all relevant handlers
+ * filter the listeners table, and call all relevant handlers.
+ * The listeners are looked up in sx_glb.listeners_hash under RCU, so the RX path never
+ * takes sx_glb.listeners_lock. For every syndrome the non-default listeners of all the
+ * port/LAG/VLAN/global keys are served first, and the default listeners only take the
+ * packet if none of them consumed it (the list used to keep defaults at the tail for that).
  */
 int dispatch_pkt(struct sx_dev *dev, struct completion_info *ci, u16 entry, int dispatch_default)
 {
-    struct listener_entry           *listener;
-    struct listener_port_vlan_entry *port_vlan_listener;
-    struct list_head                *pos;
-    struct list_head                *port_vlan_pos;
-    unsigned long                    flags;
-    cq_handler                       listener_handler; /*The completion handler*/
-    void                            *listener_context; /*to pass to the handler*/
-    int                              num_found = 0;
-    u8                               is_default;
+    int num_found = 0;
 
     /* validate the syndrome range */
     if (entry > NUM_HW_SYNDROMES) {
@@ -753,41 +809,19 @@ int dispatch_pkt(struct sx_dev *dev, struct completion_info *ci, u16 entry, int
         return -1;
     }
 
-    spin_lock_irqsave(&sx_glb.listeners_lock, flags);
+    rcu_read_lock();
     /* Checking syndrome registration and NUM_HW_SYNDROMES callback iff dispatch_default set */
     /* I don't like the syndrome dispatchers at all, but it's too late to change */
     while (1) {
-        if (!list_empty(&sx_glb.listeners_db[entry].list)) {
-            list_for_each(port_vlan_pos, &sx_glb.listeners_db[entry].list) {
-                port_vlan_listener = list_entry(port_vlan_pos, struct listener_port_vlan_entry, list);
-                if (is_port_Vlan_matching(ci, port_vlan_listener)) {
-                    list_for_each(pos, &(port_vlan_listener->listener.list)) {
-                        listener = list_entry(pos, struct listener_entry, list);
-
-                        if (listener->is_default && (num_found == 0)) {
-                            COUNTER_INC(&port_vlan_listener->counters.listener.accepted.def);
-                            is_default = 1;
-                        } else {
-                            is_default = 0;
-                        }
-
-                        if (is_default || is_matching(ci, port_vlan_listener, listener)) {
-                            listener_handler = listener->handler;
-                            listener_context = listener->context;
-                            listener_handler(ci, listener_context);
-                            listener->rx_pkts++;
-                            ++num_found;
-                        }
-                    }
-                }
-            }
-        }
+        num_found = __dispatch_synd(ci, entry, num_found, 0);
+        num_found = __dispatch_synd(ci, entry, num_found, 1);
+
         if (!dispatch_default || (entry == NUM_HW_SYNDROMES)) {
             break;
         }
         entry = NUM_HW_SYNDROMES;
     }
-    spin_unlock_irqrestore(&sx_glb.listeners_lock, flags);
+    rcu_read_unlock();
 
     if (num_found == 0) {
         inc_unconsumed_packets_counter(dev, ci->hw_synd, ci->pkt_type);
@@ -888,8 +922,7 @@ int rx_ptp_trap_handler(struct sx_priv *priv, struct completion_info *ci, int cq
         rx_ptp_event->ci = ci;
 
         spin_lock_bh(&ptp_rx_db.sysport_lock[sysport]);
-        list_add_tail(&rx_ptp_event->common.list, &ptp_rx_db.sysport_events_list[sysport]);
-        atomic64_inc(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_PENDING_EVENTS]);
+        ptp_enqueue_event(sysport, &rx_ptp_event->common, &ptp_rx_db);
 
         if (!need_timestamp) {
             ptp_dequeue_general_messages(sysport, &ptp_rx_db);
@@ -989,6 +1022,9 @@ int rx_skb(void                  *context,
     u8                      is_isx = 0;
     u16                     byte_count = 0;
     u16                     mad_attr_id;
+    struct sx_stats        *glb_stats, *dev_stats;
+    unsigned long           stats_flags;
+    u8                      stats_swid;
 
 #ifdef SX_DEBUG
     printk(KERN_DEBUG PFX "rx_skb: Entered function\n");
@@ -1149,19 +1185,17 @@ int rx_skb(void                  *context,
         }
     }
 
-    sx_glb.stats.rx_by_pkt_type[ci->swid][ci->pkt_type]++;
-    sx_glb.stats.rx_by_synd[ci->swid][ci->hw_synd]++;
-    sx_glb.stats.rx_by_synd_bytes[ci->swid][ci->hw_synd] += skb->len;
+    glb_stats = sx_stats_pcpu_get(&sx_glb.stats, &stats_flags);
+    glb_stats->rx_by_pkt_type[ci->swid][ci->pkt_type]++;
+    glb_stats->rx_by_synd[ci->swid][ci->hw_synd]++;
+    glb_stats->rx_by_synd_bytes[ci->swid][ci->hw_synd] += skb->len;
 
-    if (ci->swid < NUMBER_OF_SWIDS) {
-        sx_device->stats.rx_by_pkt_type[ci->swid][ci->pkt_type]++;
-        sx_device->stats.rx_by_synd[ci->swid][ci->hw_synd]++;
-        sx_device->stats.rx_by_synd_bytes[ci->swid][ci->hw_synd] += skb->len;
-    } else {
-        sx_device->stats.rx_by_pkt_type[NUMBER_OF_SWIDS][ci->pkt_type]++;
-        sx_device->stats.rx_by_synd[NUMBER_OF_SWIDS][ci->hw_synd]++;
-        sx_device->stats.rx_by_synd_bytes[NUMBER_OF_SWIDS][ci->hw_synd] += skb->len;
-    }
+    dev_stats = sx_device->stats.per_cpu[smp_processor_id()];
+    stats_swid = (ci->swid < NUMBER_OF_SWIDS) ? ci->swid : NUMBER_OF_SWIDS;
+    dev_stats->rx_by_pkt_type[stats_swid][ci->pkt_type]++;
+    dev_stats->rx_by_synd[stats_swid][ci->hw_synd]++;
+    dev_stats->rx_by_synd_bytes[stats_swid][ci->hw_synd] += skb->len;
+    sx_stats_pcpu_put(stats_flags);
 
     if (enable_cpu_port_loopback) { /* it's a DEBUG feature */
         if (((ci->sysport != 0) || (ci->is_lag != 0)) && !is_from_monitor_rdq) {
@@ -1316,6 +1350,12 @@ int rx_skb(void                  *context,
     }
 #endif
 
+    /* responses of the EMAD pipeline go back to their sender, not to the listeners */
+    if (((ci->pkt_type == PKT_TYPE_ETH) || (ci->pkt_type == PKT_TYPE_FCoETH)) &&
+        (ci->info.eth.ethtype == ETHTYPE_EMAD) && !is_from_monitor_rdq && sx_emad_rx(ci)) {
+        goto out;
+    }
+
     if (priv->tstamp.is_ptp_enable && !is_from_monitor_rdq) {
         cqn = dqn + NUMBER_OF_SDQS;
         err = rx_ptp_trap_handler(priv, ci, cqn);
@@ -1489,11 +1529,31 @@ void wqe_sync_for_cpu(struct sx_dq *dq, int idx)
     }
 }
 
+/* Syncs a received buffer for the CPU but keeps it mapped, so it can be recycled by the RDQ pool */
+static dma_addr_t rdq_wqe_sync_for_cpu_keep_mapped(struct sx_dq *dq, int idx)
+{
+    dma_addr_t dma_addr = dq->sge[idx].hdr_pld_sg.dma_addr;
+
+    pci_dma_sync_single_for_cpu(dq->dev->pdev,
+                                dma_addr,
+                                dq->sge[idx].hdr_pld_sg.len, DMA_FROM_DEVICE);
+    dq->sge[idx].hdr_pld_sg.vaddr = NULL;
+    dq->sge[idx].hdr_pld_sg.len = 0;
+
+    return dma_addr;
+}
+
 static int post_skb(struct sx_dq *dq)
 {
     u16             size = dq->dev->profile.rdq_properties[dq->dqn].entry_size;
     int             err = 0;
     struct sk_buff *new_skb;
+    dma_addr_t      dma_addr;
+
+    if (sx_core_rdq_pool_get(dq, &new_skb, &dma_addr) == 0) {
+        sx_core_post_recv_mapped(dq, new_skb, dma_addr);
+        return 0;
+    }
 
     new_skb = alloc_skb(size, GFP_ATOMIC);
     if (!new_skb) {
@@ -1573,6 +1633,8 @@ static int sx_poll_one(struct sx_cq *cq, const struct timespec *timestamp)
     struct sk_buff *skb;
     int             err = 0;
     struct sx_priv *priv = sx_priv(cq->sx_dev);
+    int             is_pooled = 0;
+    dma_addr_t      dma_addr = 0;
     u16             wqe_ctr = 0;
     u16             idx = 0;
     u16             wqe_counter = 0;
@@ -1697,7 +1759,12 @@ static int sx_poll_one(struct sx_cq *cq, const struct timespec *timestamp)
         }
 
         ++dq->tail;
-        wqe_sync_for_cpu(dq, idx);
+        is_pooled = sx_core_rdq_pool_is_active(dq);
+        if (is_pooled) {
+            dma_addr = rdq_wqe_sync_for_cpu_keep_mapped(dq, idx);
+        } else {
+            wqe_sync_for_cpu(dq, idx);
+        }
 #ifdef SX_DEBUG
         printk(KERN_DEBUG PFX "sx_poll_one: This is a RDQ, idx = %d, "
                "wqe_ctr = %d, dq->tail = %d. "
@@ -1719,11 +1786,17 @@ static int sx_poll_one(struct sx_cq *cq, const struct timespec *timestamp)
             goto skip;
         }
 
+        if (is_pooled) {
+            /* the pool's reference, released by sx_core_rdq_pool_put() */
+            skb_get(skb);
+        }
+
         if (!is_err) {
             /* if packet length is less than 2K, let's reallocate it and reassign lower skb->truesize.
              * current skb->truesize is 10K and IP stack accounts for truesize and not for actual buffer size.
+             * Pooled buffers are not cloned, otherwise they could never be recycled.
              */
-            if (byte_count <= 2048) {
+            if ((byte_count <= 2048) && !is_pooled) {
                 struct sk_buff *new_skb;
 
                 new_skb = skb_clone(skb, GFP_ATOMIC);
@@ -1741,6 +1814,10 @@ static int sx_poll_one(struct sx_cq *cq, const struct timespec *timestamp)
             sx_skb_free(skb);
         }
 
+        if (is_pooled) {
+            sx_core_rdq_pool_put(dq, skb, dma_addr);
+        }
+
         dq->sge[idx].skb = NULL;
     }
 skip:
@@ -1764,6 +1841,182 @@ skip:
     return err;
 }
 
+#define SX_CQ_MODER_WINDOW_MSEC 100
+
+static enum hrtimer_restart sx_cq_moder_timer_fn(struct hrtimer *timer)
+{
+    struct sx_cq *cq = container_of(timer, struct sx_cq, moder.arm_timer);
+
+    sx_cq_arm(cq);
+
+    return HRTIMER_NORESTART;
+}
+
+static void sx_cq_moder_init(struct sx_cq *cq)
+{
+    struct sx_cq_moder *moder = &cq->moder;
+
+    moder->max_usec = min_t(u32, max(cq_moder_max_usec, 0), SX_CQ_MODER_USEC_MAX);
+    moder->rate_low = max(cq_moder_rate_low, 0);
+    moder->rate_high = max(cq_moder_rate_high, 0);
+    if (moder->rate_high <= moder->rate_low) {
+        moder->max_usec = 0;
+    }
+
+    moder->busy_poll_usec = min_t(u32, max(cq_busy_poll_usec, 0), SX_CQ_BUSY_POLL_USEC_MAX);
+    moder->window_start = jiffies;
+    hrtimer_init(&moder->arm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    moder->arm_timer.function = sx_cq_moder_timer_fn;
+}
+
+/* Once per window, turn the CQE rate of the window into the delay of the next re-arms */
+static void sx_cq_moder_sample(struct sx_cq_moder *moder, int num_of_cqes)
+{
+    unsigned long elapsed;
+    u64           tmp;
+
+    moder->window_cqes += num_of_cqes;
+    elapsed = jiffies - moder->window_start;
+    if (elapsed < msecs_to_jiffies(SX_CQ_MODER_WINDOW_MSEC)) {
+        return;
+    }
+
+    tmp = (u64)moder->window_cqes * HZ;
+    do_div(tmp, elapsed);
+    moder->rate = (u32)min_t(u64, tmp, 0xffffffff);
+    moder->window_cqes = 0;
+    moder->window_start = jiffies;
+
+    if (!moder->max_usec || (moder->rate <= moder->rate_low)) {
+        moder->cur_usec = 0;
+    } else if (moder->rate >= moder->rate_high) {
+        moder->cur_usec = moder->max_usec;
+    } else {
+        tmp = (u64)moder->max_usec * (moder->rate - moder->rate_low);
+        do_div(tmp, moder->rate_high - moder->rate_low);
+        moder->cur_usec = (u32)tmp;
+    }
+}
+
+static void sx_cq_moder_arm(struct sx_cq *cq)
+{
+    struct sx_cq_moder *moder = &cq->moder;
+
+    if (!moder->cur_usec) {
+        moder->arms++;
+        sx_cq_arm(cq);
+        return;
+    }
+
+    /* CQEs that arrive until the timer expires are reported by a single event */
+    if (!hrtimer_active(&moder->arm_timer)) {
+        moder->deferred_arms++;
+        hrtimer_start(&moder->arm_timer,
+                      ktime_set(0, moder->cur_usec * NSEC_PER_USEC),
+                      HRTIMER_MODE_REL);
+    }
+}
+
+/* Spin on an empty CQ for up to busy_poll_usec before giving up and re-arming it */
+static int sx_cq_busy_poll(struct sx_cq *cq, const struct timespec *timestamp, int budget, int *err)
+{
+    struct timespec ts;
+    ktime_t         deadline = ktime_add_us(ktime_get(), cq->moder.busy_poll_usec);
+    int             num_of_cqes = 0;
+
+    while (num_of_cqes < budget) {
+        /* the timestamp of the EQ pass is stale by now */
+        if (timestamp) {
+            getnstimeofday(&ts);
+        }
+
+        *err = sx_poll_one(cq, timestamp ? &ts : NULL);
+        if (!*err) {
+            num_of_cqes++;
+            continue;
+        }
+
+        if ((*err != -EAGAIN) || (ktime_to_ns(ktime_sub(deadline, ktime_get())) <= 0)) {
+            break;
+        }
+
+        cpu_relax();
+    }
+
+    if (num_of_cqes) {
+        cq->moder.busy_poll_hits++;
+    } else {
+        cq->moder.busy_poll_misses++;
+    }
+
+    return num_of_cqes;
+}
+
+int sx_cq_set_moderation(struct sx_dev *dev, int cqn, const struct ku_rdq_moderation *params)
+{
+    struct sx_cq_table *cq_table = &sx_priv(dev)->cq_table;
+    struct sx_cq       *cq;
+    unsigned long       flags;
+    int                 err = 0;
+
+    if ((params->max_usec > SX_CQ_MODER_USEC_MAX) ||
+        (params->busy_poll_usec > SX_CQ_BUSY_POLL_USEC_MAX) ||
+        (params->max_usec && (params->rate_high <= params->rate_low))) {
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&cq_table->lock, flags);
+    cq = cq_table->cq[cqn];
+    if (!cq) {
+        err = -ENOENT;
+        goto out;
+    }
+
+    cq->moder.rate_low = params->rate_low;
+    cq->moder.rate_high = params->rate_high;
+    cq->moder.max_usec = params->max_usec;
+    cq->moder.busy_poll_usec = params->busy_poll_usec;
+    if (!cq->moder.max_usec) {
+        cq->moder.cur_usec = 0;
+    } else if (cq->moder.cur_usec > cq->moder.max_usec) {
+        cq->moder.cur_usec = cq->moder.max_usec;
+    }
+
+out:
+    spin_unlock_irqrestore(&cq_table->lock, flags);
+    return err;
+}
+
+int sx_cq_get_moderation(struct sx_dev *dev, int cqn, struct ku_rdq_moderation *params)
+{
+    struct sx_cq_table *cq_table = &sx_priv(dev)->cq_table;
+    struct sx_cq       *cq;
+    unsigned long       flags;
+    int                 err = 0;
+
+    spin_lock_irqsave(&cq_table->lock, flags);
+    cq = cq_table->cq[cqn];
+    if (!cq) {
+        err = -ENOENT;
+        goto out;
+    }
+
+    params->max_usec = cq->moder.max_usec;
+    params->rate_low = cq->moder.rate_low;
+    params->rate_high = cq->moder.rate_high;
+    params->busy_poll_usec = cq->moder.busy_poll_usec;
+    params->cur_usec = cq->moder.cur_usec;
+    params->rate = cq->moder.rate;
+    params->arms = cq->moder.arms;
+    params->deferred_arms = cq->moder.deferred_arms;
+    params->busy_poll_hits = cq->moder.busy_poll_hits;
+    params->busy_poll_misses = cq->moder.busy_poll_misses;
+
+out:
+    spin_unlock_irqrestore(&cq_table->lock, flags);
+    return err;
+}
+
 /* return errno on error, otherwise num of handled cqes */
 int sx_cq_completion(struct sx_dev         *dev,
                      u32                    cqn,
@@ -1799,9 +2052,15 @@ int sx_cq_completion(struct sx_dev         *dev,
         }
     } while (!err && ++num_of_cqes < weight);
 
+    if ((err == -EAGAIN) && cq->moder.busy_poll_usec && (num_of_cqes < weight)) {
+        num_of_cqes += sx_cq_busy_poll(cq, timestamp, weight - num_of_cqes, &err);
+    }
+
+    sx_cq_moder_sample(&cq->moder, num_of_cqes);
+
     if (num_of_cqes < weight) {
         sx_bitmap_free(prio_bitmap, cqn);
-        sx_cq_arm(cq);
+        sx_cq_moder_arm(cq);
     }
 
     if (!err || (err == -EAGAIN)) {
@@ -1957,6 +2216,7 @@ int sx_core_create_cq(struct sx_dev *dev, int nent, struct sx_cq **cq, u8 cqn)
     init_completion(&tcq->free);
     spin_lock_init(&tcq->lock);
     spin_lock_init(&tcq->rearm_lock);
+    sx_cq_moder_init(tcq);
     sx_cq_set_ci(tcq);
     sx_cq_arm(tcq);
     *cq = tcq;
@@ -2002,6 +2262,14 @@ void sx_core_destroy_cq(struct sx_dev *dev, struct sx_cq *cq)
     spin_lock_irqsave(&cq_table->lock, flags);
     cq_table->cq[cq->cqn] = NULL;
     spin_unlock_irqrestore(&cq_table->lock, flags);
+
+    /* a poller that still holds the CQ neither spins on it nor defers its re-arm any more,
+     * and no deferred re-arm may hit the CQ once it belongs to SW */
+    cq->moder.busy_poll_usec = 0;
+    cq->moder.max_usec = 0;
+    cq->moder.cur_usec = 0;
+    hrtimer_cancel(&cq->moder.arm_timer);
+
     err = sx_HW2SW_CQ(dev, cq->cqn);
     if (err) {
         sx_warn(dev, "HW2SW_CQ failed (%d) "
@@ -2013,6 +2281,8 @@ void sx_core_destroy_cq(struct sx_dev *dev, struct sx_cq *cq)
         complete(&cq->free);
     }
     wait_for_completion(&cq->free);
+    /* covers a re-arm deferred by a poller that was already past the checks above */
+    hrtimer_cancel(&cq->moder.arm_timer);
 
     if (cq->cqe_ts_arr) {
         vfree(cq->cqe_ts_arr);
@@ -2057,11 +2327,73 @@ int iterate_active_cqs(struct sx_dev *dev, struct sx_bitmap *active_cq_bitmap)
     return should_continue_polling;
 }
 
+static void * sx_get_sw_cqe_all_versions(struct sx_cq *cq, u32 n)
+{
+    switch (cq->cqe_version) {
+    case 0:
+        return sx_get_sw_cqe_v0(cq, n);
+
+    case 1:
+        return sx_get_sw_cqe_v1(cq, n);
+
+    case 2:
+        return sx_get_sw_cqe_v2(cq, n);
+    }
+
+    return NULL;
+}
+
+/* Count the CQEs written by HW since cons_index from their ownership bit,
+ * this is what QUERY_CQ's producer counter would tell, without a FW command */
+static u32 __monitor_cq_new_cqes(struct sx_cq *cq)
+{
+    u32 cnt;
+
+    for (cnt = 0; cnt < cq->nent; cnt++) {
+        if (!sx_get_sw_cqe_all_versions(cq, cq->cons_index + cnt)) {
+            break;
+        }
+    }
+
+    /* read CQE contents only after the ownership bits */
+    rmb();
+
+    return cnt;
+}
+
+#define SX_MON_DRAIN_WINDOW HZ
+
+static void __monitor_rdq_drain_sample(struct sx_dq *rdq, u32 rx_cnt)
+{
+    unsigned long elapsed;
+    u64           tmp;
+
+    rdq->mon_drain_window_cnt += rx_cnt;
+    elapsed = jiffies - rdq->mon_drain_window_start;
+    if (elapsed < SX_MON_DRAIN_WINDOW) {
+        return;
+    }
+
+    tmp = (u64)rdq->mon_drain_window_cnt * HZ;
+    do_div(tmp, elapsed);
+    rdq->mon_drain_rate = (u32)min_t(u64, tmp, 0xffffffff);
+    rdq->mon_drain_window_cnt = 0;
+    rdq->mon_drain_window_start = jiffies;
+}
+
+u32 sx_monitor_rdq_drain_rate(struct sx_dq *rdq)
+{
+    /* the rate is sampled only while packets are drained */
+    if (time_after(jiffies, rdq->mon_drain_window_start + 2 * SX_MON_DRAIN_WINDOW)) {
+        return 0;
+    }
+
+    return rdq->mon_drain_rate;
+}
+
 int __handle_monitor_rdq_completion(struct sx_dev *dev, int dqn)
 {
-    int                err;
-    struct ku_query_cq cq_context;
-    static __be16      rx_cnt = 0;
+    u32                rx_cnt = 0;
     unsigned long      flags;
     struct sx_cq      *cq;
     struct sx_dq      *rdq;
@@ -2091,37 +2423,26 @@ int __handle_monitor_rdq_completion(struct sx_dev *dev, int dqn)
     cq = rdq->cq;
     cqn = cq->cqn;
 
-    /* read cq producer counter, which indicate the total number of
-     * received packets */
-    err = sx_QUERY_CQ(dev, cqn, &cq_context);
-    if (err) {
-        sx_err(dev, "sx_QUERY_CQ failed for cqn %08x\n", cqn);
-        return -EINVAL;
-    }
-
-    /* valid cqes is cqes between cons_index and producer_index */
-    if (cq_context.producer_counter == cq->cons_index) {
+    /* valid cqes are the HW owned ones starting at cons_index */
+    rx_cnt = __monitor_cq_new_cqes(cq);
+    if (rx_cnt == 0) {
         /* No packets was received so
          * arm cq so next time we will be waked up from interrupt */
-        rx_cnt = 0;
         sx_cq_arm(cq);
         goto out;
     }
 
-    /* Calculate number of received packets */
-    rx_cnt = cq_context.producer_counter - cq->cons_index;
-
     /* if CQ configured with TS enable add them to each cqe */
-    if (sx_bitmap_test(&priv->cq_table.ts_bitmap, cq->cqn)) {
-        for (i = cq->cons_index; i < cq_context.producer_counter; i++) {
-            cq->cqe_ts_arr[i % cq->nent] = priv->cq_table.timestamps[cq->cqn];
+    if (sx_bitmap_test(&priv->cq_table.ts_bitmap, cqn)) {
+        for (i = 0; i < rx_cnt; i++) {
+            cq->cqe_ts_arr[(cq->cons_index + i) % cq->nent] = priv->cq_table.timestamps[cqn];
         }
     }
 
     if (enable_monitor_rdq_trace_points) {
-        cq_ts_enabled = sx_bitmap_test(&priv->cq_table.ts_bitmap, cq->cqn);
-        for (i = cq->cons_index; i < cq_context.producer_counter; i++) {
-            sx_get_cqe_all_versions(cq, i, &u_cqe);
+        cq_ts_enabled = sx_bitmap_test(&priv->cq_table.ts_bitmap, cqn);
+        for (i = 0; i < rx_cnt; i++) {
+            sx_get_cqe_all_versions(cq, cq->cons_index + i, &u_cqe);
             if (u_cqe.v2 == NULL) {
                 continue;
             }
@@ -2131,10 +2452,10 @@ int __handle_monitor_rdq_completion(struct sx_dev *dev, int dqn)
             if (is_send) {
                 continue;
             }
-            idx = i % rdq->wqe_cnt;
+            idx = (cq->cons_index + i) % rdq->wqe_cnt;
             skb = rdq->sge[idx].skb;
             if (cq_ts_enabled) {
-                trace_monitor_rdq_rx(skb, trap_id, &cq->cqe_ts_arr[i % cq->nent]);
+                trace_monitor_rdq_rx(skb, trap_id, &cq->cqe_ts_arr[(cq->cons_index + i) % cq->nent]);
             } else {
                 trace_monitor_rdq_rx(skb, trap_id, NULL);
             }
@@ -2142,7 +2463,7 @@ int __handle_monitor_rdq_completion(struct sx_dev *dev, int dqn)
     }
 
     /* simulate we polled all cqes */
-    cq->cons_index = cq_context.producer_counter;
+    cq->cons_index += rx_cnt;
     sx_cq_set_ci(cq);
 
     /* update rdq head and tail */
@@ -2165,6 +2486,7 @@ int __handle_monitor_rdq_completion(struct sx_dev *dev, int dqn)
     }
 
 out:
+    __monitor_rdq_drain_sample(rdq, rx_cnt);
     return rx_cnt;
 }
 
@@ -2174,6 +2496,8 @@ static int __monitor_cq_handler_thread(void *arg)
     struct sx_dev               *dev = (struct sx_dev*)arg;
     struct cpu_traffic_priority *cpu_traffic_prio = &sx_priv(dev)->cq_table.cpu_traffic_prio;
     int                          should_continue_polling;
+    int                          ring_half_full;
+    struct sx_dq                *rdq;
     int                          ret;
     int                          i;
 
@@ -2186,17 +2510,27 @@ static int __monitor_cq_handler_thread(void *arg)
         }
 
         should_continue_polling = 0;
+        ring_half_full = 0;
         for (i = 0; i < sx_priv(dev)->monitor_rdqs_count; i++) {
             ret = __handle_monitor_rdq_completion(dev,
                                                   sx_priv(dev)->monitor_rdqs_arr[i]);
             if (ret > 0) {
                 should_continue_polling++;
+                rdq = sx_priv(dev)->rdq_table.dq[sx_priv(dev)->monitor_rdqs_arr[i]];
+                if (rdq && (ret >= rdq->wqe_cnt / 2)) {
+                    ring_half_full = 1;
+                }
             }
         }
 
         if (should_continue_polling) {
-            usleep_range(mon_cq_thread_delay_time_usec,
-                         mon_cq_thread_delay_time_usec + 5);
+            /* polling is cheap now, so do not let a storm run ahead of us while sleeping */
+            if (ring_half_full) {
+                cond_resched();
+            } else {
+                usleep_range(mon_cq_thread_delay_time_usec,
+                             mon_cq_thread_delay_time_usec + 5);
+            }
             up(&cpu_traffic_prio->monitor_cq_thread_sem); /* re-arm thread loop */
         }
     }
@@ -2252,6 +2586,18 @@ static void __sampling_timer_fn(unsigned long data)
 }
 
 
+static void __cq_thread_set_cpu(struct task_struct *thread, int cpu)
+{
+    if ((cpu < 0) || (cpu >= nr_cpu_ids) || !cpu_online(cpu)) {
+        return;
+    }
+
+    if (set_cpus_allowed_ptr(thread, cpumask_of(cpu))) {
+        printk(KERN_WARNING PFX "failed to move thread %s to CPU %d\n", thread->comm, cpu);
+    }
+}
+
+
 int __cpu_traffic_priority_init(struct sx_dev *dev, struct cpu_traffic_priority *cpu_traffic_prio)
 {
     char            thread_name[32];
@@ -2291,6 +2637,8 @@ int __cpu_traffic_priority_init(struct sx_dev *dev, struct cpu_traffic_priority
         goto out;
     }
 
+    __cq_thread_set_cpu(cpu_traffic_prio->low_prio_cq_thread, low_prio_cq_thread_cpu);
+
     err = sx_bitmap_init(&sx_priv(dev)->active_monitor_cq_bitmap, dev->dev_cap.max_num_cqs);
     if (err) {
         printk(KERN_ERR PFX "Monitor RDQ bitmap init failed. Aborting...\n");
@@ -2305,6 +2653,8 @@ int __cpu_traffic_priority_init(struct sx_dev *dev, struct cpu_traffic_priority
         goto out;
     }
 
+    __cq_thread_set_cpu(cpu_traffic_prio->monitor_cq_thread, mon_cq_thread_cpu);
+
 out:
 
     return err;
@@ -2428,7 +2778,7 @@ void sx_core_dump_synd_tbl(struct sx_dev *dev)
                            port_vlan_listener->vlan,
                            listener->is_default,
                            listener->handler,
-                           listener->rx_pkts);
+                           (u64)atomic64_read(&listener->rx_pkts));
 
                     switch (listener->listener_type) {
                     case L2_TYPE_DONT_CARE:
@@ -45,6 +45,9 @@
 #define ETH_CRC_LENGTH 4
 #define IB_CRC_LENGTH  6
 
+#define SX_CQ_MODER_USEC_MAX     10000
+#define SX_CQ_BUSY_POLL_USEC_MAX 1000
+
 /************************************************
  * Enums
  ***********************************************/
@@ -193,6 +196,9 @@ int iterate_active_cqs(struct sx_dev *dev, struct sx_bitmap *active_cq_bitmap);
 void sx_cq_show_cq(struct sx_dev *dev, int cqn);
 void sx_cq_dump_cq(struct sx_dev *dev, int cqn);
 void sx_cq_flush_rdq(struct sx_dev *my_dev, int idx);
+int sx_cq_set_moderation(struct sx_dev *dev, int cqn, const struct ku_rdq_moderation *params);
+int sx_cq_get_moderation(struct sx_dev *dev, int cqn, struct ku_rdq_moderation *params);
+u32 sx_monitor_rdq_drain_rate(struct sx_dq *rdq);
 void sx_printk_cqe_v0(union sx_cqe *u_cqe);
 void sx_printk_cqe_v2(union sx_cqe *u_cqe);
 void sx_fill_ci_from_cqe_v0(struct completion_info *ci, union sx_cqe *u_cqe);
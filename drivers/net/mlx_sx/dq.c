@@ -38,6 +38,8 @@
 #include <linux/pci.h>
 #include <linux/if_ether.h>
 #include <linux/delay.h>
+#include <linux/version.h>
+#include <linux/dma-mapping.h>
 #include "dq.h"
 #include "cq.h"
 #include "alloc.h"
@@ -62,6 +64,7 @@ extern int tx_debug_pkt_type;
 extern int tx_debug_emad_type;
 extern int tx_dump;
 extern int tx_dump_cnt;
+extern int rdq_buff_pool_enable;
 
 /************************************************
  * Functions                            *
@@ -144,23 +147,54 @@ static __be16 sx_set_wqe_flags(u8 set_lp, enum ku_pkt_type type)
     return cpu_to_be16(flags);
 }
 
+/*
+ * The WQE has room for the linear part and SX_SDQ_MAX_FRAGS fragments. Pull the
+ * leading fragments (or a frag_list) into the linear part so that only the
+ * bytes that do not fit are copied.
+ */
+static int sx_fit_skb_to_wqe(struct sk_buff *skb)
+{
+    unsigned int pull_len = 0;
+    int          i;
+
+    if (skb_has_frag_list(skb)) {
+        return __skb_linearize(skb);
+    }
+
+    for (i = 0; i < skb_shinfo(skb)->nr_frags - SX_SDQ_MAX_FRAGS; i++) {
+        pull_len += skb_frag_size(&skb_shinfo(skb)->frags[i]);
+    }
+
+    if (!__pskb_pull_tail(skb, pull_len)) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
 static int sx_build_send_packet(struct sx_dq *sdq, struct sk_buff *skb, struct sx_wqe *wqe, int idx)
 {
     int             i, num_frags;
     struct sk_buff *orig_skb = NULL;
 
-    num_frags = skb_shinfo(skb)->nr_frags;
-    if (num_frags > 2) { /* no support for more than 2 fragments ... */
-        orig_skb = skb;
-        skb = skb_copy(skb, GFP_ATOMIC);
+    if ((skb_shinfo(skb)->nr_frags > SX_SDQ_MAX_FRAGS) || skb_has_frag_list(skb)) {
+        if (!skb_shared(skb)) {
+            if (sx_fit_skb_to_wqe(skb)) {
+                return -ENOMEM;
+            }
+        } else {
+            /* someone else holds the skb, send a linear copy of it */
+            orig_skb = skb;
+            skb = skb_copy(skb, GFP_ATOMIC);
 
-        if (!skb) {
-            return -ENOMEM;
+            if (!skb) {
+                return -ENOMEM;
+            }
         }
-
-        num_frags = 0;
     }
 
+    num_frags = skb_shinfo(skb)->nr_frags;
+
     sdq->sge[idx].skb = skb;
     sdq->sge[idx].hdr_pld_sg.vaddr = skb->data;
     sdq->sge[idx].hdr_pld_sg.len = skb_headlen(skb);
@@ -213,7 +247,7 @@ static int sx_build_send_packet(struct sx_dq *sdq, struct sk_buff *skb, struct s
                                        sge_data->dma_addr, sge_data->len, DMA_TO_DEVICE);
     }
 
-    for (; i < 2; i++) {
+    for (; i < SX_SDQ_MAX_FRAGS; i++) {
         wqe->byte_count[i + 1] = 0;
     }
 
@@ -301,11 +335,82 @@ out_mod:
     return err;
 }
 
-int sx_add_pkts_to_sdq(struct sx_dq *sdq)
+/* DQ must be locked here!!! */
+static void sx_sdq_ring_db(struct sx_dq *sdq)
+{
+    /*
+     * Make sure that descriptors are written before
+     * doorbell.
+     */
+    wmb();
+
+    __raw_writel((__force u32)cpu_to_be32(sdq->head & 0xffff),
+                 sdq->db);
+    mmiowb();
+    sdq->db_pending = 0;
+}
+
+
+/*
+ * Pending packets are kept in slots preallocated with the SDQ, one per WQE.
+ * Only a backlog longer than the SDQ itself falls back to kmalloc().
+ * DQ must be locked here!!!
+ */
+static struct sx_pkt * sx_sdq_pkt_get(struct sx_dq *sdq)
+{
+    struct sx_pkt *pkt;
+
+    if (!list_empty(&sdq->pkt_free_list)) {
+        pkt = list_first_entry(&sdq->pkt_free_list, struct sx_pkt, list);
+        list_del(&pkt->list);
+        return pkt;
+    }
+
+    return kmalloc(sizeof(*pkt), GFP_ATOMIC);
+}
+
+
+/* DQ must be locked here!!! */
+static void sx_sdq_pkt_put(struct sx_dq *sdq, struct sx_pkt *pkt)
+{
+    if ((pkt >= sdq->pkt_slots) && (pkt < sdq->pkt_slots + sdq->wqe_cnt)) {
+        list_add(&pkt->list, &sdq->pkt_free_list);
+    } else {
+        kfree(pkt);
+    }
+}
+
+
+/* Write the WQE of a packet at the SDQ head, the skb is freed on error. DQ must be locked here!!! */
+static int sx_sdq_post_skb(struct sx_dq *sdq, struct sk_buff *skb, u8 set_lp, enum ku_pkt_type type)
+{
+    struct sx_wqe *wqe;
+    int            wqe_idx;
+    int            err;
+
+    wqe_idx = sdq->head & (sdq->wqe_cnt - 1);
+    wqe = sx_get_send_wqe(sdq, wqe_idx);
+
+    wqe->flags = sx_set_wqe_flags(set_lp, type);
+    err = sx_build_send_packet(sdq, skb, wqe, wqe_idx);
+    if (err) {
+        sx_skb_free(skb);
+        return err;
+    }
+
+    ++sdq->head;
+    return 0;
+}
+
+
+/*
+ * Move the packets queued on the SDQ to its WQEs. With defer_db the doorbell
+ * is not rung, it is left to sx_core_tx_batch_flush() of the caller's batch.
+ * DQ must be locked here!!!
+ */
+static int __sx_add_pkts_to_sdq(struct sx_dq *sdq, u8 defer_db)
 {
-    struct sx_wqe    *wqe;
     int               err = 0;
-    int               wqe_idx;
     struct sx_pkt    *curr_pkt;
     struct list_head *pos, *q;
     u8                arm = 0;
@@ -313,39 +418,81 @@ int sx_add_pkts_to_sdq(struct sx_dq *sdq)
     list_for_each_safe(pos, q, &sdq->pkts_list.list) {
         curr_pkt = list_entry(pos, struct sx_pkt, list);
         list_del(pos);
-        wqe_idx = sdq->head & (sdq->wqe_cnt - 1);
-        wqe = sx_get_send_wqe(sdq, wqe_idx);
-
-        wqe->flags = sx_set_wqe_flags(curr_pkt->set_lp, curr_pkt->type);
-        err = sx_build_send_packet(sdq, curr_pkt->skb, wqe, wqe_idx);
+        err = sx_sdq_post_skb(sdq, curr_pkt->skb, curr_pkt->set_lp, curr_pkt->type);
+        sx_sdq_pkt_put(sdq, curr_pkt);
         if (err) {
-            sx_skb_free(curr_pkt->skb);
             break;
         }
 
-        ++sdq->head;
-        kfree(curr_pkt);
         arm = 1;
         if (sx_dq_overflow(sdq)) {
             break; /* go to arm the db */
         }
     }
 
-    if (arm) {
-        /*
-         * Make sure that descriptors are written before
-         * doorbell.
-         */
-        wmb();
-
-        __raw_writel((__force u32)cpu_to_be32(sdq->head & 0xffff),
-                     sdq->db);
-        mmiowb();
+    if (arm && defer_db) {
+        sdq->db_pending = 1;
+    } else if (arm || sdq->db_pending) {
+        sx_sdq_ring_db(sdq);
     }
     return err;
 }
 
-int __sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *meta)
+int sx_add_pkts_to_sdq(struct sx_dq *sdq)
+{
+    return __sx_add_pkts_to_sdq(sdq, 0);
+}
+
+
+void sx_core_tx_batch_init(struct sx_tx_batch *batch)
+{
+    batch->sdq_cnt = 0;
+}
+
+
+static int sx_core_tx_batch_add(struct sx_tx_batch *batch, struct sx_dq *sdq)
+{
+    int i;
+
+    for (i = 0; i < batch->sdq_cnt; i++) {
+        if (batch->sdq[i] == sdq) {
+            return 0;
+        }
+    }
+
+    /* only when sending to more than one device */
+    if (batch->sdq_cnt == NUMBER_OF_SDQS) {
+        return -ENOSPC;
+    }
+
+    batch->sdq[batch->sdq_cnt++] = sdq;
+    return 0;
+}
+
+
+/* Ring the doorbell once for each SDQ that got WQEs through the batch */
+void sx_core_tx_batch_flush(struct sx_tx_batch *batch)
+{
+    unsigned long flags;
+    struct sx_dq *sdq;
+    int           i;
+
+    for (i = 0; i < batch->sdq_cnt; i++) {
+        sdq = batch->sdq[i];
+        spin_lock_irqsave(&sdq->lock, flags);
+        if (sdq->db_pending) {
+            sx_sdq_ring_db(sdq);
+        }
+        spin_unlock_irqrestore(&sdq->lock, flags);
+    }
+
+    batch->sdq_cnt = 0;
+}
+
+static int __sx_core_post_send_batch(struct sx_dev      *dev,
+                                     struct sk_buff     *skb,
+                                     struct isx_meta    *meta,
+                                     struct sx_tx_batch *batch)
 {
     unsigned long  flags = 0;
     int            err = 0;
@@ -422,7 +569,7 @@ int __sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta
         return -EFAULT;
     }
 
-    if ((skb->len > 2048) && (dev->profile.cpu_egress_tclass[sdqn] > max_cpu_etclass_for_unlimited_mtu)) {
+    if ((skb->len > SX_LIMITED_MTU_MAX_PKT_SIZE) && (dev->profile.cpu_egress_tclass[sdqn] > max_cpu_etclass_for_unlimited_mtu)) {
         printk(KERN_ERR PFX "sx_core_post_send: cannot send packet of size %u "
                "from SDQ %u since it's bounded to cpu_tclass %u\n",
                skb->len, sdqn, dev->profile.cpu_egress_tclass[sdqn]);
@@ -451,8 +598,20 @@ int __sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta
     return 0;
 #endif
 
-    new_pkt = kmalloc(sizeof(*new_pkt), GFP_ATOMIC);
+    spin_lock_irqsave(&sdq->lock, flags);
+
+    if (dev->pdev && list_empty(&sdq->pkts_list.list) && !sx_dq_overflow(sdq)) {
+        /* nothing is pending and there is a free WQE, no need to queue the packet */
+        err = sx_sdq_post_skb(sdq, skb, meta->lp, meta->type);
+        if (!err) {
+            sdq->db_pending = 1;
+        }
+        goto out_db;
+    }
+
+    new_pkt = sx_sdq_pkt_get(sdq);
     if (!new_pkt) {
+        spin_unlock_irqrestore(&sdq->lock, flags);
         if (printk_ratelimit()) {
             printk(KERN_WARNING PFX "sx_core_post_send: "
                    "error - cannot allocate packets memory\n");
@@ -464,7 +623,6 @@ int __sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta
     new_pkt->skb = skb;
     new_pkt->set_lp = meta->lp;
     new_pkt->type = meta->type;
-    spin_lock_irqsave(&sdq->lock, flags);
     list_add_tail(&new_pkt->list, &sdq->pkts_list.list);
     if (sx_dq_overflow(sdq)) {
         if ((sdq->last_full_queue != sdq->last_completion) &&
@@ -479,7 +637,12 @@ int __sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta
     }
 
     if (dev->pdev) {
-        err = sx_add_pkts_to_sdq(sdq);
+        err = __sx_add_pkts_to_sdq(sdq, 1);
+    }
+
+out_db:
+    if (sdq->db_pending && (!batch || sx_core_tx_batch_add(batch, sdq))) {
+        sx_sdq_ring_db(sdq);
     }
 
 out:
@@ -487,9 +650,22 @@ out:
     return err;
 }
 
-int sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *meta)
+int __sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *meta)
 {
-    int err = 0;
+    return __sx_core_post_send_batch(dev, skb, meta, NULL);
+}
+
+/*
+ * Same as sx_core_post_send(), but packets that go to an SDQ directly only get
+ * their WQEs written. The caller rings the doorbells with sx_core_tx_batch_flush().
+ */
+int sx_core_post_send_batch(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *meta, struct sx_tx_batch *batch)
+{
+    int              err = 0;
+    struct sx_dev   *stats_dev;
+    struct sx_stats *glb_stats, *dev_stats;
+    unsigned long    stats_flags;
+    u8               stats_swid;
 
     /* WA for pad TX packets with size less than ETH_ZLEN */
     if (((meta->type == SX_PKT_TYPE_ETH_DATA) ||
@@ -580,21 +756,16 @@ int sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *
         }
     }
 
-    if ((dev != NULL) && (meta->swid < NUMBER_OF_SWIDS)) {
-        sx_glb.stats.tx_by_pkt_type[meta->swid][meta->type]++;
-        sx_glb.stats.tx_by_pkt_type_bytes[meta->swid][meta->type] += skb->len;
-        dev->stats.tx_by_pkt_type[meta->swid][meta->type]++;
-        dev->stats.tx_by_pkt_type_bytes[meta->swid][meta->type] += skb->len;
-    } else if (dev != NULL) {
-        sx_glb.stats.tx_by_pkt_type[NUMBER_OF_SWIDS][meta->type]++;
-        sx_glb.stats.tx_by_pkt_type_bytes[NUMBER_OF_SWIDS][meta->type] += skb->len;
-        dev->stats.tx_by_pkt_type[NUMBER_OF_SWIDS][meta->type]++;
-        dev->stats.tx_by_pkt_type_bytes[NUMBER_OF_SWIDS][meta->type] += skb->len;
-    } else if (sx_glb.tmp_dev_ptr) {
-        sx_glb.stats.tx_by_pkt_type[NUMBER_OF_SWIDS][meta->type]++;
-        sx_glb.stats.tx_by_pkt_type_bytes[NUMBER_OF_SWIDS][meta->type] += skb->len;
-        sx_glb.tmp_dev_ptr->stats.tx_by_pkt_type[NUMBER_OF_SWIDS][meta->type]++;
-        sx_glb.tmp_dev_ptr->stats.tx_by_pkt_type_bytes[NUMBER_OF_SWIDS][meta->type] += skb->len;
+    stats_dev = (dev != NULL) ? dev : sx_glb.tmp_dev_ptr;
+    if (stats_dev != NULL) {
+        stats_swid = ((dev != NULL) && (meta->swid < NUMBER_OF_SWIDS)) ? meta->swid : NUMBER_OF_SWIDS;
+        glb_stats = sx_stats_pcpu_get(&sx_glb.stats, &stats_flags);
+        glb_stats->tx_by_pkt_type[stats_swid][meta->type]++;
+        glb_stats->tx_by_pkt_type_bytes[stats_swid][meta->type] += skb->len;
+        dev_stats = stats_dev->stats.per_cpu[smp_processor_id()];
+        dev_stats->tx_by_pkt_type[stats_swid][meta->type]++;
+        dev_stats->tx_by_pkt_type_bytes[stats_swid][meta->type] += skb->len;
+        sx_stats_pcpu_put(stats_flags);
     }
 
     if ((meta->type == SX_PKT_TYPE_DROUTE_EMAD_CTL) || /* emad */
@@ -611,26 +782,32 @@ int sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *
     }
 #ifndef NO_PCI /* In real mode we should only call __sx_core_post_send when we have PCI device */
     else if (dev && dev->pdev) {
-        err = __sx_core_post_send(dev, skb, meta);
+        err = __sx_core_post_send_batch(dev, skb, meta, batch);
     } else {
         return -EFAULT;
     }
 #else
     else {
-        err = __sx_core_post_send(dev, skb, meta);
+        err = __sx_core_post_send_batch(dev, skb, meta, batch);
     }
 #endif
 
     return err;
 }
+
+int sx_core_post_send(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *meta)
+{
+    return sx_core_post_send_batch(dev, skb, meta, NULL);
+}
 EXPORT_SYMBOL(sx_core_post_send);
 
 /*
  * Posts a buffer to the HW RDQ
  * The skb contains the kernel buffer address and length of the buffer.
- * Post recv maps the buffer to DMA memory and adds it to RDQ.
+ * Post recv maps the buffer to DMA memory (unless it is already mapped
+ * and is_mapped is set) and adds it to RDQ.
  */
-void sx_core_post_recv(struct sx_dq *rdq, struct sk_buff *skb)
+static void __sx_core_post_recv(struct sx_dq *rdq, struct sk_buff *skb, u8 is_mapped, dma_addr_t dma_addr)
 {
     unsigned long  flags;
     int            idx;
@@ -669,7 +846,19 @@ void sx_core_post_recv(struct sx_dq *rdq, struct sk_buff *skb)
      *      - the same buffer will be reposted
      *      - The start of the buffer will not be filled by 0x55555555
      *        because the same buffer is used
+     *
+     * A buffer recycled from the RDQ pool is still mapped, so it only has
+     * to be handed back to the device (there is no pool under CONFIG_44x,
+     * see sx_core_rdq_pool_init()).
      */
+    if ((skb != NULL) && is_mapped) {
+        rdq->sge[idx].skb = skb;
+        rdq->sge[idx].hdr_pld_sg.vaddr = skb->data;
+        rdq->sge[idx].hdr_pld_sg.len = length;
+        rdq->sge[idx].hdr_pld_sg.dma_addr = dma_addr;
+        goto post;
+    }
+
     if (skb != NULL) {
         rdq->sge[idx].skb = skb;
         rdq->sge[idx].hdr_pld_sg.vaddr = skb->data;
@@ -721,6 +910,7 @@ void sx_core_post_recv(struct sx_dq *rdq, struct sk_buff *skb)
         goto out;
     }
 
+post:
     wqe->dma_addr[0] =
         cpu_to_be64(rdq->sge[idx].hdr_pld_sg.dma_addr);
     wqe->byte_count[0] = cpu_to_be16(rdq->sge[idx].hdr_pld_sg.len);
@@ -757,6 +947,159 @@ out:
     spin_unlock_irqrestore(&rdq->lock, flags);
 }
 
+void sx_core_post_recv(struct sx_dq *rdq, struct sk_buff *skb)
+{
+    __sx_core_post_recv(rdq, skb, 0, 0);
+}
+
+/* Posts a buffer that is already mapped FROM_DEVICE (taken from the RDQ pool) */
+void sx_core_post_recv_mapped(struct sx_dq *rdq, struct sk_buff *skb, dma_addr_t dma_addr)
+{
+    __sx_core_post_recv(rdq, skb, 1, dma_addr);
+}
+
+static void __sx_core_rdq_pool_unmap(struct sx_dq *rdq, dma_addr_t dma_addr)
+{
+    int length = rdq->dev->profile.rdq_properties[rdq->dqn].entry_size;
+
+    /* the CPU already owns the buffer (synced before the packet was handled) */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0))
+    dma_unmap_single_attrs(&rdq->dev->pdev->dev, dma_addr, length, DMA_FROM_DEVICE, DMA_ATTR_SKIP_CPU_SYNC);
+#else
+    pci_unmap_single(rdq->dev->pdev, dma_addr, length, PCI_DMA_FROMDEVICE);
+#endif
+}
+
+static int __sx_core_rdq_pool_skb_recyclable(struct sk_buff *skb)
+{
+    /* only the pool may still reference the buffer */
+    return !skb_shared(skb) && !skb_cloned(skb) && !skb_is_nonlinear(skb) && (skb->destructor == NULL);
+}
+
+static void __sx_core_rdq_pool_skb_reset(struct sx_dq *rdq, struct sk_buff *skb)
+{
+    int length = rdq->dev->profile.rdq_properties[rdq->dqn].entry_size;
+
+    /* bring the buffer back to the state post_skb() allocates it in */
+    skb->data = skb->head;
+    skb_reset_tail_pointer(skb);
+    skb->len = 0;
+    skb->dev = NULL;
+    skb->protocol = 0;
+    memset(skb->cb, 0, sizeof(skb->cb));
+    skb_put(skb, length);
+}
+
+int sx_core_rdq_pool_init(struct sx_dq *rdq)
+{
+    struct sx_rdq_pool *pool = &rdq->rx_pool;
+
+    memset(pool, 0, sizeof(*pool));
+
+    if (!rdq->dev->pdev) {
+        return 0;
+    }
+
+#ifdef CONFIG_44x
+    /* The PPC460 L2 errata workaround in __sx_core_post_recv() writes every
+     * cache line of the buffer before it is mapped, so each posted buffer
+     * has to go through a fresh mapping */
+    return 0;
+#endif
+
+    pool->entries = kcalloc(rdq->wqe_cnt, sizeof(*pool->entries), GFP_KERNEL);
+    if (!pool->entries) {
+        return -ENOMEM;
+    }
+
+    pool->size = rdq->wqe_cnt;
+
+    return 0;
+}
+
+void sx_core_rdq_pool_deinit(struct sx_dq *rdq)
+{
+    struct sx_rdq_pool *pool = &rdq->rx_pool;
+    unsigned long       flags;
+    u32                 i;
+
+    spin_lock_irqsave(&rdq->lock, flags);
+    for (i = 0; i < pool->count; i++) {
+        __sx_core_rdq_pool_unmap(rdq, pool->entries[i].dma_addr);
+        kfree_skb(pool->entries[i].skb);
+    }
+
+    pool->count = 0;
+    pool->size = 0;
+    spin_unlock_irqrestore(&rdq->lock, flags);
+
+    kfree(pool->entries);
+    pool->entries = NULL;
+}
+
+int sx_core_rdq_pool_is_active(struct sx_dq *rdq)
+{
+    /* monitor RDQs repost the same buffers and don't need the pool */
+    return !rdq->is_send && !rdq->is_monitor && (rdq->rx_pool.size > 0);
+}
+
+/* Returns 0 and a mapped buffer if the pool is not empty, -ENOENT otherwise */
+int sx_core_rdq_pool_get(struct sx_dq *rdq, struct sk_buff **skb, dma_addr_t *dma_addr)
+{
+    struct sx_rdq_pool *pool = &rdq->rx_pool;
+    unsigned long       flags;
+    int                 err = 0;
+
+    if (!sx_core_rdq_pool_is_active(rdq)) {
+        return -ENOENT;
+    }
+
+    spin_lock_irqsave(&rdq->lock, flags);
+    if (pool->count == 0) {
+        pool->miss++;
+        err = -ENOENT;
+        goto out;
+    }
+
+    pool->count--;
+    *skb = pool->entries[pool->count].skb;
+    *dma_addr = pool->entries[pool->count].dma_addr;
+    pool->hit++;
+
+out:
+    spin_unlock_irqrestore(&rdq->lock, flags);
+    return err;
+}
+
+/*
+ * Releases the pool's reference on a received buffer. The buffer is kept mapped
+ * and recycled if no consumer holds it anymore, otherwise it is unmapped and
+ * left to the consumer.
+ */
+void sx_core_rdq_pool_put(struct sx_dq *rdq, struct sk_buff *skb, dma_addr_t dma_addr)
+{
+    struct sx_rdq_pool *pool = &rdq->rx_pool;
+    unsigned long       flags;
+
+    spin_lock_irqsave(&rdq->lock, flags);
+    if (sx_core_rdq_pool_is_active(rdq) && !rdq->is_flushing &&
+        (pool->count < pool->size) && __sx_core_rdq_pool_skb_recyclable(skb)) {
+        __sx_core_rdq_pool_skb_reset(rdq, skb);
+        pool->entries[pool->count].skb = skb;
+        pool->entries[pool->count].dma_addr = dma_addr;
+        pool->count++;
+        pool->recycled++;
+        spin_unlock_irqrestore(&rdq->lock, flags);
+        return;
+    }
+
+    pool->busy++;
+    spin_unlock_irqrestore(&rdq->lock, flags);
+
+    __sx_core_rdq_pool_unmap(rdq, dma_addr);
+    kfree_skb(skb);
+}
+
 /*
  * This function is used because we can't call kfree_skb on IB packets
  * which hold info in the nonlinear part of the SKB which was not
@@ -922,6 +1265,7 @@ static int sx_dq_alloc(struct sx_dev *dev, u8 send, struct sx_dq *dq, u8 dqn)
 {
     int                 err;
     int                 dq_base;
+    int                 i;
     unsigned long       flags;
     struct sx_priv     *priv = sx_priv(dev);
     struct sx_dq_table *dq_table = send ?
@@ -939,6 +1283,19 @@ static int sx_dq_alloc(struct sx_dev *dev, u8 send, struct sx_dq *dq, u8 dqn)
         goto err_out;
     }
 
+    if (send) {
+        dq->pkt_slots = kcalloc(dq->wqe_cnt, sizeof(*dq->pkt_slots), GFP_KERNEL);
+        if (!dq->pkt_slots) {
+            err = -ENOMEM;
+            goto err_out;
+        }
+
+        INIT_LIST_HEAD(&dq->pkt_free_list);
+        for (i = 0; i < dq->wqe_cnt; i++) {
+            list_add_tail(&dq->pkt_slots[i].list, &dq->pkt_free_list);
+        }
+    }
+
     spin_lock_irqsave(&dq_table->lock, flags);
     dq_table->dq[dq->dqn] = dq;
     spin_unlock_irqrestore(&dq_table->lock, flags);
@@ -957,6 +1314,7 @@ static int sx_dq_alloc(struct sx_dev *dev, u8 send, struct sx_dq *dq, u8 dqn)
     return 0;
 
 err_out:
+    kfree(dq->pkt_slots);
     kfree(dq->sge);
     sx_bitmap_free(&dq_table->bitmap, dq->dqn);
 
@@ -995,6 +1353,13 @@ static int sx_create_dq(struct sx_dev *dev, int nent, u8 dqn, struct sx_dq **dq,
         goto free_buf;
     }
 
+    if (!send && rdq_buff_pool_enable) {
+        /* the RDQ works without the pool if it cannot be allocated */
+        if (sx_core_rdq_pool_init(tdq)) {
+            sx_warn(dev, "failed to allocate RX buffer pool of RDQ %d\n", tdq->dqn);
+        }
+    }
+
     tdq->state = DQ_STATE_RESET;
     tdq->is_flushing = 0;
     /* TODO: handle errors */
@@ -1105,12 +1470,17 @@ static void sx_dq_free(struct sx_dev *dev, struct sx_dq *dq)
              *  get a kernel oops if the user already closed the FD */
             tmp_pkt->skb->destructor = NULL;
             sx_skb_free(tmp_pkt->skb);
-            kfree(tmp_pkt);
+            sx_sdq_pkt_put(dq, tmp_pkt);
         }
     }
 
     sx_free_dq_sges(dev, dq);
     kfree(dq->sge);
+    kfree(dq->pkt_slots);
+
+    if (!dq->is_send) {
+        sx_core_rdq_pool_deinit(dq);
+    }
 }
 
 static void sx_dq_remove(struct sx_dev *dev, struct sx_dq *dq)
@@ -60,10 +60,22 @@ struct sx_dq_context {
     /* Physical Address of Descriptor Queue page <i> (i=0,1,...,7) */
 };
 
+/* SDQs that got WQEs without a doorbell, see sx_core_post_send_batch() */
+struct sx_tx_batch {
+    struct sx_dq *sdq[NUMBER_OF_SDQS];
+    int           sdq_cnt;
+};
+
 /************************************************
  * Functions
  ***********************************************/
 void sx_core_post_recv(struct sx_dq *rdq, struct sk_buff *skb);
+void sx_core_post_recv_mapped(struct sx_dq *rdq, struct sk_buff *skb, dma_addr_t dma_addr);
+int sx_core_rdq_pool_init(struct sx_dq *rdq);
+void sx_core_rdq_pool_deinit(struct sx_dq *rdq);
+int sx_core_rdq_pool_is_active(struct sx_dq *rdq);
+int sx_core_rdq_pool_get(struct sx_dq *rdq, struct sk_buff **skb, dma_addr_t *dma_addr);
+void sx_core_rdq_pool_put(struct sx_dq *rdq, struct sk_buff *skb, dma_addr_t dma_addr);
 void sx_core_repost_recv(struct sx_dq *rdq);
 int sx_core_init_sdq_table(struct sx_dev *dev);
 int sx_core_init_rdq_table(struct sx_dev *dev);
@@ -77,6 +89,10 @@ void sx_core_destroy_rdq_table(struct sx_dev *dev, u8 free_table);
 void sx_core_destroy_sdq(struct sx_dev *dev, struct sx_dq *dq);
 void sx_core_destroy_rdq(struct sx_dev *dev, struct sx_dq *dq);
 int sx_add_pkts_to_sdq(struct sx_dq *sdq);
+void sx_core_tx_batch_init(struct sx_tx_batch *batch);
+void sx_core_tx_batch_flush(struct sx_tx_batch *batch);
+int sx_core_post_send_batch(struct sx_dev *dev, struct sk_buff *skb, struct isx_meta *meta,
+                            struct sx_tx_batch *batch);
 int sx_hw2sw_dq(struct sx_dev *dev, struct sx_dq *dq);
 int sx_dq_modify_2err(struct sx_dev *dev, struct sx_dq *dq);
 int sx_flush_dq(struct sx_dev *dev, struct sx_dq *dq, bool update_flushing_state);
@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2010-2019,  Mellanox Technologies. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <linux/hashtable.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/wait.h>
+#include <linux/mlx_sx/device.h>
+#include <linux/mlx_sx/driver.h>
+#include <linux/mlx_sx/kernel_user.h>
+
+#include "sx.h"
+#include "dq.h"
+#include "sx_dbg_dump_proc.h"
+#include "emad.h"
+
+/*
+ * Windowed EMAD pipeline: sx_emad_send_batch() keeps up to emad_window_size EMADs in
+ * flight (over PCI or SGMII, whatever the EMAD path of the device is) and correlates
+ * the responses to the requests by the EMAD transaction ID. Responses to EMADs of the
+ * pipeline are consumed by sx_emad_rx() and never reach the listeners.
+ */
+
+#define SX_EMAD_HASH_BITS 8
+
+extern int emad_window_size;
+
+struct sx_emad_pending {
+    struct hlist_node  hash_node;
+    u64                tid;
+    ktime_t            start;
+    u8                 window_class;
+    u8                 posted;
+    struct completion  done;
+    struct sk_buff    *rx_skb;
+};
+struct sx_emad_window_stats {
+    u64 sent;
+    u64 completed;
+    u64 timeouts;
+    u64 max_usec;
+    u64 latency[SX_EMAD_LATENCY_BUCKETS];
+};
+struct sx_emad_pipeline {
+    spinlock_t                  lock;
+    wait_queue_head_t           wait_q;
+    DECLARE_HASHTABLE(pending_hash, SX_EMAD_HASH_BITS); /* tid -> sx_emad_pending */
+    u32                         in_flight;
+    u32                         max_in_flight;
+    u64                         tid_collisions;
+    struct sx_emad_window_stats stats[SX_EMAD_WINDOW_CLASSES];
+};
+static struct sx_emad_pipeline __emad_pipeline;
+
+static u32 __emad_window(void)
+{
+    int window = emad_window_size;
+
+    if (window < 1) {
+        return 1;
+    }
+
+    return min(window, SX_EMAD_WINDOW_MAX);
+}
+
+static struct sx_emad_pending * __emad_pending_lookup(u64 tid)
+{
+    struct sx_emad_pending *pending;
+
+    hash_for_each_possible(__emad_pipeline.pending_hash, pending, hash_node, tid) {
+        if (pending->tid == tid) {
+            return pending;
+        }
+    }
+
+    return NULL;
+}
+
+/* must be called with the pipeline lock held */
+static void __emad_pending_remove(struct sx_emad_pending *pending)
+{
+    hash_del(&pending->hash_node);
+    __emad_pipeline.in_flight--;
+    wake_up(&__emad_pipeline.wait_q);
+}
+
+static int __emad_swid_get(struct sx_dev *dev, int dev_id, u8 *swid)
+{
+    int i;
+
+    /* according to the PRM, emads should get "any ethernet swid" */
+    if (!dev || !dev->profile_set || is_sgmii_device(dev_id)) {
+        *swid = 0;
+        return 0;
+    }
+
+    for (i = 0; i < NUMBER_OF_SWIDS; i++) {
+        if (dev->profile.swid_type[i] == SX_KU_L2_TYPE_ETH) {
+            *swid = i;
+            return 0;
+        }
+    }
+
+    return -EFAULT;
+}
+
+/*
+ * Wait for the response of a posted EMAD until its deadline. An EMAD that did not get
+ * its response in time is taken out of the pipeline, so its window slot is released.
+ */
+static int __emad_pending_wait(struct sx_emad_pending *pending, unsigned long timeout_msec)
+{
+    s64           elapsed_msec;
+    unsigned long flags;
+    int           err = 0;
+
+    elapsed_msec = ktime_to_ms(ktime_sub(ktime_get(), pending->start));
+    if (elapsed_msec < (s64)timeout_msec) {
+        wait_for_completion_timeout(&pending->done, msecs_to_jiffies(timeout_msec - elapsed_msec));
+    }
+
+    spin_lock_irqsave(&__emad_pipeline.lock, flags);
+    if (hash_hashed(&pending->hash_node)) {
+        __emad_pending_remove(pending);
+        __emad_pipeline.stats[pending->window_class].timeouts++;
+        err = -ETIMEDOUT;
+    }
+    spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+
+    return err;
+}
+
+/*
+ * Send a batch of EMADs to a device and collect their responses. A new EMAD is sent
+ * as soon as the number of EMADs in flight (of all callers) drops below the window,
+ * without waiting for the previous EMADs to complete. The result and the response of
+ * every EMAD are returned in its request; the return value is only about the batch.
+ */
+int sx_emad_send_batch(struct sx_dev      *dev,
+                       int                 dev_id,
+                       struct sx_emad_req *reqs,
+                       int                 count,
+                       unsigned long       timeout_msec)
+{
+    struct sx_emad_pending *pending;
+    struct sx_emad_pending *p;
+    struct isx_meta         meta;
+    unsigned long           flags;
+    u32                     window;
+    int                     oldest = 0;
+    int                     err = 0;
+    int                     i;
+
+    if (!reqs || (count <= 0)) {
+        return -EINVAL;
+    }
+
+    if (timeout_msec == 0) {
+        timeout_msec = SX_EMAD_TIMEOUT_MSEC;
+    }
+
+    pending = kcalloc(count, sizeof(*pending), GFP_KERNEL);
+    if (!pending) {
+        for (i = 0; i < count; i++) {
+            sx_skb_free(reqs[i].skb);
+            reqs[i].rx_skb = NULL;
+            reqs[i].err = -ENOMEM;
+        }
+
+        return -ENOMEM;
+    }
+
+    memset(&meta, 0, sizeof(meta));
+    meta.etclass = 6;
+    meta.rdq = 0x1f;
+    meta.lp = 1;
+    meta.type = SX_PKT_TYPE_EMAD_CTL;
+    meta.dev_id = (uint8_t)dev_id;
+    err = __emad_swid_get(dev, dev_id, &meta.swid);
+    if (err) {
+        printk(KERN_WARNING PFX "sx_emad_send_batch: trying to send emads from an IB only system\n");
+    }
+
+    for (i = 0; i < count; i++) {
+        p = &pending[i];
+        reqs[i].rx_skb = NULL;
+
+        if (err || !reqs[i].skb || (reqs[i].skb->len < sizeof(struct sx_emad))) {
+            reqs[i].err = err ? err : -EINVAL;
+            sx_skb_free(reqs[i].skb);
+            continue;
+        }
+
+        p->tid = be64_to_cpu(((struct sx_emad*)reqs[i].skb->data)->emad_op.tid);
+        init_completion(&p->done);
+        INIT_HLIST_NODE(&p->hash_node);
+
+        spin_lock_irqsave(&__emad_pipeline.lock, flags);
+        window = __emad_window();
+        while (__emad_pipeline.in_flight >= window) {
+            spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+
+            /* the window is full, wait for our oldest EMAD or for a slot of another caller */
+            while ((oldest < i) && !pending[oldest].posted) {
+                oldest++;
+            }
+
+            if (oldest < i) {
+                reqs[oldest].err = __emad_pending_wait(&pending[oldest], timeout_msec);
+                oldest++;
+            } else if (!wait_event_timeout(__emad_pipeline.wait_q,
+                                           __emad_pipeline.in_flight < __emad_window(),
+                                           msecs_to_jiffies(timeout_msec))) {
+                reqs[i].err = -EBUSY;
+                goto free_skb;
+            }
+
+            spin_lock_irqsave(&__emad_pipeline.lock, flags);
+            window = __emad_window();
+        }
+
+        if (__emad_pending_lookup(p->tid)) {
+            __emad_pipeline.tid_collisions++;
+            spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+            reqs[i].err = -EEXIST;
+            goto free_skb;
+        }
+
+        p->window_class = min(ilog2(window), SX_EMAD_WINDOW_CLASSES - 1);
+        p->start = ktime_get();
+        p->posted = 1;
+        hash_add(__emad_pipeline.pending_hash, &p->hash_node, p->tid);
+        __emad_pipeline.in_flight++;
+        if (__emad_pipeline.in_flight > __emad_pipeline.max_in_flight) {
+            __emad_pipeline.max_in_flight = __emad_pipeline.in_flight;
+        }
+        __emad_pipeline.stats[p->window_class].sent++;
+        spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+
+        /* sx_core_post_send() frees the skb on error */
+        reqs[i].err = sx_core_post_send(dev, reqs[i].skb, &meta);
+        reqs[i].skb = NULL;
+        if (reqs[i].err) {
+            spin_lock_irqsave(&__emad_pipeline.lock, flags);
+            if (hash_hashed(&p->hash_node)) {
+                __emad_pending_remove(p);
+            }
+            spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+            p->posted = 0;
+        }
+
+        continue;
+
+free_skb:
+        sx_skb_free(reqs[i].skb);
+        reqs[i].skb = NULL;
+    }
+
+    for (i = oldest; i < count; i++) {
+        if (pending[i].posted) {
+            reqs[i].err = __emad_pending_wait(&pending[i], timeout_msec);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        reqs[i].skb = NULL;
+        if (pending[i].posted && !reqs[i].err) {
+            reqs[i].rx_skb = pending[i].rx_skb;
+            reqs[i].err = reqs[i].rx_skb ? 0 : -ENOMEM;
+        } else if (pending[i].rx_skb) {
+            kfree_skb(pending[i].rx_skb);
+        }
+    }
+
+    kfree(pending);
+    return 0;
+}
+EXPORT_SYMBOL(sx_emad_send_batch);
+
+/*
+ * Called for every EMAD received. Returns 1 if the EMAD is the response of an EMAD in
+ * the pipeline (the caller must not dispatch it), 0 otherwise.
+ */
+int sx_emad_rx(struct completion_info *ci)
+{
+    struct sx_emad_window_stats *stats;
+    struct sx_emad_pending      *pending;
+    unsigned long                flags;
+    u64                          usec;
+    u64                          tid;
+    int                          bucket;
+
+    if (!READ_ONCE(__emad_pipeline.in_flight) || (ci->skb->len < sizeof(struct sx_emad))) {
+        return 0;
+    }
+
+    tid = be64_to_cpu(((struct sx_emad*)ci->skb->data)->emad_op.tid);
+
+    spin_lock_irqsave(&__emad_pipeline.lock, flags);
+    pending = __emad_pending_lookup(tid);
+    if (!pending) {
+        spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+        return 0;
+    }
+
+    __emad_pending_remove(pending);
+
+    usec = ktime_to_us(ktime_sub(ktime_get(), pending->start));
+    bucket = usec ? min(ilog2(usec) + 1, SX_EMAD_LATENCY_BUCKETS - 1) : 0;
+    stats = &__emad_pipeline.stats[pending->window_class];
+    stats->completed++;
+    stats->latency[bucket]++;
+    if (usec > stats->max_usec) {
+        stats->max_usec = usec;
+    }
+
+    /* the RX skb belongs to the caller of rx_skb(), keep a copy for the sender */
+    pending->rx_skb = skb_copy(ci->skb, GFP_ATOMIC);
+    complete(&pending->done);
+    spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+
+    return 1;
+}
+
+static int __emad_pipeline_dump_proc_show(struct seq_file *m, void *v)
+{
+    struct sx_emad_window_stats stats[SX_EMAD_WINDOW_CLASSES];
+    unsigned long               flags;
+    u32                         in_flight, max_in_flight;
+    u64                         tid_collisions;
+    int                         i, j;
+
+    spin_lock_irqsave(&__emad_pipeline.lock, flags);
+    memcpy(stats, __emad_pipeline.stats, sizeof(stats));
+    in_flight = __emad_pipeline.in_flight;
+    max_in_flight = __emad_pipeline.max_in_flight;
+    tid_collisions = __emad_pipeline.tid_collisions;
+    spin_unlock_irqrestore(&__emad_pipeline.lock, flags);
+
+    seq_printf(m, "window: %u, in flight: %u, max in flight: %u, tid collisions: %llu\n\n",
+               __emad_window(), in_flight, max_in_flight, tid_collisions);
+
+    for (i = 0; i < SX_EMAD_WINDOW_CLASSES; i++) {
+        if (!stats[i].sent) {
+            continue;
+        }
+
+        seq_printf(m, "window %u-%u: sent %llu, completed %llu, timeouts %llu, max %llu usec\n",
+                   1 << i, min((2 << i) - 1, SX_EMAD_WINDOW_MAX),
+                   stats[i].sent, stats[i].completed, stats[i].timeouts, stats[i].max_usec);
+
+        for (j = 0; j < SX_EMAD_LATENCY_BUCKETS; j++) {
+            if (!stats[i].latency[j]) {
+                continue;
+            }
+
+            if (j < SX_EMAD_LATENCY_BUCKETS - 1) {
+                seq_printf(m, "    < %-8u usec: %llu\n", 1 << j, stats[i].latency[j]);
+            } else {
+                seq_printf(m, "    >= %-7u usec: %llu\n", 1 << (j - 1), stats[i].latency[j]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int __init sx_emad_init(void)
+{
+    spin_lock_init(&__emad_pipeline.lock);
+    init_waitqueue_head(&__emad_pipeline.wait_q);
+    hash_init(__emad_pipeline.pending_hash);
+
+    sx_dbg_dump_proc_fs_register("emad_pipeline_dump", __emad_pipeline_dump_proc_show, NULL);
+    return 0;
+}
+
+void sx_emad_deinit(void)
+{
+    sx_dbg_dump_proc_fs_unregister("emad_pipeline_dump");
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2010-2019,  Mellanox Technologies. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __SX_EMAD_H__
+#define __SX_EMAD_H__
+
+#include <linux/skbuff.h>
+
+#define SX_EMAD_WINDOW_MAX          256
+#define SX_EMAD_TIMEOUT_MSEC        1000
+#define SX_EMAD_LATENCY_BUCKETS     16 /* bucket n holds latencies below 2^n usec, the last one the rest */
+#define SX_EMAD_WINDOW_CLASSES      9  /* window sizes 1, 2-3, 4-7, ..., 128-255, 256 */
+
+/* one EMAD of sx_emad_send_batch() */
+struct sx_emad_req {
+    struct sk_buff *skb;    /* IN: EMAD request frame, always consumed */
+    struct sk_buff *rx_skb; /* OUT: EMAD response frame, freed by the caller */
+    int             err;    /* OUT: result of this EMAD */
+};
+
+int sx_emad_send_batch(struct sx_dev      *dev,
+                       int                 dev_id,
+                       struct sx_emad_req *reqs,
+                       int                 count,
+                       unsigned long       timeout_msec);
+int sx_emad_rx(struct completion_info *ci);
+
+int sx_emad_init(void);
+void sx_emad_deinit(void);
+
+#endif /* __SX_EMAD_H__ */
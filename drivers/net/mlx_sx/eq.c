@@ -52,7 +52,7 @@ extern int      cpu_traffic_priority_active;
 extern int      cpu_traffic_tasklet_reschedule_enable;
 extern atomic_t cq_backup_polling_enabled;
 extern int      handle_monitor_rdq_in_timer;
-static void sx_intr_tasklet_handler(unsigned long data);
+extern int      eq_irq_cpu;
 
 /************************************************
  * Functions                                    *
@@ -223,27 +223,36 @@ static void sx_eq_int(struct sx_dev *dev, struct sx_eq *eq)
 
     if (should_continue_polling) {
         atomic_set(&cpu_traffic_prio->high_prio_cq_in_load, 1);
-        tasklet_schedule(&priv->intr_tasklet);
+        tasklet_schedule(&eq->tasklet);
     }
 }
 
 
-static void sx_intr_tasklet_handler(unsigned long data)
+/* Each EQ has its own tasklet, so command completions on the async EQ are
+ * never held back by a completion EQ that keeps rescheduling under load */
+static void sx_eq_tasklet_handler(unsigned long data)
 {
-    struct sx_dev  *dev = (struct sx_dev *)data;
+    struct sx_eq   *eq = (struct sx_eq *)data;
+    struct sx_dev  *dev = eq->dev;
     struct sx_priv *priv = sx_priv(dev);
-    int             i;
 
-    for (i = 0; i < SX_NUM_EQ; ++i) {
-        if (!sx_bitmap_test(&priv->eq_table.bitmap, priv->eq_table.eq[i].eqn)) {
-            /* This is for avoiding cases of receiving interrupts during
-             * deinit process, which happened on multi-core CPUs */
-            printk(KERN_DEBUG PFX "sx_intr_tasklet_handler: Skipping EQ %d "
-                   "which was already freed\n", priv->eq_table.eq[i].eqn);
-            continue;
-        }
+    if (!sx_bitmap_test(&priv->eq_table.bitmap, eq->eqn)) {
+        /* This is for avoiding cases of receiving interrupts during
+         * deinit process, which happened on multi-core CPUs */
+        printk(KERN_DEBUG PFX "sx_eq_tasklet_handler: Skipping EQ %d "
+               "which was already freed\n", eq->eqn);
+        return;
+    }
+
+    sx_eq_int(dev, eq);
+}
 
-        sx_eq_int(dev, &priv->eq_table.eq[i]);
+static void sx_schedule_all_eqs(struct sx_priv *priv)
+{
+    int i;
+
+    for (i = 0; i < SX_NUM_EQ; ++i) {
+        tasklet_schedule(&priv->eq_table.eq[i].tasklet);
     }
 }
 
@@ -254,22 +263,22 @@ static irqreturn_t sx_interrupt(int irq, void *dev_ptr)
 
     writel(priv->eq_table.clr_mask, priv->eq_table.clr_int);
 
-    tasklet_schedule(&priv->intr_tasklet);
+    sx_schedule_all_eqs(priv);
 
     return IRQ_HANDLED;
 }
 
 static irqreturn_t sx_msi_x_interrupt(int irq, void *dev_ptr)
 {
-    struct sx_dev  *dev = dev_ptr;
-    struct sx_priv *priv = sx_priv(dev);
+    struct sx_dev *dev = dev_ptr;
 
-    tasklet_schedule(&priv->intr_tasklet);
+    sx_schedule_all_eqs(sx_priv(dev));
 
     return IRQ_HANDLED;
 }
 
 
+
 static int sx_SW2HW_EQ(struct sx_dev *dev, struct sx_cmd_mailbox *mailbox, int eq_num)
 {
     return sx_cmd(dev, dev->device_id, mailbox, eq_num, 0, SX_CMD_SW2HW_EQ,
@@ -406,19 +415,74 @@ err_out:
     return err;
 }
 
+static void sx_set_irq_cpu(struct sx_dev *dev, unsigned int irq, int cpu)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 35))
+    if (cpu < 0) {
+        return;
+    }
+
+    if ((cpu >= nr_cpu_ids) || !cpu_online(cpu)) {
+        sx_warn(dev, "CPU %d is not online, leaving irq %u affinity as is\n", cpu, irq);
+        return;
+    }
+
+    if (irq_set_affinity_hint(irq, cpumask_of(cpu))) {
+        sx_warn(dev, "Failed to set irq %u affinity hint to CPU %d\n", irq, cpu);
+    }
+#endif
+}
+
+static void sx_clear_irq_cpu(unsigned int irq)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 35))
+    irq_set_affinity_hint(irq, NULL);
+#endif
+}
+
 static void sx_free_irqs(struct sx_dev *dev)
 {
     struct sx_eq_table *eq_table = &sx_priv(dev)->eq_table;
+    int                 i;
 
     if (eq_table->have_irq) {
         free_irq(dev->pdev->irq, dev);
+        eq_table->have_irq = 0;
     }
+
     if (eq_table->eq[0].have_irq) {
+        sx_clear_irq_cpu(eq_table->eq[0].irq);
         free_irq(eq_table->eq[0].irq, dev);
-        eq_table->eq[0].have_irq = 0;
+        for (i = 0; i < SX_NUM_EQ; ++i) {
+            eq_table->eq[i].have_irq = 0;
+        }
     }
 }
 
+static int sx_request_msi_x_irqs(struct sx_dev *dev)
+{
+    struct sx_eq_table *eq_table = &sx_priv(dev)->eq_table;
+    int                 err;
+    int                 i;
+
+    /* The EQ context has no MSI-X vector field, so the device cannot be told to signal
+     * each EQ on its own entry. All the EQs share entry 0 and its handler schedules every
+     * EQ tasklet. */
+    err = request_irq(eq_table->eq[0].irq,
+                      sx_msi_x_interrupt,
+                      0, DRV_NAME "_msix", dev);
+    if (err) {
+        return err;
+    }
+
+    for (i = 0; i < SX_NUM_EQ; ++i) {
+        eq_table->eq[i].have_irq = 1;
+    }
+
+    sx_set_irq_cpu(dev, eq_table->eq[0].irq, eq_irq_cpu);
+    return 0;
+}
+
 static int sx_map_clr_int(struct sx_dev *dev)
 {
     struct sx_priv *priv = sx_priv(dev);
@@ -451,8 +515,12 @@ int sx_init_eq_table(struct sx_dev *dev)
     return 0;
 #endif
 
-    tasklet_init(&priv->intr_tasklet, sx_intr_tasklet_handler,
-                 (unsigned long)dev);
+    for (i = 0; i < SX_NUM_EQ; ++i) {
+        priv->eq_table.eq[i].dev = dev;
+        tasklet_init(&priv->eq_table.eq[i].tasklet, sx_eq_tasklet_handler,
+                     (unsigned long)&priv->eq_table.eq[i]);
+    }
+
     err = sx_bitmap_init(&priv->eq_table.bitmap, SX_NUM_EQ);
     if (err) {
         return err;
@@ -476,15 +544,10 @@ int sx_init_eq_table(struct sx_dev *dev)
     }
 
     if (dev->flags & SX_FLAG_MSI_X) {
-        err = request_irq(priv->eq_table.eq[0].irq,
-                          sx_msi_x_interrupt,
-                          0, DRV_NAME "_msix", dev);
+        err = sx_request_msi_x_irqs(dev);
         if (err) {
-            goto err_out_async;
+            goto err_out_comp;
         }
-
-        priv->eq_table.eq[SX_EQ_COMP].have_irq = 1;
-        priv->eq_table.eq[SX_EQ_ASYNC].have_irq = 1;
     } else {
         err = request_irq(dev->pdev->irq, sx_interrupt,
                           IRQF_SHARED, DRV_NAME, dev);
@@ -533,7 +596,9 @@ void sx_cleanup_eq_table(struct sx_dev *dev)
 
     sx_unmap_clr_int(dev);
 
-    tasklet_kill(&priv->intr_tasklet);
+    for (i = 0; i < SX_NUM_EQ; ++i) {
+        tasklet_kill(&priv->eq_table.eq[i].tasklet);
+    }
 }
 
 
@@ -93,11 +93,6 @@ struct sx_eqe {
     u8 owner;   /* SW(consumer)/HW(producer) owner*/
 } __attribute__((packed));
 
-/************************************************
- * Externals
- ***********************************************/
-extern struct tasklet_struct intr_tasklet;
-
 /************************************************
  * Functions prototype
  ***********************************************/
@@ -33,6 +33,8 @@
 #ifndef SX_FW_INTERNAL_H
 #define SX_FW_INTERNAL_H
 
+#include <linux/mlx_sx/cmd.h>
+
 #define SX_PSID_SIZE 16
 
 #define SX_GET(dest, source, offset)            \
@@ -77,13 +79,6 @@
         }                                        \
     } while (0)
 
-struct ku_operation_tlv;
-
-typedef int (*access_reg_encode_cb_t)(u8 *inbox, void *ku_reg, void *context);
-typedef int (*access_reg_decode_cb_t)(u8 *outbox, void *ku_reg, void *context);
-
-#define SX_ACCESS_REG_F_IGNORE_FW_RET_CODE (1 << 0)
-
 int sx_ACCESS_REG_internal(struct sx_dev           *dev,
                            uint8_t                  dev_id,
                            uint32_t                 flags,
@@ -37,6 +37,7 @@
 #include "fw_internal.h"
 #include <linux/mlx_sx/cmd.h>
 #include <linux/mlx_sx/driver.h>
+#include <linux/mlx_sx/auto_registers/reg.h>
 #include "sxd_access_reg_pddr.h"
 
 extern struct sx_globals sx_glb;
@@ -51,6 +52,18 @@ extern struct sx_globals sx_glb;
 #define SX_PUT_REG_FIELD(dest, source, offset) SX_PUT(dest, source, ((offset) - REG_START_OFFSET))
 #define SX_GET_REG_FIELD(dest, source, offset) SX_GET(dest, source, ((offset) - REG_START_OFFSET))
 
+#define REG_END_TLV_SIZE 0x10
+
+/*
+ * Pooled mailboxes keep whatever their last user wrote, and the whole mailbox is posted.
+ * The firmware parses TLVs until it finds an all-zero END TLV, so clear the request area
+ * together with the END TLV that follows it.
+ */
+static void __sx_access_reg_clear_inbox(void *inbox, u32 req_size)
+{
+    memset(inbox, 0, min_t(u32, req_size + REG_END_TLV_SIZE, SX_MAILBOX_SIZE));
+}
+
 int sx_ACCESS_REG_internal(struct sx_dev           *dev,
                            uint8_t                  dev_id,
                            uint32_t                 flags,
@@ -77,19 +90,23 @@ int sx_ACCESS_REG_internal(struct sx_dev           *dev,
         return -EINVAL;
     }
 
-    in_mailbox = sx_alloc_cmd_mailbox(dev, dev_id);
+    if (IN_MB_SIZE(reg_len) > SX_MAILBOX_SIZE) {
+        return -EINVAL;
+    }
+
+    in_mailbox = sx_cmd_mailbox_pool_get(dev, dev_id);
     if (IS_ERR(in_mailbox)) {
         return PTR_ERR(in_mailbox);
     }
 
-    out_mailbox = sx_alloc_cmd_mailbox(dev, dev_id);
+    out_mailbox = sx_cmd_mailbox_pool_get(dev, dev_id);
     if (IS_ERR(out_mailbox)) {
         err = PTR_ERR(out_mailbox);
         goto out_free;
     }
 
     inbox = in_mailbox->buf;
-    memset(inbox, 0, SX_MAILBOX_SIZE);
+    __sx_access_reg_clear_inbox(inbox, IN_MB_SIZE(reg_len));
     outbox = out_mailbox->buf;
 
     set_operation_tlv(inbox, op_tlv);
@@ -123,12 +140,173 @@ int sx_ACCESS_REG_internal(struct sx_dev           *dev,
     }
 
 out:
-    sx_free_cmd_mailbox(dev, out_mailbox);
+    sx_cmd_mailbox_pool_put(dev, out_mailbox);
 
 out_free:
-    sx_free_cmd_mailbox(dev, in_mailbox);
+    sx_cmd_mailbox_pool_put(dev, in_mailbox);
+    return err;
+}
+
+
+/*
+ * Same as sx_ACCESS_REG_internal() for a list of registers. The registers are encoded
+ * up front, posted together over the command interface with sx_cmd_box_batch() and
+ * decoded as their completions come back, SX_ACCESS_REG_BATCH_CHUNK at a time.
+ * The result of every register is returned in its op.
+ */
+int sx_ACCESS_REG_batch(struct sx_dev           *dev,
+                        uint8_t                  dev_id,
+                        struct sx_access_reg_op *ops,
+                        int                      count)
+{
+    struct sx_cmd_batch_entry *entries;
+    struct sx_cmd_batch_entry *entry;
+    struct sx_access_reg_op   *op;
+    u16                        type_len;
+    int                        chunk;
+    int                        base;
+    int                        err = 0;
+    int                        i;
+
+    if (!ops || (count <= 0)) {
+        return -EINVAL;
+    }
+
+    if (!dev) {
+        err = -EINVAL;
+        goto out_err;
+    }
+
+    entries = kcalloc(min(count, SX_ACCESS_REG_BATCH_CHUNK), sizeof(*entries), GFP_KERNEL);
+    if (!entries) {
+        err = -ENOMEM;
+        goto out_err;
+    }
+
+    for (base = 0; base < count; base += chunk) {
+        chunk = min(count - base, SX_ACCESS_REG_BATCH_CHUNK);
+        memset(entries, 0, chunk * sizeof(*entries));
+
+        for (i = 0; i < chunk; i++) {
+            op = &ops[base + i];
+            entry = &entries[i];
+            entry->op = SX_CMD_ACCESS_REG;
+            entry->err = -EINVAL;
+
+            if (op->raw_size ? !op->reg_encode_cb : (!op->op_tlv || !op->ku_reg)) {
+                continue;
+            }
+
+            entry->in_mb_size = op->raw_size ? op->raw_size : IN_MB_SIZE(op->reg_len);
+            if (entry->in_mb_size > SX_MAILBOX_SIZE) {
+                continue;
+            }
+
+            entry->in_param = sx_cmd_mailbox_pool_get(dev, dev_id);
+            if (IS_ERR(entry->in_param)) {
+                entry->err = PTR_ERR(entry->in_param);
+                entry->in_param = NULL;
+                continue;
+            }
+
+            entry->out_param = sx_cmd_mailbox_pool_get(dev, dev_id);
+            if (IS_ERR(entry->out_param)) {
+                entry->err = PTR_ERR(entry->out_param);
+                entry->out_param = NULL;
+                continue;
+            }
+
+            __sx_access_reg_clear_inbox(entry->in_param->buf, entry->in_mb_size);
+
+            if (op->raw_size) {
+                entry->err = op->reg_encode_cb(entry->in_param->buf, op->ku_reg, op->context);
+                continue;
+            }
+
+            set_operation_tlv(entry->in_param->buf, op->op_tlv);
+            type_len = (REG_TLV_TYPE << 11) | op->reg_len;
+            SX_PUT(entry->in_param->buf, type_len, REG_TLV_OFFSET);
+
+            entry->err = 0;
+            if (op->reg_encode_cb) {
+                entry->err = op->reg_encode_cb((u8*)entry->in_param->buf + REG_START_OFFSET,
+                                               op->ku_reg, op->context);
+            }
+        }
+
+        /* registers that failed to encode keep their error and are not sent */
+        for (i = 0; i < chunk; i++) {
+            ops[base + i].err = entries[i].err;
+        }
+
+        err = sx_cmd_box_batch(dev, dev_id, entries, chunk, SX_CMD_TIME_CLASS_A);
+
+        for (i = 0; i < chunk; i++) {
+            op = &ops[base + i];
+            entry = &entries[i];
+
+            if (op->err) {
+                goto free_mailboxes;
+            }
+
+            if (err) {
+                op->err = err;
+                goto free_mailboxes;
+            }
+
+            op->err = entry->err;
+            if (op->err) {
+                if (op->flags & SX_ACCESS_REG_F_IGNORE_FW_RET_CODE) {
+                    op->err = 0;
+                }
+
+                goto free_mailboxes;
+            }
+
+            if (op->raw_size) {
+                if (op->reg_decode_cb) {
+                    op->err = op->reg_decode_cb(entry->out_param->buf, op->ku_reg, op->context);
+                }
+
+                goto free_mailboxes;
+            }
+
+            get_operation_tlv(entry->out_param->buf, op->op_tlv);
+            if (op->reg_decode_cb && (op->op_tlv->method == 0x01)) { /* 0x01 = Query */
+                op->err = op->reg_decode_cb((u8*)entry->out_param->buf + REG_START_OFFSET,
+                                            op->ku_reg, op->context);
+            }
+
+free_mailboxes:
+            if (entry->out_param) {
+                sx_cmd_mailbox_pool_put(dev, entry->out_param);
+            }
+
+            if (entry->in_param) {
+                sx_cmd_mailbox_pool_put(dev, entry->in_param);
+            }
+        }
+
+        if (err) {
+            for (i = base + chunk; i < count; i++) {
+                ops[i].err = err;
+            }
+
+            break;
+        }
+    }
+
+    kfree(entries);
+    return err;
+
+out_err:
+    for (i = 0; i < count; i++) {
+        ops[i].err = err;
+    }
+
     return err;
 }
+EXPORT_SYMBOL(sx_ACCESS_REG_batch);
 
 
 /************************************************
@@ -4364,6 +4542,121 @@ int sx_ACCESS_REG_MTPPTR(struct sx_dev *dev, struct ku_access_mtpptr_reg *reg_da
 }
 EXPORT_SYMBOL(sx_ACCESS_REG_MTPPTR);
 
+/* MTPPTR of several ports with the register accesses in flight together, the result of reg_list[i] in err_list[i] */
+int sx_ACCESS_REG_MTPPTR_batch(struct sx_dev               *dev,
+                               struct ku_access_mtpptr_reg *reg_list,
+                               int                         *err_list,
+                               int                          count,
+                               u8                           to_host_order)
+{
+    struct sx_access_reg_op *ops;
+    int                      err;
+    int                      i;
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    ops = kcalloc(count, sizeof(*ops), GFP_KERNEL);
+    if (!ops) {
+        for (i = 0; i < count; i++) {
+            err_list[i] = -ENOMEM;
+        }
+
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < count; i++) {
+        ops[i].op_tlv = &reg_list[i].op_tlv;
+        ops[i].reg_encode_cb = __MTPPTR_encode;
+        ops[i].reg_decode_cb = __MTPPTR_decode;
+        ops[i].reg_len = MTPPTR_REG_LEN;
+        ops[i].ku_reg = &reg_list[i].mtpptr_reg;
+        ops[i].context = &to_host_order;
+    }
+
+    err = sx_ACCESS_REG_batch(dev, reg_list[0].dev_id, ops, count);
+
+    for (i = 0; i < count; i++) {
+        err_list[i] = ops[i].err;
+    }
+
+    kfree(ops);
+    return err;
+}
+EXPORT_SYMBOL(sx_ACCESS_REG_MTPPTR_batch);
+
+/************************************************
+ * MCDA batch
+ ***********************************************/
+#define REG_MCDA_DATA_OFFSET 0x10
+/* MLXSW_MCDA_LEN may be patched down (mlxfw 0004_reg_h.patch), only that much data is sent */
+#define MCDA_MAX_DATA_LEN    (MLXSW_MCDA_LEN - REG_MCDA_DATA_OFFSET)
+
+static int __MCDA_batch_encode(u8 *inbox, void *ku_reg, void *context)
+{
+    struct ku_mcda_reg *mcda_reg = (struct ku_mcda_reg*)ku_reg;
+    int                 i;
+
+    /* a block larger than the register TLV would be cut short on the way to the device */
+    if ((mcda_reg->size > MCDA_MAX_DATA_LEN) || (mcda_reg->size > SXD_MCDA_DATA_NUM * 4)) {
+        return -EINVAL;
+    }
+
+    mlxsw_reg_mcda_update_handle_set((char*)inbox, mcda_reg->update_handle);
+    mlxsw_reg_mcda_offset_set((char*)inbox, mcda_reg->offset);
+    mlxsw_reg_mcda_size_set((char*)inbox, mcda_reg->size);
+
+    /* the inbox is cleared, the data beyond the block size is left zero */
+    for (i = 0; i * 4 < mcda_reg->size; i++) {
+        mlxsw_reg_mcda_data_set((char*)inbox, i, mcda_reg->data[i]);
+    }
+
+    return 0;
+}
+
+/* Write a list of MCDA blocks (component download), keeping several of them in flight */
+int sx_ACCESS_REG_MCDA_batch(struct sx_dev             *dev,
+                             struct ku_access_mcda_reg *reg_list,
+                             int                       *err_list,
+                             int                        count)
+{
+    struct sx_access_reg_op *ops;
+    u16                      reg_len_dword = (MLXSW_MCDA_LEN >> 2) + 1;
+    int                      err;
+    int                      i;
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    if (MLXSW_MCDA_LEN % 4 > 0) {
+        reg_len_dword++;
+    }
+
+    ops = kcalloc(count, sizeof(*ops), GFP_KERNEL);
+    if (!ops) {
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < count; i++) {
+        ops[i].op_tlv = &reg_list[i].op_tlv;
+        ops[i].reg_encode_cb = __MCDA_batch_encode;
+        ops[i].reg_len = reg_len_dword;
+        ops[i].ku_reg = &reg_list[i].mcda_reg;
+    }
+
+    err = sx_ACCESS_REG_batch(dev, reg_list[0].dev_id, ops, count);
+
+    for (i = 0; i < count; i++) {
+        err_list[i] = ops[i].err;
+    }
+
+    kfree(ops);
+    return err;
+}
+EXPORT_SYMBOL(sx_ACCESS_REG_MCDA_batch);
+
 /************************************************
  * MTPPS
  ***********************************************/
@@ -5062,20 +5355,20 @@ int sx_ACCESS_REG_RAW_BUFF(struct sx_dev *dev, struct ku_access_reg_raw_buff *ra
         return -ENOMEM;
     }
 
-    in_mailbox = sx_alloc_cmd_mailbox(dev, raw_data->dev_id);
+    in_mailbox = sx_cmd_mailbox_pool_get(dev, raw_data->dev_id);
     if (IS_ERR(in_mailbox)) {
         return PTR_ERR(in_mailbox);
     }
 
-    out_mailbox = sx_alloc_cmd_mailbox(dev, raw_data->dev_id);
+    out_mailbox = sx_cmd_mailbox_pool_get(dev, raw_data->dev_id);
     if (IS_ERR(out_mailbox)) {
         err = PTR_ERR(out_mailbox);
         goto out_free;
     }
 
     inbox = in_mailbox->buf;
-    memset(inbox, 0, SX_MAILBOX_SIZE);
     outbox = out_mailbox->buf;
+    __sx_access_reg_clear_inbox(inbox, raw_data->raw_buff.size);
 
     err = copy_from_user(inbox, raw_data->raw_buff.buff,
                          raw_data->raw_buff.size);
@@ -5094,8 +5387,8 @@ int sx_ACCESS_REG_RAW_BUFF(struct sx_dev *dev, struct ku_access_reg_raw_buff *ra
                        raw_data->raw_buff.size);
 
 out:
-    sx_free_cmd_mailbox(dev, out_mailbox);
+    sx_cmd_mailbox_pool_put(dev, out_mailbox);
 out_free:
-    sx_free_cmd_mailbox(dev, in_mailbox);
+    sx_cmd_mailbox_pool_put(dev, in_mailbox);
     return err;
 }
@@ -127,6 +127,12 @@ static const ioctl_handler_cb_t
     [IOCTL_CMD_INDEX(CTRL_CMD_SET_PCI_PROFILE_DRIVER_ONLY)] = ctrl_cmd_set_pci_profile_driver_only,
     [IOCTL_CMD_INDEX(CTRL_CMD_FLUSH_EVLIST)] = ctrl_cmd_flush_evlist,
     [IOCTL_CMD_INDEX(CTRL_CMD_SET_SW_IB_NODE_DESC)] = ctrl_cmd_set_sw_ib_node_desc,
+    [IOCTL_CMD_INDEX(CTRL_CMD_SET_RX_RING)] = ctrl_cmd_set_rx_ring,
+    [IOCTL_CMD_INDEX(CTRL_CMD_WRITE_MULTI)] = ctrl_cmd_write_multi,
+    [IOCTL_CMD_INDEX(CTRL_CMD_SET_RDQ_MODERATION)] = ctrl_cmd_set_rdq_moderation,
+    [IOCTL_CMD_INDEX(CTRL_CMD_GET_RDQ_MODERATION)] = ctrl_cmd_get_rdq_moderation,
+    [IOCTL_CMD_INDEX(CTRL_CMD_ACCESS_REG_BATCH)] = ctrl_cmd_access_reg_batch,
+    [IOCTL_CMD_INDEX(CTRL_CMD_SEND_EMAD_BATCH)] = ctrl_cmd_send_emad_batch,
 };
 
 
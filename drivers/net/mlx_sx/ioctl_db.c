@@ -482,7 +482,7 @@ long ctrl_cmd_restore_sx_core_db(struct file *file, unsigned int cmd, unsigned l
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     SX_CORE_IOCTL_MEMCPY(sysport_filter_db);
     SX_CORE_IOCTL_MEMCPY(lag_filter_db);
     SX_CORE_IOCTL_MEMCPY(pvid_sysport_db);
@@ -516,7 +516,12 @@ long ctrl_cmd_restore_sx_core_db(struct file *file, unsigned int cmd, unsigned l
     SX_CORE_IOCTL_MEMCPY(port_vid_to_fid);
     SX_CORE_IOCTL_MEMCPY(fid_to_hwfid);
     SX_CORE_IOCTL_MEMCPY(rif_id_to_hwfid);
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
+
+    err = sx_trap_filter_rebuild(sx_priv(dev));
+    if (err) {
+        goto out;
+    }
 
     err = sx_core_ioctl_set_rdq_properties(dev, sx_core_db);
     if (err) {
@@ -710,13 +715,13 @@ long ctrl_cmd_set_vid_membership(struct file *file, unsigned int cmd, unsigned l
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (vid_data.is_lag) {
         sx_priv(dev)->lag_vtag_mode[vid_data.lag_id][vid_data.vid] = vid_data.is_tagged;
     } else {
         sx_priv(dev)->port_vtag_mode[vid_data.phy_port][vid_data.vid] = vid_data.is_tagged;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -749,13 +754,13 @@ long ctrl_cmd_set_prio_tagging(struct file *file, unsigned int cmd, unsigned lon
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (prio_tag_data.is_lag) {
         sx_priv(dev)->lag_prio_tagging_mode[prio_tag_data.lag_id] = prio_tag_data.is_prio_tagged;
     } else {
         sx_priv(dev)->port_prio_tagging_mode[prio_tag_data.phy_port] = prio_tag_data.is_prio_tagged;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -802,13 +807,13 @@ long ctrl_cmd_set_prio_to_tc(struct file *file, unsigned int cmd, unsigned long
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (prio_to_tc_data.is_lag) {
         sx_priv(dev)->lag_prio2tc[prio_to_tc_data.lag_id][prio_to_tc_data.priority] = prio_to_tc_data.traffic_class;
     } else {
         sx_priv(dev)->port_prio2tc[prio_to_tc_data.phy_port][prio_to_tc_data.priority] = prio_to_tc_data.traffic_class;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -819,6 +824,7 @@ long ctrl_cmd_set_local_port_to_swid(struct file *file, unsigned int cmd, unsign
 {
     struct ku_local_port_swid_data local_port_swid_data;
     struct sx_dev                 *dev;
+    unsigned long                  flags;
     int                            err;
 
     SX_CORE_IOCTL_GET_GLOBAL_DEV(&dev);
@@ -835,7 +841,9 @@ long ctrl_cmd_set_local_port_to_swid(struct file *file, unsigned int cmd, unsign
         goto out;
     }
 
+    sx_db_write_lock(sx_priv(dev), flags);
     sx_priv(dev)->local_to_swid_db[local_port_swid_data.local_port] = local_port_swid_data.swid;
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 #ifdef SX_DEBUG
     printk(KERN_DEBUG PFX " sx_ioctl() (PSPA) LOC_PORT_TO_SWID lp:%d, swid: %d \n",
@@ -852,6 +860,7 @@ long ctrl_cmd_set_ib_to_local_port(struct file *file, unsigned int cmd, unsigned
 {
     struct ku_ib_local_port_data ib_local_port_data;
     struct sx_dev               *dev;
+    unsigned long                flags;
     int                          err;
 
     SX_CORE_IOCTL_GET_GLOBAL_DEV(&dev);
@@ -875,7 +884,9 @@ long ctrl_cmd_set_ib_to_local_port(struct file *file, unsigned int cmd, unsigned
         goto out;
     }
 
+    sx_db_write_lock(sx_priv(dev), flags);
     sx_priv(dev)->ib_to_local_db[ib_local_port_data.ib_port] = ib_local_port_data.local_port;
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 #ifdef SX_DEBUG
     printk(KERN_DEBUG PFX " sx_ioctl() (PLIB) IB_TO_LOCAL_PORT ib_p:%d, lc_p:%d \n",
@@ -908,10 +919,10 @@ long ctrl_cmd_set_system_to_local_port(struct file *file, unsigned int cmd, unsi
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     sx_priv(dev)->system_to_local_db[system_local_port_data.system_port] = system_local_port_data.local_port;
     sx_priv(dev)->local_to_system_db[system_local_port_data.local_port] = system_local_port_data.system_port;
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 #ifdef SX_DEBUG
     printk(KERN_DEBUG PFX " sx_ioctl() (SSPR) SYSTEM_TO_LOCAL_PORT sys_p:0x%x, lc_p:%d \n",
@@ -954,7 +965,7 @@ long ctrl_cmd_set_port_rp_mode(struct file *file, unsigned int cmd, unsigned lon
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
 
     if (port_rp_mode_data.is_lag) {
         if (port_rp_mode_data.lag_id >= lag_max) {
@@ -1010,7 +1021,7 @@ long ctrl_cmd_set_port_rp_mode(struct file *file, unsigned int cmd, unsigned lon
     sx_priv(dev)->rif_id_to_hwfid[port_rp_mode_data.rif_id] = port_rp_mode_data.hw_efid;
 
 out_unlock:
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1049,7 +1060,7 @@ long ctrl_cmd_set_local_port_to_lag(struct file *file, unsigned int cmd, unsigne
     lag_id = local_to_lag_data.lag_id;
     lag_port_index = local_to_lag_data.lag_port_index;
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (local_to_lag_data.is_lag) {
         /* Adding the port to LAG */
         sx_priv(dev)->lag_member_to_local_db[lag_id][lag_port_index] = local_to_lag_data.local_port;
@@ -1069,7 +1080,7 @@ long ctrl_cmd_set_local_port_to_lag(struct file *file, unsigned int cmd, unsigne
             sx_priv(dev)->local_to_swid_db[local_to_lag_data.local_port] = 255;
         }
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 #ifdef SX_DEBUG
     printk(KERN_DEBUG PFX " sx_ioctl() (SLCOR) LOCAL_PORT_TO_LAG is_lag:%d,lid:%d,port_id:%x,loc_port:%d\n",
@@ -1114,9 +1125,9 @@ long ctrl_cmd_lag_oper_state_set(struct file *file, unsigned int cmd, unsigned l
     lag_state_event_data->lag_oper_state_set.lag_id = lag_oper_state_data.lag_id;
     lag_state_event_data->lag_oper_state_set.oper_state = lag_oper_state_data.oper_state;
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     sx_priv(dev)->lag_oper_state[lag_oper_state_data.lag_id] = lag_oper_state_data.oper_state;
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
     sx_core_dispatch_event(dev, SX_DEV_EVENT_LAG_OPER_STATE_UPDATE, lag_state_event_data);
     kfree(lag_state_event_data);
@@ -1148,9 +1159,9 @@ long ctrl_cmd_port_ber_monitor_state_set(struct file *file, unsigned int cmd, un
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     sx_priv(dev)->port_ber_monitor_state[ber_monitor_state_data.local_port] = ber_monitor_state_data.ber_monitor_state;
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1179,13 +1190,13 @@ long ctrl_cmd_port_ber_monitor_bitmask_set(struct file *file, unsigned int cmd,
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     sx_priv(dev)->port_ber_monitor_bitmask[ber_monitor_bitmask_data.local_port] = ber_monitor_bitmask_data.bitmask;
     /* If BER monitor is disable: clear the operational state */
     if (ber_monitor_bitmask_data.bitmask == 0) {
         sx_priv(dev)->port_ber_monitor_state[ber_monitor_bitmask_data.local_port] = 0;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1216,7 +1227,7 @@ long ctrl_cmd_tele_threshold_set(struct file *file, unsigned int cmd, unsigned l
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (tele_thrs_data.tc_vec == 0) {
         sx_priv(dev)->tele_thrs_state[tele_thrs_data.local_port] = 0;
         /* We clear tc vector DB only if all TCs were removed */
@@ -1224,7 +1235,7 @@ long ctrl_cmd_tele_threshold_set(struct file *file, unsigned int cmd, unsigned l
     } else {
         SX_TELE_THRS_VALID_SET(sx_priv(dev)->tele_thrs_state[tele_thrs_data.local_port]);
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1251,7 +1262,7 @@ long ctrl_cmd_set_vid_2_ip(struct file *file, unsigned int cmd, unsigned long da
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
 
     if (vid2ip_data.valid) {
         sx_priv(dev)->icmp_vlan2ip_db[vid2ip_data.vid] = vid2ip_data.ip_addr;
@@ -1259,7 +1270,7 @@ long ctrl_cmd_set_vid_2_ip(struct file *file, unsigned int cmd, unsigned long da
         sx_priv(dev)->icmp_vlan2ip_db[vid2ip_data.vid] = 0;
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1295,7 +1306,7 @@ long ctrl_cmd_set_port_vid_to_fid_map(struct file *file, unsigned int cmd, unsig
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
 
     if (port_vlan_to_fid_map_data.is_mapped_to_fid) {
         sx_priv(dev)->port_vid_to_fid[port_vlan_to_fid_map_data.local_port][port_vlan_to_fid_map_data.vid] =
@@ -1304,7 +1315,7 @@ long ctrl_cmd_set_port_vid_to_fid_map(struct file *file, unsigned int cmd, unsig
         sx_priv(dev)->port_vid_to_fid[port_vlan_to_fid_map_data.local_port][port_vlan_to_fid_map_data.vid] = 0;
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1333,9 +1344,9 @@ long ctrl_cmd_set_fid_to_hwfid_map(struct file *file, unsigned int cmd, unsigned
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     sx_priv(dev)->fid_to_hwfid[fid_to_hwfid_map_data.fid] = fid_to_hwfid_map_data.hw_fid;
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1364,14 +1375,14 @@ long ctrl_cmd_set_default_vid(struct file *file, unsigned int cmd, unsigned long
         }
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (default_vid_data.is_lag) {
         sx_priv(dev)->pvid_lag_db[default_vid_data.lag_id] = default_vid_data.default_vid;
     } else {
         sx_priv(dev)->pvid_sysport_db[default_vid_data.sysport] = default_vid_data.default_vid;
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -40,6 +40,7 @@
 #include "cq.h"
 #include "dq.h"
 #include "alloc.h"
+#include "emad.h"
 #include "ioctl_internal.h"
 
 #include "trace.h"
@@ -57,6 +58,9 @@ extern int enable_monitor_rdq_trace_points;
  */
 #define SX_SW_EVENT_LIST_SIZE_MAX 1024
 
+/* upper bound of the vmalloc_user() area of a single mmap RX ring */
+#define SX_RX_RING_SIZE_MAX (256 * 1024 * 1024)
+
 
 /**
  * This function is used to prepare required parameters for
@@ -388,6 +392,82 @@ static uint32_t sx_monitor_count_get(struct sx_dq *bound_monitor_rdq)
 }
 
 
+/**
+ * Copy a packet to the next slot of the file's mmap RX ring.
+ * Must be called with file->lock held.
+ *
+ * returns: 0 success
+ *          -ENOSPC the ring is full (user space did not advance tail)
+ */
+static int sx_rx_ring_put(struct sx_rx_ring *ring, struct completion_info *comp_info)
+{
+    struct event_data edata;
+    struct ku_read   *metadata;
+    struct sk_buff   *skb = comp_info->skb;
+    u32               tail;
+    u32               copy_len;
+
+    tail = *(volatile u32*)&ring->hdr->tail;
+    if ((u32)(ring->head - tail) >= ring->slot_count) {
+        ring->hdr->drops++;
+        return -ENOSPC;
+    }
+
+    /* do not write the slot before user space is done with it */
+    smp_mb();
+
+    metadata = (struct ku_read*)(ring->slots + (ring->head & (ring->slot_count - 1)) * ring->slot_size);
+    memset(metadata, 0, sizeof(*metadata));
+
+    sx_cq_handle_event_data_prepare(&edata, skb, comp_info);
+    sx_copy_pkt_metadata_prepare(metadata, &edata);
+
+    copy_len = min_t(u32, skb->len, ring->slot_size - sizeof(*metadata));
+    metadata->length = copy_len;
+    if (skb_copy_bits(skb, 0, metadata + 1, copy_len)) {
+        ring->hdr->drops++;
+        return -EFAULT;
+    }
+
+    /* publish the slot content before the new head */
+    smp_wmb();
+    ring->head++;
+    *(volatile u32*)&ring->hdr->head = ring->head;
+
+    return 0;
+}
+
+
+/**
+ * Deliver a packet to the mmap RX ring of the file if one is set.
+ *
+ * returns: true if the packet was consumed by the ring (stored or dropped)
+ *          false if the file has no ring and the packet should go to the event list
+ */
+static bool sx_cq_handler_rx_ring(struct sx_rsc *file, struct completion_info *comp_info)
+{
+    unsigned long flags;
+    bool          consumed = false;
+    int           err = 0;
+
+    spin_lock_irqsave(&file->lock, flags);
+    if (file->rx_ring) {
+        consumed = true;
+        err = sx_rx_ring_put(file->rx_ring, comp_info);
+        if (!err) {
+            wake_up_interruptible(&file->poll_wait);
+        }
+    }
+    spin_unlock_irqrestore(&file->lock, flags);
+
+    if (consumed && err) {
+        inc_eventlist_drops_counter(comp_info->dev, comp_info->hw_synd);
+    }
+
+    return consumed;
+}
+
+
 static void sx_cq_handler(struct completion_info *comp_info, void *context)
 {
     unsigned long      flags;
@@ -396,6 +476,11 @@ static void sx_cq_handler(struct completion_info *comp_info, void *context)
     struct sx_dev     *sx_dev = comp_info->dev;
     struct sk_buff    *skb = comp_info->skb;
 
+    /* unlocked peek, sx_cq_handler_rx_ring() checks again under file->lock */
+    if (file->rx_ring && sx_cq_handler_rx_ring(file, comp_info)) {
+        return;
+    }
+
     skb_get(skb);
     edata = kmalloc(sizeof(*edata), GFP_ATOMIC);
     if (edata == NULL) {
@@ -1399,6 +1484,97 @@ out:
 }
 
 
+static int __rdq_moderation_get_cqn(struct sx_dev *dev, int rdq, int *cqn)
+{
+    uint8_t rdq_num = 0;
+    int     err;
+
+    err = sx_core_get_rdq_num_max(dev, &rdq_num);
+    if (err) {
+        printk(KERN_ERR PFX "Error: failed to get max RDQ num\n");
+        return err;
+    }
+
+    if ((rdq < 0) || (rdq >= rdq_num)) {
+        printk(KERN_WARNING PFX "RDQ moderation: RDQ value (%d) is not valid\n", rdq);
+        return -EINVAL;
+    }
+
+    *cqn = rdq + NUMBER_OF_SDQS;
+    return 0;
+}
+
+
+long ctrl_cmd_set_rdq_moderation(struct file *file, unsigned int cmd, unsigned long data)
+{
+    struct ku_rdq_moderation params;
+    struct sx_dev           *dev;
+    int                      cqn;
+    int                      err = 0;
+
+    SX_CORE_IOCTL_GET_GLOBAL_DEV(&dev);
+
+    if (!dev->pdev) {
+        printk(KERN_DEBUG PFX "will not set RDQ moderation since there's no PCI device\n");
+        goto out;
+    }
+
+    err = copy_from_user(&params, (void*)data, sizeof(params));
+    if (err) {
+        goto out;
+    }
+
+    err = __rdq_moderation_get_cqn(dev, params.rdq, &cqn);
+    if (err) {
+        goto out;
+    }
+
+    err = sx_cq_set_moderation(dev, cqn, &params);
+    if (err) {
+        printk(KERN_WARNING PFX "Cannot set moderation of RDQ %d (err=%d)\n", params.rdq, err);
+    }
+
+out:
+    return err;
+}
+
+
+long ctrl_cmd_get_rdq_moderation(struct file *file, unsigned int cmd, unsigned long data)
+{
+    struct ku_rdq_moderation params;
+    struct sx_dev           *dev;
+    int                      cqn;
+    int                      err = 0;
+
+    SX_CORE_IOCTL_GET_GLOBAL_DEV(&dev);
+
+    if (!dev->pdev) {
+        err = -ENODEV;
+        goto out;
+    }
+
+    err = copy_from_user(&params, (void*)data, sizeof(params));
+    if (err) {
+        goto out;
+    }
+
+    err = __rdq_moderation_get_cqn(dev, params.rdq, &cqn);
+    if (err) {
+        goto out;
+    }
+
+    err = sx_cq_get_moderation(dev, cqn, &params);
+    if (err) {
+        goto out;
+    }
+
+    err = copy_to_user((void*)data, &params, sizeof(params));
+
+out:
+    return err;
+}
+
+
 long ctrl_cmd_set_rdq_cpu_priority(struct file *file, unsigned int cmd, unsigned long data)
 {
     struct ku_rdq_cpu_priority rdq_cpu_prio;
@@ -1471,12 +1647,12 @@ long ctrl_cmd_set_truncate_params(struct file *file, unsigned int cmd, unsigned
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (truncate_params.truncate_enable) {
         if (truncate_params.truncate_size < SX_TRUNCATE_SIZE_MIN) {
             printk(KERN_ERR PFX "CTRL_CMD_SET_TRUNCATE_PARAMS: Truncate size %u is not valid\n",
                    truncate_params.truncate_size);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+            sx_db_write_unlock(sx_priv(dev), flags);
             err = -EINVAL;
             goto out;
         }
@@ -1486,7 +1662,7 @@ long ctrl_cmd_set_truncate_params(struct file *file, unsigned int cmd, unsigned
         sx_priv(dev)->truncate_size_db[truncate_params.rdq] = 0;
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -1507,22 +1683,22 @@ long ctrl_cmd_get_counters(struct file *file, unsigned int cmd, unsigned long da
     }
 
     /* the index NUMBER_OF_SWIDS holds the global counters of all swids */
-    counters->fromcpu_data_packet = sx_glb.stats.tx_by_pkt_type[swid][SX_PKT_TYPE_ETH_DATA];
-    counters->fromcpu_data_byte = sx_glb.stats.tx_by_pkt_type_bytes[swid][SX_PKT_TYPE_ETH_DATA];
-    counters->fromcpu_control_packet = sx_glb.stats.tx_by_pkt_type[swid][SX_PKT_TYPE_ETH_CTL_UC] +
-                                       sx_glb.stats.tx_by_pkt_type[swid][SX_PKT_TYPE_ETH_CTL_MC];
-    counters->fromcpu_control_byte = sx_glb.stats.tx_by_pkt_type_bytes[swid][SX_PKT_TYPE_ETH_CTL_UC] +
-                                     sx_glb.stats.tx_by_pkt_type_bytes[swid][SX_PKT_TYPE_ETH_CTL_MC];
+    counters->fromcpu_data_packet = SX_STATS_READ(&sx_glb.stats, tx_by_pkt_type[swid][SX_PKT_TYPE_ETH_DATA]);
+    counters->fromcpu_data_byte = SX_STATS_READ(&sx_glb.stats, tx_by_pkt_type_bytes[swid][SX_PKT_TYPE_ETH_DATA]);
+    counters->fromcpu_control_packet = SX_STATS_READ(&sx_glb.stats, tx_by_pkt_type[swid][SX_PKT_TYPE_ETH_CTL_UC]) +
+                                       SX_STATS_READ(&sx_glb.stats, tx_by_pkt_type[swid][SX_PKT_TYPE_ETH_CTL_MC]);
+    counters->fromcpu_control_byte = SX_STATS_READ(&sx_glb.stats, tx_by_pkt_type_bytes[swid][SX_PKT_TYPE_ETH_CTL_UC]) +
+                                     SX_STATS_READ(&sx_glb.stats, tx_by_pkt_type_bytes[swid][SX_PKT_TYPE_ETH_CTL_MC]);
 
     /* iterate HW trap_id (0-511) */
     for (trap_id = 0; trap_id < NUM_HW_SYNDROMES - NUM_SW_SYNDROMES; trap_id++) { /* trap_id 0-511 (512) */
-        counters->trap_id_packet[trap_id] = sx_glb.stats.rx_by_synd[swid][trap_id];
-        counters->trap_id_byte[trap_id] = sx_glb.stats.rx_by_synd_bytes[swid][trap_id];
+        counters->trap_id_packet[trap_id] = SX_STATS_READ(&sx_glb.stats, rx_by_synd[swid][trap_id]);
+        counters->trap_id_byte[trap_id] = SX_STATS_READ(&sx_glb.stats, rx_by_synd_bytes[swid][trap_id]);
     }
 
     /* iterate SW trap_id-events (512-575) */
     for (/* trap_id initialized */; trap_id < NUM_HW_SYNDROMES; trap_id++) {  /* trap_id 512-575 (64) */
-        counters->trap_id_events[trap_id] = sx_glb.stats.rx_eventlist_by_synd[trap_id];
+        counters->trap_id_events[trap_id] = SX_STATS_READ(&sx_glb.stats, rx_eventlist_by_synd[trap_id]);
     }
 
     err = copy_to_user((void*)data, counters, sizeof(*counters));
@@ -1677,6 +1853,184 @@ out:
 }
 
 
+long ctrl_cmd_write_multi(struct file *file, unsigned int cmd, unsigned long data)
+{
+    struct ku_write_multi_params params;
+    struct ku_write             *write_list = NULL;
+    int32_t                     *result_list = NULL;
+    struct sx_tx_batch           batch;
+    uint32_t                     i;
+    int                          err = 0;
+
+    err = copy_from_user(&params, (void*)data, sizeof(params));
+    if (err) {
+        goto out;
+    }
+
+    if ((params.pkt_count == 0) || (params.pkt_count > WRITE_MULTI_PKTS_MAX) ||
+        (params.write_list == NULL) || (params.result_list == NULL)) {
+        printk(KERN_ERR PFX "ioctl WRITE_MULTI: invalid params pkt_count=%u\n", params.pkt_count);
+        err = -EINVAL;
+        goto out;
+    }
+
+    write_list = vmalloc(params.pkt_count * (sizeof(*write_list) + sizeof(*result_list)));
+    if (!write_list) {
+        printk(KERN_DEBUG PFX "can't vmalloc write_list\n");
+        err = -ENOMEM;
+        goto out;
+    }
+
+    result_list = (int32_t*)(write_list + params.pkt_count);
+
+    err = copy_from_user(write_list, params.write_list, params.pkt_count * sizeof(*write_list));
+    if (err) {
+        goto out_free;
+    }
+
+    params.sent_count = 0;
+    sx_core_tx_batch_init(&batch);
+
+    for (i = 0; i < params.pkt_count; i++) {
+        if ((write_list[i].vec_entries == 0) || (write_list[i].iov == NULL)) {
+            result_list[i] = -EINVAL;
+            continue;
+        }
+
+        result_list[i] = sx_core_write_pkt(file, &write_list[i], &batch);
+        if (result_list[i] == 0) {
+            params.sent_count++;
+        }
+    }
+
+    sx_core_tx_batch_flush(&batch);
+
+    err = copy_to_user(params.result_list, result_list, params.pkt_count * sizeof(*result_list));
+    if (err) {
+        goto out_free;
+    }
+
+    err = copy_to_user((void*)data, &params, sizeof(params));
+
+out_free:
+    vfree(write_list);
+
+out:
+    return err;
+}
+
+
+long ctrl_cmd_send_emad_batch(struct file *file, unsigned int cmd, unsigned long data)
+{
+    struct ku_emad_batch  params;
+    struct ku_emad_frame *frame_list = NULL;
+    struct sx_emad_req   *reqs;
+    int32_t              *result_list;
+    struct sk_buff       *skb;
+    struct sx_dev        *dev;
+    uint32_t              i;
+    int                   err = 0;
+
+    err = copy_from_user(&params, (void*)data, sizeof(params));
+    if (err) {
+        goto out;
+    }
+
+    if ((params.frame_count == 0) || (params.frame_count > EMAD_BATCH_MAX) ||
+        (params.frame_list == NULL) || (params.result_list == NULL)) {
+        printk(KERN_ERR PFX "ioctl SEND_EMAD_BATCH: invalid params frame_count=%u\n", params.frame_count);
+        err = -EINVAL;
+        goto out;
+    }
+
+    frame_list = vmalloc(params.frame_count * (sizeof(*frame_list) + sizeof(*reqs) + sizeof(*result_list)));
+    if (!frame_list) {
+        printk(KERN_DEBUG PFX "can't vmalloc frame_list\n");
+        err = -ENOMEM;
+        goto out;
+    }
+
+    reqs = (struct sx_emad_req*)(frame_list + params.frame_count);
+    result_list = (int32_t*)(reqs + params.frame_count);
+    memset(reqs, 0, params.frame_count * sizeof(*reqs));
+
+    err = copy_from_user(frame_list, params.frame_list, params.frame_count * sizeof(*frame_list));
+    if (err) {
+        goto out_free;
+    }
+
+    for (i = 0; i < params.frame_count; i++) {
+        if ((frame_list[i].req_size == 0) || (frame_list[i].req_buff == NULL)) {
+            continue;
+        }
+
+        /* room for the TX header and, over SGMII, the control segment, ETH header and FCS */
+        skb = alloc_skb(frame_list[i].req_size + 2 + ISX_HDR_SIZE +
+                        sizeof(struct sx_sgmii_ctrl_segment) + sizeof(struct sx_ethernet_header),
+                        GFP_KERNEL);
+        if (!skb) {
+            continue;
+        }
+
+        skb_reserve(skb, ISX_HDR_SIZE + sizeof(struct sx_sgmii_ctrl_segment) + sizeof(struct sx_ethernet_header));
+        if (copy_from_user(skb_put(skb, frame_list[i].req_size), frame_list[i].req_buff, frame_list[i].req_size)) {
+            kfree_skb(skb);
+            continue;
+        }
+
+        reqs[i].skb = skb;
+    }
+
+    down_read(&sx_glb.pci_restart_lock);
+
+    err = sx_dpt_get_sx_dev_by_id(params.dev_id, &dev);
+    if (err) {
+        printk(KERN_WARNING PFX "ioctl SEND_EMAD_BATCH: Device doesn't exist. Aborting\n");
+        up_read(&sx_glb.pci_restart_lock);
+        for (i = 0; i < params.frame_count; i++) {
+            if (reqs[i].skb) {
+                kfree_skb(reqs[i].skb);
+            }
+        }
+        goto out_free;
+    }
+
+    /* entries without an skb are failed by sx_emad_send_batch() with -EINVAL */
+    sx_emad_send_batch(dev, params.dev_id, reqs, params.frame_count, params.timeout_msec);
+    up_read(&sx_glb.pci_restart_lock);
+
+    for (i = 0; i < params.frame_count; i++) {
+        result_list[i] = reqs[i].err;
+        if (!reqs[i].rx_skb) {
+            frame_list[i].resp_size = 0;
+            continue;
+        }
+
+        if (reqs[i].rx_skb->len > frame_list[i].resp_size) {
+            result_list[i] = -ENOBUFS;
+        } else if (copy_to_user(frame_list[i].resp_buff, reqs[i].rx_skb->data, reqs[i].rx_skb->len)) {
+            result_list[i] = -EFAULT;
+        }
+
+        frame_list[i].resp_size = min_t(u32, reqs[i].rx_skb->len, frame_list[i].resp_size);
+        kfree_skb(reqs[i].rx_skb);
+    }
+
+    err = copy_to_user(params.result_list, result_list, params.frame_count * sizeof(*result_list));
+    if (err) {
+        goto out_free;
+    }
+
+    err = copy_to_user(params.frame_list, frame_list, params.frame_count * sizeof(*frame_list));
+
+out_free:
+    vfree(frame_list);
+
+out:
+    return err;
+}
+
+
 /**
  * This function is used for reading Monitor RDQ statistics
  * (e.g. the total number of discarded packets). It count the
@@ -1721,6 +2075,8 @@ long ctrl_cmd_get_rdq_stat(struct file *file, unsigned int cmd, unsigned long da
     ku.discarded_pkts_total_num = monitor_dq->mon_rx_count - monitor_dq->mon_rx_start_total +
                                   monitor_dq->sw_dup_evlist_total_cnt;
 
+    ku.drain_rate = sx_monitor_rdq_drain_rate(monitor_dq);
+
     if (ku.clear_after_read == true) {
         monitor_dq->mon_rx_start_total = monitor_dq->mon_rx_count;
     }
@@ -1794,10 +2150,106 @@ long ctrl_cmd_flush_evlist(struct file *file, unsigned int cmd, unsigned long da
 }
 
 
+void sx_rx_ring_free(struct sx_rx_ring *ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    vfree(ring->hdr);
+    kfree(ring);
+}
+
+
+static struct sx_rx_ring * sx_rx_ring_alloc(const struct ku_rx_ring_params *params)
+{
+    struct sx_rx_ring *ring;
+    u64                size;
+
+    size = KU_RX_RING_HDR_SIZE + (u64)params->slot_count * params->slot_size;
+    if (size > SX_RX_RING_SIZE_MAX) {
+        printk(KERN_ERR PFX "RX ring of %u slots of %u bytes is too big\n",
+               params->slot_count, params->slot_size);
+        return NULL;
+    }
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring) {
+        return NULL;
+    }
+
+    ring->size = PAGE_ALIGN((size_t)size);
+    ring->hdr = vmalloc_user(ring->size);
+    if (!ring->hdr) {
+        kfree(ring);
+        return NULL;
+    }
+
+    ring->slots = (u8*)ring->hdr + KU_RX_RING_HDR_SIZE;
+    ring->slot_count = params->slot_count;
+    ring->slot_size = params->slot_size;
+    ring->head = 0;
+    ring->hdr->slot_count = params->slot_count;
+    ring->hdr->slot_size = params->slot_size;
+
+    return ring;
+}
+
+
+long ctrl_cmd_set_rx_ring(struct file *file, unsigned int cmd, unsigned long data)
+{
+    struct ku_rx_ring_params params;
+    struct sx_rsc           *rsc = file->private_data;
+    struct sx_rx_ring       *new_ring = NULL;
+    struct sx_rx_ring       *old_ring = NULL;
+    unsigned long            flags;
+    int                      err = 0;
+
+    err = copy_from_user(&params, (void*)data, sizeof(params));
+    if (err) {
+        goto out;
+    }
+
+    if (params.slot_count) {
+        if ((params.slot_count > KU_RX_RING_SLOT_COUNT_MAX) ||
+            (params.slot_count & (params.slot_count - 1)) ||
+            (params.slot_size <= sizeof(struct ku_read)) ||
+            (params.slot_size > KU_RX_RING_SLOT_SIZE_MAX) ||
+            (params.slot_size % 8)) {
+            printk(KERN_ERR PFX "ioctl SET_RX_RING: invalid params "
+                   "slot_count=%u slot_size=%u\n",
+                   params.slot_count, params.slot_size);
+            err = -EINVAL;
+            goto out;
+        }
+
+        new_ring = sx_rx_ring_alloc(&params);
+        if (!new_ring) {
+            err = -ENOMEM;
+            goto out;
+        }
+    }
+
+    mutex_lock(&rsc->rx_ring_mutex);
+    spin_lock_irqsave(&rsc->lock, flags);
+    old_ring = rsc->rx_ring;
+    rsc->rx_ring = new_ring;
+    spin_unlock_irqrestore(&rsc->lock, flags);
+    mutex_unlock(&rsc->rx_ring_mutex);
+
+    /* existing mappings keep a reference on the pages of the old ring */
+    sx_rx_ring_free(old_ring);
+
+out:
+    return err;
+}
+
+
 long ctrl_cmd_trap_filter_add(struct file *file, unsigned int cmd, unsigned long data)
 {
     struct ku_trap_filter_data filter_data;
     struct sx_dev             *dev;
+    struct sx_trap_filter     *new_filter = NULL;
     unsigned long              flags;
     int                        i, idx = -1;
     uint16_t                   lag_max = 0, lag_member_max = 0;
@@ -1823,13 +2275,19 @@ long ctrl_cmd_trap_filter_add(struct file *file, unsigned int cmd, unsigned long
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    new_filter = sx_trap_filter_alloc();
+    if (!new_filter) {
+        err = -ENOMEM;
+        goto out;
+    }
+
+    sx_db_write_lock(sx_priv(dev), flags);
     if (filter_data.is_lag) {
         if (filter_data.lag_id >= lag_max) {
             printk(KERN_ERR PFX "Received LAG ID 0x%x "
                    "is invalid\n",
                    filter_data.lag_id);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+            sx_db_write_unlock(sx_priv(dev), flags);
             err = -EINVAL;
             goto out;
         }
@@ -1842,7 +2300,7 @@ long ctrl_cmd_trap_filter_add(struct file *file, unsigned int cmd, unsigned long
                        "of trap ID 0x%x\n",
                        filter_data.lag_id,
                        filter_data.trap_id);
-                spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+                sx_db_write_unlock(sx_priv(dev), flags);
                 err = -EEXIST;
                 goto out;
             }
@@ -1861,6 +2319,7 @@ long ctrl_cmd_trap_filter_add(struct file *file, unsigned int cmd, unsigned long
         } else {
             sx_priv(dev)->lag_filter_db[filter_data.trap_id][idx] =
                 filter_data.lag_id;
+            __sx_trap_filter_set(sx_priv(dev), filter_data.trap_id, 1, filter_data.lag_id, &new_filter);
             printk(KERN_INFO PFX "LAG ID %u was added to filter list "
                    "of trap ID 0x%x\n", filter_data.lag_id,
                    filter_data.trap_id);
@@ -1874,7 +2333,7 @@ long ctrl_cmd_trap_filter_add(struct file *file, unsigned int cmd, unsigned long
                        "of trap ID 0x%x\n",
                        filter_data.sysport,
                        filter_data.trap_id);
-                spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+                sx_db_write_unlock(sx_priv(dev), flags);
                 err = -EEXIST;
                 goto out;
             }
@@ -1892,15 +2351,17 @@ long ctrl_cmd_trap_filter_add(struct file *file, unsigned int cmd, unsigned long
         } else {
             sx_priv(dev)->sysport_filter_db[filter_data.trap_id][idx] =
                 filter_data.sysport;
+            __sx_trap_filter_set(sx_priv(dev), filter_data.trap_id, 0, filter_data.sysport, &new_filter);
             printk(KERN_INFO PFX "system port 0x%x was added to filter "
                    "list of trap ID 0x%x\n", filter_data.sysport,
                    filter_data.trap_id);
         }
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
+    kfree(new_filter);
     return err;
 }
 
@@ -1933,13 +2394,13 @@ long ctrl_cmd_trap_filter_remove(struct file *file, unsigned int cmd, unsigned l
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
     if (filter_data.is_lag) {
         if (filter_data.lag_id >= lag_max) {
             printk(KERN_ERR PFX "Received LAG ID 0x%x "
                    "is invalid\n",
                    filter_data.lag_id);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+            sx_db_write_unlock(sx_priv(dev), flags);
             err = -EINVAL;
             goto out;
         }
@@ -1949,6 +2410,7 @@ long ctrl_cmd_trap_filter_remove(struct file *file, unsigned int cmd, unsigned l
                 filter_data.lag_id) {
                 sx_priv(dev)->lag_filter_db[filter_data.trap_id][i] =
                     LAG_ID_INVALID;
+                __sx_trap_filter_clear(sx_priv(dev), filter_data.trap_id, 1, filter_data.lag_id);
                 printk(KERN_INFO PFX "LAG ID %u was removed from filter list "
                        "of trap ID 0x%x\n", filter_data.lag_id,
                        filter_data.trap_id);
@@ -1966,6 +2428,7 @@ long ctrl_cmd_trap_filter_remove(struct file *file, unsigned int cmd, unsigned l
             if (sx_priv(dev)->sysport_filter_db[filter_data.trap_id][i] ==
                 filter_data.sysport) {
                 sx_priv(dev)->sysport_filter_db[filter_data.trap_id][i] = 0;
+                __sx_trap_filter_clear(sx_priv(dev), filter_data.trap_id, 0, filter_data.sysport);
                 printk(KERN_INFO PFX "system port 0x%x was removed from filter "
                        "list of trap ID 0x%x\n", filter_data.sysport,
                        filter_data.trap_id);
@@ -1980,7 +2443,7 @@ long ctrl_cmd_trap_filter_remove(struct file *file, unsigned int cmd, unsigned l
         }
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_unlock(sx_priv(dev), flags);
 
 out:
     return err;
@@ -2008,7 +2471,7 @@ long ctrl_cmd_trap_filter_remove_all(struct file *file, unsigned int cmd, unsign
         goto out;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    sx_db_write_lock(sx_priv(dev), flags);
 
     for (i = 0; i < MAX_LAG_PORTS_IN_FILTER; i++) {
         sx_priv(dev)->lag_filter_db[filter_data.trap_id][i] = LAG_ID_INVALID;
@@ -2018,7 +2481,9 @@ long ctrl_cmd_trap_filter_remove_all(struct file *file, unsigned int cmd, unsign
         sx_priv(dev)->sysport_filter_db[filter_data.trap_id][i] = 0;
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    __sx_trap_filter_flush(sx_priv(dev), filter_data.trap_id);
+
+    sx_db_write_unlock(sx_priv(dev), flags);
     printk(KERN_INFO PFX "Removed all ports and LAGs from the filter list "
            "of trap ID %d\n", filter_data.trap_id);
 
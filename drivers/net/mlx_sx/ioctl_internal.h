@@ -32,6 +32,7 @@
 
 struct file;
 struct sx_dev;
+struct sx_tx_batch;
 extern struct sx_globals sx_glb;
 
 #define IOCTL_CMD_INDEX(cmd) ((cmd) - CTRL_CMD_MIN_VAL)
@@ -95,6 +96,7 @@ int get_edata_from_elist(int               *evlist_size,
 void sx_copy_pkt_metadata_prepare(struct ku_read    *metadata_p,
                                   struct event_data *edata_p);
 void unset_monitor_rdq(struct sx_dq *dq);
+int sx_core_write_pkt(struct file *filp, struct ku_write *write_data, struct sx_tx_batch *batch);
 int sx_core_ptp_cleanup(struct sx_dev *dev);
 int sx_send_enable_ib_swid_events(struct sx_dev *dev, u8 swid);
 
@@ -167,6 +169,12 @@ long ctrl_cmd_read_multi(struct file *file, unsigned int cmd, unsigned long data
 long ctrl_cmd_get_rdq_stat(struct file *file, unsigned int cmd, unsigned long data);
 long ctrl_cmd_set_skb_offload_fwd_mark_en(struct file *file, unsigned int cmd, unsigned long data);
 long ctrl_cmd_flush_evlist(struct file *file, unsigned int cmd, unsigned long data);
+long ctrl_cmd_set_rx_ring(struct file *file, unsigned int cmd, unsigned long data);
+long ctrl_cmd_write_multi(struct file *file, unsigned int cmd, unsigned long data);
+long ctrl_cmd_set_rdq_moderation(struct file *file, unsigned int cmd, unsigned long data);
+long ctrl_cmd_get_rdq_moderation(struct file *file, unsigned int cmd, unsigned long data);
+long ctrl_cmd_access_reg_batch(struct file *file, unsigned int cmd, unsigned long data);
+long ctrl_cmd_send_emad_batch(struct file *file, unsigned int cmd, unsigned long data);
 long ctrl_cmd_trap_filter_add(struct file *file, unsigned int cmd, unsigned long data);
 long ctrl_cmd_trap_filter_remove(struct file *file, unsigned int cmd, unsigned long data);
 long ctrl_cmd_trap_filter_remove_all(struct file *file, unsigned int cmd, unsigned long data);
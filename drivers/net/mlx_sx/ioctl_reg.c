@@ -31,12 +31,14 @@
  */
 
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 
 #include <linux/mlx_sx/kernel_user.h>
 #include <linux/mlx_sx/cmd.h>
 
 #include "sx.h"
 #include "sx_dpt.h"
+#include "fw_internal.h"
 #include "ioctl_internal.h"
 
 SX_CORE_IOCTL_ACCESS_REG_HANDLER(PSPA, ku_access_pspa_reg);
@@ -110,6 +112,93 @@ SX_CORE_IOCTL_ACCESS_REG_HANDLER(MCION, ku_access_mcion_reg);
 SX_CORE_IOCTL_ACCESS_REG_HANDLER(PMMP, ku_access_pmmp_reg);
 SX_CORE_IOCTL_ACCESS_REG_HANDLER(QPCR, ku_access_qpcr_reg);
 
+static int __access_reg_batch_encode(u8 *inbox, void *ku_reg, void *context)
+{
+    struct ku_raw_reg *raw_reg = (struct ku_raw_reg*)ku_reg;
+
+    return copy_from_user(inbox, raw_reg->buff, raw_reg->size) ? -EFAULT : 0;
+}
+
+static int __access_reg_batch_decode(u8 *outbox, void *ku_reg, void *context)
+{
+    struct ku_raw_reg *raw_reg = (struct ku_raw_reg*)ku_reg;
+
+    return copy_to_user(raw_reg->buff, outbox, raw_reg->size) ? -EFAULT : 0;
+}
+
+long ctrl_cmd_access_reg_batch(struct file *file, unsigned int cmd, unsigned long data)
+{
+    struct ku_access_reg_batch params;
+    struct ku_raw_reg         *reg_list = NULL;
+    struct sx_access_reg_op   *ops = NULL;
+    int32_t                   *result_list;
+    struct sx_dev             *dev;
+    uint32_t                   i;
+    int                        err = 0;
+
+    err = copy_from_user(&params, (void*)data, sizeof(params));
+    if (err) {
+        goto out;
+    }
+
+    if ((params.reg_count == 0) || (params.reg_count > ACCESS_REG_BATCH_MAX) ||
+        (params.reg_list == NULL) || (params.result_list == NULL)) {
+        printk(KERN_ERR PFX "ioctl ACCESS_REG_BATCH: invalid params reg_count=%u\n", params.reg_count);
+        err = -EINVAL;
+        goto out;
+    }
+
+    reg_list = vmalloc(params.reg_count * (sizeof(*reg_list) + sizeof(*ops) + sizeof(*result_list)));
+    if (!reg_list) {
+        printk(KERN_DEBUG PFX "can't vmalloc reg_list\n");
+        err = -ENOMEM;
+        goto out;
+    }
+
+    ops = (struct sx_access_reg_op*)(reg_list + params.reg_count);
+    result_list = (int32_t*)(ops + params.reg_count);
+    memset(ops, 0, params.reg_count * sizeof(*ops));
+
+    err = copy_from_user(reg_list, params.reg_list, params.reg_count * sizeof(*reg_list));
+    if (err) {
+        goto out_free;
+    }
+
+    /* a zero sized entry has no raw_size and is rejected by sx_ACCESS_REG_batch() with -EINVAL */
+    for (i = 0; i < params.reg_count; i++) {
+        ops[i].reg_encode_cb = __access_reg_batch_encode;
+        ops[i].reg_decode_cb = __access_reg_batch_decode;
+        ops[i].raw_size = reg_list[i].size;
+        ops[i].ku_reg = &reg_list[i];
+    }
+
+    down_read(&sx_glb.pci_restart_lock);
+
+    err = sx_dpt_get_cmd_sx_dev_by_id(params.dev_id, &dev);
+    if (err) {
+        printk(KERN_WARNING PFX "sx_core_access_reg BATCH: Device doesn't exist. Aborting\n");
+        up_read(&sx_glb.pci_restart_lock);
+        goto out_free;
+    }
+
+    err = sx_ACCESS_REG_batch(dev, params.dev_id, ops, params.reg_count);
+    up_read(&sx_glb.pci_restart_lock);
+
+    for (i = 0; i < params.reg_count; i++) {
+        result_list[i] = ops[i].err;
+    }
+
+    if (copy_to_user(params.result_list, result_list, params.reg_count * sizeof(*result_list))) {
+        err = -EFAULT;
+    }
+
+out_free:
+    vfree(reg_list);
+
+out:
+    return err;
+}
+
 
 const ioctl_handler_cb_t
     ioctl_reg_handler_table[CTRL_CMD_ACCESS_REG_MAX - CTRL_CMD_ACCESS_REG_MIN + 1] = {
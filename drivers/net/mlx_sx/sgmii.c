@@ -410,6 +410,8 @@ int sgmii_init(void)
         goto sgmii_worker_failed;
     }
 
+    sx_dbg_dump_proc_fs_register("sgmii_transactions", sgmii_transaction_dump, NULL);
+
     __sgmii_global_counters_init();
     use_sgmii = 1;
     return 0;
@@ -437,6 +439,7 @@ void sgmii_deinit(void)
     __sgmii_wq_deinit();
 
     sx_dbg_dump_proc_fs_unregister("sgmii_general_info");
+    sx_dbg_dump_proc_fs_unregister("sgmii_transactions");
 
     sgmii_cr_space_deinit();
     sgmii_mad_deinit();
@@ -436,6 +436,7 @@ int sgmii_cr_space_init(void)
     int ret;
 
     ret = sgmii_transaction_db_init(&__cr_space_tr_db,
+                                    "CR-Space",
                                     __sgmii_fill_cr_space_control_segment,
                                     NULL,
                                     __cr_space_work_entry_status_cb,
@@ -452,4 +453,5 @@ int sgmii_cr_space_init(void)
 
 void sgmii_cr_space_deinit(void)
 {
+    sgmii_transaction_db_deinit(&__cr_space_tr_db);
 }
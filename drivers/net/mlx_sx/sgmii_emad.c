@@ -389,6 +389,7 @@ int sgmii_emad_init(void)
     int                       ret;
 
     ret = sgmii_transaction_db_init(&__emad_tr_db,
+                                    "EMAD",
                                     sgmii_fill_common_control_segment,
                                     sgmii_fill_common_tx_base_header,
                                     __emad_work_entry_status_cb,
@@ -403,6 +404,7 @@ int sgmii_emad_init(void)
                            NULL, CHECK_DUP_DISABLED_E, NULL, NULL);
     if (ret) {
         printk(KERN_ERR "failed to register EMAD handler (ret=%d)\n", ret);
+        sgmii_transaction_db_deinit(&__emad_tr_db);
     }
 
     return ret;
@@ -415,4 +417,6 @@ void sgmii_emad_deinit(void)
 
     dummy.dont_care.sysport = SYSPORT_DONT_CARE_VALUE;
     sx_core_remove_synd(0, EMAD_TRAP_ID, L2_TYPE_DONT_CARE, 0, dummy, NULL, NULL, __sgmii_rx_emad, NULL);
+
+    sgmii_transaction_db_deinit(&__emad_tr_db);
 }
@@ -35,6 +35,9 @@
 
 #include <linux/types.h>
 #include <linux/if_vlan.h>
+#include <linux/hashtable.h>
+#include <linux/timer.h>
+#include <linux/seq_file.h>
 
 #include <linux/mlx_sx/kernel_user.h>
 #include "sgmii.h"
@@ -279,9 +282,37 @@ typedef int (*sgmii_transaction_sync_send_cb)(int
                                               const struct isx_meta                 *meta,
                                               struct sgmii_sync_transaction_context *context);
 
+#define SGMII_TR_HASH_BITS        (8)
+#define SGMII_TR_WHEEL_BITS       (8)
+#define SGMII_TR_WHEEL_SIZE       (1 << SGMII_TR_WHEEL_BITS) /* in jiffies */
+#define SGMII_TR_LATENCY_BUCKETS  (20) /* log2(usec) */
+#define SGMII_TR_ATTEMPTS_BUCKETS (8)
+
+struct sgmii_transaction_stats {
+    uint64_t started;
+    uint64_t joined;
+    uint64_t completed;
+    uint64_t dev_mismatch;
+    uint64_t timedout;
+    uint64_t terminated;
+    uint64_t retransmissions;
+    uint64_t max_latency_usec;
+    uint64_t latency[SGMII_TR_LATENCY_BUCKETS]; /* send to completion */
+    uint64_t attempts[SGMII_TR_ATTEMPTS_BUCKETS]; /* send attempts of completed transactions */
+    uint32_t in_progress;
+    uint32_t max_in_progress;
+};
 struct sgmii_transaction_db {
-    struct sx_core_map                 db_map;
+    const char                        *name;
+    struct list_head                   db_list; /* all transaction databases, for the debug dump */
+    DECLARE_HASHTABLE(db_hash, SGMII_TR_HASH_BITS); /* transactions in progress, by transaction ID */
     spinlock_t                         db_lock;
+    /* retransmission timer wheel, one slot per jiffy */
+    struct list_head                   wheel[SGMII_TR_WHEEL_SIZE];
+    unsigned long                      wheel_clk; /* next slot (jiffy) to process */
+    struct timer_list                  wheel_timer;
+    uint8_t                            shutdown;
+    struct sgmii_transaction_stats     stats;
     sgmii_fill_control_segment_cb_t    fill_control_segment_cb;
     sgmii_fill_tx_base_header_cb_t     fill_tx_base_header_cb;
     sgmii_transaction_entry_handler_cb entry_handler_cb;
@@ -296,11 +327,16 @@ struct sgmii_transaction_info {
 };
 
 int sgmii_transaction_db_init(struct sgmii_transaction_db       *tr_db,
+                              const char                        *name,
                               sgmii_fill_control_segment_cb_t    fill_control_segment_cb,
                               sgmii_fill_tx_base_header_cb_t     fill_tx_base_header_cb,
                               sgmii_transaction_entry_handler_cb entry_handler_cb,
                               sgmii_transaction_completion_cb_t  transaction_completion_cb);
 
+void sgmii_transaction_db_deinit(struct sgmii_transaction_db *tr_db);
+
+int sgmii_transaction_dump(struct seq_file *m, void *v);
+
 int sgmii_transaction_check_completion(struct sgmii_transaction_db *tr_db,
                                        struct sk_buff              *rx_skb,
                                        sgmii_transaction_id_t       tr_id,
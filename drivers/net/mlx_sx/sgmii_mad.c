@@ -472,6 +472,7 @@ int sgmii_mad_init(void)
     mutex_init(&__mad_ifc_mutex);
 
     ret = sgmii_transaction_db_init(&__mad_tr_db,
+                                    "MAD",
                                     sgmii_fill_common_control_segment,
                                     sgmii_fill_common_tx_base_header,
                                     __mad_work_entry_status_cb,
@@ -516,6 +517,7 @@ mad_qp1_failed:
     sx_core_remove_synd(0, INFINIBAND_QP0_TRAP_ID, L2_TYPE_IB, 0, crit, NULL, NULL, __sgmii_rx_mad, NULL);
 
 mad_qp0_failed:
+    sgmii_transaction_db_deinit(&__mad_tr_db);
     return ret;
 }
 
@@ -535,4 +537,6 @@ void sgmii_mad_deinit(void)
 
     crit.ib.qpn = QPN_MULTICAST_VALUE;
     sx_core_remove_synd(0, INFINIBAND_OTHER_QPS_TRAP_ID, L2_TYPE_IB, 0, crit, NULL, NULL, __sgmii_rx_mad, NULL);
+
+    sgmii_transaction_db_deinit(&__mad_tr_db);
 }
@@ -31,17 +31,20 @@
  */
 
 #include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/mlx_sx/kernel_user.h>
 #include <linux/mlx_sx/driver.h>
 
 #include "sgmii_internal.h"
-#include "map.h"
 
 struct sgmii_transaction_entry {
-    struct sx_core_map_info      map_info;
+    struct hlist_node            hash_node;
+    struct list_head             wheel_node;
+    unsigned long                expires; /* next send attempt (jiffies) */
+    ktime_t                      start;
     struct sgmii_transaction_db *tr_db;
     sgmii_transaction_id_t       tr_id;
-    int                          completed;
     int                          attempts_total;
     int                          attempts_so_far;
     struct sgmii_dev            *sgmii_dev;
@@ -50,22 +53,95 @@ struct sgmii_transaction_entry {
     struct isx_meta              meta;
     void                        *context;
 };
-static int __sgmii_transaction_compare_cb(const void* key1, const void *key2)
+
+static LIST_HEAD(__tr_db_list);
+static DEFINE_SPINLOCK(__tr_db_list_lock);
+
+static struct sgmii_transaction_entry * __sgmii_transaction_lookup(struct sgmii_transaction_db *tr_db,
+                                                                   sgmii_transaction_id_t       tr_id)
+{
+    struct sgmii_transaction_entry *entry;
+
+    hash_for_each_possible(tr_db->db_hash, entry, hash_node, tr_id) {
+        if (entry->tr_id == tr_id) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* must be called with db_lock held. the wheel callback re-arms the timer itself (arm_timer = 0) */
+static void __sgmii_transaction_schedule(struct sgmii_transaction_entry *entry, unsigned long delay, int arm_timer)
 {
-    const sgmii_transaction_id_t *tr_id1 = (const sgmii_transaction_id_t*)key1;
-    const sgmii_transaction_id_t *tr_id2 = (const sgmii_transaction_id_t*)key2;
+    struct sgmii_transaction_db *tr_db = entry->tr_db;
+
+    entry->expires = jiffies + delay;
+
+    /* a slot the wheel has already passed will only be visited again in a full round */
+    if (time_before(entry->expires, tr_db->wheel_clk)) {
+        entry->expires = tr_db->wheel_clk;
+    }
 
-    return ((*tr_id1) - (*tr_id2));
+    list_add_tail(&entry->wheel_node, &tr_db->wheel[entry->expires & (SGMII_TR_WHEEL_SIZE - 1)]);
+
+    if (arm_timer && !tr_db->shutdown &&
+        (!timer_pending(&tr_db->wheel_timer) || time_before(entry->expires, tr_db->wheel_timer.expires))) {
+        mod_timer(&tr_db->wheel_timer, entry->expires);
+    }
 }
 
 
+/* must be called with db_lock held. the entry is removed from the database and freed */
 static void __sgmii_transaction_complete(struct sk_buff                          *rx_skb,
                                          struct sgmii_transaction_entry          *entry,
                                          enum sgmii_transaction_completion_status status,
                                          struct sgmii_dev                        *rx_dev)
 {
-    struct sgmii_transaction_info tr_info;
-    struct sgmii_transaction_db  *tr_db = entry->tr_db;
+    struct sgmii_transaction_info   tr_info;
+    struct sgmii_transaction_db    *tr_db = entry->tr_db;
+    struct sgmii_transaction_stats *stats = &tr_db->stats;
+    u64                             usec;
+    int                             bucket;
+
+    hash_del(&entry->hash_node);
+    list_del(&entry->wheel_node);
+    stats->in_progress--;
+
+    switch (status) {
+    case SGMII_TR_COMP_ST_COMPLETED:
+    case SGMII_TR_COMP_ST_RX_DEV_MISMATCH:
+        if (status == SGMII_TR_COMP_ST_COMPLETED) {
+            stats->completed++;
+        } else {
+            stats->dev_mismatch++;
+        }
+
+        usec = ktime_to_us(ktime_sub(ktime_get(), entry->start));
+        if (usec > stats->max_latency_usec) {
+            stats->max_latency_usec = usec;
+        }
+
+        bucket = usec ? ilog2(usec) + 1 : 0;
+        if (bucket >= SGMII_TR_LATENCY_BUCKETS) {
+            bucket = SGMII_TR_LATENCY_BUCKETS - 1;
+        }
+        stats->latency[bucket]++;
+
+        bucket = min(entry->attempts_so_far, SGMII_TR_ATTEMPTS_BUCKETS - 1);
+        stats->attempts[bucket]++;
+        break;
+
+    case SGMII_TR_COMP_ST_TIMEDOUT:
+        stats->timedout++;
+        break;
+
+    case SGMII_TR_COMP_ST_TERMINATED:
+    default:
+        stats->terminated++;
+        break;
+    }
 
     tr_info.tr_db = tr_db;
     tr_info.tr_id = entry->tr_id;
@@ -78,32 +154,23 @@ static void __sgmii_transaction_complete(struct sk_buff
 
     tr_db->transaction_completion_cb(rx_skb, status, &tr_info, entry->context);
     sgmii_dev_dec_ref(entry->sgmii_dev);
+    kfree(entry);
 }
 
 
-static void __sgmii_transaction_task(void *task_param)
+/* must be called with db_lock held. the entry is off the wheel */
+static void __sgmii_transaction_send(struct sgmii_transaction_entry *entry)
 {
-    struct sgmii_transaction_info   tr_info;
-    struct sgmii_transaction_entry *entry;
-    struct sgmii_transaction_db    *tr_db;
-    int                             err;
-
-    memcpy(&entry, task_param, sizeof(entry)); /* copy the entry pointer itself */
-    tr_db = entry->tr_db;
-
-    spin_lock_bh(&tr_db->db_lock);
-
-    if (entry->completed) {
-        kfree(entry);
-        goto out;
-    }
+    struct sgmii_transaction_info tr_info;
+    struct sgmii_transaction_db  *tr_db = entry->tr_db;
+    int                           err;
 
     if (entry->attempts_total == entry->attempts_so_far) {
-        sx_core_map_remove(&tr_db->db_map, &entry->tr_id, NULL);
-
+        /* the entry is off the wheel, an empty wheel_node keeps the list_del()
+         * in __sgmii_transaction_complete() harmless */
+        INIT_LIST_HEAD(&entry->wheel_node);
         __sgmii_transaction_complete(NULL, entry, SGMII_TR_COMP_ST_TIMEDOUT, NULL);
-        kfree(entry);
-        goto out;
+        return;
     }
 
     tr_info.tr_db = entry->tr_db;
@@ -119,15 +186,62 @@ static void __sgmii_transaction_task(void *task_param)
                      tr_db->fill_tx_base_header_cb);
 
     entry->attempts_so_far++;
+    if (entry->attempts_so_far > 1) {
+        tr_db->stats.retransmissions++;
+    }
+
     tr_info.send_attempts_so_far = entry->attempts_so_far;
 
     tr_db->entry_handler_cb(err, &tr_info, entry->context);
 
-    sgmii_queue_task(__sgmii_transaction_task,
-                     &entry, sizeof(entry), /* yes, sizeof pointer! */
-                     msecs_to_jiffies(sgmii_get_send_interval_msec()));
+    __sgmii_transaction_schedule(entry, msecs_to_jiffies(sgmii_get_send_interval_msec()), 0);
+}
+
+
+static void __sgmii_transaction_wheel_cb(unsigned long data)
+{
+    struct sgmii_transaction_db    *tr_db = (struct sgmii_transaction_db*)data;
+    struct sgmii_transaction_entry *entry, *tmp;
+    unsigned long                   now = jiffies, next;
+    struct list_head                expired;
+    int                             slots;
+
+    INIT_LIST_HEAD(&expired);
+
+    spin_lock_bh(&tr_db->db_lock);
+
+    /* when the wheel was idle for more than a round, a single sweep visits all the slots */
+    for (slots = 0; time_before_eq(tr_db->wheel_clk, now) && slots < SGMII_TR_WHEEL_SIZE; slots++) {
+        list_for_each_entry_safe(entry, tmp, &tr_db->wheel[tr_db->wheel_clk & (SGMII_TR_WHEEL_SIZE - 1)],
+                                 wheel_node) {
+            if (time_before_eq(entry->expires, now)) { /* otherwise, it is in a later round */
+                list_move_tail(&entry->wheel_node, &expired);
+            }
+        }
+
+        tr_db->wheel_clk++;
+    }
+
+    tr_db->wheel_clk = now + 1;
+
+    /* sending reschedules each entry on a slot ahead of the wheel clock */
+    list_for_each_entry_safe(entry, tmp, &expired, wheel_node) {
+        list_del(&entry->wheel_node);
+        __sgmii_transaction_send(entry);
+    }
+
+    /* re-arm for the first occupied slot (it may hold a later round, then we just pass by).
+     * entries sent above did not touch the timer, so an entry that was already on the wheel
+     * with an earlier slot is not held back by them */
+    if (!tr_db->shutdown && tr_db->stats.in_progress) {
+        for (next = tr_db->wheel_clk; next != tr_db->wheel_clk + SGMII_TR_WHEEL_SIZE; next++) {
+            if (!list_empty(&tr_db->wheel[next & (SGMII_TR_WHEEL_SIZE - 1)])) {
+                mod_timer(&tr_db->wheel_timer, next);
+                break;
+            }
+        }
+    }
 
-out:
     spin_unlock_bh(&tr_db->db_lock);
 }
 
@@ -137,32 +251,24 @@ int sgmii_transaction_check_completion(struct sgmii_transaction_db *tr_db,
                                        sgmii_transaction_id_t       tr_id,
                                        struct sgmii_dev            *rx_dev)
 {
-    struct sx_core_map_info                 *map_info;
     struct sgmii_transaction_entry          *entry;
     enum sgmii_transaction_completion_status st;
     unsigned long                            flags;
-    int                                      ret;
 
     /* we are called from dispatch_pkt() which holds a spinlock with IRQ off. we must keep this line ... */
     spin_lock_irqsave(&tr_db->db_lock, flags);
 
-    ret = sx_core_map_remove(&tr_db->db_map, &tr_id, &map_info);
-    if (ret) { /* transaction not found */
+    entry = __sgmii_transaction_lookup(tr_db, tr_id);
+    if (!entry) { /* transaction not found */
         spin_unlock_irqrestore(&tr_db->db_lock, flags);
         return 0;
     }
 
-    /* if we get here, the transaction was in the map - so we know that the entry is scheduled
-     * for retransmission by __sgmii_transaction_task(). the entry will not be deallocated here.
-     * it will be marked as 'completed' and the worker thread will delete it eventually.
-     */
-    entry = container_of(map_info, struct sgmii_transaction_entry, map_info);
-
     st = (entry->sgmii_dev == rx_dev) ? SGMII_TR_COMP_ST_COMPLETED :
          SGMII_TR_COMP_ST_RX_DEV_MISMATCH;
 
+    /* the entry is taken off the retransmission wheel and freed */
     __sgmii_transaction_complete(rx_skb, entry, st, rx_dev);
-    entry->completed = 1;
 
     spin_unlock_irqrestore(&tr_db->db_lock, flags);
     return 1;
@@ -171,24 +277,18 @@ int sgmii_transaction_check_completion(struct sgmii_transaction_db *tr_db,
 
 int sgmii_transaction_terminate(struct sgmii_transaction_db *tr_db, sgmii_transaction_id_t tr_id)
 {
-    struct sx_core_map_info        *map_info;
     struct sgmii_transaction_entry *entry;
-    int                             err;
+    int                             err = 0;
 
     spin_lock_bh(&tr_db->db_lock);
 
-    err = sx_core_map_remove(&tr_db->db_map, &tr_id, &map_info);
-    if (err) { /* transaction not found */
+    entry = __sgmii_transaction_lookup(tr_db, tr_id);
+    if (!entry) { /* transaction not found */
+        err = -ENOENT;
         goto out;
     }
 
-    /* if we get here, the transaction was in the map - so we know that the entry is scheduled
-     * for retransmission by __sgmii_transaction_task(). the entry will not be deallocated here.
-     * it will be marked as 'completed' and the worker thread will delete it eventually.
-     */
-    entry = container_of(map_info, struct sgmii_transaction_entry, map_info);
     __sgmii_transaction_complete(NULL, entry, SGMII_TR_COMP_ST_TERMINATED, NULL);
-    entry->completed = 1;
 
 out:
     spin_unlock_bh(&tr_db->db_lock);
@@ -204,7 +304,6 @@ int sgmii_send_transaction(struct sgmii_transaction_db *tr_db,
                            void                        *context)
 {
     struct sgmii_transaction_entry *entry, *existing_entry;
-    struct sx_core_map_info        *existing_info;
     int                             ret = -ENOMEM, max_attempts;
 
     entry = kmalloc(sizeof(struct sgmii_transaction_entry), GFP_ATOMIC);
@@ -216,11 +315,11 @@ int sgmii_send_transaction(struct sgmii_transaction_db *tr_db,
 
     entry->tr_db = tr_db;
     entry->tr_id = tr_id;
-    entry->completed = 0;
     entry->attempts_total = max_attempts;
     entry->attempts_so_far = 0;
     entry->sgmii_dev = sgmii_dev;
     entry->skb = skb;
+    entry->start = ktime_get();
 
     entry->meta_is_valid = (meta != NULL);
     if (entry->meta_is_valid) {
@@ -231,21 +330,31 @@ int sgmii_send_transaction(struct sgmii_transaction_db *tr_db,
 
     spin_lock_bh(&tr_db->db_lock);
 
-    ret = sx_core_map_lookup(&tr_db->db_map, &entry->tr_id, &existing_info);
-    if (ret == 0) { /* joining an existing transaction */
-        existing_entry = container_of(existing_info, struct sgmii_transaction_entry, map_info);
+    if (tr_db->shutdown) {
+        ret = -ENODEV;
+        goto out;
+    }
+
+    existing_entry = __sgmii_transaction_lookup(tr_db, tr_id);
+    if (existing_entry) { /* joining an existing transaction */
         existing_entry->attempts_total = max_attempts;
+        tr_db->stats.joined++;
         ret = -EINPROGRESS;
         goto out;
     }
 
-    ret = sx_core_map_insert(&tr_db->db_map, &entry->tr_id, &entry->map_info, GFP_ATOMIC);
-    if (ret) {
-        goto out;
+    hash_add(tr_db->db_hash, &entry->hash_node, tr_id);
+
+    tr_db->stats.started++;
+    tr_db->stats.in_progress++;
+    if (tr_db->stats.in_progress > tr_db->stats.max_in_progress) {
+        tr_db->stats.max_in_progress = tr_db->stats.in_progress;
     }
 
     sgmii_dev_inc_ref(sgmii_dev);
-    sgmii_queue_task(__sgmii_transaction_task, &entry, sizeof(entry) /* yes, sizeof pointer! */, 0);
+
+    /* first attempt goes out on the next tick of the wheel */
+    __sgmii_transaction_schedule(entry, 0, 1);
 
     spin_unlock_bh(&tr_db->db_lock);
 
@@ -328,31 +437,124 @@ void sgmii_sync_transaction_complete(struct sgmii_sync_transaction_context   *co
 }
 
 
+int sgmii_transaction_dump(struct seq_file *m, void *v)
+{
+    struct sgmii_transaction_stats stats;
+    struct sgmii_transaction_db   *tr_db;
+    int                            i;
+
+    spin_lock(&__tr_db_list_lock);
+
+    list_for_each_entry(tr_db, &__tr_db_list, db_list) {
+        spin_lock_bh(&tr_db->db_lock);
+        memcpy(&stats, &tr_db->stats, sizeof(stats));
+        spin_unlock_bh(&tr_db->db_lock);
+
+        seq_printf(m, "----------------------------------------------------------------------\n");
+        seq_printf(m, "SGMII %s transactions\n", tr_db->name);
+        seq_printf(m, "----------------------------------------------------------------------\n");
+        seq_printf(m, "In progress (max) ............................ %u (%u)\n",
+                   stats.in_progress, stats.max_in_progress);
+        seq_printf(m, "Started ...................................... %llu\n", stats.started);
+        seq_printf(m, "Joined an existing transaction ............... %llu\n", stats.joined);
+        seq_printf(m, "Completed .................................... %llu\n", stats.completed);
+        seq_printf(m, "Completed on another device .................. %llu\n", stats.dev_mismatch);
+        seq_printf(m, "Timed out .................................... %llu\n", stats.timedout);
+        seq_printf(m, "Terminated ................................... %llu\n", stats.terminated);
+        seq_printf(m, "Retransmissions .............................. %llu\n", stats.retransmissions);
+        seq_printf(m, "Max latency (usec) ........................... %llu\n", stats.max_latency_usec);
+
+        seq_printf(m, "Latency:\n");
+        for (i = 0; i < SGMII_TR_LATENCY_BUCKETS; i++) {
+            if (!stats.latency[i]) {
+                continue;
+            }
+
+            if (i < SGMII_TR_LATENCY_BUCKETS - 1) {
+                seq_printf(m, "    < %-8u usec: %llu\n", 1 << i, stats.latency[i]);
+            } else {
+                seq_printf(m, "    >= %-7u usec: %llu\n", 1 << (i - 1), stats.latency[i]);
+            }
+        }
+
+        seq_printf(m, "Send attempts until completion:\n");
+        for (i = 0; i < SGMII_TR_ATTEMPTS_BUCKETS; i++) {
+            if (!stats.attempts[i]) {
+                continue;
+            }
+
+            seq_printf(m, "    %s%-2d: %llu\n", (i < SGMII_TR_ATTEMPTS_BUCKETS - 1) ? "" : ">=", i, stats.attempts[i]);
+        }
+
+        seq_printf(m, "\n");
+    }
+
+    spin_unlock(&__tr_db_list_lock);
+    return 0;
+}
+
+
 int sgmii_transaction_db_init(struct sgmii_transaction_db       *tr_db,
+                              const char                        *name,
                               sgmii_fill_control_segment_cb_t    fill_control_segment_cb,
                               sgmii_fill_tx_base_header_cb_t     fill_tx_base_header_cb,
                               sgmii_transaction_entry_handler_cb entry_handler_cb,
                               sgmii_transaction_completion_cb_t  transaction_completion_cb)
 {
-    int ret;
+    int i;
 
     if (!tr_db || !transaction_completion_cb) {
         printk(KERN_ERR "failed to initialize SGMII transaction database - invalid argument\n");
         return -EINVAL;
     }
 
-    ret = sx_core_map_init(&tr_db->db_map, __sgmii_transaction_compare_cb, sizeof(sgmii_transaction_id_t), 0);
-    if (ret) {
-        printk(KERN_ERR "failed to initialize SGMII transaction database\n");
-        return ret;
+    memset(&tr_db->stats, 0, sizeof(tr_db->stats));
+    hash_init(tr_db->db_hash);
+    spin_lock_init(&tr_db->db_lock);
+
+    for (i = 0; i < SGMII_TR_WHEEL_SIZE; i++) {
+        INIT_LIST_HEAD(&tr_db->wheel[i]);
     }
 
-    spin_lock_init(&tr_db->db_lock);
+    tr_db->wheel_clk = jiffies;
+    tr_db->shutdown = 0;
+    setup_timer(&tr_db->wheel_timer, __sgmii_transaction_wheel_cb, (unsigned long)tr_db);
 
+    tr_db->name = name;
     tr_db->entry_handler_cb = entry_handler_cb;
     tr_db->fill_control_segment_cb = fill_control_segment_cb;
     tr_db->fill_tx_base_header_cb = fill_tx_base_header_cb;
     tr_db->transaction_completion_cb = transaction_completion_cb;
 
+    spin_lock(&__tr_db_list_lock);
+    list_add_tail(&tr_db->db_list, &__tr_db_list);
+    spin_unlock(&__tr_db_list_lock);
+
     return 0;
 }
+
+
+void sgmii_transaction_db_deinit(struct sgmii_transaction_db *tr_db)
+{
+    struct sgmii_transaction_entry *entry;
+    struct hlist_node              *tmp;
+    int                             bkt;
+
+    spin_lock(&__tr_db_list_lock);
+    list_del(&tr_db->db_list);
+    spin_unlock(&__tr_db_list_lock);
+
+    spin_lock_bh(&tr_db->db_lock);
+    tr_db->shutdown = 1;
+    spin_unlock_bh(&tr_db->db_lock);
+
+    /* the wheel callback does not re-arm the timer after shutdown */
+    del_timer_sync(&tr_db->wheel_timer);
+
+    /* complete whatever is still in progress, so synchronous waiters are released */
+    spin_lock_bh(&tr_db->db_lock);
+    hash_for_each_safe(tr_db->db_hash, bkt, tmp, entry, hash_node) {
+        __sgmii_transaction_complete(NULL, entry, SGMII_TR_COMP_ST_TERMINATED, NULL);
+    }
+    spin_unlock_bh(&tr_db->db_lock);
+}
@@ -45,6 +45,11 @@
 #include <linux/mlx_sx/driver.h>
 #include <linux/mlx_sx/sx_i2c_if.h>
 #include <linux/timer.h>
+#include <linux/rcupdate.h>
+#include <linux/hashtable.h>
+#include <linux/seqlock.h>
+#include <linux/mutex.h>
+#include <linux/hrtimer.h>
 #include "eq.h"
 #include "fw.h"
 #include "icm.h"
@@ -182,6 +187,7 @@ extern int sx_debug_level;
 #define SX_CORE_UNUSED_PARAM(P)
 #define MAX_SYSTEM_PORTS_IN_FILTER 256
 #define MAX_LAG_PORTS_IN_FILTER    256
+#define SX_LISTENERS_HASH_BITS     10
 
 /************************************************
  *  Enums
@@ -256,16 +262,28 @@ struct event_data {
     u8               dest_is_lag;
     u8               dest_lag_subport;
 };
+/* RX ring shared with user space through mmap() (see struct ku_rx_ring_hdr) */
+struct sx_rx_ring {
+    struct ku_rx_ring_hdr *hdr;         /* vmalloc_user() area, slots follow at KU_RX_RING_HDR_SIZE */
+    u8                    *slots;
+    u32                    slot_count;  /* kernel copies, user space may scribble on hdr */
+    u32                    slot_size;
+    size_t                 size;        /* size of the whole mapping */
+    u32                    head;
+};
+
 struct sx_rsc { /* sx  resource */
-    struct event_data evlist;           /* event list           */
-    int               evlist_size;      /* the current size     */
-    spinlock_t        lock;         /* event list lock	*/
-    wait_queue_head_t poll_wait;
-    atomic_t          multi_packet_read_enable;
-    atomic_t          read_blocking_state;
-    struct semaphore  write_sem;
-    struct sx_dq     *bound_monitor_rdq;
-    struct file     * owner;
+    struct event_data  evlist;           /* event list           */
+    int                evlist_size;      /* the current size     */
+    spinlock_t         lock;         /* event list lock	*/
+    wait_queue_head_t  poll_wait;
+    atomic_t           multi_packet_read_enable;
+    atomic_t           read_blocking_state;
+    struct semaphore   write_sem;
+    struct sx_dq      *bound_monitor_rdq;
+    struct file      * owner;
+    struct sx_rx_ring *rx_ring;         /* protected by lock, NULL when packets are queued on evlist */
+    struct mutex       rx_ring_mutex;   /* serializes ring set up/tear down against mmap() */
 };
 struct tx_base_header_v0 {
     u8  ctl_mc;
@@ -312,15 +330,16 @@ struct sx_buf {
  * EQ - Structs
  ***********************************************/
 struct sx_eq {
-    struct sx_dev      *dev;
-    void __iomem       *ci_db;
-    void __iomem       *arm_db;
-    int                 eqn;
-    u32                 cons_index;
-    u16                 irq;
-    u16                 have_irq;
-    int                 nent;
-    struct sx_buf_list *page_list;
+    struct sx_dev        *dev;
+    void __iomem         *ci_db;
+    void __iomem         *arm_db;
+    int                   eqn;
+    u32                   cons_index;
+    u16                   irq;
+    u16                   have_irq;
+    int                   nent;
+    struct sx_buf_list   *page_list;
+    struct tasklet_struct tasklet;      /* per-EQ bottom half */
 };
 struct sx_eq_table {
     struct sx_bitmap bitmap;
@@ -341,6 +360,25 @@ struct sx_cq_bkp_poll {
     int      last_interval_cons_index;
     atomic_t cq_bkp_poll_mode;
 };
+
+/* Software interrupt moderation of a CQ. The CQ is not re-armed right after a
+ * completion pass but cur_usec later, cur_usec follows the CQE rate between
+ * rate_low (no delay) and rate_high (max_usec). */
+struct sx_cq_moder {
+    u32            max_usec;         /* latency target, 0 disables moderation */
+    u32            rate_low;         /* CQEs/sec */
+    u32            rate_high;        /* CQEs/sec */
+    u32            busy_poll_usec;   /* spin on an empty CQ before re-arming, 0 disables busy-poll */
+    u32            cur_usec;
+    u32            rate;             /* CQEs/sec in the last window */
+    u32            window_cqes;
+    unsigned long  window_start;     /* jiffies */
+    struct hrtimer arm_timer;
+    u64            arms;
+    u64            deferred_arms;
+    u64            busy_poll_hits;
+    u64            busy_poll_misses;
+};
 struct sx_cq {
     u32                   cons_index;
     u32                   cons_index_snapshot;
@@ -364,6 +402,7 @@ struct sx_cq {
     u8               (*sx_get_cqe_owner_cb)(struct sx_cq *cq, int n);
     void             (*sx_cqe_owner_init_cb)(struct sx_cq *cq);
     struct timespec* cqe_ts_arr;
+    struct sx_cq_moder moder;
 };
 struct cpu_traffic_priority {
     struct sx_bitmap    high_prio_cq_bitmap;     /* CPU high priority CQs */
@@ -399,6 +438,7 @@ struct sx_sge_internal {
     struct sx_sge_data pld_sg_2;
     struct sk_buff    *skb;
 };
+#define SX_SDQ_MAX_FRAGS 2 /* a send WQE has 3 pointers: linear part + 2 fragments */
 struct sx_wqe {
     __be16 flags;
     __be16 byte_count[3];
@@ -416,6 +456,20 @@ enum dq_state {
     DQ_STATE_RTS,
     DQ_STATE_ERROR,
 };
+struct sx_rdq_pool_entry {
+    struct sk_buff *skb;
+    dma_addr_t      dma_addr;
+};
+/* pool of RX buffers that are kept DMA-mapped between receptions, protected by sx_dq lock */
+struct sx_rdq_pool {
+    struct sx_rdq_pool_entry *entries;
+    u32                       size;
+    u32                       count;
+    u64                       hit;      /* RDQ refilled from the pool */
+    u64                       miss;     /* RDQ refilled by a new allocation */
+    u64                       recycled; /* buffers returned to the pool */
+    u64                       busy;     /* buffers still held by a consumer, not recycled */
+};
 struct sx_dq {
     void                    (*event)(struct sx_dq *, enum sx_event);
     struct sx_dev          *dev;
@@ -433,6 +487,9 @@ struct sx_dq {
     __be32                 *db;
     int                     is_flushing;
     struct sx_pkt           pkts_list;
+    struct sx_pkt          *pkt_slots;       /* wqe_cnt preallocated pkts_list entries, non valid for rdq */
+    struct list_head        pkt_free_list;
+    u8                      db_pending;      /* WQEs were posted without ringing the doorbell */
     enum dq_state           state;
     atomic_t                refcount;
     struct completion       free;
@@ -443,6 +500,9 @@ struct sx_dq {
     uint32_t                mon_rx_count;
     uint32_t                mon_rx_start;
     uint32_t                mon_rx_start_total; /* start point to calculate total number of discarded packets per RDQ */
+    uint32_t                mon_drain_rate;     /* packets/sec drained from the monitor RDQ in the last window */
+    uint32_t                mon_drain_window_cnt;
+    unsigned long           mon_drain_window_start;
     struct sx_rsc         * file_priv_p;
     uint8_t                 cpu_tclass;
 
@@ -451,26 +511,56 @@ struct sx_dq {
     struct event_data *sw_dup_evlist_p;
     uint32_t           sw_dup_evlist_cnt;            /* number of discarded packets in the SW cyclic buffer */
     uint32_t           sw_dup_evlist_total_cnt;      /* total number of discarded packets per SW cyclic buffer (could be greater than size of the cyclic buffer) */
+
+    struct sx_rdq_pool rx_pool; /* non valid for sdq */
 };
 struct sx_dq_table {
     struct sx_bitmap bitmap;
     spinlock_t       lock;    /* dq_table lock */
     struct sx_dq   **dq;
 };
+/* I2C commands of different devices (lanes) are polled concurrently. All the commands of a
+ * device share one lane - they use the same local mailboxes on the device */
+#define SX_CMD_I2C_LANES    16
+#define SX_CMD_I2C_OP_STATS 16
+
+/* timing of the I2C commands of one opcode, protected by sx_cmd.i2c_stats_lock */
+struct sx_cmd_i2c_op_stats {
+    u16 op;
+    u64 count;
+    u64 errors;
+    u64 polls;      /* HCR status reads while waiting for the go bit */
+    u64 total_usec;
+    u64 max_usec;
+};
+/* mailboxes allocated from sx_cmd.pool once and reused for register access, protected by lock */
+struct sx_cmd_mailbox_pool {
+    spinlock_t              lock;
+    struct sx_cmd_mailbox  *entries;
+    struct sx_cmd_mailbox **free_list;
+    u32                     size;
+    u32                     free_count;
+    u32                     max_in_use;
+    u64                     hit;      /* mailbox taken from the pool */
+    u64                     miss;     /* pool was empty, mailbox allocated */
+};
 struct sx_cmd {
-    struct pci_pool       *pool;
-    void __iomem          *hcr;
-    struct mutex           hcr_mutex;  /* the HCR's mutex */
-    struct semaphore       pci_poll_sem;
-    struct semaphore       i2c_poll_sem;
-    struct semaphore       event_sem;
-    int                    max_cmds;
-    spinlock_t             context_lock;  /* the context lock */
-    int                    free_head;
-    struct sx_cmd_context *context;
-    u16                    token_mask;
-    u8                     use_events;
-    u8                     toggle;
+    struct pci_pool           *pool;
+    void __iomem              *hcr;
+    struct mutex               hcr_mutex;  /* the HCR's mutex */
+    struct semaphore           pci_poll_sem;
+    struct semaphore           i2c_poll_sem[SX_CMD_I2C_LANES];
+    struct semaphore           event_sem;
+    int                        max_cmds;
+    spinlock_t                 context_lock;  /* the context lock */
+    int                        free_head;
+    struct sx_cmd_context     *context;
+    u16                        token_mask;
+    u8                         use_events;
+    u8                         toggle;
+    struct sx_cmd_mailbox_pool mailbox_pool;
+    spinlock_t                 i2c_stats_lock;
+    struct sx_cmd_i2c_op_stats i2c_op_stats[SX_CMD_I2C_OP_STATS];
 };
 struct sx_catas_err {
     u32 __iomem      *map;
@@ -586,6 +676,22 @@ struct ber_work_data {
     u8                  local_port;
     struct delayed_work dwork;
 };
+
+/*
+ * Membership bitmaps of the trap port filter of one syndrome. Allocated only
+ * for syndromes with filtered ports/LAGs and looked up under RCU on the RX path.
+ * sysport_filter_db/lag_filter_db remain the list of record (backup, restore, dumps).
+ */
+struct sx_trap_filter {
+    struct rcu_head rcu;
+    u16             sysport_cnt;
+    u16             lag_cnt;
+    DECLARE_BITMAP(sysport_bitmap, MAX_SYSPORT_NUM);
+    DECLARE_BITMAP(lag_bitmap, SXD_LAG_ID_MAX + 1);
+};
+struct sx_trap_filter_index {
+    struct sx_trap_filter __rcu *synd[NUM_HW_SYNDROMES]; /* updated under db_lock */
+};
 struct sx_priv;
 /* Note - all these callbacks are called when the db_lock spinlock is locked! */
 struct dev_specific_cb {
@@ -658,6 +764,7 @@ struct sx_priv {
     struct sx_bitmap cq_high_priority;
     u8               local_to_swid_db[MAX_PHYPORT_NUM + 1];
     spinlock_t       db_lock;            /* Lock for all DBs */
+    seqcount_t       db_seq;             /* Lock-free readers of the DBs, see sx_db_read_begin() */
     u16              pvid_sysport_db[MAX_SYSPORT_NUM];
     u16              pvid_lag_db[MAX_LAG_NUM];
 
@@ -672,6 +779,7 @@ struct sx_priv {
     u16 truncate_size_db[NUMBER_OF_RDQS];
     u16 sysport_filter_db[NUM_HW_SYNDROMES][MAX_SYSTEM_PORTS_IN_FILTER];
     u16 lag_filter_db[NUM_HW_SYNDROMES][MAX_LAG_PORTS_IN_FILTER];
+    struct sx_trap_filter_index *trap_filter; /* O(1) lookup of the two DBs above */
     u8  lag_oper_state[MAX_LAG_NUM];
     u8  port_ber_monitor_bitmask[MAX_PHYPORT_NUM + 1];
     u8  port_ber_monitor_state[MAX_PHYPORT_NUM + 1];
@@ -695,7 +803,6 @@ struct sx_priv {
     wait_queue_head_t      dev_specific_cb_not_in_use;
     /* ECMP redirect IP override */
     u32                   icmp_vlan2ip_db[SXD_MAX_VLAN_NUM];
-    struct tasklet_struct intr_tasklet;
     u32                   monitor_rdqs_arr[MAX_MONITOR_RDQ_NUM];
     u32                   monitor_rdqs_count;
     struct sx_bitmap      active_monitor_cq_bitmap;      /* WJH CQs that hold CQEs to handle */
@@ -707,8 +814,9 @@ struct listener_entry {
     union ku_filter_critireas critireas;    /* more filter critireas  */
     cq_handler                handler;      /* The completion handler */
     void                     *context;      /* to pass to the handler */
-    u64                       rx_pkts;
-    struct list_head          list;
+    atomic64_t                rx_pkts;
+    struct list_head          list;         /* RCU protected */
+    struct rcu_head           rcu;
 };
 struct listener_port_vlan_entry {
     enum port_vlan_match match_crit;
@@ -726,12 +834,6 @@ struct listener_port_vlan_entry {
                 struct sx_core_counter lag;
                 struct sx_core_counter vlan;
             } accepted;
-
-            struct {
-                struct sx_core_counter sysport;
-                struct sx_core_counter lag;
-                struct sx_core_counter vlan;
-            } mismtach;
         } listener_port_vlan;
 
         struct {
@@ -770,7 +872,10 @@ struct listener_port_vlan_entry {
     } counters;
 
     struct listener_entry listener;
-    struct list_head      list;
+    struct list_head      list;       /* per-syndrome list, used under listeners_lock only */
+    u64                   hash_key;   /* see sx_listener_hash_key() */
+    struct hlist_node     hash_node;  /* RCU protected, used by dispatch_pkt() */
+    struct rcu_head       rcu;
 };
 struct sx_globals {
     struct rw_semaphore             pci_restart_lock;
@@ -781,11 +886,12 @@ struct sx_globals {
     struct sx_dev                  *oob_backbone_dev; /* SwitchX that interconnects all OOB devices */
     struct sx_dpt_s                 sx_dpt;
     struct sx_i2c_ifc               sx_i2c;
-    struct sx_stats                 stats;
+    struct sx_stats_pcpu            stats;
     struct ku_profile               profile;
     int                             index[SX_MAX_DEVICES];
     struct listener_port_vlan_entry listeners_db[NUM_HW_SYNDROMES + 1];
-    spinlock_t                      listeners_lock; /* listeners' lock */
+    spinlock_t                      listeners_lock; /* listeners' writers lock */
+    DECLARE_HASHTABLE(listeners_hash, SX_LISTENERS_HASH_BITS); /* (synd, port/lag/vlan) -> port_vlan listener */
     struct cdev                     cdev;
     u8                              pci_drivers_in_use;
 };
@@ -814,6 +920,74 @@ static inline struct sx_priv * sx_priv(struct sx_dev *p_dev)
     return container_of(p_dev, struct sx_priv, dev);
 }
 
+/*
+ * Key of a port/vlan listener in sx_glb.listeners_hash. Every (syndrome, match criteria, id)
+ * triplet has at most one listener_port_vlan_entry, so a lookup never needs to walk more
+ * than the hash bucket.
+ */
+static inline u64 sx_listener_hash_key(u16 hw_synd, enum port_vlan_match match_crit, u16 id)
+{
+    return ((u64)hw_synd << 32) | ((u64)match_crit << 16) | id;
+}
+
+/*
+ * Writers of the port/LAG/VLAN DBs in sx_priv hold db_lock and bump db_seq around
+ * the update. Readers on the RX path don't take db_lock; they sample the DBs between
+ * sx_db_read_begin() and sx_db_read_retry() and start over if a writer raced with them.
+ */
+#define sx_db_write_lock(priv, flags)                   \
+    do {                                                \
+        spin_lock_irqsave(&(priv)->db_lock, flags);     \
+        write_seqcount_begin(&(priv)->db_seq);          \
+    } while (0)
+
+#define sx_db_write_unlock(priv, flags)                 \
+    do {                                                \
+        write_seqcount_end(&(priv)->db_seq);            \
+        spin_unlock_irqrestore(&(priv)->db_lock, flags); \
+    } while (0)
+
+static inline unsigned sx_db_read_begin(struct sx_priv *priv)
+{
+    return read_seqcount_begin(&priv->db_seq);
+}
+
+static inline int sx_db_read_retry(struct sx_priv *priv, unsigned seq)
+{
+    return read_seqcount_retry(&priv->db_seq, seq);
+}
+
+/*
+ * Returns this CPU's statistics with local interrupts disabled, so the counters
+ * can be updated without atomics from any context. Must be followed by
+ * sx_stats_pcpu_put().
+ */
+static inline struct sx_stats * sx_stats_pcpu_get(struct sx_stats_pcpu *stats, unsigned long *flags)
+{
+    local_irq_save(*flags);
+    return stats->per_cpu[smp_processor_id()];
+}
+
+static inline void sx_stats_pcpu_put(unsigned long flags)
+{
+    local_irq_restore(flags);
+}
+
+/* Sum of a single counter over all CPUs, e.g. SX_STATS_READ(&dev->stats, rx_by_synd[swid][synd]) */
+#define SX_STATS_READ(stats, field) sx_stats_pcpu_read((stats), offsetof(struct sx_stats, field))
+
+int sx_trap_filter_init(struct sx_priv *priv);
+void sx_trap_filter_deinit(struct sx_priv *priv);
+struct sx_trap_filter * sx_trap_filter_alloc(void);
+void __sx_trap_filter_set(struct sx_priv *priv, u16 trap_id, u8 is_lag, u16 id, struct sx_trap_filter **new_filter);
+void __sx_trap_filter_clear(struct sx_priv *priv, u16 trap_id, u8 is_lag, u16 id);
+void __sx_trap_filter_flush(struct sx_priv *priv, u16 trap_id);
+int sx_trap_filter_rebuild(struct sx_priv *priv);
+int sx_stats_pcpu_init(struct sx_stats_pcpu *stats);
+void sx_stats_pcpu_deinit(struct sx_stats_pcpu *stats);
+void sx_stats_pcpu_clear(struct sx_stats_pcpu *stats);
+void sx_rx_ring_free(struct sx_rx_ring *ring);
+u64 sx_stats_pcpu_read(struct sx_stats_pcpu *stats, size_t offset);
 void * sx_get_dev_context(void);
 void inc_unconsumed_packets_global_counter(u16 hw_synd, enum sx_packet_type pkt_type);
 void inc_filtered_lag_packets_global_counter(void);
@@ -829,6 +1003,8 @@ int sx_cmd_init(struct sx_dev *dev);
 int sx_cmd_init_pci(struct sx_dev *dev);
 int sx_cmd_pool_create(struct sx_dev *dev);
 void sx_cmd_pool_destroy(struct sx_dev *dev);
+struct sx_cmd_mailbox * sx_cmd_mailbox_pool_get(struct sx_dev *dev, int sx_dev_id);
+void sx_cmd_mailbox_pool_put(struct sx_dev *dev, struct sx_cmd_mailbox *mailbox);
 void sx_cmd_unmap(struct sx_dev *dev);
 void sx_core_start_catas_poll(struct sx_dev *dev);
 void sx_core_stop_catas_poll(struct sx_dev *dev);
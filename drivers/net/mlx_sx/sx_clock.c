@@ -38,6 +38,9 @@
 #include <linux/udp.h>
 #include <linux/ipv6.h>
 #include <linux/kthread.h>
+#include <linux/sort.h>
+#include <linux/math64.h>
+#include <linux/hash.h>
 #include <linux/if_vlan.h>
 #include <net/sock.h>
 #include "sx_clock.h"
@@ -50,6 +53,7 @@
 
 #define PTP_GC_TIME         (5 * HZ) /* Event with age of more than 5 seconds should be garbage-collected */
 #define PTP_LATE_MATCH_TIME (HZ / 4) /* matching after 1/4 second or longer is 'late match' */
+#define PTP_GC_INTERVAL     (HZ)     /* aging pass over the ports that have pending events/records */
 
 extern struct sx_globals        sx_glb;
 struct sx_priv                 *__priv = NULL;
@@ -74,6 +78,27 @@ atomic64_t        ptp_rx_budget[PTP_MAX_PORTS];
 atomic64_t        ptp_tx_budget[PTP_MAX_PORTS];
 atomic64_t        ptp_counters[2][PTP_COUNTER_LAST];
 static atomic64_t ptp_records_dist[2][SX_MAX_PTP_RECORDS + 1];
+static inline struct hlist_head * __event_bucket(struct ptp_db *db,
+                                                 u16            local_port,
+                                                 u8             msg_type,
+                                                 u8             domain_num,
+                                                 u16            sequence_id)
+{
+    u32 key = ((u32)msg_type << 24) | ((u32)domain_num << 16) | sequence_id;
+
+    return &db->sysport_events_hash[local_port][hash_32(key, PTP_PORT_HASH_BITS)];
+}
+
+
+/* MUST BE CALLED UNDER db->sysport_lock[local_port] */
+static void __dequeue_event(struct ptp_common_event_data *ced, struct ptp_db *db)
+{
+    list_del(&ced->list);
+    hlist_del_init(&ced->hash);
+    atomic64_dec(&ptp_counters[db->direction][PTP_COUNTER_PENDING_EVENTS]);
+}
+
+
 static void __gc_db(int sysport, struct ptp_db *db, u8 gc_all)
 {
     struct ptp_common_event_data *iter_common, *tmp_common;
@@ -84,10 +109,9 @@ static void __gc_db(int sysport, struct ptp_db *db, u8 gc_all)
 
     list_for_each_entry_safe(iter_common, tmp_common, &db->sysport_events_list[sysport], list) {
         if (gc_all || time_after(now, iter_common->since + PTP_GC_TIME)) {
-            list_del(&iter_common->list);
+            __dequeue_event(iter_common, db);
             db->gc_cb(iter_common);
             atomic64_inc(&ptp_counters[db->direction][PTP_COUNTER_GC_EVENTS]);
-            atomic64_dec(&ptp_counters[db->direction][PTP_COUNTER_PENDING_EVENTS]);
         } else {
             break; /* events are placed in the list in chronological order */
         }
@@ -104,21 +128,34 @@ static void __gc_db(int sysport, struct ptp_db *db, u8 gc_all)
         }
     }
 
+    /* the bit is set under the same lock when an event/record is queued */
+    if (list_empty(&db->sysport_events_list[sysport]) && list_empty(&db->sysport_records_list[sysport])) {
+        clear_bit(sysport, db->pending_ports);
+    }
+
     spin_unlock_bh(&db->sysport_lock[sysport]);
 }
 
 
-/* garbage collection for RX/TX events and records */
-static void __gc(struct work_struct *work)
+/* age out the expired events/records, visiting only the ports that have something pending */
+static void __gc_pending_ports(struct ptp_db *db)
 {
     int sysport;
 
-    for (sysport = 0; sysport < PTP_MAX_PORTS; sysport++) {
-        __gc_db(sysport, &ptp_rx_db, 0);
-        __gc_db(sysport, &ptp_tx_db, 0);
+    for_each_set_bit(sysport, db->pending_ports, PTP_MAX_PORTS) {
+        atomic64_inc(&ptp_counters[db->direction][PTP_COUNTER_GC_PORT_VISITS]);
+        __gc_db(sysport, db, 0);
     }
+}
+
+
+/* garbage collection for RX/TX events and records */
+static void __gc(struct work_struct *work)
+{
+    __gc_pending_ports(&ptp_rx_db);
+    __gc_pending_ports(&ptp_tx_db);
 
-    queue_delayed_work(__priv->dev.generic_wq, &__gc_dwork, PTP_GC_TIME);
+    queue_delayed_work(__priv->dev.generic_wq, &__gc_dwork, PTP_GC_INTERVAL);
 }
 
 
@@ -611,6 +648,22 @@ static void __ptp_gc_cb_tx(struct ptp_common_event_data *ced)
 }
 
 
+/* MUST BE CALLED UNDER db->sysport_lock[local_port] */
+void ptp_enqueue_event(u16 local_port, struct ptp_common_event_data *ced, struct ptp_db *db)
+{
+    INIT_HLIST_NODE(&ced->hash);
+    list_add_tail(&ced->list, &db->sysport_events_list[local_port]);
+
+    if (ced->need_timestamp) {
+        hlist_add_head(&ced->hash,
+                       __event_bucket(db, local_port, ced->msg_type, ced->domain_num, ced->sequence_id));
+    }
+
+    set_bit(local_port, db->pending_ports);
+    atomic64_inc(&ptp_counters[db->direction][PTP_COUNTER_PENDING_EVENTS]);
+}
+
+
 void ptp_dequeue_general_messages(u8 local_port, struct ptp_db *db)
 {
     struct ptp_common_event_data *ced, *tmp;
@@ -620,8 +673,7 @@ void ptp_dequeue_general_messages(u8 local_port, struct ptp_db *db)
             break;
         }
 
-        list_del(&ced->list);
-        atomic64_dec(&ptp_counters[db->direction][PTP_COUNTER_PENDING_EVENTS]);
+        __dequeue_event(ced, db);
         db->handle_cb(ced, 0);
     }
 }
@@ -630,15 +682,20 @@ void ptp_dequeue_general_messages(u8 local_port, struct ptp_db *db)
 static u8 __match_record_with_event(const struct mtpptr_record *record, u8 local_port, struct ptp_db *db)
 {
     struct ptp_common_event_data *ced, *found = NULL;
+    struct hlist_head            *bucket;
+    u16                           sequence_id = be16_to_cpu(record->sequence_id);
     u64                           frc;
 
-    list_for_each_entry(ced, &db->sysport_events_list[local_port], list) {
-        if (ced->need_timestamp &&
-            (record->domain_number == ced->domain_num) &&
+    bucket = __event_bucket(db, local_port, record->message_type, record->domain_number, sequence_id);
+
+    /* events are added at the bucket head, so the last match is the oldest one, as with the ordered list */
+    hlist_for_each_entry(ced, bucket, hash) {
+        if ((record->domain_number == ced->domain_num) &&
             (record->message_type == ced->msg_type) &&
-            (be16_to_cpu(record->sequence_id) == ced->sequence_id)) {
+            (sequence_id == ced->sequence_id)) {
             found = ced;
-            break;
+        } else {
+            atomic64_inc(&ptp_counters[db->direction][PTP_COUNTER_HASH_COLLISIONS]);
         }
     }
 
@@ -646,6 +703,8 @@ static u8 __match_record_with_event(const struct mtpptr_record *record, u8 local
         return 0;
     }
 
+    atomic64_inc(&ptp_counters[db->direction][PTP_COUNTER_HASH_MATCH]);
+
     do {
         ced = list_entry(db->sysport_events_list[local_port].next, struct ptp_common_event_data, list);
 
@@ -659,8 +718,7 @@ static u8 __match_record_with_event(const struct mtpptr_record *record, u8 local
             frc = 0;
         }
 
-        list_del(&ced->list);
-        atomic64_dec(&ptp_counters[db->direction][PTP_COUNTER_PENDING_EVENTS]);
+        __dequeue_event(ced, db);
         db->handle_cb(ced, frc);
     } while (ced != found);
 
@@ -723,6 +781,7 @@ void ptp_lookup_event(const u8 *mtpptr_buff, struct ptp_db *db)
                 memcpy(&to_cache->mtpptr, &record[i], sizeof(to_cache->mtpptr));
 
                 list_add_tail(&to_cache->list, &db->sysport_records_list[local_port]);
+                set_bit(local_port, db->pending_ports);
                 atomic64_inc(&ptp_counters[db->direction][PTP_COUNTER_PENDING_RECORDS]);
             }
         }
@@ -809,44 +868,140 @@ void ptp_free_tx_event_data(struct ptp_tx_event_data *tx_event_data)
 }
 
 
-static int __sx_clock_rx_polling_thread(void *data)
+/* ports queried together by one sx_ACCESS_REG_MTPPTR_batch() call */
+#define PTP_POLL_BATCH_SIZE (32)
+
+struct ptp_poll_port {
+    unsigned long since; /* arrival of the oldest pending event on the port */
+    u16           local_port;
+};
+static struct ptp_poll_port        __ptp_poll_ports[PTP_MAX_PORTS];
+static struct ku_access_mtpptr_reg __ptp_poll_regs[PTP_POLL_BATCH_SIZE];
+static int                         __ptp_poll_errs[PTP_POLL_BATCH_SIZE];
+
+static int __ptp_poll_port_cmp(const void *a, const void *b)
 {
-    struct ku_access_mtpptr_reg ku_mtpptr;
-    int                         local_port;
-    int                         err;
-    u8                          has_events;
+    const struct ptp_poll_port *port_a = (const struct ptp_poll_port*)a;
+    const struct ptp_poll_port *port_b = (const struct ptp_poll_port*)b;
 
-    while (!kthread_should_stop()) {
-        err = down_timeout(&ptp_polling_sem, 1 * HZ);
-        if (err == -ETIME) { /* return to wait */
-            continue;
+    if (time_before(port_a->since, port_b->since)) {
+        return -1;
+    }
+
+    if (time_after(port_a->since, port_b->since)) {
+        return 1;
+    }
+
+    return (int)port_a->local_port - (int)port_b->local_port;
+}
+
+
+/* collect the ports that have events waiting for a timestamp, oldest waiter first */
+static int __sx_clock_rx_polling_collect(void)
+{
+    struct ptp_common_event_data *oldest;
+    int                           local_port;
+    int                           num_ports = 0;
+
+    for (local_port = 0; local_port < PTP_MAX_PORTS; local_port++) {
+        spin_lock_bh(&ptp_rx_db.sysport_lock[local_port]);
+        if (!list_empty(&ptp_rx_db.sysport_events_list[local_port])) {
+            oldest = list_first_entry(&ptp_rx_db.sysport_events_list[local_port],
+                                      struct ptp_common_event_data,
+                                      list);
+            __ptp_poll_ports[num_ports].since = oldest->since;
+            __ptp_poll_ports[num_ports].local_port = local_port;
+            num_ports++;
+        }
+        spin_unlock_bh(&ptp_rx_db.sysport_lock[local_port]);
+    }
+
+    if (num_ports > 1) {
+        sort(__ptp_poll_ports, num_ports, sizeof(__ptp_poll_ports[0]), __ptp_poll_port_cmp, NULL);
+    }
+
+    return num_ports;
+}
+
+
+static void __sx_clock_rx_polling_cycle(void)
+{
+    struct ku_access_mtpptr_reg *ku_mtpptr;
+    ktime_t                      start;
+    u64                          cycle_usec;
+    u64                          num_records = 0;
+    int                          num_ports;
+    int                          batch_size;
+    int                          err;
+    int                          i, j;
+
+    start = ktime_get();
+
+    num_ports = __sx_clock_rx_polling_collect();
+    if (num_ports == 0) {
+        return;
+    }
+
+    for (i = 0; i < num_ports; i += batch_size) {
+        batch_size = min(num_ports - i, PTP_POLL_BATCH_SIZE);
+
+        for (j = 0; j < batch_size; j++) {
+            ku_mtpptr = &__ptp_poll_regs[j];
+            memset(ku_mtpptr, 0, sizeof(*ku_mtpptr));
+
+            ku_mtpptr->dev_id = __priv->dev.device_id;
+            sx_cmd_set_op_tlv(&ku_mtpptr->op_tlv, MTPPTR_REG_ID, 1);
+            ku_mtpptr->mtpptr_reg.clr = 1;
+            ku_mtpptr->mtpptr_reg.dir = PTP_PACKET_INGRESS;
+            ku_mtpptr->mtpptr_reg.local_port = __ptp_poll_ports[i + j].local_port;
         }
 
-        for (local_port = 0; local_port < PTP_MAX_PORTS; local_port++) {
-            spin_lock_bh(&ptp_rx_db.sysport_lock[local_port]);
-            has_events = !list_empty(&ptp_rx_db.sysport_events_list[local_port]);
-            spin_unlock_bh(&ptp_rx_db.sysport_lock[local_port]);
+        err = sx_ACCESS_REG_MTPPTR_batch(&__priv->dev, __ptp_poll_regs, __ptp_poll_errs, batch_size, 0);
+        if (err) {
+            /* nothing of this batch can be trusted, the registers may not have been queried at all */
+            atomic64_add(batch_size, &ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_REG_ACCESS_FAILED]);
+            continue;
+        }
 
-            if (!has_events) {
+        for (j = 0; j < batch_size; j++) {
+            if (__ptp_poll_errs[j]) {
+                atomic64_inc(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_REG_ACCESS_FAILED]);
                 continue;
             }
 
-            memset(&ku_mtpptr, 0, sizeof(ku_mtpptr));
+            atomic64_inc(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_REG_ACCESS_SUCCEEDED]);
+
+            /* register is kept in network order, number of records is at byte 11 (see ptp_lookup_event()) */
+            num_records += ((u8*)&__ptp_poll_regs[j].mtpptr_reg)[11];
+            ptp_lookup_event((u8*)&__ptp_poll_regs[j].mtpptr_reg, &ptp_rx_db);
+        }
+    }
+
+    cycle_usec = ktime_to_us(ktime_sub(ktime_get(), start));
 
-            ku_mtpptr.dev_id = __priv->dev.device_id;
-            sx_cmd_set_op_tlv(&ku_mtpptr.op_tlv, MTPPTR_REG_ID, 1);
-            ku_mtpptr.mtpptr_reg.clr = 1;
-            ku_mtpptr.mtpptr_reg.dir = PTP_PACKET_INGRESS;
-            ku_mtpptr.mtpptr_reg.local_port = local_port;
+    atomic64_inc(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_CYCLES]);
+    atomic64_add(num_ports, &ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_PORTS]);
+    atomic64_add(num_records, &ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_RECORDS]);
+    atomic64_add(cycle_usec, &ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_CYCLE_USEC]);
 
-            err = sx_ACCESS_REG_MTPPTR(&__priv->dev, &ku_mtpptr, 0);
-            if (err) {
-                atomic64_inc(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_REG_ACCESS_FAILED]);
-            } else {
-                atomic64_inc(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_REG_ACCESS_SUCCEEDED]);
-                ptp_lookup_event((u8*)&ku_mtpptr.mtpptr_reg, &ptp_rx_db);
-            }
+    /* polling thread is the only writer */
+    if (cycle_usec > (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_CYCLE_MAX_USEC])) {
+        atomic64_set(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_CYCLE_MAX_USEC], cycle_usec);
+    }
+}
+
+
+static int __sx_clock_rx_polling_thread(void *data)
+{
+    int err;
+
+    while (!kthread_should_stop()) {
+        err = down_timeout(&ptp_polling_sem, 1 * HZ);
+        if (err == -ETIME) { /* return to wait */
+            continue;
         }
+
+        __sx_clock_rx_polling_cycle();
     }
 
     return 0;
@@ -855,16 +1010,21 @@ static int __sx_clock_rx_polling_thread(void *data)
 
 static void __init_db(struct ptp_db *db, u8 direction, ptp_db_handle_cb_t handle_cb, ptp_db_gc_cb_t gc_cb)
 {
-    int i;
+    int i, j;
 
     db->handle_cb = handle_cb;
     db->gc_cb = gc_cb;
     db->direction = direction;
+    bitmap_zero(db->pending_ports, PTP_MAX_PORTS);
 
     for (i = 0; i < PTP_MAX_PORTS; i++) {
         spin_lock_init(&db->sysport_lock[i]);
         INIT_LIST_HEAD(&db->sysport_events_list[i]);
         INIT_LIST_HEAD(&db->sysport_records_list[i]);
+
+        for (j = 0; j < PTP_PORT_HASH_SIZE; j++) {
+            INIT_HLIST_HEAD(&db->sysport_events_hash[i][j]);
+        }
     }
 }
 
@@ -1108,6 +1268,7 @@ static void __dump_db(struct seq_file *m, const char *title, struct ptp_db *db)
 int sx_dbg_ptp_dump_proc_show(struct seq_file *m, void *v)
 {
     char section[40];
+    u64  poll_cycles, poll_usec, poll_ports, poll_records;
     int  i;
 
     seq_printf(m, "PTP DUMP\n");
@@ -1206,6 +1367,42 @@ int sx_dbg_ptp_dump_proc_show(struct seq_file *m, void *v)
                (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_PENDING_RECORDS]),
                (u64)atomic64_read(&ptp_counters[PTP_PACKET_EGRESS][PTP_COUNTER_PENDING_RECORDS]));
 
+    seq_printf(m, "%-40s   %-15llu   %-15llu\n",
+               "Hash matches",
+               (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_HASH_MATCH]),
+               (u64)atomic64_read(&ptp_counters[PTP_PACKET_EGRESS][PTP_COUNTER_HASH_MATCH]));
+
+    seq_printf(m, "%-40s   %-15llu   %-15llu\n",
+               "Hash collisions",
+               (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_HASH_COLLISIONS]),
+               (u64)atomic64_read(&ptp_counters[PTP_PACKET_EGRESS][PTP_COUNTER_HASH_COLLISIONS]));
+
+    seq_printf(m, "%-40s   %-15llu   %-15llu\n",
+               "GC port visits",
+               (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_GC_PORT_VISITS]),
+               (u64)atomic64_read(&ptp_counters[PTP_PACKET_EGRESS][PTP_COUNTER_GC_PORT_VISITS]));
+
+    seq_printf(m, "\n");
+
+    poll_cycles = (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_CYCLES]);
+    poll_usec = (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_CYCLE_USEC]);
+    poll_ports = (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_PORTS]);
+    poll_records = (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_RECORDS]);
+
+    seq_printf(m, "%-40s   %-15llu\n", "FW poll cycles", poll_cycles);
+    seq_printf(m, "%-40s   %-15llu\n", "FW poll ports queried", poll_ports);
+    seq_printf(m, "%-40s   %-15llu\n", "FW poll records collected", poll_records);
+    seq_printf(m, "%-40s   %-15llu\n", "FW poll cycle time - total (usec)", poll_usec);
+    seq_printf(m, "%-40s   %-15llu\n",
+               "FW poll cycle time - max (usec)",
+               (u64)atomic64_read(&ptp_counters[PTP_PACKET_INGRESS][PTP_COUNTER_POLL_CYCLE_MAX_USEC]));
+
+    if (poll_cycles) {
+        seq_printf(m, "%-40s   %-15llu\n", "FW poll cycle time - avg (usec)", div64_u64(poll_usec, poll_cycles));
+        seq_printf(m, "%-40s   %-15llu\n", "FW poll ports per cycle - avg", div64_u64(poll_ports, poll_cycles));
+        seq_printf(m, "%-40s   %-15llu\n", "FW poll records per cycle - avg", div64_u64(poll_records, poll_cycles));
+    }
+
     seq_printf(m, "\n");
 
     for (i = 0; i <= SX_MAX_PTP_RECORDS; i++) {
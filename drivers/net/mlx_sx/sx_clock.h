@@ -90,18 +90,30 @@ enum ptp_counters {
     PTP_COUNTER_EMPTY_TS,
     PTP_COUNTER_REG_ACCESS_SUCCEEDED,
     PTP_COUNTER_REG_ACCESS_FAILED,
+    PTP_COUNTER_POLL_CYCLES,
+    PTP_COUNTER_POLL_PORTS,
+    PTP_COUNTER_POLL_RECORDS,
+    PTP_COUNTER_POLL_CYCLE_USEC,
+    PTP_COUNTER_POLL_CYCLE_MAX_USEC,
+    PTP_COUNTER_HASH_MATCH,
+    PTP_COUNTER_HASH_COLLISIONS,
+    PTP_COUNTER_GC_PORT_VISITS,
     PTP_COUNTER_LAST
 };
 
 #define PTP_MAX_PORTS (MAX_PHYPORT_NUM + MAX_LAG_NUM)
+/* per-port buckets of the events waiting for a timestamp, keyed by (message type, sequence id, domain) */
+#define PTP_PORT_HASH_BITS (5)
+#define PTP_PORT_HASH_SIZE (1 << PTP_PORT_HASH_BITS)
 
 struct ptp_common_event_data {
-    struct list_head list;
-    u16              sequence_id;
-    u8               msg_type;
-    u8               domain_num;
-    u8               need_timestamp;
-    unsigned long    since;
+    struct list_head  list;
+    struct hlist_node hash; /* hashed only when need_timestamp is set */
+    u16               sequence_id;
+    u8                msg_type;
+    u8                domain_num;
+    u8                need_timestamp;
+    unsigned long     since;
 };
 struct ptp_rx_event_data {
     struct ptp_common_event_data common;
@@ -118,7 +130,9 @@ typedef void (*ptp_db_gc_cb_t)(struct ptp_common_event_data *ced);
 struct ptp_db {
     struct list_head   sysport_events_list[PTP_MAX_PORTS];
     struct list_head   sysport_records_list[PTP_MAX_PORTS];
+    struct hlist_head  sysport_events_hash[PTP_MAX_PORTS][PTP_PORT_HASH_SIZE];
     spinlock_t         sysport_lock[PTP_MAX_PORTS];
+    unsigned long      pending_ports[BITS_TO_LONGS(PTP_MAX_PORTS)]; /* ports with events/records to age */
     u8                 direction;
     ptp_db_handle_cb_t handle_cb;
     ptp_db_gc_cb_t     gc_cb;
@@ -139,6 +153,7 @@ int sx_ptp_cleanup(struct sx_priv *priv);
 int sx_ptp_pkt_parse(struct sk_buff *skb, u8 *is_ptp, u16 *evt_seqid, u8 *evt_dom_num, u8 *msg_type);
 void sx_fill_hwstamp(struct sx_tstamp *tstamp, u64 timestamp, struct skb_shared_hwtstamps *hwts);
 
+void ptp_enqueue_event(u16 local_port, struct ptp_common_event_data *ced, struct ptp_db *db);
 void ptp_dequeue_general_messages(u8 local_port, struct ptp_db *db);
 void ptp_lookup_event(const u8 *mtpptr_buff, struct ptp_db *db);
 
@@ -68,6 +68,7 @@
 #include "sx_clock.h"
 #include "sgmii.h"
 #include "counter.h"
+#include "emad.h"
 
 #ifdef CONFIG_44x
 #include <asm/dcr.h>
@@ -279,7 +280,19 @@ module_param_named(cpu_traffic_tasklet_reschedule_enable,
                    cpu_traffic_tasklet_reschedule_enable,
                    int, 0644);
 MODULE_PARM_DESC(cpu_traffic_tasklet_reschedule_enable,
-                 "enabled/disable reschedule of intr_tasklet_handler");
+                 "enabled/disable reschedule of the EQ tasklets");
+
+int eq_irq_cpu = -1;
+module_param_named(eq_irq_cpu, eq_irq_cpu, int, 0444);
+MODULE_PARM_DESC(eq_irq_cpu, "CPU affinity hint for the MSI-X interrupt shared by the EQs, -1 for none");
+
+int low_prio_cq_thread_cpu = -1;
+module_param_named(low_prio_cq_thread_cpu, low_prio_cq_thread_cpu, int, 0444);
+MODULE_PARM_DESC(low_prio_cq_thread_cpu, "CPU to run the low-priority CQ thread on, -1 for any");
+
+int mon_cq_thread_cpu = -1;
+module_param_named(mon_cq_thread_cpu, mon_cq_thread_cpu, int, 0444);
+MODULE_PARM_DESC(mon_cq_thread_cpu, "CPU to run the monitor CQ thread on, -1 for any");
 
 int chip_info_type = -1;
 module_param_named(chip_info_type, chip_info_type, int, 0444);
@@ -305,6 +318,42 @@ int enable_monitor_rdq_trace_points = 0;
 module_param_named(enable_monitor_rdq_trace_points, enable_monitor_rdq_trace_points, int, 0644);
 MODULE_PARM_DESC(enable_monitor_rdq_trace_points, "enabled/disable monitor RDQs trace points");
 
+int rdq_buff_pool_enable = 1;
+module_param_named(rdq_buff_pool_enable, rdq_buff_pool_enable, int, 0644);
+MODULE_PARM_DESC(rdq_buff_pool_enable, "enabled/disable recycling of DMA-mapped RX buffers (applied on RDQ creation)");
+
+int cq_moder_max_usec = 0;
+module_param_named(cq_moder_max_usec, cq_moder_max_usec, int, 0644);
+MODULE_PARM_DESC(cq_moder_max_usec, "default max CQ interrupt hold back in usec, 0 disables moderation (applied on CQ creation)");
+
+int cq_moder_rate_low = 10000;
+module_param_named(cq_moder_rate_low, cq_moder_rate_low, int, 0644);
+MODULE_PARM_DESC(cq_moder_rate_low, "default CQEs/sec up to which CQ interrupts are not held back (applied on CQ creation)");
+
+int cq_moder_rate_high = 200000;
+module_param_named(cq_moder_rate_high, cq_moder_rate_high, int, 0644);
+MODULE_PARM_DESC(cq_moder_rate_high, "default CQEs/sec from which CQ interrupts are held back by cq_moder_max_usec (applied on CQ creation)");
+
+int cq_busy_poll_usec = 0;
+module_param_named(cq_busy_poll_usec, cq_busy_poll_usec, int, 0644);
+MODULE_PARM_DESC(cq_busy_poll_usec, "default usec to busy-poll an empty CQ before re-arming it, 0 disables (applied on CQ creation)");
+
+int cmd_mailbox_pool_size = 16;
+module_param_named(cmd_mailbox_pool_size, cmd_mailbox_pool_size, int, 0444);
+MODULE_PARM_DESC(cmd_mailbox_pool_size, "number of command mailboxes kept allocated for register access");
+
+int emad_window_size = 32;
+module_param_named(emad_window_size, emad_window_size, int, 0644);
+MODULE_PARM_DESC(emad_window_size, "max EMADs in flight in the EMAD pipeline (1-256)");
+
+int i2c_cmd_poll_min_usec = 20;
+module_param_named(i2c_cmd_poll_min_usec, i2c_cmd_poll_min_usec, int, 0644);
+MODULE_PARM_DESC(i2c_cmd_poll_min_usec, "first sleep in usec between polls of the go bit of an I2C command");
+
+int i2c_cmd_poll_max_usec = 2000;
+module_param_named(i2c_cmd_poll_max_usec, i2c_cmd_poll_max_usec, int, 0644);
+MODULE_PARM_DESC(i2c_cmd_poll_max_usec, "longest sleep in usec between polls of the go bit of an I2C command");
+
 #ifdef CONFIG_PCI_MSI
 
 static int msi_x = 1;
@@ -613,8 +662,7 @@ int sx_core_pending_ptp_eg_pkt(struct sx_dev *dev, struct sk_buff *skb, u16 sysp
         ptp_event->common.since = jiffies;
 
         spin_lock_irqsave(&ptp_tx_db.sysport_lock[sysport_lag_id], flags);
-        list_add_tail(&ptp_event->common.list, &ptp_tx_db.sysport_events_list[sysport_lag_id]);
-        atomic64_inc(&ptp_counters[PTP_PACKET_EGRESS][PTP_COUNTER_PENDING_EVENTS]);
+        ptp_enqueue_event(sysport_lag_id, &ptp_event->common, &ptp_tx_db);
         spin_unlock_irqrestore(&ptp_tx_db.sysport_lock[sysport_lag_id], flags);
     }
 
@@ -626,7 +674,7 @@ int sx_core_get_prio2tc(struct sx_dev *dev, uint16_t port_lag_id, uint8_t is_lag
 {
     struct sx_priv *dev_priv = sx_priv(dev);
     uint16_t        local = 0, phy_port_max = 0;
-    unsigned long   flags;
+    unsigned        seq;
 
     if (pcp > MAX_PRIO_NUM) {
         printk(KERN_ERR PFX "PCP %d is invalid. (MAX %d).\n",
@@ -639,21 +687,23 @@ int sx_core_get_prio2tc(struct sx_dev *dev, uint16_t port_lag_id, uint8_t is_lag
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        *tc = dev_priv->lag_prio2tc[port_lag_id][pcp];
-    } else {
-        local = dev_priv->system_to_local_db[port_lag_id];
-
-        if (local > phy_port_max) {
-            printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
-                   local, phy_port_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if (is_lag) {
+            *tc = dev_priv->lag_prio2tc[port_lag_id][pcp];
+        } else {
+            local = dev_priv->system_to_local_db[port_lag_id];
+            if (local <= phy_port_max) {
+                *tc = dev_priv->port_prio2tc[local][pcp];
+            }
         }
-        *tc = dev_priv->port_prio2tc[local][pcp];
+    } while (sx_db_read_retry(dev_priv, seq));
+
+    if (!is_lag && (local > phy_port_max)) {
+        printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
+               local, phy_port_max);
+        return -EINVAL;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
 
     return 0;
 }
@@ -662,15 +712,16 @@ EXPORT_SYMBOL(sx_core_get_prio2tc);
 int sx_core_get_pvid(struct sx_dev *dev, uint16_t sysport_lag_id, uint8_t is_lag, uint16_t       *pvid)
 {
     struct sx_priv *dev_priv = sx_priv(dev);
-    unsigned long   flags;
+    unsigned        seq;
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        *pvid = dev_priv->pvid_lag_db[sysport_lag_id];
-    } else {
-        *pvid = dev_priv->pvid_sysport_db[sysport_lag_id];
-    }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if (is_lag) {
+            *pvid = dev_priv->pvid_lag_db[sysport_lag_id];
+        } else {
+            *pvid = dev_priv->pvid_sysport_db[sysport_lag_id];
+        }
+    } while (sx_db_read_retry(dev_priv, seq));
 
     return 0;
 }
@@ -684,28 +735,30 @@ int sx_core_get_vlan_tagging(struct sx_dev *dev,
 {
     struct sx_priv *dev_priv = sx_priv(dev);
     uint16_t        local = 0, phy_port_max = 0;
-    unsigned long   flags;
+    unsigned        seq;
 
     if (sx_core_get_phy_port_max(dev, &phy_port_max)) {
         printk(KERN_ERR PFX "Failed to get max number of phy ports.\n");
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        *is_vlan_tagged = dev_priv->lag_vtag_mode[port_lag_id][vlan];
-    } else {
-        local = dev_priv->system_to_local_db[port_lag_id];
-
-        if (local > phy_port_max) {
-            printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
-                   local, phy_port_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if (is_lag) {
+            *is_vlan_tagged = dev_priv->lag_vtag_mode[port_lag_id][vlan];
+        } else {
+            local = dev_priv->system_to_local_db[port_lag_id];
+            if (local <= phy_port_max) {
+                *is_vlan_tagged = dev_priv->port_vtag_mode[local][vlan];
+            }
         }
-        *is_vlan_tagged = dev_priv->port_vtag_mode[local][vlan];
+    } while (sx_db_read_retry(dev_priv, seq));
+
+    if (!is_lag && (local > phy_port_max)) {
+        printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
+               local, phy_port_max);
+        return -EINVAL;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
 
     return 0;
 }
@@ -715,28 +768,30 @@ int sx_core_get_prio_tagging(struct sx_dev *dev, uint16_t port_lag_id, uint8_t i
 {
     struct sx_priv *dev_priv = sx_priv(dev);
     uint16_t        local = 0, phy_port_max = 0;
-    unsigned long   flags;
+    unsigned        seq;
 
     if (sx_core_get_phy_port_max(dev, &phy_port_max)) {
         printk(KERN_ERR PFX "Failed to get max number of phy port.\n");
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        *is_port_prio_tagged = dev_priv->lag_prio_tagging_mode[port_lag_id];
-    } else {
-        local = dev_priv->system_to_local_db[port_lag_id];
-
-        if (local > phy_port_max) {
-            printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
-                   local, phy_port_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if (is_lag) {
+            *is_port_prio_tagged = dev_priv->lag_prio_tagging_mode[port_lag_id];
+        } else {
+            local = dev_priv->system_to_local_db[port_lag_id];
+            if (local <= phy_port_max) {
+                *is_port_prio_tagged = dev_priv->port_prio_tagging_mode[local];
+            }
         }
-        *is_port_prio_tagged = dev_priv->port_prio_tagging_mode[local];
+    } while (sx_db_read_retry(dev_priv, seq));
+
+    if (!is_lag && (local > phy_port_max)) {
+        printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
+               local, phy_port_max);
+        return -EINVAL;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
 
     return 0;
 }
@@ -918,8 +973,9 @@ int sx_core_get_rp_rfid(struct sx_dev *dev, uint16_t port_lag_id, uint8_t is_lag
 {
     struct sx_priv *dev_priv = sx_priv(dev);
     uint16_t        local = 0, phy_port_max = 0, rif_id = 0;
-    unsigned long   flags;
     uint16_t        lag_max = 0, lag_member_max = 0;
+    uint8_t         rp_valid = 0;
+    unsigned        seq;
 
     if (vlan_id >= SXD_MAX_VLAN_NUM) {
         printk(KERN_ERR PFX "vlan_id %d is invalid. (MAX %d).\n",
@@ -939,43 +995,48 @@ int sx_core_get_rp_rfid(struct sx_dev *dev, uint16_t port_lag_id, uint8_t is_lag
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        if (port_lag_id > lag_max) {
-            net_err_ratelimited(PFX "port_lag_id %d is invalid. (MAX %d).\n",
-                                port_lag_id, lag_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+    if (is_lag && (port_lag_id > lag_max)) {
+        net_err_ratelimited(PFX "port_lag_id %d is invalid. (MAX %d).\n",
+                            port_lag_id, lag_max);
+        return -EINVAL;
+    }
+
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        rp_valid = 0;
+        if (is_lag) {
+            rp_valid = dev_priv->lag_rp_rif_valid[port_lag_id][vlan_id];
+            rif_id = dev_priv->lag_rp_rif[port_lag_id][vlan_id];
+        } else {
+            local = dev_priv->system_to_local_db[port_lag_id];
+            if (local <= phy_port_max) {
+                rp_valid = dev_priv->port_rp_rif_valid[local][vlan_id];
+                rif_id = dev_priv->port_rp_rif[local][vlan_id];
+            }
         }
-        if (!dev_priv->lag_rp_rif_valid[port_lag_id][vlan_id]) {
-            printk(KERN_ERR PFX "No RP on LAG ID %d and vlan %d.\n",
-                   port_lag_id, vlan_id);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+
+        if (rp_valid) {
+            *rfid = dev_priv->rif_id_to_hwfid[rif_id];
         }
+    } while (sx_db_read_retry(dev_priv, seq));
 
-        rif_id = dev_priv->lag_rp_rif[port_lag_id][vlan_id];
-        *rfid = dev_priv->rif_id_to_hwfid[rif_id];
-    } else {
-        local = dev_priv->system_to_local_db[port_lag_id];
+    if (!is_lag && (local > phy_port_max)) {
+        net_err_ratelimited(PFX "Local %d is invalid. (MAX %d).\n",
+                            local, phy_port_max);
+        return -EINVAL;
+    }
 
-        if (local > phy_port_max) {
-            net_err_ratelimited(PFX "Local %d is invalid. (MAX %d).\n",
-                                local, phy_port_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
-        }
-        if (!dev_priv->port_rp_rif_valid[local][vlan_id]) {
+    if (!rp_valid) {
+        if (is_lag) {
+            printk(KERN_ERR PFX "No RP on LAG ID %d and vlan %d.\n",
+                   port_lag_id, vlan_id);
+        } else {
             printk(KERN_ERR PFX "No RP on port %d and vlan %d.\n",
                    local, vlan_id);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
         }
-
-        rif_id = dev_priv->port_rp_rif[local][vlan_id];
-        *rfid = dev_priv->rif_id_to_hwfid[rif_id];
+        *rfid = 0;
+        return -EINVAL;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
 
     return 0;
 }
@@ -1013,10 +1074,11 @@ EXPORT_SYMBOL(sx_core_get_rp_vlan);
 
 int sx_core_get_rp_mode(struct sx_dev *dev, u8 is_lag, u16 sysport_lag_id, u16 vlan_id, u8 *is_rp)
 {
-    unsigned long flags;
-    u16           lag_id = 0;
-    uint16_t      local = 0, phy_port_max = 0;
-    uint16_t      lag_max = 0, lag_member_max = 0;
+    struct sx_priv *dev_priv = sx_priv(dev);
+    u16             lag_id = 0;
+    uint16_t        local = 0, phy_port_max = 0;
+    uint16_t        lag_max = 0, lag_member_max = 0;
+    unsigned        seq;
 
     if (vlan_id >= SXD_MAX_VLAN_NUM) {
         printk(KERN_ERR PFX "vlan_id %d is invalid. (MAX %d).\n",
@@ -1034,27 +1096,29 @@ int sx_core_get_rp_mode(struct sx_dev *dev, u8 is_lag, u16 sysport_lag_id, u16 v
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        if (sysport_lag_id > lag_max) {
-            printk(KERN_ERR PFX "LAG ID %d is invalid. (MAX %d).\n",
-                   lag_id, lag_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
-        }
-        *is_rp = sx_priv(dev)->lag_rp_rif_valid[sysport_lag_id][vlan_id];
-    } else {
-        local = sx_priv(dev)->system_to_local_db[sysport_lag_id];
+    if (is_lag && (sysport_lag_id > lag_max)) {
+        printk(KERN_ERR PFX "LAG ID %d is invalid. (MAX %d).\n",
+               lag_id, lag_max);
+        return -EINVAL;
+    }
 
-        if (local > phy_port_max) {
-            printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
-                   local, phy_port_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if (is_lag) {
+            *is_rp = dev_priv->lag_rp_rif_valid[sysport_lag_id][vlan_id];
+        } else {
+            local = dev_priv->system_to_local_db[sysport_lag_id];
+            if (local <= phy_port_max) {
+                *is_rp = dev_priv->port_rp_rif_valid[local][vlan_id];
+            }
         }
-        *is_rp = sx_priv(dev)->port_rp_rif_valid[local][vlan_id];
+    } while (sx_db_read_retry(dev_priv, seq));
+
+    if (!is_lag && (local > phy_port_max)) {
+        printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
+               local, phy_port_max);
+        return -EINVAL;
     }
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
 
     return 0;
 }
@@ -1064,7 +1128,7 @@ EXPORT_SYMBOL(sx_core_get_rp_mode);
 int sx_core_get_vlan2ip(struct sx_dev *dev, uint16_t vid, uint32_t *ip_addr)
 {
     struct sx_priv *dev_priv = sx_priv(dev);
-    unsigned long   flags;
+    unsigned        seq;
 
     if (dis_vid2ip) {
         return 0;
@@ -1076,11 +1140,10 @@ int sx_core_get_vlan2ip(struct sx_dev *dev, uint16_t vid, uint32_t *ip_addr)
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-
-    *ip_addr = dev_priv->icmp_vlan2ip_db[vid];
-
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        *ip_addr = dev_priv->icmp_vlan2ip_db[vid];
+    } while (sx_db_read_retry(dev_priv, seq));
 
     return 0;
 }
@@ -1090,7 +1153,7 @@ int sx_core_get_fid_by_port_vid(struct sx_dev *dev, struct completion_info *comp
 {
     struct sx_priv *dev_priv = sx_priv(dev);
     uint16_t        local = 0, phy_port_max = 0;
-    unsigned long   flags;
+    unsigned        seq;
     uint8_t         is_lag = comp_info->is_lag;
     uint16_t        sysport_lag_id = comp_info->sysport;
     uint16_t        lag_port_id = comp_info->lag_subport;
@@ -1107,21 +1170,24 @@ int sx_core_get_fid_by_port_vid(struct sx_dev *dev, struct completion_info *comp
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-
-    if (is_lag) {
-        local = sx_priv(dev)->lag_member_to_local_db[sysport_lag_id][lag_port_id];
-    } else {
-        local = dev_priv->system_to_local_db[sysport_lag_id];
-        if (local > phy_port_max) {
-            printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
-                   local, phy_port_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if (is_lag) {
+            local = dev_priv->lag_member_to_local_db[sysport_lag_id][lag_port_id];
+        } else {
+            local = dev_priv->system_to_local_db[sysport_lag_id];
+            if (local > phy_port_max) {
+                continue;
+            }
         }
+        *fid = dev_priv->port_vid_to_fid[local][vid];
+    } while (sx_db_read_retry(dev_priv, seq));
+
+    if (!is_lag && (local > phy_port_max)) {
+        printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
+               local, phy_port_max);
+        return -EINVAL;
     }
-    *fid = dev_priv->port_vid_to_fid[local][vid];
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
 
     return 0;
 }
@@ -1240,11 +1306,228 @@ EXPORT_SYMBOL(sx_get_dev_context);
 /************************************************
  *  Helper Functions
  ***********************************************/
+int sx_trap_filter_init(struct sx_priv *priv)
+{
+    priv->trap_filter = vzalloc(sizeof(*priv->trap_filter));
+    if (!priv->trap_filter) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void sx_trap_filter_deinit(struct sx_priv *priv)
+{
+    int i;
+
+    if (!priv->trap_filter) {
+        return;
+    }
+
+    /* wait for RX path readers of the bitmaps */
+    synchronize_rcu();
+
+    for (i = 0; i < NUM_HW_SYNDROMES; i++) {
+        kfree(rcu_dereference_protected(priv->trap_filter->synd[i], 1));
+    }
+
+    vfree(priv->trap_filter);
+    priv->trap_filter = NULL;
+}
+
+/* allocated out of db_lock and handed to __sx_trap_filter_set() */
+struct sx_trap_filter * sx_trap_filter_alloc(void)
+{
+    return kzalloc(sizeof(struct sx_trap_filter), GFP_KERNEL);
+}
+
+/* db_lock must be held. Consumes *new_filter if the syndrome had no filter yet */
+void __sx_trap_filter_set(struct sx_priv *priv, u16 trap_id, u8 is_lag, u16 id, struct sx_trap_filter **new_filter)
+{
+    struct sx_trap_filter *filter;
+
+    if (is_lag && (id > SXD_LAG_ID_MAX)) {
+        return;
+    }
+
+    filter = rcu_dereference_protected(priv->trap_filter->synd[trap_id],
+                                       lockdep_is_held(&priv->db_lock));
+    if (!filter) {
+        if (!*new_filter) {
+            return;
+        }
+
+        filter = *new_filter;
+        *new_filter = NULL;
+        rcu_assign_pointer(priv->trap_filter->synd[trap_id], filter);
+    }
+
+    if (is_lag) {
+        if (!__test_and_set_bit(id, filter->lag_bitmap)) {
+            filter->lag_cnt++;
+        }
+    } else {
+        if (!__test_and_set_bit(id, filter->sysport_bitmap)) {
+            filter->sysport_cnt++;
+        }
+    }
+}
+
+/* db_lock must be held */
+void __sx_trap_filter_clear(struct sx_priv *priv, u16 trap_id, u8 is_lag, u16 id)
+{
+    struct sx_trap_filter *filter;
+
+    if (is_lag && (id > SXD_LAG_ID_MAX)) {
+        return;
+    }
+
+    filter = rcu_dereference_protected(priv->trap_filter->synd[trap_id],
+                                       lockdep_is_held(&priv->db_lock));
+    if (!filter) {
+        return;
+    }
+
+    if (is_lag) {
+        if (__test_and_clear_bit(id, filter->lag_bitmap)) {
+            filter->lag_cnt--;
+        }
+    } else {
+        if (__test_and_clear_bit(id, filter->sysport_bitmap)) {
+            filter->sysport_cnt--;
+        }
+    }
+
+    if ((filter->lag_cnt == 0) && (filter->sysport_cnt == 0)) {
+        __sx_trap_filter_flush(priv, trap_id);
+    }
+}
+
+/* db_lock must be held */
+void __sx_trap_filter_flush(struct sx_priv *priv, u16 trap_id)
+{
+    struct sx_trap_filter *filter;
+
+    filter = rcu_dereference_protected(priv->trap_filter->synd[trap_id],
+                                       lockdep_is_held(&priv->db_lock));
+    if (!filter) {
+        return;
+    }
+
+    RCU_INIT_POINTER(priv->trap_filter->synd[trap_id], NULL);
+    kfree_rcu(filter, rcu);
+}
+
+/* Rebuilds the bitmaps from sysport_filter_db/lag_filter_db (e.g. after they were restored) */
+int sx_trap_filter_rebuild(struct sx_priv *priv)
+{
+    struct sx_trap_filter *new_filter = NULL;
+    unsigned long          flags;
+    int                    trap_id, i;
+
+    for (trap_id = 0; trap_id < NUM_HW_SYNDROMES; trap_id++) {
+        if (!new_filter) {
+            new_filter = sx_trap_filter_alloc();
+            if (!new_filter) {
+                return -ENOMEM;
+            }
+        }
+
+        sx_db_write_lock(priv, flags);
+        __sx_trap_filter_flush(priv, trap_id);
+        for (i = 0; i < MAX_SYSTEM_PORTS_IN_FILTER; i++) {
+            if (priv->sysport_filter_db[trap_id][i] != 0) {
+                __sx_trap_filter_set(priv, trap_id, 0, priv->sysport_filter_db[trap_id][i], &new_filter);
+            }
+        }
+
+        for (i = 0; i < MAX_LAG_PORTS_IN_FILTER; i++) {
+            if (priv->lag_filter_db[trap_id][i] < LAG_ID_INVALID) {
+                __sx_trap_filter_set(priv, trap_id, 1, priv->lag_filter_db[trap_id][i], &new_filter);
+            }
+        }
+        sx_db_write_unlock(priv, flags);
+    }
+
+    kfree(new_filter);
+    return 0;
+}
+
+int sx_stats_pcpu_init(struct sx_stats_pcpu *stats)
+{
+    int cpu;
+
+    stats->per_cpu = kcalloc(nr_cpu_ids, sizeof(*stats->per_cpu), GFP_KERNEL);
+    if (!stats->per_cpu) {
+        return -ENOMEM;
+    }
+
+    for_each_possible_cpu(cpu) {
+        stats->per_cpu[cpu] = vzalloc_node(sizeof(struct sx_stats), cpu_to_node(cpu));
+        if (!stats->per_cpu[cpu]) {
+            sx_stats_pcpu_deinit(stats);
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+void sx_stats_pcpu_deinit(struct sx_stats_pcpu *stats)
+{
+    int cpu;
+
+    if (!stats->per_cpu) {
+        return;
+    }
+
+    for_each_possible_cpu(cpu) {
+        vfree(stats->per_cpu[cpu]);
+    }
+
+    kfree(stats->per_cpu);
+    stats->per_cpu = NULL;
+}
+
+void sx_stats_pcpu_clear(struct sx_stats_pcpu *stats)
+{
+    int cpu;
+
+    if (!stats->per_cpu) {
+        return;
+    }
+
+    for_each_possible_cpu(cpu) {
+        memset(stats->per_cpu[cpu], 0, sizeof(struct sx_stats));
+    }
+}
+
+u64 sx_stats_pcpu_read(struct sx_stats_pcpu *stats, size_t offset)
+{
+    u64 sum = 0;
+    int cpu;
+
+    if (!stats->per_cpu) {
+        return 0;
+    }
+
+    for_each_possible_cpu(cpu) {
+        sum += *(u64*)((u8*)stats->per_cpu[cpu] + offset);
+    }
+
+    return sum;
+}
+
 void inc_unconsumed_packets_counter(struct sx_dev *dev, u16 hw_synd, enum sx_packet_type pkt_type)
 {
+    struct sx_stats *stats;
+    unsigned long    flags;
+
     inc_unconsumed_packets_global_counter(hw_synd, pkt_type);
     if (dev) {
-        dev->stats.rx_unconsumed_by_synd[hw_synd][pkt_type]++;
+        stats = sx_stats_pcpu_get(&dev->stats, &flags);
+        stats->rx_unconsumed_by_synd[hw_synd][pkt_type]++;
+        sx_stats_pcpu_put(flags);
         dev->unconsumed_packets_counter++;
     }
 #ifdef SX_DEBUG
@@ -1255,11 +1538,16 @@ void inc_unconsumed_packets_counter(struct sx_dev *dev, u16 hw_synd, enum sx_pac
 
 void inc_eventlist_drops_counter(struct sx_dev* sx_dev, u16 hw_synd)
 {
+    struct sx_stats *stats;
+    unsigned long    flags;
+
     inc_eventlist_drops_global_counter(hw_synd);
 
     if (sx_dev != NULL) {
         sx_dev->eventlist_drops_counter++;
-        sx_dev->stats.rx_eventlist_drops_by_synd[hw_synd]++;
+        stats = sx_stats_pcpu_get(&sx_dev->stats, &flags);
+        stats->rx_eventlist_drops_by_synd[hw_synd]++;
+        sx_stats_pcpu_put(flags);
     }
 
 #ifdef SX_DEBUG
@@ -1286,8 +1574,13 @@ void inc_filtered_port_packets_counter(struct sx_dev *dev)
 
 void inc_unconsumed_packets_global_counter(u16 hw_synd, enum sx_packet_type pkt_type)
 {
+    struct sx_stats *stats;
+    unsigned long    flags;
+
     unconsumed_packets_counter++;
-    sx_glb.stats.rx_unconsumed_by_synd[hw_synd][pkt_type]++;
+    stats = sx_stats_pcpu_get(&sx_glb.stats, &flags);
+    stats->rx_unconsumed_by_synd[hw_synd][pkt_type]++;
+    sx_stats_pcpu_put(flags);
  #ifdef SX_DEBUG
     printk(KERN_ERR PFX "A packet with trap ID 0x%x and type %s "
            "was not consumed\n", hw_synd, sx_cqe_packet_type_str[pkt_type]);
@@ -1296,8 +1589,13 @@ void inc_unconsumed_packets_global_counter(u16 hw_synd, enum sx_packet_type pkt_
 
 static void inc_eventlist_drops_global_counter(u16 hw_synd)
 {
+    struct sx_stats *stats;
+    unsigned long    flags;
+
     eventlist_drops_counter++;
-    sx_glb.stats.rx_eventlist_drops_by_synd[hw_synd]++;
+    stats = sx_stats_pcpu_get(&sx_glb.stats, &flags);
+    stats->rx_eventlist_drops_by_synd[hw_synd]++;
+    sx_stats_pcpu_put(flags);
  #ifdef SX_DEBUG
     printk(KERN_ERR PFX "A packet with trap ID 0x%x "
            "was dropped from the event list\n", hw_synd);
@@ -1488,6 +1786,8 @@ static int sx_send_loopback(struct sx_dev *dev, struct ku_write *write_data, voi
     struct ethhdr         *eth_h = NULL;
     u8                     is_from_rp = IS_RP_DONT_CARE_E;
     u16                    fid = 0;
+    struct sx_stats       *stats;
+    unsigned long          flags;
 
     memset(&ci, 0, sizeof(ci));
     err = copy_buff_to_skb(&ci.skb, write_data, false);
@@ -1526,13 +1826,7 @@ static int sx_send_loopback(struct sx_dev *dev, struct ku_write *write_data, voi
         ci.is_tagged = VLAN_UNTAGGED_E;
     }
     if (ci.vid == 0) {
-        spin_lock_bh(&sx_priv(dev)->db_lock);
-        if (ci.is_lag) {
-            ci.vid = sx_priv(dev)->pvid_lag_db[ci.sysport];
-        } else {
-            ci.vid = sx_priv(dev)->pvid_sysport_db[ci.sysport];
-        }
-        spin_unlock_bh(&sx_priv(dev)->db_lock);
+        sx_core_get_pvid(dev, ci.sysport, ci.is_lag, &ci.vid);
     }
 
     if ((ci.sysport != 0) || (ci.is_lag != 0)) {
@@ -1557,8 +1851,12 @@ static int sx_send_loopback(struct sx_dev *dev, struct ku_write *write_data, voi
     ci.user_def_val = 0;
 
     if (dispatch_pkt(dev, &ci, ci.hw_synd, 0) > 0) {
-        dev->stats.rx_eventlist_by_synd[write_data->meta.loopback_data.trap_id]++;
-        sx_glb.stats.rx_eventlist_by_synd[write_data->meta.loopback_data.trap_id]++;
+        stats = sx_stats_pcpu_get(&dev->stats, &flags);
+        stats->rx_eventlist_by_synd[write_data->meta.loopback_data.trap_id]++;
+        sx_stats_pcpu_put(flags);
+        stats = sx_stats_pcpu_get(&sx_glb.stats, &flags);
+        stats->rx_eventlist_by_synd[write_data->meta.loopback_data.trap_id]++;
+        sx_stats_pcpu_put(flags);
     }
 
 out:
@@ -1881,21 +2179,6 @@ static void __init_port_vlan_listener_counters(u16 hw_synd, struct listener_port
                          "listener_port_vlan - accepted [vlan]",
                          COUNTER_SEV_INFO);
 
-    sx_core_counter_init(&port_vlan_listener->counters.category,
-                         &port_vlan_listener->counters.listener_port_vlan.mismtach.sysport,
-                         "listener_port_vlan - mismatch [sysport]",
-                         COUNTER_SEV_INFO);
-
-    sx_core_counter_init(&port_vlan_listener->counters.category,
-                         &port_vlan_listener->counters.listener_port_vlan.mismtach.lag,
-                         "listener_port_vlan - mismatch [lag]",
-                         COUNTER_SEV_INFO);
-
-    sx_core_counter_init(&port_vlan_listener->counters.category,
-                         &port_vlan_listener->counters.listener_port_vlan.mismtach.vlan,
-                         "listener_port_vlan - mismatch [vlan]",
-                         COUNTER_SEV_INFO);
-
     /* listener counters */
 
     sx_core_counter_init(&port_vlan_listener->counters.category,
@@ -1982,9 +2265,6 @@ static void __deinit_port_vlan_listener_counters(struct listener_port_vlan_entry
     sx_core_counter_deinit(&port_vlan_listener->counters.listener_port_vlan.accepted.sysport);
     sx_core_counter_deinit(&port_vlan_listener->counters.listener_port_vlan.accepted.lag);
     sx_core_counter_deinit(&port_vlan_listener->counters.listener_port_vlan.accepted.vlan);
-    sx_core_counter_deinit(&port_vlan_listener->counters.listener_port_vlan.mismtach.sysport);
-    sx_core_counter_deinit(&port_vlan_listener->counters.listener_port_vlan.mismtach.lag);
-    sx_core_counter_deinit(&port_vlan_listener->counters.listener_port_vlan.mismtach.vlan);
 
     /* listener counters */
     sx_core_counter_deinit(&port_vlan_listener->counters.listener.accepted.def);
@@ -2006,6 +2286,64 @@ static void __deinit_port_vlan_listener_counters(struct listener_port_vlan_entry
     sx_core_counter_category_deinit(&port_vlan_listener->counters.category);
 }
 
+static void __sx_core_port_vlan_listener_hash_key_set(u16 hw_synd, struct listener_port_vlan_entry *port_vlan_listener)
+{
+    u16 id = 0;
+
+    switch (port_vlan_listener->match_crit) {
+    case PORT_VLAN_MATCH_PORT_VALID:
+        id = port_vlan_listener->sysport;
+        break;
+
+    case PORT_VLAN_MATCH_LAG_VALID:
+        id = port_vlan_listener->lag_id;
+        break;
+
+    case PORT_VLAN_MATCH_VLAN_VALID:
+        id = port_vlan_listener->vlan;
+        break;
+
+    default:
+        break;
+    }
+
+    port_vlan_listener->hash_key = sx_listener_hash_key(hw_synd, port_vlan_listener->match_crit, id);
+}
+
+/* must be called under sx_glb.listeners_lock. dispatch_pkt() may still hold the listener, so free it after RCU grace period */
+static void __sx_core_listener_del(struct listener_entry *listener)
+{
+    list_del_rcu(&listener->list);
+    kfree_rcu(listener, rcu);
+}
+
+/* must be called under sx_glb.listeners_lock and only when the port/vlan listener has no more listeners */
+static void __sx_core_port_vlan_listener_del(struct listener_port_vlan_entry *port_vlan_listener)
+{
+    list_del(&port_vlan_listener->list);
+    hash_del_rcu(&port_vlan_listener->hash_node);
+    __deinit_port_vlan_listener_counters(port_vlan_listener);
+    kfree_rcu(port_vlan_listener, rcu);
+}
+
+/* must be called under sx_glb.listeners_lock. The port/vlan listener must hold at least one listener */
+static void __sx_core_port_vlan_listener_add(u16                              hw_synd,
+                                             struct listener_port_vlan_entry *port_vlan_listener,
+                                             u8                               add_tail)
+{
+    __init_port_vlan_listener_counters(hw_synd, port_vlan_listener);
+    __sx_core_port_vlan_listener_hash_key_set(hw_synd, port_vlan_listener);
+
+    if (add_tail) {
+        list_add_tail(&port_vlan_listener->list, &sx_glb.listeners_db[hw_synd].list);
+    } else {
+        list_add(&port_vlan_listener->list, &sx_glb.listeners_db[hw_synd].list);
+    }
+
+    /* publish to dispatch_pkt() only when the entry is fully initialized */
+    hash_add_rcu(sx_glb.listeners_hash, &port_vlan_listener->hash_node, port_vlan_listener->hash_key);
+}
+
 
 /**
  * Create new listener with the given swid,type,critireas and add it to an entry
@@ -2076,7 +2414,7 @@ int sx_core_add_synd(u8                          swid,
     new_listener->context = context;
     new_listener->listener_type = type;
     new_listener->is_default = is_default;
-    new_listener->rx_pkts = 0;
+    atomic64_set(&new_listener->rx_pkts, 0);
     spin_lock_irqsave(&sx_glb.listeners_lock, flags);
     /* default listeners are stored at Don't care */
     /* entry, at the end of the list              */
@@ -2106,8 +2444,8 @@ int sx_core_add_synd(u8                          swid,
                 found_same_port_vlan_listener = __sx_core_match_port_vlan_listener(port_vlan_listener,
                                                                                    new_port_vlan_listener);
                 if (found_same_port_vlan_listener) {
-                    list_add_tail(&(new_listener->list),
-                                  &(port_vlan_listener->listener.list));
+                    list_add_tail_rcu(&(new_listener->list),
+                                      &(port_vlan_listener->listener.list));
                     break;
                 }
             }
@@ -2115,13 +2453,11 @@ int sx_core_add_synd(u8                          swid,
         if (found_same_port_vlan_listener == 1) {
             kfree(new_port_vlan_listener);
         } else {
-            list_add_tail(&(new_port_vlan_listener->list),
-                          &(sx_glb.listeners_db[hw_synd].list));
             INIT_LIST_HEAD(&new_port_vlan_listener->listener.list);
             list_add_tail(&(new_listener->list),
                           &(new_port_vlan_listener->listener.list));
 
-            __init_port_vlan_listener_counters(hw_synd, new_port_vlan_listener);
+            __sx_core_port_vlan_listener_add(hw_synd, new_port_vlan_listener, 1);
         }
     } else {
         if (!list_empty(&sx_glb.listeners_db[hw_synd].list)) {
@@ -2147,16 +2483,14 @@ int sx_core_add_synd(u8                          swid,
 
         if (found_same_listener == 0) {
             if (found_same_port_vlan_listener == 0) {
-                list_add(&(new_port_vlan_listener->list),
-                         &(sx_glb.listeners_db[hw_synd].list));
                 INIT_LIST_HEAD(&new_port_vlan_listener->listener.list);
                 list_add(&(new_listener->list),
                          &(new_port_vlan_listener->listener.list));
 
-                __init_port_vlan_listener_counters(hw_synd, new_port_vlan_listener);
+                __sx_core_port_vlan_listener_add(hw_synd, new_port_vlan_listener, 0);
             } else { /**found_same_port_vlan_listener == 1*/
-                list_add(&(new_listener->list),
-                         &(port_vlan_listener->listener.list));
+                list_add_rcu(&(new_listener->list),
+                             &(port_vlan_listener->listener.list));
                 kfree(new_port_vlan_listener);
             }
         } else {
@@ -2302,19 +2636,13 @@ int sx_core_remove_synd(u8                          swid,
                 listener = list_entry(pos, struct listener_entry, list);
                 if (is_to_remove_listener(swid, type, is_default,
                                           critireas, context, listener, handler)) {
-                    list_del(pos);
-                    /* Listener was allocated as atomic memory
-                     * so it's OK to free it under spinlock */
-                    kfree(listener);
+                    __sx_core_listener_del(listener);
                     listener_removed = 1;
                     break;
                 }
             }
             if (list_empty(&(port_vlan_listener->listener.list))) {
-                list_del(port_vlan_pos);
-
-                __deinit_port_vlan_listener_counters(port_vlan_listener);
-                kfree(port_vlan_listener);
+                __sx_core_port_vlan_listener_del(port_vlan_listener);
             }
         }
     }
@@ -2822,7 +3150,7 @@ static int get_rp_vid_from_db(struct sx_dev *dev, struct completion_info *comp_i
     uint16_t        local = 0, phy_port_max = 0;
     uint16_t        port_lag_id = comp_info->sysport;
     uint8_t         is_lag = comp_info->is_lag;
-    unsigned long   flags;
+    unsigned        seq;
 
     *vlan_id = 0;
 
@@ -2836,22 +3164,24 @@ static int get_rp_vid_from_db(struct sx_dev *dev, struct completion_info *comp_i
         return -EINVAL;
     }
 
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
-    if (is_lag) {
-        *vlan_id = dev_priv->lag_rp_vid[port_lag_id];
-    } else {
-        local = dev_priv->system_to_local_db[port_lag_id];
-
-        if (local > phy_port_max) {
-            printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
-                   local, phy_port_max);
-            spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
-            return -EINVAL;
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if (is_lag) {
+            *vlan_id = dev_priv->lag_rp_vid[port_lag_id];
+        } else {
+            local = dev_priv->system_to_local_db[port_lag_id];
+            if (local <= phy_port_max) {
+                *vlan_id = dev_priv->local_rp_vid[local];
+            }
         }
-        *vlan_id = dev_priv->local_rp_vid[local];
+    } while (sx_db_read_retry(dev_priv, seq));
+
+    if (!is_lag && (local > phy_port_max)) {
+        printk(KERN_ERR PFX "Local %d is invalid. (MAX %d).\n",
+               local, phy_port_max);
+        return -EINVAL;
     }
 
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
     return 0;
 }
 
@@ -2863,33 +3193,21 @@ static int get_rp_vid_from_ci(struct sx_dev *dev, struct completion_info *comp_i
 
 static int get_swid_from_db(struct sx_dev *dev, struct completion_info *comp_info, u8 *swid)
 {
+    struct sx_priv     *dev_priv = sx_priv(dev);
     enum sx_packet_type pkt_type = comp_info->pkt_type;
     u8                  is_lag = comp_info->is_lag;
     u16                 sysport_lag_id = comp_info->sysport;
     u16                 lag_port_id = comp_info->lag_subport;
     u16                 system_port, local_port, ib_port;
-    unsigned long       flags;
-
-    spin_lock_irqsave(&sx_priv(dev)->db_lock, flags);
+    unsigned            seq;
 
     switch (pkt_type) {
     case PKT_TYPE_ETH:
     case PKT_TYPE_FCoETH:
-        if (is_lag) {
-            local_port = sx_priv(dev)->lag_member_to_local_db[sysport_lag_id][lag_port_id];
-        } else {
-            system_port = sysport_lag_id;
-            local_port = sx_priv(dev)->system_to_local_db[system_port];
-        }
-
-        break;
-
     case PKT_TYPE_IB_Raw: /* TODO: Extract qpn from IB Raw pkts */
     case PKT_TYPE_IB_non_Raw:
     case PKT_TYPE_FCoIB:
     case PKT_TYPE_ETHoIB:
-        ib_port = (sysport_lag_id >> 4) & 0x7f;
-        local_port = sx_priv(dev)->ib_to_local_db[ib_port];
         break;
 
     default:
@@ -2897,12 +3215,26 @@ static int get_swid_from_db(struct sx_dev *dev, struct completion_info *comp_inf
             printk(KERN_WARNING PFX "Received packet type is FC, "
                    "and therefore unsupported right now\n");
         }
-        spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
         return 0;
     }
 
-    *swid = sx_priv(dev)->local_to_swid_db[local_port];
-    spin_unlock_irqrestore(&sx_priv(dev)->db_lock, flags);
+    do {
+        seq = sx_db_read_begin(dev_priv);
+        if ((pkt_type == PKT_TYPE_ETH) || (pkt_type == PKT_TYPE_FCoETH)) {
+            if (is_lag) {
+                local_port = dev_priv->lag_member_to_local_db[sysport_lag_id][lag_port_id];
+            } else {
+                system_port = sysport_lag_id;
+                local_port = dev_priv->system_to_local_db[system_port];
+            }
+        } else {
+            ib_port = (sysport_lag_id >> 4) & 0x7f;
+            local_port = dev_priv->ib_to_local_db[ib_port];
+        }
+
+        *swid = dev_priv->local_to_swid_db[local_port];
+    } while (sx_db_read_retry(dev_priv, seq));
+
     return 0;
 }
 
@@ -3521,6 +3853,7 @@ static int sx_core_open(struct inode *inode, struct file *filp)
     atomic_set(&file->multi_packet_read_enable, false);
     atomic_set(&file->read_blocking_state, true);
     sema_init(&file->write_sem, SX_WRITE_LIMIT);
+    mutex_init(&file->rx_ring_mutex);
     file->owner = filp;
     filp->private_data = file; /* connect the fd with its resources */
 
@@ -3528,6 +3861,122 @@ static int sx_core_open(struct inode *inode, struct file *filp)
 }
 
 
+/**
+ * Send a single packet described by a ku_write struct (already copied from
+ * user space). Packets that go to an SDQ are added to the batch, the caller
+ * must ring the doorbells with sx_core_tx_batch_flush() once it is done.
+ *
+ * param[in] filp       - a pointer to the associated file
+ * param[in] write_data - the packet to send
+ * param[in] batch      - the TX batch the packet is added to
+ *
+ * returns: 0 success
+ *	    !0 error
+ */
+int sx_core_write_pkt(struct file *filp, struct ku_write *write_data, struct sx_tx_batch *batch)
+{
+    int             err = 0;
+    struct sk_buff *skb = NULL;
+    struct sx_dev  *dev = NULL;
+    struct sx_rsc  *rsc = filp->private_data;
+    int             i;
+
+    err = sx_dpt_get_sx_dev_by_id(write_data->meta.dev_id, &dev);
+    if (err) {
+        printk(KERN_WARNING PFX "sx_core_write: "
+               "Device doesn't exist. Aborting\n");
+        goto out;
+    }
+#if 0
+    if (dev && !dev->profile_set) {
+        printk(KERN_WARNING PFX "sx_core_write() cannot "
+               "execute because the profile is not "
+               "set\n");
+        err = -ENOEXEC;
+        goto out;
+    }
+#endif
+
+    if (!is_sgmii_device(write_data->meta.dev_id)) {
+        err = check_valid_meta(dev, &write_data->meta);
+        if (err) {
+            printk(KERN_WARNING PFX "Cannot execute because meta "
+                   "is invalid\n");
+            goto out;
+        }
+    }
+
+    if (write_data->meta.type == SX_PKT_TYPE_LOOPBACK_CTL) {
+        err = sx_send_loopback(dev, write_data, filp);
+        if (err) {
+            printk(KERN_WARNING PFX "sx_core_write: "
+                   "Failed sending loopback packet\n");
+            goto out;
+        }
+
+        if (dev) {
+            loopback_packets_counter++;
+            dev->loopback_packets_counter++;
+        } else if (sx_glb.tmp_dev_ptr) {
+            sx_glb.tmp_dev_ptr->loopback_packets_counter++;
+        }
+        goto out;
+    }
+
+    /* according to the PRM, emads should get "any ethernet swid" */
+    if ((write_data->meta.type == SX_PKT_TYPE_DROUTE_EMAD_CTL) ||
+        (write_data->meta.type == SX_PKT_TYPE_EMAD_CTL)) {
+        if (!dev || !dev->profile_set || is_sgmii_device(write_data->meta.dev_id)) {
+            write_data->meta.swid = 0;
+        } else {
+            for (i = 0; i < NUMBER_OF_SWIDS; i++) {
+                if (dev->profile.swid_type[i] ==
+                    SX_KU_L2_TYPE_ETH) {
+                    write_data->meta.swid = i;
+                    break;
+                }
+            }
+
+            if (i == NUMBER_OF_SWIDS) { /* no ETH swids found */
+                printk(KERN_WARNING PFX "sx_core_write: Err: "
+                       "trying to send an emad from "
+                       "an IB only system\n");
+                err = -EFAULT;
+                write_data->meta.swid = 0;
+                goto out;
+            }
+        }
+    }
+
+    err = copy_buff_to_skb(&skb, write_data, true);
+    if (err) {
+        goto out;
+    }
+
+    memcpy(skb->cb, &rsc, sizeof(rsc));
+    skb->destructor = sx_skb_destructor;
+#ifndef NO_PCI
+    get_file(rsc->owner);
+    if (down_trylock(&rsc->write_sem)) {
+        /* the semaphore is released on TX completion, which needs the doorbell */
+        sx_core_tx_batch_flush(batch);
+        down(&rsc->write_sem);
+    }
+#endif
+    err = sx_core_post_send_batch(dev, skb, &write_data->meta, batch);
+    if (err) {
+        printk(KERN_WARNING PFX "sx_core_write: got error"
+               " from sx_core_post_send\n");
+        /* we don't free the packet because sx_core_post_send free
+         * the packet in case of an error */
+        goto out;
+    }
+
+out:
+    return err;
+}
+
+
 /**
  * Send packets - EMADs, Ethernet packets. We copy the packets
  * from user space, as is, and post them to the HW SDQ. The
@@ -3535,7 +3984,8 @@ static int sx_core_open(struct inode *inode, struct file *filp)
  * according to the profile. Buf is formatted according to
  * ku_write struct. Count is the size of ku_write buffer
  * (without the packets data). We support sending multiple
- * packets in a single operation.
+ * packets in a single operation, the doorbell of each SDQ is
+ * rung once for all of them.
  *
  * param[in] filp  - a pointer to the associated file
  * param[in] buf   - ku_write struct/s
@@ -3548,130 +3998,53 @@ static int sx_core_open(struct inode *inode, struct file *filp)
  */
 static ssize_t sx_core_write(struct file *filp, const char __user *buf, size_t count, loff_t *pos)
 {
-    struct ku_write write_data;
-    int             err = 0;
-    int             user_buffer_copied_size = 0;
-    struct sk_buff *skb = NULL;
-    struct sx_dev  *dev = NULL;
-    struct sx_rsc  *rsc = filp->private_data;
-    int             i;
+    struct ku_write    write_data;
+    struct sx_tx_batch batch;
+    int                err = 0;
+    int                user_buffer_copied_size = 0;
 
     if ((count == 0) || (buf == NULL)) {
         err = -EINVAL;
         goto out;
     }
 
+    sx_core_tx_batch_init(&batch);
+
     while (user_buffer_copied_size + sizeof(write_data) <= count) {
         err = copy_from_user((void*)&write_data,
                              ((void*)buf) + user_buffer_copied_size,
                              sizeof(write_data));
         if (err) {
-            goto out;
+            goto out_flush;
         }
 
         if (((write_data.vec_entries != 0) && (write_data.iov == NULL)) ||
             ((write_data.vec_entries == 0) && (write_data.iov != NULL))) {
             err = -EINVAL;
-            goto out;
+            goto out_flush;
         }
 
         if (write_data.vec_entries == 0) {
             break;
         }
 
-        err = sx_dpt_get_sx_dev_by_id(write_data.meta.dev_id, &dev);
+        err = sx_core_write_pkt(filp, &write_data, &batch);
         if (err) {
-            printk(KERN_WARNING PFX "sx_core_write: "
-                   "Device doesn't exist. Aborting\n");
-            goto out;
-        }
-#if 0
-        if (dev && !dev->profile_set) {
-            printk(KERN_WARNING PFX "sx_core_write() cannot "
-                   "execute because the profile is not "
-                   "set\n");
-            err = -ENOEXEC;
-            goto out;
-        }
-#endif
-
-        if (!is_sgmii_device(write_data.meta.dev_id)) {
-            err = check_valid_meta(dev, &write_data.meta);
-            if (err) {
-                printk(KERN_WARNING PFX "Cannot execute because meta "
-                       "is invalid\n");
-                goto out;
-            }
-        }
-
-        if (write_data.meta.type == SX_PKT_TYPE_LOOPBACK_CTL) {
-            err = sx_send_loopback(dev, &write_data, filp);
-            if (err) {
-                printk(KERN_WARNING PFX "sx_core_write: "
-                       "Failed sending loopback packet\n");
-                goto out;
-            }
-
-            if (dev) {
-                loopback_packets_counter++;
-                dev->loopback_packets_counter++;
-            } else if (sx_glb.tmp_dev_ptr) {
-                sx_glb.tmp_dev_ptr->loopback_packets_counter++;
-            }
-            user_buffer_copied_size += sizeof(write_data);
-            continue;
-        }
-
-        /* according to the PRM, emads should get "any ethernet swid" */
-        if ((write_data.meta.type == SX_PKT_TYPE_DROUTE_EMAD_CTL) ||
-            (write_data.meta.type == SX_PKT_TYPE_EMAD_CTL)) {
-            if (!dev || !dev->profile_set || is_sgmii_device(write_data.meta.dev_id)) {
-                write_data.meta.swid = 0;
-            } else {
-                for (i = 0; i < NUMBER_OF_SWIDS; i++) {
-                    if (dev->profile.swid_type[i] ==
-                        SX_KU_L2_TYPE_ETH) {
-                        write_data.meta.swid = i;
-                        break;
-                    }
-                }
-
-                if (i == NUMBER_OF_SWIDS) { /* no ETH swids found */
-                    printk(KERN_WARNING PFX "sx_core_write: Err: "
-                           "trying to send an emad from "
-                           "an IB only system\n");
-                    err = -EFAULT;
-                    write_data.meta.swid = 0;
-                    goto out;
-                }
-            }
+            goto out_flush;
         }
 
         user_buffer_copied_size += sizeof(write_data);
-        err = copy_buff_to_skb(&skb, &write_data, true);
-        if (err) {
-            goto out;
-        }
-
-        memcpy(skb->cb, &rsc, sizeof(rsc));
-        skb->destructor = sx_skb_destructor;
-#ifndef NO_PCI
-        get_file(rsc->owner);
-        down(&rsc->write_sem);
-#endif
-        err = sx_core_post_send(dev, skb, &write_data.meta);
-        if (err) {
-            printk(KERN_WARNING PFX "sx_core_write: got error"
-                   " from sx_core_post_send\n");
-            /* we don't free the packet because sx_core_post_send free
-             * the packet in case of an error */
-            goto out;
-        }
     }
 
+    sx_core_tx_batch_flush(&batch);
+
     SX_CORE_UNUSED_PARAM(pos);
     return user_buffer_copied_size;
 
+out_flush:
+    /* the packets sent before the failure are already on the SDQs */
+    sx_core_tx_batch_flush(&batch);
+
 out:
 #ifdef SX_DEBUG
     printk(KERN_DEBUG PFX "sx_core_write: return "
@@ -3834,6 +4207,8 @@ int sx_core_ioctl_monitor_rdq_stat_get(struct file *filp, struct sx_dev *dev, un
     ku.discarded_pkts_total_num = monitor_dq->mon_rx_count - monitor_dq->mon_rx_start_total +
                                   monitor_dq->sw_dup_evlist_total_cnt;
 
+    ku.drain_rate = sx_monitor_rdq_drain_rate(monitor_dq);
+
     if (ku.clear_after_read == true) {
         monitor_dq->mon_rx_start_total = monitor_dq->mon_rx_count;
     }
@@ -3874,6 +4249,10 @@ static unsigned int sx_core_poll(struct file *filp, poll_table *wait)
     if (!list_empty(&file->evlist.list)) {
         mask |= POLLIN | POLLRDNORM;  /* readable */
     }
+    if (file->rx_ring &&
+        (file->rx_ring->head != *(volatile u32*)&file->rx_ring->hdr->tail)) {
+        mask |= POLLIN | POLLRDNORM;  /* RX ring is not empty */
+    }
     if (file->evlist_size < SX_EVENT_LIST_SIZE) {
         mask |= POLLOUT | POLLWRNORM; /* writable */
     }
@@ -3882,6 +4261,41 @@ static unsigned int sx_core_poll(struct file *filp, poll_table *wait)
     return mask;
 }
 
+
+/**
+ * Map the RX ring of the file (set with CTRL_CMD_SET_RX_RING) to user space.
+ * The whole ring, header included, is mapped from offset 0.
+ *
+ * param[in] filp - a pointer to the associated file.
+ * param[in] vma  - the user space area to map the ring to.
+ *
+ * returns: 0 success
+ *        !0 error
+ */
+static int sx_core_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct sx_rsc *file = filp->private_data;
+    int            err = 0;
+
+    mutex_lock(&file->rx_ring_mutex);
+
+    if (!file->rx_ring) {
+        err = -ENXIO;
+        goto out;
+    }
+
+    if ((vma->vm_pgoff != 0) || (vma->vm_end - vma->vm_start > file->rx_ring->size)) {
+        err = -EINVAL;
+        goto out;
+    }
+
+    err = remap_vmalloc_range(vma, file->rx_ring->hdr, 0);
+
+out:
+    mutex_unlock(&file->rx_ring_mutex);
+    return err;
+}
+
 static int sx_core_close(struct inode *inode, struct file *filp)
 {
     struct event_data               *edata;
@@ -3913,20 +4327,21 @@ static int sx_core_close(struct inode *inode, struct file *filp)
                     listener = list_entry(pos,
                                           struct listener_entry, list);
                     if ((struct file *)listener->context == filp) {
-                        list_del(pos);
-                        kfree(listener);
+                        __sx_core_listener_del(listener);
                     }
                 }
                 if (list_empty(&(port_vlan_listener->listener.list))) {
-                    list_del(port_vlan_pos);
-                    __deinit_port_vlan_listener_counters(port_vlan_listener);
-                    kfree(port_vlan_listener);
+                    __sx_core_port_vlan_listener_del(port_vlan_listener);
                 }
             }
         }
     }
 
     spin_unlock_irqrestore(&sx_glb.listeners_lock, flags);
+
+    /* dispatch_pkt() may still run a removed listener of this file on another CPU */
+    synchronize_rcu();
+
     spin_lock_irqsave(&file->lock, flags);
     list_for_each_safe(pos, q, &file->evlist.list) {
         edata = list_entry(pos, struct event_data, list);
@@ -3937,6 +4352,10 @@ static int sx_core_close(struct inode *inode, struct file *filp)
 
     spin_unlock_irqrestore(&file->lock, flags);
 
+    /* no listener of this file is left, so the RX ring is not used anymore */
+    sx_rx_ring_free(file->rx_ring);
+    file->rx_ring = NULL;
+
     if (sx_glb.pci_drivers_in_use & PCI_DRIVER_F_SX_DRIVER) {
         spin_lock_irqsave(&sx_priv(dev)->rdq_table.lock, flags);
         for (i = 0; i < dev->dev_cap.max_num_rdqs; ++i) {
@@ -3976,14 +4395,11 @@ int sx_core_flush_synd_by_context(void * context)
                     listener = list_entry(pos,
                                           struct listener_entry, list);
                     if (listener->context == context) {
-                        list_del(pos);
-                        kfree(listener);
+                        __sx_core_listener_del(listener);
                     }
                 }
                 if (list_empty(&(port_vlan_listener->listener.list))) {
-                    list_del(port_vlan_pos);
-                    __deinit_port_vlan_listener_counters(port_vlan_listener);
-                    kfree(port_vlan_listener);
+                    __sx_core_port_vlan_listener_del(port_vlan_listener);
                 }
             }
         }
@@ -3991,6 +4407,9 @@ int sx_core_flush_synd_by_context(void * context)
 
     spin_unlock_irqrestore(&sx_glb.listeners_lock, flags);
 
+    /* make sure dispatch_pkt() no longer uses the removed listeners before the caller releases the context */
+    synchronize_rcu();
+
     return 0;
 }
 EXPORT_SYMBOL(sx_core_flush_synd_by_context);
@@ -4016,14 +4435,11 @@ int sx_core_flush_synd_by_handler(cq_handler handler)
                     listener = list_entry(pos,
                                           struct listener_entry, list);
                     if (listener->handler == handler) {
-                        list_del(pos);
-                        kfree(listener);
+                        __sx_core_listener_del(listener);
                     }
                 }
                 if (list_empty(&(port_vlan_listener->listener.list))) {
-                    list_del(port_vlan_pos);
-                    __deinit_port_vlan_listener_counters(port_vlan_listener);
-                    kfree(port_vlan_listener);
+                    __sx_core_port_vlan_listener_del(port_vlan_listener);
                 }
             }
         }
@@ -4031,6 +4447,9 @@ int sx_core_flush_synd_by_handler(cq_handler handler)
 
     spin_unlock_irqrestore(&sx_glb.listeners_lock, flags);
 
+    /* make sure dispatch_pkt() no longer uses the removed listeners before the caller releases the context */
+    synchronize_rcu();
+
     return 0;
 }
 EXPORT_SYMBOL(sx_core_flush_synd_by_handler);
@@ -4049,6 +4468,7 @@ static const struct file_operations sx_core_fops = {
     .unlocked_ioctl = sx_core_ioctl,
     .compat_ioctl = sx_core_ioctl,
     .poll = sx_core_poll,
+    .mmap = sx_core_mmap,
     .release = sx_core_close
 };
 
@@ -4626,6 +5046,18 @@ int sx_core_init_one(struct sx_priv **sx_priv)
     memset(priv, 0, sizeof *priv);
     dev = &priv->dev;
 
+    err = sx_stats_pcpu_init(&dev->stats);
+    if (err) {
+        printk(KERN_ERR PFX "Device stats alloc failed, aborting.\n");
+        goto out_free_priv;
+    }
+
+    err = sx_trap_filter_init(priv);
+    if (err) {
+        printk(KERN_ERR PFX "Trap filter index alloc failed, aborting.\n");
+        goto out_free_priv;
+    }
+
     /* default pvid for all ports is 1 */
     for (i = 0; i < MAX_SYSPORT_NUM; i++) {
         if (i < MAX_LAG_NUM) {
@@ -4672,6 +5104,7 @@ int sx_core_init_one(struct sx_priv **sx_priv)
     dev->dev_sw_rst_flow = 0;
     spin_lock_init(&priv->ctx_lock);
     spin_lock_init(&priv->db_lock);
+    seqcount_init(&priv->db_seq);
     INIT_LIST_HEAD(&priv->ctx_list);
     INIT_LIST_HEAD(&priv->dev_list);
     atomic_set(&priv->cq_backup_polling_refcnt, 0);
@@ -4696,7 +5129,7 @@ int sx_core_init_one(struct sx_priv **sx_priv)
         sx_err(dev, "Failed to register the device, aborting.\n");
         goto catas_stop;
     }
-    memset(&dev->stats, 0, sizeof(dev->stats));
+    sx_stats_pcpu_clear(&dev->stats);
 
 #ifdef NO_PCI
     err = sx_setup_sx(dev);
@@ -4726,6 +5159,8 @@ catas_stop:
     sx_core_catas_cleanup(dev);
 
 out_free_priv:
+    sx_trap_filter_deinit(priv);
+    sx_stats_pcpu_deinit(&dev->stats);
     vfree(priv);
 
 out:
@@ -4767,6 +5202,8 @@ void sx_core_remove_one(struct sx_priv *priv)
     sx_dpt_remove_dev(dev->device_id, 1);
 
     sx_core_dev_deinit_switchx_cb(dev);
+    sx_trap_filter_deinit(priv);
+    sx_stats_pcpu_deinit(&dev->stats);
     vfree(priv);
 }
 
@@ -4907,7 +5344,7 @@ void sx_core_clear_internal_data(void)
     }
 
     /* clear global stats */
-    memset(&sx_glb.stats, 0, sizeof(sx_glb.stats));
+    sx_stats_pcpu_clear(&sx_glb.stats);
 
     /* kernel db is cleared in sx_core_remove_one_pci */
 }
@@ -5151,6 +5588,12 @@ static int __init sx_core_init(void)
 
     memset(&sx_glb, 0, sizeof(sx_glb));
 
+    ret = sx_stats_pcpu_init(&sx_glb.stats);
+    if (ret) {
+        printk(KERN_ERR PFX "Couldn't allocate global stats. Aborting...\n");
+        return ret;
+    }
+
     sx_core_skb_hook_init();
 
 #ifndef NO_PCI
@@ -5163,6 +5606,7 @@ static int __init sx_core_init(void)
     sx_dbg_dump_proc_fs_init();
 
     sx_dpt_init();
+    sx_emad_init();
 
     init_rwsem(&sx_glb.pci_restart_lock);
     spin_lock_init(&sx_glb.pci_devs_lock);
@@ -5172,6 +5616,7 @@ static int __init sx_core_init(void)
     for (i = 0; i < NUM_HW_SYNDROMES + 1; i++) {
         INIT_LIST_HEAD(&sx_glb.listeners_db[i].list);
     }
+    hash_init(sx_glb.listeners_hash);
 
     char_dev = MKDEV(SX_MAJOR, SX_BASE_MINOR);
     ret = register_chrdev_region(char_dev, SX_MAX_DEVICES,
@@ -5257,8 +5702,10 @@ out_cdev:
     unregister_chrdev_region(char_dev, SX_MAX_DEVICES);
 
 out_close_proc:
+    sx_emad_deinit();
     sx_dbg_dump_proc_fs_deinit();
     sx_core_close_proc_fs();
+    sx_stats_pcpu_deinit(&sx_glb.stats);
 
     return ret;
 }
@@ -5283,17 +5730,16 @@ static void sx_core_listeners_cleanup(void)
                 port_vlan_listener = list_entry(port_vlan_pos, struct listener_port_vlan_entry, list);
                 list_for_each_safe(pos, q, &(port_vlan_listener->listener.list)) {
                     listener = list_entry(pos, struct listener_entry, list);
-                    list_del(pos);
-                    kfree(listener);
+                    __sx_core_listener_del(listener);
                 }
-                list_del(port_vlan_pos);
-
-                __deinit_port_vlan_listener_counters(port_vlan_listener);
-                kfree(port_vlan_listener);
+                __sx_core_port_vlan_listener_del(port_vlan_listener);
             }
         }
     }
     spin_unlock_irqrestore(&sx_glb.listeners_lock, flags);
+
+    /* wait for the pending kfree_rcu() of the removed listeners */
+    rcu_barrier();
 }
 
 static void __exit sx_core_cleanup(void)
@@ -5324,8 +5770,10 @@ static void __exit sx_core_cleanup(void)
 
     sx_core_listeners_cleanup();
     sx_core_counters_deinit();
+    sx_emad_deinit();
     sx_dbg_dump_proc_fs_deinit();
     sx_core_close_proc_fs();
+    sx_stats_pcpu_deinit(&sx_glb.stats);
 }
 
 /************************************************
@@ -38,6 +38,7 @@
 #include <linux/mlx_sx/kernel_user.h>
 #include "sx.h"
 #include "alloc.h"
+#include "dq.h"
 #include "sx_dbg_dump_proc.h"
 
 /************************************************
@@ -502,7 +503,7 @@ static void print_listener(struct seq_file                 *m,
                reg_key_name,
                uc_name,
                type_name,
-               listener->rx_pkts);
+               (u64)atomic64_read(&listener->rx_pkts));
 }
 
 static int sx_dbg_trap_reg_dump_proc_show(struct seq_file *m, void *v)
@@ -556,7 +557,7 @@ static int sx_dbg_unconsumed_pkt_dump_proc_show(struct seq_file *m, void *v)
     for (synd = 0; synd < NUM_HW_SYNDROMES + 1; synd++) {
         total_cnt = 0;
         for (pkt_ind = 0; pkt_ind < PKT_TYPE_NUM; pkt_ind++) {
-            total_cnt = total_cnt + sx_glb.stats.rx_unconsumed_by_synd[synd][pkt_ind];
+            total_cnt = total_cnt + SX_STATS_READ(&sx_glb.stats, rx_unconsumed_by_synd[synd][pkt_ind]);
         }
         if (total_cnt > 0) {
             seq_printf(m, "%-40s|%-8d| %llu\n", trap_id_str(synd), synd, total_cnt);
@@ -834,6 +835,166 @@ int sx_dbg_dump_monitor_rdq_show(struct seq_file *m, void *v)
     return 0;
 }
 
+static int sx_dbg_rdq_pool_dump_proc_show(struct seq_file *m, void *v)
+{
+    int                 rdq_n;
+    struct sx_dq_table *rdq_table = NULL;
+    struct sx_dq       *rdq;
+    unsigned long       flags;
+    struct sx_dev      *dev = sx_glb.sx_dpt.dpt_info[DEFAULT_DEVICE_ID].sx_pcie_info.sx_dev;
+
+    if (!dev) {
+        return -ENODEV;
+    }
+
+    rdq_table = &sx_priv(dev)->rdq_table;
+
+    print_header(m, "RDQ buffer pool dump");
+
+    seq_printf(m, "%-6s| %-8s| %-8s| %-14s| %-14s| %-14s| %-14s\n",
+               "RDQ", "size", "count", "hit", "miss", "recycled", "busy");
+    seq_printf(m, "--------------------------------------------"
+               "--------------------------------------------\n");
+
+    spin_lock_irqsave(&rdq_table->lock, flags);
+    for (rdq_n = 0; rdq_n < dev->dev_cap.max_num_rdqs; rdq_n++) {
+        rdq = rdq_table->dq[rdq_n];
+        if (!rdq || !sx_core_rdq_pool_is_active(rdq)) {
+            continue;
+        }
+
+        seq_printf(m, "%-6d| %-8u| %-8u| %-14llu| %-14llu| %-14llu| %-14llu\n",
+                   rdq_n,
+                   rdq->rx_pool.size,
+                   rdq->rx_pool.count,
+                   rdq->rx_pool.hit,
+                   rdq->rx_pool.miss,
+                   rdq->rx_pool.recycled,
+                   rdq->rx_pool.busy);
+    }
+    spin_unlock_irqrestore(&rdq_table->lock, flags);
+
+    return 0;
+}
+
+static int sx_dbg_cmd_mailbox_pool_dump_proc_show(struct seq_file *m, void *v)
+{
+    struct sx_cmd_mailbox_pool *mb_pool;
+    unsigned long               flags;
+    struct sx_dev              *dev = sx_glb.sx_dpt.dpt_info[DEFAULT_DEVICE_ID].sx_pcie_info.sx_dev;
+
+    if (!dev) {
+        return -ENODEV;
+    }
+
+    mb_pool = &sx_priv(dev)->cmd.mailbox_pool;
+
+    print_header(m, "Command mailbox pool dump");
+
+    seq_printf(m, "%-8s| %-8s| %-8s| %-11s| %-14s| %-14s\n",
+               "size", "free", "in use", "max in use", "hit", "miss");
+    seq_printf(m, "--------------------------------------------"
+               "--------------------------------------\n");
+
+    spin_lock_irqsave(&mb_pool->lock, flags);
+    seq_printf(m, "%-8u| %-8u| %-8u| %-11u| %-14llu| %-14llu\n",
+               mb_pool->size,
+               mb_pool->free_count,
+               mb_pool->size - mb_pool->free_count,
+               mb_pool->max_in_use,
+               mb_pool->hit,
+               mb_pool->miss);
+    spin_unlock_irqrestore(&mb_pool->lock, flags);
+
+    return 0;
+}
+
+static int sx_dbg_i2c_cmd_stats_dump_proc_show(struct seq_file *m, void *v)
+{
+    struct sx_cmd_i2c_op_stats stats[SX_CMD_I2C_OP_STATS];
+    struct sx_cmd             *cmd;
+    struct sx_dev             *dev = sx_glb.sx_dpt.dpt_info[DEFAULT_DEVICE_ID].sx_pcie_info.sx_dev;
+    int                        i;
+
+    if (!dev) {
+        dev = sx_glb.tmp_dev_ptr;
+        if (!dev) {
+            return -ENODEV;
+        }
+    }
+
+    cmd = &sx_priv(dev)->cmd;
+
+    spin_lock(&cmd->i2c_stats_lock);
+    memcpy(stats, cmd->i2c_op_stats, sizeof(stats));
+    spin_unlock(&cmd->i2c_stats_lock);
+
+    print_header(m, "I2C command stats dump");
+
+    seq_printf(m, "%-8s| %-10s| %-8s| %-12s| %-12s| %-12s\n",
+               "opcode", "count", "errors", "avg polls", "avg usec", "max usec");
+    seq_printf(m, "--------------------------------------------"
+               "-------------------------\n");
+
+    for (i = 0; i < SX_CMD_I2C_OP_STATS; i++) {
+        if (stats[i].count == 0) {
+            continue;
+        }
+
+        seq_printf(m, "0x%-6x| %-10llu| %-8llu| %-12llu| %-12llu| %-12llu\n",
+                   stats[i].op,
+                   stats[i].count,
+                   stats[i].errors,
+                   div64_u64(stats[i].polls, stats[i].count),
+                   div64_u64(stats[i].total_usec, stats[i].count),
+                   stats[i].max_usec);
+    }
+
+    return 0;
+}
+
+static int sx_dbg_trap_filter_dump_proc_show(struct seq_file *m, void *v)
+{
+    int                    synd, id;
+    struct sx_trap_filter *filter;
+    struct sx_dev         *dev = sx_glb.sx_dpt.dpt_info[DEFAULT_DEVICE_ID].sx_pcie_info.sx_dev;
+
+    if (!dev) {
+        return -ENODEV;
+    }
+
+    print_header(m, "Trap port filter dump");
+
+    seq_printf(m, "filtered port packets: %llu\n", dev->filtered_port_packets_counter);
+    seq_printf(m, "filtered LAG packets:  %llu\n\n", dev->filtered_lag_packets_counter);
+
+    seq_printf(m, "%-40s|%-8s|%-9s|%-9s\n", "Trap Name", "Trap ID", "Sysports", "LAGs");
+    seq_printf(m, "---------------------------------------"
+               "---------------------------------------\n");
+
+    rcu_read_lock();
+    for (synd = 0; synd < NUM_HW_SYNDROMES; synd++) {
+        filter = rcu_dereference(sx_priv(dev)->trap_filter->synd[synd]);
+        if (!filter) {
+            continue;
+        }
+
+        seq_printf(m, "%-40s|%-8d|%-9u|%-9u\n", trap_id_str(synd), synd,
+                   filter->sysport_cnt, filter->lag_cnt);
+
+        for_each_set_bit(id, filter->sysport_bitmap, MAX_SYSPORT_NUM) {
+            seq_printf(m, "    sysport 0x%x\n", id);
+        }
+
+        for_each_set_bit(id, filter->lag_bitmap, SXD_LAG_ID_MAX + 1) {
+            seq_printf(m, "    LAG %d\n", id);
+        }
+    }
+    rcu_read_unlock();
+
+    return 0;
+}
+
 int sx_dbg_dump_fid_to_hwfid_show(struct seq_file *m, void *v)
 {
     u16             i = 0;
@@ -1042,6 +1203,10 @@ int __init sx_dbg_dump_proc_fs_init(void)
     sx_dbg_dump_proc_fs_register("tele_thrs_dump", sx_dbg_tele_thrs_dump_proc_show, NULL);
     sx_dbg_dump_proc_fs_register("ptp_dump", sx_dbg_ptp_dump_proc_show, NULL);
     sx_dbg_dump_proc_fs_register("monitor_rdq_dump", sx_dbg_dump_monitor_rdq_show, NULL);
+    sx_dbg_dump_proc_fs_register("rdq_pool_dump", sx_dbg_rdq_pool_dump_proc_show, NULL);
+    sx_dbg_dump_proc_fs_register("cmd_mailbox_pool_dump", sx_dbg_cmd_mailbox_pool_dump_proc_show, NULL);
+    sx_dbg_dump_proc_fs_register("i2c_cmd_stats_dump", sx_dbg_i2c_cmd_stats_dump_proc_show, NULL);
+    sx_dbg_dump_proc_fs_register("trap_filter_dump", sx_dbg_trap_filter_dump_proc_show, NULL);
     sx_dbg_dump_proc_fs_register("fid_to_hwfid_dump", sx_dbg_dump_fid_to_hwfid_show, NULL);
     sx_dbg_dump_proc_fs_register("rif_to_hwfid_dump", sx_dbg_dump_rif_to_hwfid_show, NULL);
 
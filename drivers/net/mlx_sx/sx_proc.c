@@ -1818,6 +1818,18 @@ void __sx_proc_dump_rdq(struct sx_dev *dev)
                    atomic_read(&rdq_table->dq[i]->cq->refcount),
                    (sx_bitmap_test(&sx_priv(dev)->cq_table.ts_bitmap, cqn) ? 1 : 0),
                    (int)rdq_table->dq[i]->is_monitor);
+            printk(KERN_INFO "[rdq %d]: moder max_usec:%u, cur_usec:%u, rate:%u, "
+                   "arms:%llu, deferred_arms:%llu, busy_poll_usec:%u, "
+                   "busy_poll_hits:%llu, busy_poll_misses:%llu\n",
+                   i,
+                   rdq_table->dq[i]->cq->moder.max_usec,
+                   rdq_table->dq[i]->cq->moder.cur_usec,
+                   rdq_table->dq[i]->cq->moder.rate,
+                   rdq_table->dq[i]->cq->moder.arms,
+                   rdq_table->dq[i]->cq->moder.deferred_arms,
+                   rdq_table->dq[i]->cq->moder.busy_poll_usec,
+                   rdq_table->dq[i]->cq->moder.busy_poll_hits,
+                   rdq_table->dq[i]->cq->moder.busy_poll_misses);
         }
     }
 }
@@ -1985,30 +1997,30 @@ void __dump_stats(struct sx_dev* sx_dev)
         }
 
         for (pkt_type = 0; pkt_type < PKT_TYPE_NUM; pkt_type++) {
-            if (0 != sx_dev->stats.rx_by_pkt_type[swid][pkt_type]) {
+            if (0 != SX_STATS_READ(&sx_dev->stats, rx_by_pkt_type[swid][pkt_type])) {
                 printk("rx pkt of type [%s (%d)]: %llu \n",
                        sx_cqe_packet_type_str[pkt_type], pkt_type,
-                       sx_dev->stats.rx_by_pkt_type[swid][pkt_type]);
+                       SX_STATS_READ(&sx_dev->stats, rx_by_pkt_type[swid][pkt_type]));
             }
 
-            if (0 != sx_dev->stats.tx_by_pkt_type[swid][pkt_type]) {
+            if (0 != SX_STATS_READ(&sx_dev->stats, tx_by_pkt_type[swid][pkt_type])) {
                 printk("tx pkt of type [%s (%d)]: %llu (%llu bytes)\n",
                        ku_pkt_type_str[pkt_type], pkt_type,
-                       sx_dev->stats.tx_by_pkt_type[swid][pkt_type],
-                       sx_dev->stats.tx_by_pkt_type_bytes[swid][pkt_type]);
+                       SX_STATS_READ(&sx_dev->stats, tx_by_pkt_type[swid][pkt_type]),
+                       SX_STATS_READ(&sx_dev->stats, tx_by_pkt_type_bytes[swid][pkt_type]));
             }
         }     /* for (pkt_type=0; pkt_type<PKT_TYPE_NUM; pkt_type++) { */
 
         for (synd = 0; synd < NUM_HW_SYNDROMES; synd++) {
-            if (0 != sx_dev->stats.rx_by_synd[swid][synd]) {
+            if (0 != SX_STATS_READ(&sx_dev->stats, rx_by_synd[swid][synd])) {
                 printk("rx pkt on synd [%d]: %llu (%llu bytes)\n", synd,
-                       sx_dev->stats.rx_by_synd[swid][synd],
-                       sx_dev->stats.rx_by_synd_bytes[swid][synd]);
+                       SX_STATS_READ(&sx_dev->stats, rx_by_synd[swid][synd]),
+                       SX_STATS_READ(&sx_dev->stats, rx_by_synd_bytes[swid][synd]));
             }
 
-            if (0 != sx_dev->stats.rx_eventlist_by_synd[synd]) {
+            if (0 != SX_STATS_READ(&sx_dev->stats, rx_eventlist_by_synd[synd])) {
                 printk("events on synd [%d]: %llu\n", synd,
-                       sx_dev->stats.rx_eventlist_by_synd[synd]);
+                       SX_STATS_READ(&sx_dev->stats, rx_eventlist_by_synd[synd]));
             }
         }     /* for (synd=0; synd<PKT_TYPE_NUM; synd++) { */
     }
@@ -2016,19 +2028,19 @@ void __dump_stats(struct sx_dev* sx_dev)
     printk("=========================\n");
     for (synd = 0; synd < NUM_HW_SYNDROMES; synd++) {
         for (pkt_type = 0; pkt_type < PKT_TYPE_NUM; pkt_type++) {
-            if (sx_dev->stats.rx_unconsumed_by_synd[synd][pkt_type] != 0) {
+            if (SX_STATS_READ(&sx_dev->stats, rx_unconsumed_by_synd[synd][pkt_type]) != 0) {
                 printk("rx unconsumed on synd [%d] type [%s]: %llu \n",
                        synd, sx_cqe_packet_type_str[pkt_type],
-                       sx_dev->stats.rx_unconsumed_by_synd[synd][pkt_type]);
+                       SX_STATS_READ(&sx_dev->stats, rx_unconsumed_by_synd[synd][pkt_type]));
             }
         }
     }
     /* rx_eventlist_drops_by_synd */
     printk("=========================\n");
     for (synd = 0; synd < NUM_HW_SYNDROMES; synd++) {
-        if (sx_dev->stats.rx_eventlist_drops_by_synd[synd] != 0) {
+        if (SX_STATS_READ(&sx_dev->stats, rx_eventlist_drops_by_synd[synd]) != 0) {
             printk("rx event list drops on synd [%d]: %llu \n",
-                   synd, sx_dev->stats.rx_eventlist_drops_by_synd[synd]);
+                   synd, SX_STATS_READ(&sx_dev->stats, rx_eventlist_drops_by_synd[synd]));
         }
     }
 
@@ -58,6 +58,11 @@ enum mlxfw_fsm_state_err {
     MLXFW_FSM_STATE_ERR_MAX,
 };
 struct mlxfw_dev;
+struct mlxfw_fsm_block {
+    u8 *data;
+    u16 size;
+    u32 offset;
+};
 struct mlxfw_dev_ops {
     int (*component_query)(struct mlxfw_dev *mlxfw_dev, u16 component_index,
                            u32 *p_max_size, u8 *p_align_bits,
@@ -71,6 +76,10 @@ struct mlxfw_dev_ops {
     int (*fsm_block_download)(struct mlxfw_dev *mlxfw_dev, u32 fwhandle,
                               u8 *data, u16 size, u32 offset);
 
+    /* optional - downloads several blocks with their writes in flight together */
+    int (*fsm_block_download_batch)(struct mlxfw_dev *mlxfw_dev, u32 fwhandle,
+                                    struct mlxfw_fsm_block *blocks, int count);
+
     int (*fsm_component_verify)(struct mlxfw_dev *mlxfw_dev, u32 fwhandle,
                                 u16 component_index);
 
@@ -35,6 +35,8 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include "mlxfw.h"
 #include "mlxfw_mfa2.h"
@@ -44,6 +46,8 @@
 #define MLXFW_FSM_STATE_WAIT_ROUNDS \
     (MLXFW_FSM_STATE_WAIT_TIMEOUT_MS / MLXFW_FSM_STATE_WAIT_CYCLE_MS)
 #define MLXFW_FSM_MAX_COMPONENT_SIZE (10 * (1 << 20))
+#define MLXFW_FSM_BLOCK_BATCH        32
+#define MLXFW_FSM_PROGRESS_STEP      10 /* percent */
 
 static const char * const mlxfw_fsm_state_err_str[] = {
     [MLXFW_FSM_STATE_ERR_ERROR] =
@@ -102,14 +106,72 @@ retry:
 #define MLXFW_ALIGN_UP(x, align_bits) \
     MLXFW_ALIGN_DOWN((x) + ((1 << (align_bits)) - 1), (align_bits))
 
+static void mlxfw_download_progress(struct mlxfw_mfa2_component *comp, u32 done, ktime_t start, u32 *next_percent)
+{
+    u64 usec = ktime_to_us(ktime_sub(ktime_get(), start));
+    u32 percent = (u32)div_u64((u64)done * 100, max_t(u32, comp->data_size, 1));
+
+    if ((percent < *next_percent) && (done < comp->data_size)) {
+        return;
+    }
+
+    while (*next_percent <= percent) {
+        *next_percent += MLXFW_FSM_PROGRESS_STEP;
+    }
+
+    pr_info("Component %d: downloaded %u/%u bytes (%u%%), %llu KB/s\n",
+            comp->index, min_t(u32, done, comp->data_size), comp->data_size, min_t(u32, percent, 100),
+            usec ? div64_u64((u64)done * 1000000, usec * 1024) : 0);
+}
+
+static int mlxfw_download_blocks(struct mlxfw_dev *mlxfw_dev, u32 fwhandle, struct mlxfw_mfa2_component *comp,
+                                 u8 comp_align_bits, u16 comp_max_write_size)
+{
+    struct mlxfw_fsm_block blocks[MLXFW_FSM_BLOCK_BATCH];
+    u32                    next_percent = MLXFW_FSM_PROGRESS_STEP;
+    int                    count;
+    ktime_t                start = ktime_get();
+    u32                    end = MLXFW_ALIGN_UP(comp->data_size, comp_align_bits);
+    u32                    offset = 0;
+    int                    err;
+
+    while (offset < end) {
+        /* without the batch op, one block goes at a time */
+        for (count = 0;
+             (offset < end) &&
+             (count < (mlxfw_dev->ops->fsm_block_download_batch ? MLXFW_FSM_BLOCK_BATCH : 1));
+             count++, offset += comp_max_write_size) {
+            blocks[count].data = comp->data + offset;
+            blocks[count].size = (u16)min_t(u32, comp->data_size - offset,
+                                            comp_max_write_size);
+            blocks[count].offset = offset;
+        }
+
+        if (mlxfw_dev->ops->fsm_block_download_batch) {
+            err = mlxfw_dev->ops->fsm_block_download_batch(mlxfw_dev, fwhandle,
+                                                           blocks, count);
+        } else {
+            err = mlxfw_dev->ops->fsm_block_download(mlxfw_dev, fwhandle,
+                                                     blocks[0].data, blocks[0].size,
+                                                     blocks[0].offset);
+        }
+        if (err) {
+            pr_err("Component %d: block download at offset %u failed (%d)\n",
+                   comp->index, blocks[0].offset, err);
+            return err;
+        }
+
+        mlxfw_download_progress(comp, offset, start, &next_percent);
+    }
+
+    return 0;
+}
+
 static int mlxfw_flash_component(struct mlxfw_dev *mlxfw_dev, u32 fwhandle, struct mlxfw_mfa2_component *comp)
 {
     u16 comp_max_write_size;
     u8  comp_align_bits;
     u32 comp_max_size;
-    u16 block_size;
-    u8 *block_ptr;
-    u32 offset;
     int err;
 
     err = mlxfw_dev->ops->component_query(mlxfw_dev, comp->index,
@@ -144,18 +206,10 @@ static int mlxfw_flash_component(struct mlxfw_dev *mlxfw_dev, u32 fwhandle, stru
     }
 
     pr_debug("Component download\n");
-    for (offset = 0;
-         offset < MLXFW_ALIGN_UP(comp->data_size, comp_align_bits);
-         offset += comp_max_write_size) {
-        block_ptr = comp->data + offset;
-        block_size = (u16)min_t(u32, comp->data_size - offset,
+    err = mlxfw_download_blocks(mlxfw_dev, fwhandle, comp, comp_align_bits,
                                 comp_max_write_size);
-        err = mlxfw_dev->ops->fsm_block_download(mlxfw_dev, fwhandle,
-                                                 block_ptr, block_size,
-                                                 offset);
-        if (err) {
-            goto err_out;
-        }
+    if (err) {
+        goto err_out;
     }
 
     pr_debug("Component verify\n");
@@ -37,13 +37,14 @@
 
 
 static struct cdev    cdev;
-static parse_cmd_func parse_func;
-static bool           g_initialized = false;
-static long sx_bfd_ioctl(struct file *fp __attribute__((unused)), unsigned int cmd, unsigned long data)
+static parse_cmd_func    parse_func;
+static release_file_func release_file;
+static bool              g_initialized = false;
+static long sx_bfd_ioctl(struct file *fp, unsigned int cmd, unsigned long data)
 {
     int err = 0;
 
-    err = parse_func((char*)data, cmd);
+    err = parse_func(fp, (char*)data, cmd);
     if (err < 0) {
         printk(KERN_ERR "Parsing BFD command failed (%d).\n", err);
         goto bail;
@@ -53,13 +54,23 @@ bail:
     return err;
 }
 
+static int sx_bfd_release(struct inode *inode __attribute__((unused)), struct file *fp)
+{
+    if (release_file) {
+        release_file(fp);
+    }
+
+    return 0;
+}
+
 
 static const struct file_operations sx_bfd_fops = {
     .owner = THIS_MODULE,
-    .unlocked_ioctl = sx_bfd_ioctl      /* As of Linux kernel 2.6.11 need to use unlocked_ioctl */
+    .unlocked_ioctl = sx_bfd_ioctl,     /* As of Linux kernel 2.6.11 need to use unlocked_ioctl */
+    .release = sx_bfd_release
 };
 
-int sx_bfd_cdev_init(parse_cmd_func func)
+int sx_bfd_cdev_init(parse_cmd_func func, release_file_func release_func)
 {
     int          err = 0;
     static dev_t char_dev;
@@ -89,6 +100,7 @@ int sx_bfd_cdev_init(parse_cmd_func func)
         }
 
         parse_func = func;
+        release_file = release_func;
 
         printk(KERN_DEBUG "BFD char-device initialized.\n");
 
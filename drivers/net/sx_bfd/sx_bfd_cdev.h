@@ -33,12 +33,15 @@
 #ifndef __SX_BFD_CDEV_H_
 #define __SX_BFD_CDEV_H_
 
-typedef int (*parse_cmd_func)(char* data, int cmd);
+struct file;
+
+typedef int (*parse_cmd_func)(struct file *fp, char* data, int cmd);
+typedef void (*release_file_func)(struct file *fp);
 
 /*
- *  Initialize BFD cdev
+ *  Initialize BFD cdev, release_func is called when the last reference to an opened file goes away
  */
-int sx_bfd_cdev_init(parse_cmd_func func);
+int sx_bfd_cdev_init(parse_cmd_func func, release_file_func release_func);
 
 /*
  *  De-initialize BFD cdev
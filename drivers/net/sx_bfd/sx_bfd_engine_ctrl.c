@@ -38,8 +38,9 @@
 #include <linux/sx_bfd/sx_bfd_ctrl_cmds.h>
 #include "sx_bfd_tx_session.h"
 #include "sx_bfd_rx_session.h"
+#include "sx_bfd_event.h"
 
-static int sx_bfd_parse_cmd(char* data, int cmd)
+static int sx_bfd_parse_cmd(struct file *fp, char* data, int cmd)
 {
     int err = -ENOTTY;
 
@@ -84,6 +85,17 @@ static int sx_bfd_parse_cmd(char* data, int cmd)
         printk(KERN_DEBUG "Request & Clear TX statistics\n");
         return sx_bfd_get_tx_sess_stats(data, true);
 
+    case SX_BFD_CMD_REGISTER_EVENT_RING:
+        printk(KERN_DEBUG "REGISTER_EVENT_RING.\n");
+        return sx_bfd_event_ring_register(data, fp);
+
+    case SX_BFD_CMD_UNREGISTER_EVENT_RING:
+        printk(KERN_DEBUG "UNREGISTER_EVENT_RING.\n");
+        return sx_bfd_event_ring_unregister(data);
+
+    case SX_BFD_CMD_GET_EVENTS:
+        return sx_bfd_event_ring_read(data);
+
     default:
         printk(KERN_DEBUG "Unsupported sx bfd command");
     }
@@ -91,11 +103,17 @@ static int sx_bfd_parse_cmd(char* data, int cmd)
     return err;
 }
 
+/* an agent that exits without unregistering must not leave its event ring behind */
+static void sx_bfd_release_file(struct file *fp)
+{
+    sx_bfd_event_release_file(fp);
+}
+
 int sx_bfd_engine_ctrl_init(void)
 {
     int err;
 
-    err = sx_bfd_cdev_init(&sx_bfd_parse_cmd);
+    err = sx_bfd_cdev_init(&sx_bfd_parse_cmd, &sx_bfd_release_file);
     if (err < 0) {
         printk(KERN_ERR "Kernel BFD chardevice failed to initialize.\n");
         goto bail;
@@ -134,5 +152,7 @@ void sx_bfd_engine_ctrl_deinit(void)
 
     sx_bfd_tx_session_deinit();
 
+    sx_bfd_event_deinit();
+
     sx_bfd_workqueue_deinit();
 }
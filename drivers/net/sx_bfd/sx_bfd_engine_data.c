@@ -35,6 +35,7 @@
 #include <linux/kthread.h>
 #include <linux/sched.h>
 #include <linux/jiffies.h>
+#include <linux/rcupdate.h>
 #include <net/ipv6.h>
 
 #include "sx_bfd_engine_data.h"
@@ -44,54 +45,65 @@
 #include "sx_bfd_workqueue.h"
 
 
-#define MAX_BFD_SIZE 128
+static bool ttl_valid(enum sx_bfd_sock_type sock_type, struct metadata *metadata)
+{
+    return !((sock_type == sx_bfd_SOCK_SINGLEHOP) && (metadata->ttl != 0) && (metadata->ttl != 255));
+}
 
+/* Function which processes a packet received on a BFD RX socket (called by the RX workers) */
 void recv_packet(struct socket        *t_sock,
                  enum sx_bfd_sock_type sock_type,
                  uint32_t              vrf_id,
-                 unsigned long         bfd_user_space_pid)
+                 unsigned long         bfd_user_space_pid,
+                 char                 *buf,
+                 int                   len,
+                 struct metadata      *metadata)
 {
-    char                      buf[MAX_BFD_SIZE];
-    struct metadata           metadata;
-    int                       len;
     struct sx_bfd_rx_session *session;
     struct ip_addr            ip_addr;
     unsigned long             current_jiffies, received_packet_msec;
 
-    /* Get the packet received on the socket.
-     * Its UDP socket - here we will get frame frame and not number of frames
-     * in one shot.*/
-    len = sx_bfd_socket_recv(t_sock, buf, MAX_BFD_SIZE, &metadata);
-
-    /* Check if any frame was received - len <= 0 - no frame received */
-    if (len <= 0) {
-        return;
-    }
-
     /* Get IP to check if session in DB. */
     memset(&ip_addr, 0, sizeof(struct ip_addr));
 
-    ip_addr.family = ((struct sockaddr*)&metadata.peer_addr)->sa_family;
+    ip_addr.family = ((struct sockaddr*)&metadata->peer_addr)->sa_family;
     if (ip_addr.family == AF_INET) {
-        memcpy(&ip_addr.ipv4, &metadata.peer_addr.peer_in.sin_addr, sizeof(struct in_addr));
+        memcpy(&ip_addr.ipv4, &metadata->peer_addr.peer_in.sin_addr, sizeof(struct in_addr));
     } else {
-        memcpy(&ip_addr.ipv6, &metadata.peer_addr.peer_in6.sin6_addr, sizeof(struct in6_addr));
+        memcpy(&ip_addr.ipv6, &metadata->peer_addr.peer_in6.sin6_addr, sizeof(struct in6_addr));
     }
 
+    /* Fast path - the expected packet of a known session is handled under RCU,
+     * without taking the session DB lock and the session/VRF references. */
+    rcu_read_lock();
+    session = sx_bfd_rx_sess_lkp_rcu(&ip_addr, vrf_id, t_sock);
+    if (session && ttl_valid(sock_type, metadata) &&
+        (session->packet_len == len) && (memcmp(buf, session->packet, len) == 0)) {
+        rx_delayed_work_dispatch_rcu(session);
+        atomic_set(&session->remote_heard, true);
+        atomic64_inc(&session->rx_counter);
+        session->last_time = jiffies_to_msecs(jiffies);
+        rcu_read_unlock();
+        return;
+    }
+    rcu_read_unlock();
+
+    /* Slow path - packets that go to user space */
+
     /* Get session */
     session = sx_bfd_rx_sess_get_by_ip_vrf(&ip_addr, vrf_id, t_sock);
     if (!session) {
         /* If session is not found - send the packet to user space to take care. */
-        sx_bfd_event_send_packet(NULL, buf, len, &metadata, bfd_user_space_pid);
+        sx_bfd_event_send_packet(NULL, buf, len, metadata, bfd_user_space_pid);
         return;
     }
 
 
     /* Validate the frame. */
-    if ((sock_type == sx_bfd_SOCK_SINGLEHOP) && (metadata.ttl != 0) && (metadata.ttl != 255)) {
+    if (!ttl_valid(sock_type, metadata)) {
         /* If frame is not valid - send this frame to user space via trap
          * and increment dropped_packet counter as it will be dropped in user space */
-        sx_bfd_event_send_packet(session, buf, len, &metadata, bfd_user_space_pid);
+        sx_bfd_event_send_packet(session, buf, len, metadata, bfd_user_space_pid);
         atomic64_inc(&session->dropped_packets);
         /* Release the ref_counter on session and delete from DB if required */
         sx_bfd_rx_sess_put(session);
@@ -114,7 +126,7 @@ void recv_packet(struct socket        *t_sock,
     if ((session->packet_len != len) ||
         (memcmp(buf, session->packet, len) != 0)) {
         /* If its not expected packet send it to user space */
-        sx_bfd_event_send_packet(session, buf, len, &metadata, bfd_user_space_pid);
+        sx_bfd_event_send_packet(session, buf, len, metadata, bfd_user_space_pid);
     }
 
     /* Decrement the ref_count of the session and remove it from DB if required */
@@ -47,7 +47,10 @@ void sx_bfd_engine_data_deinit(void);
 void recv_packet(struct socket        *t_sock,
                  enum sx_bfd_sock_type sock_type,
                  uint32_t              vrf_id,
-                 unsigned long         bfd_user_space_pid);
+                 unsigned long         bfd_user_space_pid,
+                 char                 *buf,
+                 int                   len,
+                 struct metadata      *metadata);
 
 
 #endif /* __SX_BFD_ENGINE_DATA_H_ */
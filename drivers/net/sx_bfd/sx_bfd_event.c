@@ -31,6 +31,15 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/kref.h>
+#include <linux/jhash.h>
+#include <linux/hashtable.h>
+#include <linux/log2.h>
+#include <linux/uaccess.h>
 
 #include "sx_bfd_event.h"
 #include <linux/sx_bfd/sx_bfd_ctrl_cmds.h>
@@ -39,10 +48,349 @@
 #define SX_TRAP_ID_BFD_TIMEOUT_EVENT 0x20f
 #define SX_TRAP_ID_BFD_PACKET_EVENT  0x210
 
+/* largest BFD control packet carried by a packet event */
+#define SX_BFD_EVENT_MAX_PACKET_SIZE 128
+/* largest batch copied to user space by one SX_BFD_CMD_GET_EVENTS */
+#define SX_BFD_EVENT_BATCH_MAX_BYTES (32 * 1024)
+
+#define SX_BFD_EVENT_RINGS_HASH_BITS 4
+
 extern int send_trap(const void    *buf,
                      const uint32_t buf_size,
                      uint16_t       trap_id);
 
+struct __attribute__((__packed__)) sx_bfd_packet_event_buf {
+    struct bfd_packet_event event;
+    char                    packet[SX_BFD_EVENT_MAX_PACKET_SIZE];
+};
+struct __attribute__((__packed__)) sx_bfd_event_slot {
+    struct bfd_event_hdr hdr;
+    union {
+        struct sx_bfd_packet_event_buf packet;
+        struct bfd_timeout_event       timeout;
+    } data;
+};
+
+/* Per-agent ring of pending events, filled by the RX path and the timers, drained by the agent */
+struct sx_bfd_event_ring {
+    struct hlist_node          node;
+    struct kref                kref;
+    unsigned long              bfd_pid;
+    struct file               *owner; /* the ring goes away when this file is released */
+    spinlock_t                 lock;
+    wait_queue_head_t          wait;
+    struct sx_bfd_event_slot * slots;
+    uint32_t                   size; /* power of 2 */
+    uint32_t                   head; /* next slot to fill */
+    uint32_t                   tail; /* next slot to read */
+    bool                       dead;
+    uint64_t                   dropped;
+};
+static DEFINE_HASHTABLE(event_rings, SX_BFD_EVENT_RINGS_HASH_BITS);
+static DEFINE_SPINLOCK(event_rings_lock);
+static DEFINE_MUTEX(event_rings_db_lock); /* serializes register/unregister */
+
+static void sx_bfd_event_ring_release(struct kref *kref)
+{
+    struct sx_bfd_event_ring *ring = container_of(kref, struct sx_bfd_event_ring, kref);
+
+    vfree(ring->slots);
+    kfree(ring);
+}
+
+/* MUST BE CALLED UNDER event_rings_lock */
+static struct sx_bfd_event_ring * sx_bfd_event_ring_lkp(unsigned long bfd_pid)
+{
+    struct sx_bfd_event_ring *ring;
+
+    hash_for_each_possible(event_rings, ring, node, jhash(&bfd_pid, sizeof(bfd_pid), 0)) {
+        if (ring->bfd_pid == bfd_pid) {
+            return ring;
+        }
+    }
+
+    return NULL;
+}
+
+static struct sx_bfd_event_ring * sx_bfd_event_ring_get(unsigned long bfd_pid)
+{
+    struct sx_bfd_event_ring *ring;
+
+    spin_lock_bh(&event_rings_lock);
+    ring = sx_bfd_event_ring_lkp(bfd_pid);
+    if (ring) {
+        kref_get(&ring->kref);
+    }
+    spin_unlock_bh(&event_rings_lock);
+
+    return ring;
+}
+
+static void sx_bfd_event_ring_put(struct sx_bfd_event_ring *ring)
+{
+    kref_put(&ring->kref, sx_bfd_event_ring_release);
+}
+
+/*
+ * Queue an event on the ring of the agent.
+ * Returns false if the agent has no ring, the caller then sends the event as a trap.
+ */
+static bool sx_bfd_event_ring_post(unsigned long bfd_pid, uint16_t type, const void *event, uint16_t size)
+{
+    struct sx_bfd_event_ring *ring;
+    struct sx_bfd_event_slot *slot;
+    bool                      wake = false;
+
+    spin_lock_bh(&event_rings_lock);
+
+    ring = sx_bfd_event_ring_lkp(bfd_pid);
+    if (!ring) {
+        spin_unlock_bh(&event_rings_lock);
+        return false;
+    }
+
+    spin_lock(&ring->lock);
+
+    if (ring->head - ring->tail >= ring->size) {
+        ring->dropped++;
+    } else {
+        slot = &ring->slots[ring->head & (ring->size - 1)];
+        slot->hdr.type = type;
+        slot->hdr.size = size;
+        memcpy(&slot->data, event, size);
+
+        /* agent is woken only when the ring turns non-empty, the rest is picked by the same batch */
+        wake = (ring->head == ring->tail);
+        ring->head++;
+    }
+
+    spin_unlock(&ring->lock);
+
+    if (wake) {
+        wake_up_interruptible(&ring->wait);
+    }
+
+    spin_unlock_bh(&event_rings_lock);
+
+    return true;
+}
+
+static bool sx_bfd_event_ring_ready(struct sx_bfd_event_ring *ring)
+{
+    bool ready;
+
+    spin_lock_bh(&ring->lock);
+    ready = ring->dead || (ring->head != ring->tail);
+    spin_unlock_bh(&ring->lock);
+
+    return ready;
+}
+
+int sx_bfd_event_ring_register(char *data, struct file *fp)
+{
+    struct bfd_event_ring_params params;
+    struct sx_bfd_event_ring    *ring = NULL;
+    int                          err = 0;
+
+    if (copy_from_user(&params, data, sizeof(params))) {
+        printk(KERN_ERR "Failed to copy event ring parameters from user.\n");
+        return -EFAULT;
+    }
+
+    if (params.ring_size == 0) {
+        params.ring_size = BFD_EVENT_RING_DEFAULT_SIZE;
+    }
+
+    if (params.ring_size > BFD_EVENT_RING_MAX_SIZE) {
+        printk(KERN_ERR "Event ring size %u is too big (max %u).\n", params.ring_size, BFD_EVENT_RING_MAX_SIZE);
+        return -EINVAL;
+    }
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring) {
+        printk(KERN_ERR "Memory allocation for event ring failed.\n");
+        return -ENOMEM;
+    }
+
+    ring->size = roundup_pow_of_two(params.ring_size);
+    ring->slots = vmalloc(ring->size * sizeof(struct sx_bfd_event_slot));
+    if (!ring->slots) {
+        printk(KERN_ERR "Memory allocation for event ring slots failed.\n");
+        kfree(ring);
+        return -ENOMEM;
+    }
+
+    kref_init(&ring->kref);
+    spin_lock_init(&ring->lock);
+    init_waitqueue_head(&ring->wait);
+    INIT_HLIST_NODE(&ring->node);
+    ring->bfd_pid = params.bfd_pid;
+    ring->owner = fp;
+
+    mutex_lock(&event_rings_db_lock);
+    spin_lock_bh(&event_rings_lock);
+
+    if (sx_bfd_event_ring_lkp(params.bfd_pid)) {
+        printk(KERN_WARNING "Event ring of BFD agent %lu already exists.\n", params.bfd_pid);
+        err = -EEXIST;
+    } else {
+        hash_add(event_rings, &ring->node, jhash(&ring->bfd_pid, sizeof(ring->bfd_pid), 0));
+        ring = NULL;
+    }
+
+    spin_unlock_bh(&event_rings_lock);
+    mutex_unlock(&event_rings_db_lock);
+
+    if (ring) {
+        sx_bfd_event_ring_put(ring);
+    } else {
+        printk(KERN_DEBUG "Event ring of BFD agent %lu registered (%u events).\n",
+               params.bfd_pid, roundup_pow_of_two(params.ring_size));
+    }
+
+    return err;
+}
+
+static void sx_bfd_event_ring_unlink(struct sx_bfd_event_ring *ring)
+{
+    spin_lock_bh(&event_rings_lock);
+    hash_del(&ring->node);
+    spin_unlock_bh(&event_rings_lock);
+
+    /* release readers waiting on the ring */
+    spin_lock_bh(&ring->lock);
+    ring->dead = true;
+    spin_unlock_bh(&ring->lock);
+    wake_up_interruptible_all(&ring->wait);
+
+    sx_bfd_event_ring_put(ring);
+}
+
+int sx_bfd_event_ring_unregister(char *data)
+{
+    struct bfd_event_ring_params params;
+    struct sx_bfd_event_ring    *ring;
+    int                          err = 0;
+
+    if (copy_from_user(&params, data, sizeof(params))) {
+        printk(KERN_ERR "Failed to copy event ring parameters from user.\n");
+        return -EFAULT;
+    }
+
+    mutex_lock(&event_rings_db_lock);
+
+    spin_lock_bh(&event_rings_lock);
+    ring = sx_bfd_event_ring_lkp(params.bfd_pid);
+    spin_unlock_bh(&event_rings_lock);
+
+    if (!ring) {
+        printk(KERN_ERR "Event ring of BFD agent %lu doesn't exist.\n", params.bfd_pid);
+        err = -ENOENT;
+    } else {
+        sx_bfd_event_ring_unlink(ring);
+    }
+
+    mutex_unlock(&event_rings_db_lock);
+
+    return err;
+}
+
+/* Unlink the rings registered through a file whose last reference is gone */
+void sx_bfd_event_release_file(struct file *fp)
+{
+    struct sx_bfd_event_ring *ring;
+    struct hlist_node        *tmp;
+    int                       bkt;
+
+    mutex_lock(&event_rings_db_lock);
+
+    hash_for_each_safe(event_rings, bkt, tmp, ring, node) {
+        if (ring->owner == fp) {
+            printk(KERN_DEBUG "Event ring of BFD agent %lu released with its file.\n", ring->bfd_pid);
+            sx_bfd_event_ring_unlink(ring);
+        }
+    }
+
+    mutex_unlock(&event_rings_db_lock);
+}
+
+int sx_bfd_event_ring_read(char *data)
+{
+    struct bfd_event_batch    batch;
+    struct sx_bfd_event_ring *ring = NULL;
+    struct sx_bfd_event_slot *slot;
+    char                     *kbuf = NULL;
+    uint32_t                  buf_size;
+    uint32_t                  event_size;
+    long                      rc;
+    int                       err = 0;
+
+    if (copy_from_user(&batch, data, sizeof(batch))) {
+        printk(KERN_ERR "Failed to copy event batch request from user.\n");
+        return -EFAULT;
+    }
+
+    ring = sx_bfd_event_ring_get(batch.bfd_pid);
+    if (!ring) {
+        return -ENOENT;
+    }
+
+    buf_size = min_t(uint32_t, batch.buf_size, SX_BFD_EVENT_BATCH_MAX_BYTES);
+    kbuf = kmalloc(buf_size, GFP_KERNEL);
+    if (!kbuf) {
+        err = -ENOMEM;
+        goto bail;
+    }
+
+    if (batch.timeout_msec) {
+        rc = wait_event_interruptible_timeout(ring->wait,
+                                              sx_bfd_event_ring_ready(ring),
+                                              msecs_to_jiffies(batch.timeout_msec));
+        if (rc < 0) {
+            err = (int)rc;
+            goto bail;
+        }
+    }
+
+    batch.event_count = 0;
+    batch.bytes = 0;
+
+    /* take as many whole events as fit in the user buffer */
+    spin_lock_bh(&ring->lock);
+
+    while (ring->tail != ring->head) {
+        slot = &ring->slots[ring->tail & (ring->size - 1)];
+        event_size = sizeof(slot->hdr) + slot->hdr.size;
+        if (batch.bytes + event_size > buf_size) {
+            break;
+        }
+
+        memcpy(kbuf + batch.bytes, slot, event_size);
+        batch.bytes += event_size;
+        batch.event_count++;
+        ring->tail++;
+    }
+
+    batch.pending = ring->head - ring->tail;
+    batch.dropped = ring->dropped;
+
+    spin_unlock_bh(&ring->lock);
+
+    if (batch.bytes && copy_to_user(batch.buf, kbuf, batch.bytes)) {
+        err = -EFAULT;
+        goto bail;
+    }
+
+    if (copy_to_user(data, &batch, sizeof(batch))) {
+        err = -EFAULT;
+        goto bail;
+    }
+
+bail:
+    kfree(kbuf);
+    sx_bfd_event_ring_put(ring);
+    return err;
+}
 
 void sx_bfd_event_send_packet(struct sx_bfd_rx_session *session,
                               char                     *packet,
@@ -50,23 +398,21 @@ void sx_bfd_event_send_packet(struct sx_bfd_rx_session *session,
                               struct metadata          *metadata,
                               unsigned long             bfd_user_space_pid)
 {
-    struct bfd_packet_event *event_msg = NULL;
-    uint8_t                  family;
-    int                      event_msg_size = 0;
+    struct sx_bfd_packet_event_buf event_buf;
+    struct bfd_packet_event       *event_msg = &event_buf.event;
+    uint8_t                        family;
+    int                            event_msg_size = 0;
+
+    if (size > SX_BFD_EVENT_MAX_PACKET_SIZE) {
+        printk(KERN_ERR "BFD packet of %u bytes is too big for an event.\n", size);
+        return;
+    }
 
     /*calculate the size of the packet which will be sent via packet event
      * which include not only packet received on the socket but additional
      * parameters which user space BFD stack will use
      */
     event_msg_size = sizeof(struct bfd_packet_event) + size;
-
-    /* Allocate event_msg to send via packet trap*/
-    event_msg = kmalloc(event_msg_size, GFP_ATOMIC);
-    if (!event_msg) {
-        printk(KERN_ERR "event_msg is NULL .\n");
-        goto out;
-    }
-
     /* Fill all relevant information. */
     event_msg->timeout = 0;
     if (session) {
@@ -116,16 +462,15 @@ void sx_bfd_event_send_packet(struct sx_bfd_rx_session *session,
     event_msg->packet_size = size;
     memcpy(event_msg->packet, packet, size);
 
+    if (sx_bfd_event_ring_post(bfd_user_space_pid, BFD_EVENT_PACKET, event_msg, event_msg_size)) {
+        return;
+    }
+
     if (send_trap(event_msg,
                   event_msg_size,
                   SX_TRAP_ID_BFD_PACKET_EVENT) != 0) {
         printk(KERN_ERR "Failed to send data trap 0x210 for session (%d).\n", session ? session->session_id : -1);
     }
-
-out:
-    if (event_msg) {
-        kfree(event_msg);
-    }
 }
 
 void sx_bfd_event_send_timeout(struct sx_bfd_rx_session *session)
@@ -138,6 +483,10 @@ void sx_bfd_event_send_timeout(struct sx_bfd_rx_session *session)
     event.opaque_data = session->session_opaque_data;
     event.bfd_pid = session->bfd_pid;
 
+    if (sx_bfd_event_ring_post(event.bfd_pid, BFD_EVENT_TIMEOUT, &event, sizeof(event))) {
+        return;
+    }
+
     /*Send the trap */
     if (send_trap(&event,
                   sizeof(struct bfd_timeout_event),
@@ -146,3 +495,18 @@ void sx_bfd_event_send_timeout(struct sx_bfd_rx_session *session)
                session->session_id, session->vrf_id);
     }
 }
+
+void sx_bfd_event_deinit(void)
+{
+    struct sx_bfd_event_ring *ring;
+    struct hlist_node        *tmp;
+    int                       bkt;
+
+    mutex_lock(&event_rings_db_lock);
+
+    hash_for_each_safe(event_rings, bkt, tmp, ring, node) {
+        sx_bfd_event_ring_unlink(ring);
+    }
+
+    mutex_unlock(&event_rings_db_lock);
+}
@@ -44,4 +44,11 @@ void sx_bfd_event_send_packet(struct sx_bfd_rx_session *session,
                               unsigned long             bfd_user_space_pid);
 void sx_bfd_event_send_timeout(struct sx_bfd_rx_session *session);
 
+int sx_bfd_event_ring_register(char *data, struct file *fp);
+int sx_bfd_event_ring_unregister(char *data);
+int sx_bfd_event_ring_read(char *data);
+void sx_bfd_event_release_file(struct file *fp);
+
+void sx_bfd_event_deinit(void);
+
 #endif /* __SX_BFD_EVENT_H_ */
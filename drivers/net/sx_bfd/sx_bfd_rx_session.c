@@ -37,6 +37,7 @@
 #include <linux/types.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rcupdate.h>
 
 #include "sx_bfd_rx_session.h"
 #include "sx_bfd_event.h"
@@ -69,6 +70,17 @@ void rx_delayed_work_dispatch(struct sx_bfd_rx_session * session)
     spin_unlock_bh(&rx_sess_lock);
 }
 
+/* Lock-free variant for the RX fast path, MUST BE CALLED UNDER rcu_read_lock().
+ * rx_sess_del() waits for an RCU grace period between signing the session as deleted
+ * and destroying its delayed work, so the work can't be re-armed after it is destroyed. */
+void rx_delayed_work_dispatch_rcu(struct sx_bfd_rx_session * session)
+{
+    if (READ_ONCE(session->deleted) == 0) {
+        sx_bfd_delayed_work_cancel(session->dwork);
+        sx_bfd_delayed_work_dispatch(session->dwork, usecs_to_jiffies(session->interval));
+    }
+}
+
 /* Function which called when timeout interval occurs */
 static void rx_timeout_handler(uint32_t session_id)
 {
@@ -193,6 +205,32 @@ struct sx_bfd_rx_session * sx_bfd_rx_sess_get_by_ip_vrf(struct ip_addr * ip_addr
     return entry->sess;
 }
 
+/* Function returns session based of the specific IP and VRF without taking references.
+ * Like sx_bfd_rx_sess_get_by_ip_vrf(), the packet must have come on one of the VRF sockets;
+ * those are cached in the session, so the VRF DB is not touched.
+ * MUST BE CALLED UNDER rcu_read_lock(), the session is valid until rcu_read_unlock(). */
+struct sx_bfd_rx_session * sx_bfd_rx_sess_lkp_rcu(struct ip_addr * ip_addr,
+                                                  uint32_t         vrf_id,
+                                                  struct socket   *t_sock)
+{
+    struct sx_bfd_rx_session_entry *entry;
+    struct sx_bfd_rx_session       *session;
+
+    hash_for_each_possible_rcu(rx_sessions, entry, node, ip_addr_hash(ip_addr)) {
+        session = entry->sess;
+        if (!ip_addr_compare(ip_addr, &session->ip_addr) &&
+            (session->vrf_id == vrf_id)) {
+            if ((t_sock != session->sock_single_hop) &&
+                (t_sock != session->sock_multi_hop)) {
+                return NULL;
+            }
+            return session;
+        }
+    }
+
+    return NULL;
+}
+
 /* Function return session of the specific session_id */
 struct sx_bfd_rx_session * sx_bfd_rx_sess_get_by_id(uint32_t session_id)
 {
@@ -384,15 +422,19 @@ static int rx_sess_add(struct bfd_offload_info *request_hdr, char *data, int upd
         sx_bfd_rx_vrf_hash_add(entry_vrf);
     }
 
+    /* Cache the VRF sockets for the RX fast path, see sx_bfd_rx_sess_lkp_rcu() */
+    sx_bfd_rx_vrf_socks_get(session->vrf_id, &session->sock_single_hop, &session->sock_multi_hop);
+
 
     /* Initialize entry_session DS for hash */
     INIT_HLIST_NODE(&entry_session->node);
     entry_session->sess = session;
     entry_session->session_id = request_hdr->session_id;
     init_completion(&session->free_wait);
-    hash_add(rx_sessions,
-             &entry_session->node,
-             hash_key);
+    /* RX fast path looks sessions up under RCU */
+    hash_add_rcu(rx_sessions,
+                 &entry_session->node,
+                 hash_key);
 
     if (update) {
         /* To avoid on update to remove and add VRF - in delete process
@@ -502,7 +544,7 @@ static int rx_sess_del(uint32_t session_id, int update, void *stats)
     /* Delete entry session from hash - so new arrived packets (data plane)
      * won't get the session and those packets will be sent to user space
      * via packet event trap*/
-    hash_del(&entry->node);
+    hash_del_rcu(&entry->node);
 
     /* Sign the session as delete (only from command
      * delete_rx_session it can come).
@@ -518,6 +560,10 @@ static int rx_sess_del(uint32_t session_id, int update, void *stats)
     /*spin_unlock - critical section is behind */
     spin_unlock_bh(&rx_sess_lock);
 
+    /* Wait for the RX fast path readers which may still see the session
+     * (and re-arm its delayed work) - see rx_delayed_work_dispatch_rcu() */
+    synchronize_rcu();
+
     /* Wait to complete all pending works*/
     sx_bfd_destroy_delayed_work_sync(entry->sess->dwork);
 
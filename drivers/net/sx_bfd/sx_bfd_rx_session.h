@@ -62,6 +62,8 @@ struct sx_bfd_rx_session {
     uint64_t                last_time; /* last time a packet was received */
     atomic_t                remote_heard;
     unsigned long           bfd_pid;
+    struct socket          *sock_single_hop; /* RX sockets of the session VRF, */
+    struct socket          *sock_multi_hop;  /* kept alive by the VRF reference */
 };
 
 int sx_bfd_rx_session_init(void);
@@ -72,6 +74,9 @@ struct sx_bfd_rx_session * sx_bfd_rx_sess_get_by_ip_vrf(struct ip_addr * ip_addr
                                                         uint32_t         vrf_id,
                                                         struct socket   *t_sock);
 struct sx_bfd_rx_session * sx_bfd_rx_sess_get_by_id(uint32_t session_id);
+struct sx_bfd_rx_session * sx_bfd_rx_sess_lkp_rcu(struct ip_addr * ip_addr,
+                                                  uint32_t         vrf_id,
+                                                  struct socket   *t_sock);
 
 void sx_bfd_rx_sess_put(struct sx_bfd_rx_session * session);
 
@@ -80,6 +85,7 @@ int sx_bfd_rx_sess_add(char * data);
 int sx_bfd_rx_sess_del(char * data);
 
 void rx_delayed_work_dispatch(struct sx_bfd_rx_session * session);
+void rx_delayed_work_dispatch_rcu(struct sx_bfd_rx_session * session);
 
 int sx_bfd_get_rx_sess_stats(char* data, uint8_t clear_stats);
 
@@ -42,6 +42,13 @@
 #include <linux/hash.h>
 #include <linux/hashtable.h>
 #include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include "sx_bfd_socket.h"
 #include "sx_bfd_engine_data.h"
@@ -64,6 +71,12 @@
      (((hdr_state) & RX_HDR_IPV6_COMPLETE) == RX_HDR_IPV6_COMPLETE))
 
 #define SX_RX_VRFS_HASH_BITS 8
+
+/* packets read from a socket each time the socket is scheduled */
+#define SX_BFD_RX_BATCH             32
+/* packets queued on an RX worker, above that packets are dropped */
+#define SX_BFD_RX_WORKER_RING_SIZE  1024
+#define SX_BFD_RX_WORKERS_PROC_FILE "sx_bfd_rx_workers"
 DECLARE_HASHTABLE(rx_vrfs, SX_RX_VRFS_HASH_BITS);
 
 enum sx_bfd_sock_state {
@@ -109,6 +122,29 @@ struct sx_bfd_rx_socket_user_info {
     enum sx_bfd_sock_type  sock_type;
     enum sx_bfd_sock_state sock_state;
     struct completion      free_wait;
+    atomic_t               inflight; /* packets of this socket queued on the RX workers */
+};
+struct sx_bfd_rx_packet {
+    struct sx_bfd_rx_socket_user_info *user_info;
+    struct metadata                    metadata;
+    int                                len;
+    char                               buf[MAX_BFD_SIZE];
+};
+
+/* RX worker, packets of one session are always processed by the same worker */
+struct sx_bfd_rx_worker {
+    spinlock_t               lock;
+    struct sx_bfd_rx_packet *ring;
+    uint32_t                 head; /* next slot to fill */
+    uint32_t                 tail; /* next slot to process */
+    struct task_struct      *thread;
+    int                      cpu;
+
+    /* statistics */
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t batches;
+    uint32_t max_batch;
 };
 static bool g_initialized = false;
 struct sockets_scheduler {
@@ -119,6 +155,13 @@ struct sockets_scheduler {
 static struct sockets_scheduler scheduler;
 static struct task_struct      *bfd_thread = NULL;
 
+static struct sx_bfd_rx_worker __percpu *rx_workers = NULL;
+static int                              *rx_worker_cpus = NULL;
+static int                               rx_workers_num = 0;
+static DECLARE_WAIT_QUEUE_HEAD(rx_inflight_wq);
+static atomic64_t                        rx_sock_batches = ATOMIC64_INIT(0);
+static atomic64_t                        rx_sock_packets = ATOMIC64_INIT(0);
+
 /* Function which sends traffic when timeout event on Tx session occurs */
 bool sx_bfd_socket_send(struct socket * sock, char* buf, size_t buf_len, struct sockaddr *peer)
 {
@@ -207,7 +250,7 @@ int sx_bfd_socket_recv(struct socket *sock, char* buf, size_t buf_len, struct me
 
     /* get_fs && set_fs called inside the function */
     size = kernel_recvmsg(sock, &msg, &iov, 1,
-                          iov.iov_len, msg.msg_flags);
+                          iov.iov_len, MSG_DONTWAIT);
 #else
     msg.msg_iov = &iov;
     msg.msg_iovlen = 1;
@@ -216,7 +259,7 @@ int sx_bfd_socket_recv(struct socket *sock, char* buf, size_t buf_len, struct me
     set_fs(KERNEL_DS);
 
 
-    size = sock_recvmsg(sock, &msg, iov.iov_len, msg.msg_flags);
+    size = sock_recvmsg(sock, &msg, iov.iov_len, MSG_DONTWAIT);
 
     set_fs(oldfs);
 #endif
@@ -324,17 +367,20 @@ static void sk_data_ready_custom(struct sock *sk)
             return;
         }
 
+        /* Check if the socket is already scheduled - all the data waiting on it
+         * will be read in batches when its turn comes. */
+        if (!list_empty(&user_info->list)) {
+            spin_unlock_bh(&scheduler.sceduler_lock);
+            return;
+        }
+
         /* Check if the LL of sockets on which received data is empty. */
         lst_empty = list_empty(&scheduler.scheduler_list);
 
-        /* Check if other data is waiting on this socket. */
-        if (user_info->ref_count == 0) {
-            /* If this arrived data (frame) is the only one -
-             * add this socket to the LL sockets which should be managed. */
-            list_add_tail(&user_info->list, &scheduler.scheduler_list);
-        }
+        /* Add this socket to the LL sockets which should be managed. */
+        list_add_tail(&user_info->list, &scheduler.scheduler_list);
 
-        /* Update counter on the packets on this socket. */
+        /* Update counter on the references on this socket. */
         user_info->ref_count++;
 
         if (lst_empty) {
@@ -354,58 +400,179 @@ static void sk_data_ready_custom(struct sock *sk)
 }
 
 
+/* Pick the RX worker of the session the packet belongs to (peer address + VRF) */
+static struct sx_bfd_rx_worker * sx_bfd_rx_worker_select(struct sx_bfd_rx_packet *pkt)
+{
+    uint32_t hash_key;
+
+    if (((struct sockaddr*)&pkt->metadata.peer_addr)->sa_family == AF_INET) {
+        hash_key = jhash(&pkt->metadata.peer_addr.peer_in.sin_addr, sizeof(struct in_addr),
+                         pkt->user_info->vrf_id);
+    } else {
+        hash_key = jhash(&pkt->metadata.peer_addr.peer_in6.sin6_addr, sizeof(struct in6_addr),
+                         pkt->user_info->vrf_id);
+    }
+
+    return per_cpu_ptr(rx_workers, rx_worker_cpus[hash_key % rx_workers_num]);
+}
+
+
+/* Queue a received packet on its RX worker */
+static void sx_bfd_rx_worker_post(struct sx_bfd_rx_packet *pkt)
+{
+    struct sx_bfd_rx_worker *worker = sx_bfd_rx_worker_select(pkt);
+    bool                     wake = false;
+
+    spin_lock_bh(&worker->lock);
+
+    if (worker->head - worker->tail >= SX_BFD_RX_WORKER_RING_SIZE) {
+        worker->dropped++;
+        spin_unlock_bh(&worker->lock);
+        return;
+    }
+
+    atomic_inc(&pkt->user_info->inflight);
+    memcpy(&worker->ring[worker->head % SX_BFD_RX_WORKER_RING_SIZE], pkt, sizeof(*pkt));
+    wake = (worker->head == worker->tail);
+    worker->head++;
+    worker->queued++;
+
+    spin_unlock_bh(&worker->lock);
+
+    if (wake) {
+        wake_up_process(worker->thread);
+    }
+}
+
+
+/* Function which is called by RX worker thread */
+static int sx_bfd_rx_worker_thread(void *data)
+{
+    struct sx_bfd_rx_worker           *worker = (struct sx_bfd_rx_worker *)data;
+    struct sx_bfd_rx_socket_user_info *user_info;
+    struct sx_bfd_rx_packet           *pkt;
+    uint32_t                           tail, head;
+
+    while (!kthread_should_stop()) {
+        spin_lock_bh(&worker->lock);
+        tail = worker->tail;
+        head = worker->head;
+        spin_unlock_bh(&worker->lock);
+
+        /* Slots between tail and head are not touched by the producer until tail moves */
+        if (tail != head) {
+            if (head - tail > worker->max_batch) {
+                worker->max_batch = head - tail;
+            }
+            worker->batches++;
+
+            for (; tail != head; tail++) {
+                pkt = &worker->ring[tail % SX_BFD_RX_WORKER_RING_SIZE];
+                user_info = pkt->user_info;
+
+                recv_packet(user_info->t_sock, user_info->sock_type, user_info->vrf_id,
+                            user_info->bfd_user_space_pid, pkt->buf, pkt->len, &pkt->metadata);
+
+                /* socket destroy waits for all the packets of the socket to be processed */
+                if (atomic_dec_and_test(&user_info->inflight)) {
+                    wake_up_all(&rx_inflight_wq);
+                }
+            }
+
+            spin_lock_bh(&worker->lock);
+            worker->tail = tail;
+            spin_unlock_bh(&worker->lock);
+            continue;
+        }
+
+        set_current_state(TASK_INTERRUPTIBLE);
+
+        spin_lock_bh(&worker->lock);
+        head = worker->head;
+        spin_unlock_bh(&worker->lock);
+
+        if ((head == tail) && !kthread_should_stop()) {
+            schedule();
+        }
+        __set_current_state(TASK_RUNNING);
+    }
+
+    return 0;
+}
+
+
 /* Function which is called by thread */
 int sk_thread_sockets_scheduler(void *data)
 {
     struct sx_bfd_rx_socket_user_info *user_info = NULL;
+    struct sx_bfd_rx_packet            pkt;
     int                                rc = 0;
+    int                                i;
 
     while (!kthread_should_stop()) {
         /* Lock scheduler DS from other manipulation on this DS */
         spin_lock_bh(&scheduler.sceduler_lock);
         /* Get the entry from LL of the sockets to be manged  */
         user_info = list_first_entry_or_null(&scheduler.scheduler_list, struct sx_bfd_rx_socket_user_info, list);
+        if (user_info) {
+            /* new data on the socket will schedule it again */
+            list_del_init(&user_info->list);
+        }
         /* Unlock scheduler DS to allow other manipulation on this DS */
         spin_unlock_bh(&scheduler.sceduler_lock);
         if (user_info) {
             BUG_ON(user_info->t_sock == NULL);
             BUG_ON(user_info->t_sock->sk == NULL);
 
-            /*Call to the function which get real packet on the socket and
-             * process it as required. */
-            recv_packet(user_info->t_sock, user_info->sock_type, user_info->vrf_id, user_info->bfd_user_space_pid);
+            /* Read a batch of the packets waiting on the socket and hand them
+             * to the RX workers. */
+            for (i = 0; i < SX_BFD_RX_BATCH; i++) {
+                if (READ_ONCE(user_info->sock_state) == sx_bfd_sock_state_dead) {
+                    break;
+                }
 
-            /* Decrement ref_counter of the socket - important when sock_destroy
-             * function was called. Actually socket won't be destroyed if ref_counter
-             * on socket is not 0. */
-            sock_put(user_info->t_sock->sk);
+                pkt.len = sx_bfd_socket_recv(user_info->t_sock, pkt.buf, MAX_BFD_SIZE, &pkt.metadata);
+                /* Check if any frame was received - len <= 0 - no frame received */
+                if (pkt.len <= 0) {
+                    break;
+                }
+
+                pkt.user_info = user_info;
+                sx_bfd_rx_worker_post(&pkt);
+            }
+
+            atomic64_inc(&rx_sock_batches);
+            atomic64_add(i, &rx_sock_packets);
 
             /* Lock scheduler DS from other manipulation on this DS */
             spin_lock_bh(&scheduler.sceduler_lock);
 
-            /* Decrement the number of packets waiting on this specific socket
-             * being on the head of the LL  - as now we are going to manage
-             * this frame*/
-            user_info->ref_count--;
-
-            if (user_info->ref_count == 0) {
-                if (user_info->sock_state == sx_bfd_sock_state_dead) {
-                    /* If the socket was signed as DEAD (means that there is delete socket process waiting -
-                     * sign to this process that socket can be released */
-                    complete(&user_info->free_wait);
-                }
-                /* If this is the only frame (which we are going to take care
-                 * in a minute - delete this socket from the LL. */
-                list_del_init(&user_info->list);
-            } else {
-                /*If more packets are waiting on this socket - move the socket
-                 * to the tail. Avoid preemption - when one socket can be
+            if ((i == SX_BFD_RX_BATCH) && (user_info->sock_state != sx_bfd_sock_state_dead) &&
+                list_empty(&user_info->list)) {
+                /*If more packets may wait on this socket - move the socket
+                 * to the tail, keeping its reference. Avoid preemption - when one socket can be
                  * taken care all time - when other are waiting.
                  * Managing kind of RR*/
-                list_move_tail(&user_info->list, &scheduler.scheduler_list);
+                list_add_tail(&user_info->list, &scheduler.scheduler_list);
+                spin_unlock_bh(&scheduler.sceduler_lock);
+                continue;
+            }
+
+            /* Decrement the number of references on this specific socket */
+            user_info->ref_count--;
+
+            if ((user_info->ref_count == 0) && (user_info->sock_state == sx_bfd_sock_state_dead)) {
+                /* If the socket was signed as DEAD (means that there is delete socket process waiting -
+                 * sign to this process that socket can be released */
+                complete(&user_info->free_wait);
             }
             /* Unlock scheduler DS to allow other manipulation on this DS */
             spin_unlock_bh(&scheduler.sceduler_lock);
+
+            /* Decrement ref_counter of the socket - important when sock_destroy
+             * function was called. Actually socket won't be destroyed if ref_counter
+             * on socket is not 0. */
+            sock_put(user_info->t_sock->sk);
         } else {
             /* Wait on scheduler_sem which will be "upped" by
              * sk_data_ready_custom callback when any socket notification
@@ -475,6 +642,7 @@ int sx_bfd_rx_socket_init(uint16_t port, struct socket ** sock, uint32_t vrf_id,
     sk_user_data->sock_type = (port == SX_BFD_SINGLEHOP_PORT) ? sx_bfd_SOCK_SINGLEHOP : sx_bfd_SOCK_MULTIHOP;
     INIT_LIST_HEAD(&sk_user_data->list);
     init_completion(&sk_user_data->free_wait);
+    atomic_set(&sk_user_data->inflight, 0);
 
     /* Save origin sk_data_ready to use it in user sk_data_ready */
     sk_user_data->sk_data_ready_origin_cb = t_sock->sk->sk_data_ready;
@@ -788,6 +956,19 @@ int sx_bfd_rx_vrf_is_sock_same(uint32_t vrf_id, struct socket *sock)
     return 0;
 }
 
+/* Function returns the RX sockets of the VRF. MUST BE CALLED UNDER rx_sess_lock. */
+void sx_bfd_rx_vrf_socks_get(uint32_t vrf_id, struct socket **sock_single_hop, struct socket **sock_multi_hop)
+{
+    struct sx_bfd_rx_vrf_entry * entry_vrf = NULL;
+
+    entry_vrf = sx_bfd_rx_vrf_lkp_entry_by_vrf_id(vrf_id);
+    BUG_ON(entry_vrf == NULL);
+    BUG_ON(entry_vrf->vrf == NULL);
+
+    *sock_single_hop = entry_vrf->vrf->sock_single_hop;
+    *sock_multi_hop = entry_vrf->vrf->sock_multi_hop;
+}
+
 void sx_bfd_rx_vrf_put(uint32_t vrf_id, int delete)
 {
     struct sx_bfd_rx_vrf_entry * entry_vrf = NULL;
@@ -829,9 +1010,118 @@ void sx_bfd_rx_socket_destroy(struct socket * sock)
     if (wait) {
         wait_for_completion(&sk_user_data->free_wait);
     }
+
+    /* Wait for the RX workers to process the packets already read from the socket */
+    wait_event(rx_inflight_wq, atomic_read(&sk_user_data->inflight) == 0);
+
     sock_release(sock);
 }
 
+static int sx_bfd_rx_workers_proc_show(struct seq_file *m, void *v)
+{
+    struct sx_bfd_rx_worker *worker;
+    int                      i;
+
+    seq_printf(m, "BFD RX: socket batches %llu packets %llu\n",
+               (u64)atomic64_read(&rx_sock_batches),
+               (u64)atomic64_read(&rx_sock_packets));
+
+    for (i = 0; i < rx_workers_num; i++) {
+        worker = per_cpu_ptr(rx_workers, rx_worker_cpus[i]);
+        seq_printf(m, "CPU %d: queued %llu dropped %llu pending %u batches %llu max_batch %u\n",
+                   worker->cpu,
+                   worker->queued,
+                   worker->dropped,
+                   worker->head - worker->tail,
+                   worker->batches,
+                   worker->max_batch);
+    }
+
+    return 0;
+}
+
+static int sx_bfd_rx_workers_proc_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, sx_bfd_rx_workers_proc_show, NULL);
+}
+
+static const struct file_operations sx_bfd_rx_workers_proc_fops = {
+    .owner = THIS_MODULE,
+    .open = sx_bfd_rx_workers_proc_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static void sx_bfd_rx_workers_destroy(void)
+{
+    struct sx_bfd_rx_worker *worker;
+    int                      i;
+
+    for (i = 0; i < rx_workers_num; i++) {
+        worker = per_cpu_ptr(rx_workers, rx_worker_cpus[i]);
+        if (worker->thread) {
+            kthread_stop(worker->thread);
+        }
+        vfree(worker->ring);
+    }
+
+    kfree(rx_worker_cpus);
+    rx_worker_cpus = NULL;
+    rx_workers_num = 0;
+
+    free_percpu(rx_workers);
+    rx_workers = NULL;
+}
+
+static int sx_bfd_rx_workers_create(void)
+{
+    struct sx_bfd_rx_worker *worker;
+    int                      cpu;
+    int                      err = 0;
+
+    rx_workers = alloc_percpu(struct sx_bfd_rx_worker);
+    rx_worker_cpus = kcalloc(nr_cpu_ids, sizeof(int), GFP_KERNEL);
+    if ((rx_workers == NULL) || (rx_worker_cpus == NULL)) {
+        printk(KERN_ERR "Failed to allocate BFD RX workers.\n");
+        err = -ENOMEM;
+        goto bail;
+    }
+
+    for_each_online_cpu(cpu) {
+        worker = per_cpu_ptr(rx_workers, cpu);
+
+        spin_lock_init(&worker->lock);
+        worker->cpu = cpu;
+        worker->ring = vmalloc(SX_BFD_RX_WORKER_RING_SIZE * sizeof(struct sx_bfd_rx_packet));
+        if (worker->ring == NULL) {
+            printk(KERN_ERR "Failed to allocate BFD RX worker ring for CPU %d.\n", cpu);
+            err = -ENOMEM;
+            goto bail;
+        }
+
+        /* the worker is counted first, so the destroy also frees its ring */
+        rx_worker_cpus[rx_workers_num++] = cpu;
+
+        worker->thread = kthread_create(sx_bfd_rx_worker_thread, worker, "sx_bfd_rx/%d", cpu);
+        if (IS_ERR(worker->thread)) {
+            printk(KERN_ERR "Kernel BFD RX worker for CPU %d failed to start.\n", cpu);
+            err = PTR_ERR(worker->thread);
+            worker->thread = NULL;
+            goto bail;
+        }
+
+        kthread_bind(worker->thread, cpu);
+        wake_up_process(worker->thread);
+    }
+
+bail:
+    if (err) {
+        sx_bfd_rx_workers_destroy();
+    }
+    return err;
+}
+
 int sx_bfd_socket_init(void)
 {
     int err = 0;
@@ -841,11 +1131,22 @@ int sx_bfd_socket_init(void)
         sema_init(&scheduler.scheduler_sem, 0);
         spin_lock_init(&scheduler.sceduler_lock);
 
+        err = sx_bfd_rx_workers_create();
+        if (err) {
+            goto bail;
+        }
+
+        if (proc_create(SX_BFD_RX_WORKERS_PROC_FILE, S_IRUGO, NULL, &sx_bfd_rx_workers_proc_fops) == NULL) {
+            printk(KERN_WARNING "create proc %s failed\n", SX_BFD_RX_WORKERS_PROC_FILE);
+        }
+
         if (bfd_thread == NULL) {
             bfd_thread = kthread_run(sk_thread_sockets_scheduler, (void*)NULL, "BFD thread");
             if (bfd_thread == NULL) {
                 printk(KERN_ERR "Kernel BFD single-hop thread failed to start.\n");
                 err = PTR_ERR(bfd_thread);
+                remove_proc_entry(SX_BFD_RX_WORKERS_PROC_FILE, NULL);
+                sx_bfd_rx_workers_destroy();
                 goto bail;
             }
         }
@@ -864,6 +1165,10 @@ void sx_bfd_socket_deinit(void)
 {
     if (g_initialized) {
         kthread_stop(bfd_thread);
+        bfd_thread = NULL;
+
+        remove_proc_entry(SX_BFD_RX_WORKERS_PROC_FILE, NULL);
+        sx_bfd_rx_workers_destroy();
 
         g_initialized = false;
     }
@@ -35,6 +35,8 @@
 
 #include <net/sock.h>
 
+#define MAX_BFD_SIZE 128
+
 struct metadata {
     union {
         struct sockaddr_in  peer_in;
@@ -78,6 +80,7 @@ void sx_bfd_rx_vrf_entry_free_if_needed(void *rx_vrf_entry);
 void * sx_bfd_rx_vrf_entry_lkp_by_vrf_id(uint32_t vrf_id);
 void sx_bfd_rx_vrf_hash_add(void *rx_vrf_entry);
 int sx_bfd_rx_vrf_is_sock_same(uint32_t vrf_id, struct socket *sock);
+void sx_bfd_rx_vrf_socks_get(uint32_t vrf_id, struct socket **sock_single_hop, struct socket **sock_multi_hop);
 
 
 #endif /* __SX_BFD_SOCKET_H_ */
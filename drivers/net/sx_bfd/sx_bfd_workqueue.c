@@ -31,39 +31,217 @@
  */
 
 #include <linux/slab.h>
-#include <linux/workqueue.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include "sx_bfd_workqueue.h"
 
-static struct workqueue_struct * workqueue = NULL;
-static bool                      g_initialized = false;
+/*
+ * BFD session timers run on a hierarchical timer wheel per CPU, each served by a kernel thread bound
+ * to its CPU. Sessions are spread round-robin over the wheels when their work is created, and
+ * re-arming a timer (done on every TX and on every received packet) is an O(1) list operation.
+ *
+ * Level 0 has one slot per jiffy, every upper level covers SX_BFD_WHEEL_LVL_SIZE slots of the level
+ * below and is cascaded down when the level below wraps.
+ */
+#define SX_BFD_WHEEL_LVL_BITS     6
+#define SX_BFD_WHEEL_LVL_SIZE     (1 << SX_BFD_WHEEL_LVL_BITS)
+#define SX_BFD_WHEEL_LVL_MASK     (SX_BFD_WHEEL_LVL_SIZE - 1)
+#define SX_BFD_WHEEL_LEVELS       3
+#define SX_BFD_WHEEL_MAX_DELTA    ((1UL << (SX_BFD_WHEEL_LEVELS * SX_BFD_WHEEL_LVL_BITS)) - 1)
+#define SX_BFD_WHEEL_HIST_BUCKETS 16 /* log2 usec buckets, the last one holds everything above */
+#define SX_BFD_WHEEL_PROC_FILE    "sx_bfd_timers"
+
+struct sx_bfd_timer_wheel {
+    spinlock_t                   lock;
+    unsigned long                clk;     /* next jiffy to be processed */
+    struct hlist_head            slots[SX_BFD_WHEEL_LEVELS][SX_BFD_WHEEL_LVL_SIZE];
+    unsigned int                 pending;
+    struct sx_bfd_delayed_work * running; /* handler being executed right now */
+    wait_queue_head_t            running_wq;
+    struct task_struct         * thread;
+    int                          cpu;
+
+    /* statistics, written by the wheel thread only */
+    u64 fired;
+    u64 cascaded;
+    u64 late_max_usec;
+    u64 early_max_usec;
+    u64 late_hist[SX_BFD_WHEEL_HIST_BUCKETS];
+    u64 early_hist[SX_BFD_WHEEL_HIST_BUCKETS];
+};
 struct sx_bfd_delayed_work {
-    struct delayed_work work;
-    handler_func        func;
-    uint32_t            data;
+    struct hlist_node           node;
+    unsigned long               expires;
+    ktime_t                     due;
+    struct sx_bfd_timer_wheel * wheel;
+    handler_func                func;
+    uint32_t                    data;
 };
-static void handler(struct work_struct * work)
+static struct sx_bfd_timer_wheel __percpu * wheels = NULL;
+static int                                * wheel_cpus = NULL;
+static int                                  wheel_cpus_num = 0;
+static atomic_t                             wheel_next = ATOMIC_INIT(0);
+static bool                                 g_initialized = false;
+static unsigned int sx_bfd_wheel_hist_bucket(u64 usec)
+{
+    unsigned int bucket = 0;
+
+    while (usec > 1 && bucket < SX_BFD_WHEEL_HIST_BUCKETS - 1) {
+        usec >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/* MUST BE CALLED UNDER wheel->lock */
+static void sx_bfd_wheel_insert(struct sx_bfd_timer_wheel * wheel, struct sx_bfd_delayed_work * dwork)
+{
+    unsigned long expires = dwork->expires;
+    long          delta = (long)(expires - wheel->clk);
+    int           lvl;
+
+    if (delta < 0) {
+        /* already expired, fire on the next tick */
+        expires = wheel->clk;
+        delta = 0;
+    } else if (delta > SX_BFD_WHEEL_MAX_DELTA) {
+        /* placed in the farthest slot, re-inserted with the real expiry on cascade */
+        expires = wheel->clk + SX_BFD_WHEEL_MAX_DELTA;
+        delta = SX_BFD_WHEEL_MAX_DELTA;
+    }
+
+    for (lvl = 0; lvl < SX_BFD_WHEEL_LEVELS - 1; lvl++) {
+        if (delta < (1L << ((lvl + 1) * SX_BFD_WHEEL_LVL_BITS))) {
+            break;
+        }
+    }
+
+    hlist_add_head(&dwork->node,
+                   &wheel->slots[lvl][(expires >> (lvl * SX_BFD_WHEEL_LVL_BITS)) & SX_BFD_WHEEL_LVL_MASK]);
+}
+
+/* MUST BE CALLED UNDER wheel->lock. Returns the index of the cascaded slot. */
+static int sx_bfd_wheel_cascade(struct sx_bfd_timer_wheel * wheel, int lvl)
 {
-    /*
-     *  <work> is actually of type <struct delayed_work> and it is the <work> field of <struct sx_bfd_delayed_work>.
-     *  So we need to retrieve the parent struct of <work> and we will get <struct sx_bfd_delayed_work>.
-     */
-    struct sx_bfd_delayed_work * sx_bfd_work = container_of((struct delayed_work*)work,
-                                                            struct sx_bfd_delayed_work,
-                                                            work);
+    struct sx_bfd_delayed_work * dwork;
+    struct hlist_node          * tmp;
+    struct hlist_head            list;
+    int                          idx;
 
-    /* printk(KERN_ERR "sx_bfd_work %p.\n", sx_bfd_work); */
-    /* printk(KERN_ERR "sx_bfd_work->data %d.\n", sx_bfd_work->data); */
+    idx = (wheel->clk >> (lvl * SX_BFD_WHEEL_LVL_BITS)) & SX_BFD_WHEEL_LVL_MASK;
 
+    hlist_move_list(&wheel->slots[lvl][idx], &list);
+    hlist_for_each_entry_safe(dwork, tmp, &list, node) {
+        hlist_del_init(&dwork->node);
+        sx_bfd_wheel_insert(wheel, dwork);
+        wheel->cascaded++;
+    }
 
-    /* Call function with data as argument */
-    sx_bfd_work->func(sx_bfd_work->data);
+    return idx;
+}
+
+static void sx_bfd_wheel_account(struct sx_bfd_timer_wheel * wheel, struct sx_bfd_delayed_work * dwork)
+{
+    s64 delta_usec = ktime_us_delta(ktime_get(), dwork->due);
+    u64 usec;
+
+    wheel->fired++;
+
+    if (delta_usec >= 0) {
+        usec = (u64)delta_usec;
+        wheel->late_hist[sx_bfd_wheel_hist_bucket(usec)]++;
+        if (usec > wheel->late_max_usec) {
+            wheel->late_max_usec = usec;
+        }
+    } else {
+        /* jiffy granularity may fire a timer before its exact due time */
+        usec = (u64)(-delta_usec);
+        wheel->early_hist[sx_bfd_wheel_hist_bucket(usec)]++;
+        if (usec > wheel->early_max_usec) {
+            wheel->early_max_usec = usec;
+        }
+    }
+}
+
+static void sx_bfd_wheel_run(struct sx_bfd_timer_wheel * wheel)
+{
+    struct sx_bfd_delayed_work * dwork;
+    struct hlist_head            expired;
+    int                          idx;
+    int                          lvl;
+
+    spin_lock_bh(&wheel->lock);
+
+    while (time_after_eq(jiffies, wheel->clk)) {
+        idx = wheel->clk & SX_BFD_WHEEL_LVL_MASK;
+
+        /* level below wrapped - bring down the timers of the next slot of the upper level */
+        for (lvl = 1; idx == 0 && lvl < SX_BFD_WHEEL_LEVELS; lvl++) {
+            idx = sx_bfd_wheel_cascade(wheel, lvl);
+        }
+
+        hlist_move_list(&wheel->slots[0][wheel->clk & SX_BFD_WHEEL_LVL_MASK], &expired);
+        wheel->clk++;
+
+        /* the lock is released while a handler runs, cancel/dispatch may unlink the other expired entries */
+        while (!hlist_empty(&expired)) {
+            dwork = hlist_entry(expired.first, struct sx_bfd_delayed_work, node);
+            hlist_del_init(&dwork->node);
+            wheel->pending--;
+            wheel->running = dwork;
+            spin_unlock_bh(&wheel->lock);
+
+            sx_bfd_wheel_account(wheel, dwork);
+
+            /* Call function with data as argument */
+            dwork->func(dwork->data);
+
+            spin_lock_bh(&wheel->lock);
+            wheel->running = NULL;
+            wake_up_all(&wheel->running_wq);
+        }
+    }
+
+    spin_unlock_bh(&wheel->lock);
+}
+
+static int sx_bfd_wheel_thread(void * data)
+{
+    struct sx_bfd_timer_wheel * wheel = (struct sx_bfd_timer_wheel*)data;
+
+    while (!kthread_should_stop()) {
+        sx_bfd_wheel_run(wheel);
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop()) {
+            __set_current_state(TASK_RUNNING);
+            break;
+        }
+
+        /* tick while timers are pending, sleep until dispatch wakes us otherwise */
+        if (READ_ONCE(wheel->pending)) {
+            schedule_timeout(1);
+        } else {
+            schedule();
+        }
+    }
+
+    return 0;
 }
 
 int sx_bfd_create_delayed_work(sx_bfd_delayed_work_t ** dwork, handler_func func, uint32_t data)
 {
     int                          err = 0;
     struct sx_bfd_delayed_work * t_dwork = NULL;
+    int                          idx;
 
     t_dwork = (struct sx_bfd_delayed_work*)kmalloc(sizeof(struct sx_bfd_delayed_work), GFP_KERNEL);
     if (t_dwork == NULL) {
@@ -72,7 +250,11 @@ int sx_bfd_create_delayed_work(sx_bfd_delayed_work_t ** dwork, handler_func func
         goto bail;
     }
 
-    INIT_DELAYED_WORK(&t_dwork->work, handler);
+    /* spread the sessions over the CPUs */
+    idx = (unsigned int)atomic_inc_return(&wheel_next) % wheel_cpus_num;
+
+    INIT_HLIST_NODE(&t_dwork->node);
+    t_dwork->wheel = per_cpu_ptr(wheels, wheel_cpus[idx]);
     t_dwork->func = func;
     t_dwork->data = data;
 
@@ -84,42 +266,192 @@ bail:
 
 void sx_bfd_destroy_delayed_work(sx_bfd_delayed_work_t * dwork)
 {
-    if (delayed_work_pending(&dwork->work)) {
-        cancel_delayed_work(&dwork->work);
-    }
+    sx_bfd_delayed_work_cancel(dwork);
     kfree(dwork);
 }
 
 void sx_bfd_destroy_delayed_work_sync(sx_bfd_delayed_work_t * dwork)
 {
-    if (delayed_work_pending(&dwork->work)) {
-        cancel_delayed_work_sync(&dwork->work);
-    }
+    struct sx_bfd_timer_wheel * wheel = dwork->wheel;
+
+    sx_bfd_delayed_work_cancel(dwork);
+
+    /* wait for a handler of this work that may be running now */
+    wait_event(wheel->running_wq, READ_ONCE(wheel->running) != dwork);
+
     kfree(dwork);
 }
 void sx_bfd_delayed_work_dispatch(sx_bfd_delayed_work_t * dwork, unsigned long delay)
 {
-    queue_delayed_work(workqueue, &dwork->work, delay);
+    struct sx_bfd_timer_wheel * wheel = dwork->wheel;
+    bool                        wake = false;
+
+    spin_lock_bh(&wheel->lock);
+
+    /* like queue_delayed_work(), a pending work is not re-armed */
+    if (hlist_unhashed(&dwork->node)) {
+        dwork->expires = jiffies + delay;
+        dwork->due = ktime_add_us(ktime_get(), jiffies_to_usecs(delay));
+        sx_bfd_wheel_insert(wheel, dwork);
+        wake = (wheel->pending++ == 0);
+    }
+
+    spin_unlock_bh(&wheel->lock);
+
+    if (wake) {
+        wake_up_process(wheel->thread);
+    }
 }
 
 void sx_bfd_delayed_work_cancel(sx_bfd_delayed_work_t * dwork)
 {
-    cancel_delayed_work(&dwork->work);
+    struct sx_bfd_timer_wheel * wheel = dwork->wheel;
+
+    spin_lock_bh(&wheel->lock);
+
+    if (!hlist_unhashed(&dwork->node)) {
+        hlist_del_init(&dwork->node);
+        wheel->pending--;
+    }
+
+    spin_unlock_bh(&wheel->lock);
+}
+
+static void sx_bfd_wheel_hist_show(struct seq_file * m, const char * title, const u64 * hist)
+{
+    int i;
+
+    seq_printf(m, "    %-12s", title);
+    for (i = 0; i < SX_BFD_WHEEL_HIST_BUCKETS; i++) {
+        seq_printf(m, " %llu", hist[i]);
+    }
+    seq_printf(m, "\n");
+}
+
+static int sx_bfd_wheel_proc_show(struct seq_file * m, void * v)
+{
+    struct sx_bfd_timer_wheel * wheel;
+    int                         i;
+
+    seq_printf(m, "BFD timer wheels (histogram buckets are log2 usec: <=1, 2, 4, ... , >=%u)\n",
+               1 << (SX_BFD_WHEEL_HIST_BUCKETS - 1));
+    seq_printf(m, "--------------------------------------------------------------------\n");
+
+    for (i = 0; i < wheel_cpus_num; i++) {
+        wheel = per_cpu_ptr(wheels, wheel_cpus[i]);
+
+        seq_printf(m, "CPU %d: pending %u fired %llu cascaded %llu late_max_usec %llu early_max_usec %llu\n",
+                   wheel->cpu,
+                   wheel->pending,
+                   wheel->fired,
+                   wheel->cascaded,
+                   wheel->late_max_usec,
+                   wheel->early_max_usec);
+        sx_bfd_wheel_hist_show(m, "late usec:", wheel->late_hist);
+        sx_bfd_wheel_hist_show(m, "early usec:", wheel->early_hist);
+    }
+
+    return 0;
+}
+
+static int sx_bfd_wheel_proc_open(struct inode * inode, struct file * file)
+{
+    return single_open(file, sx_bfd_wheel_proc_show, NULL);
+}
+
+static const struct file_operations sx_bfd_wheel_proc_fops = {
+    .owner = THIS_MODULE,
+    .open = sx_bfd_wheel_proc_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static void sx_bfd_wheels_destroy(void)
+{
+    struct sx_bfd_timer_wheel * wheel;
+    int                         i;
+
+    for (i = 0; i < wheel_cpus_num; i++) {
+        wheel = per_cpu_ptr(wheels, wheel_cpus[i]);
+        if (wheel->thread) {
+            kthread_stop(wheel->thread);
+            wheel->thread = NULL;
+        }
+    }
+
+    kfree(wheel_cpus);
+    wheel_cpus = NULL;
+    wheel_cpus_num = 0;
+
+    free_percpu(wheels);
+    wheels = NULL;
 }
 
+static int sx_bfd_wheels_create(void)
+{
+    struct sx_bfd_timer_wheel * wheel;
+    int                         cpu, lvl, i;
+    int                         err = 0;
+
+    wheels = alloc_percpu(struct sx_bfd_timer_wheel);
+    wheel_cpus = kcalloc(nr_cpu_ids, sizeof(int), GFP_KERNEL);
+    if ((wheels == NULL) || (wheel_cpus == NULL)) {
+        printk(KERN_ERR "Memory allocation for BFD timer wheels failed.\n");
+        err = -ENOMEM;
+        goto bail;
+    }
+
+    /* A thread whose CPU goes offline is moved by the scheduler and keeps serving its wheel */
+    for_each_online_cpu(cpu) {
+        wheel = per_cpu_ptr(wheels, cpu);
+
+        spin_lock_init(&wheel->lock);
+        init_waitqueue_head(&wheel->running_wq);
+        wheel->clk = jiffies;
+        wheel->cpu = cpu;
+        for (lvl = 0; lvl < SX_BFD_WHEEL_LEVELS; lvl++) {
+            for (i = 0; i < SX_BFD_WHEEL_LVL_SIZE; i++) {
+                INIT_HLIST_HEAD(&wheel->slots[lvl][i]);
+            }
+        }
+
+        wheel->thread = kthread_create(sx_bfd_wheel_thread, wheel, "sx_bfd_wheel/%d", cpu);
+        if (IS_ERR(wheel->thread)) {
+            printk(KERN_ERR "Kernel BFD timer wheel thread for CPU %d failed.\n", cpu);
+            err = PTR_ERR(wheel->thread);
+            wheel->thread = NULL;
+            goto bail;
+        }
+
+        kthread_bind(wheel->thread, cpu);
+        wheel_cpus[wheel_cpus_num++] = cpu;
+        wake_up_process(wheel->thread);
+    }
+
+bail:
+    if (err) {
+        sx_bfd_wheels_destroy();
+    }
+    return err;
+}
 
 int sx_bfd_workqueue_init(void)
 {
     int err = 0;
 
     if (!g_initialized) {
-        workqueue = create_singlethread_workqueue("sx_bfd_workqueue");
-        if (workqueue == NULL) {
+        err = sx_bfd_wheels_create();
+        if (err) {
             printk(KERN_ERR "Kernel BFD work queue initialization failed.\n");
             err = -EIO;
             goto bail;
         }
 
+        if (proc_create(SX_BFD_WHEEL_PROC_FILE, S_IRUGO, NULL, &sx_bfd_wheel_proc_fops) == NULL) {
+            printk(KERN_WARNING "create proc %s failed\n", SX_BFD_WHEEL_PROC_FILE);
+        }
+
         g_initialized = true;
     }
 
@@ -130,8 +462,8 @@ bail:
 void sx_bfd_workqueue_deinit(void)
 {
     if (g_initialized) {
-        flush_workqueue(workqueue);
-        destroy_workqueue(workqueue);
+        remove_proc_entry(SX_BFD_WHEEL_PROC_FILE, NULL);
+        sx_bfd_wheels_destroy();
         g_initialized = false;
     }
 }
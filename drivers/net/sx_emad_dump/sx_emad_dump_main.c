@@ -37,6 +37,11 @@
 #include <linux/rtnetlink.h>
 #include <linux/netlink.h>
 #include <net/netlink.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <linux/mlx_sx/kernel_user.h>
 #include <linux/mlx_sx/skb_hook.h>
@@ -57,6 +62,14 @@ int emad_dump_tx;
 MODULE_PARM_DESC(emad_dump_tx, "en/dis TX EMAD netlink notifications");
 module_param_named(emad_dump_tx, emad_dump_tx, int, 0444);
 
+int emad_dump_sample_ratio = 1;
+MODULE_PARM_DESC(emad_dump_sample_ratio, "dump one of every N EMADs (1 - dump all)");
+module_param_named(emad_dump_sample_ratio, emad_dump_sample_ratio, int, 0644);
+
+int emad_dump_ring_size_kb = 1024;
+MODULE_PARM_DESC(emad_dump_ring_size_kb, "size of the dump ring of each direction in KB (rounded up to power of 2)");
+module_param_named(emad_dump_ring_size_kb, emad_dump_ring_size_kb, int, 0444);
+
 MODULE_AUTHOR("Dan Akunis");
 MODULE_DESCRIPTION("Emad-Dump driver");
 MODULE_LICENSE("Dual BSD/GPL");
@@ -65,12 +78,12 @@ MODULE_LICENSE("Dual BSD/GPL");
 #if NETLINK_TAP_SUPPORTED
 
 /************************************************
- *  Local variables
+ *  Definitions
  ***********************************************/
-static struct sock             *__sx_emad_dump_nl_sk = NULL;
-static struct net_device      * __nl_dev = NULL;
-static struct netlink_tap       __nl_tap;
-static struct workqueue_struct *__work_queue = NULL;
+#define SX_EMAD_DUMP_PROC_FILE      "sx_emad_dump"
+#define SX_EMAD_DUMP_MAX_PAYLOAD    (3072) /* longer EMADs are truncated */
+#define SX_EMAD_DUMP_REC_FLAG_PAD   (1 << 0) /* skip to the start of the ring */
+#define SX_EMAD_DUMP_REC_FLAG_TRUNC (1 << 1)
 
 /************************************************
  *  Type definitions
@@ -94,11 +107,43 @@ enum {
     SX_EMAD_DUMP_NL_ATTR_MAX = __SX_EMAD_DUMP_NL_ATTR_MAX - 1
 };
 
-struct skb_to_dump {
-    struct work_struct             work;
-    struct sk_buff                *skb;
+/* record in the dump ring, followed by the EMAD and padded to 8 bytes */
+struct sx_emad_dump_rec {
+    u32 len;
+    u32 flags;
+};
+struct sx_emad_dump_ring_stats {
+    u64 seen;
+    u64 sampled;
+    u64 overflow; /* ring was full */
+    u64 truncated;
+    u64 dumped;
+    u64 nl_failed;
+    u64 nl_messages;
+};
+
+/* single producer-side lock; the worker reads the records between tail and head without it */
+struct sx_emad_dump_ring {
+    spinlock_t                     lock;
+    u8                            *buf;
+    u32                            size; /* power of 2 */
+    unsigned long                  head; /* free running byte offsets */
+    unsigned long                  tail;
     enum sx_emad_dump_nl_direction direction;
+    struct work_struct             work;
+    u32                            sample_count;
+    struct sx_emad_dump_ring_stats stats;
 };
+
+/************************************************
+ *  Local variables
+ ***********************************************/
+static struct sock             *__sx_emad_dump_nl_sk = NULL;
+static struct net_device      * __nl_dev = NULL;
+static struct netlink_tap       __nl_tap;
+static struct workqueue_struct *__work_queue = NULL;
+static struct sx_emad_dump_ring __rings[2]; /* by direction */
+
 static netdev_tx_t __emad_dump_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
     consume_skb(skb);
@@ -139,101 +184,286 @@ static void __emad_dump_setup(struct net_device *dev)
  * Functions                                    *
  ***********************************************/
 
-static int __nl_hwmsg_notify(const struct sk_buff *skb, enum sx_emad_dump_nl_direction direction)
+/* adds one EMAD as a netlink message to the batch skb */
+static int __nl_hwmsg_put(struct sk_buff                *skb_batch,
+                          const u8                      *data,
+                          u32                            len,
+                          enum sx_emad_dump_nl_direction direction)
 {
     struct sx_emad_dump_nl_msghdr *hdr;
     struct nlmsghdr               *nlh;
-    struct sk_buff                *skb_new;
-
-    skb_new = nlmsg_new(NLMSG_DEFAULT_SIZE, GFP_ATOMIC);
-    if (!skb_new) {
-        return -ENOMEM;
-    }
 
-    nlh = nlmsg_put(skb_new, 0, 0, 0, sizeof(*hdr), 0);
+    nlh = nlmsg_put(skb_batch, 0, 0, 0, sizeof(*hdr), 0);
     if (!nlh) {
-        goto nla_put_failure;
+        return -EMSGSIZE;
     }
 
     hdr = nlmsg_data(nlh);
     hdr->devindex = 0;
     hdr->reserved = 0;
 
-    if (nla_put(skb_new, SX_EMAD_DUMP_NL_ATTR_PAYLOAD, skb->len, skb->data)) {
+    if (nla_put(skb_batch, SX_EMAD_DUMP_NL_ATTR_PAYLOAD, len, data)) {
         goto nla_put_failure;
     }
 
-    if (nla_put_u32(skb_new, SX_EMAD_DUMP_NL_ATTR_TYPE, 0)) {
+    if (nla_put_u32(skb_batch, SX_EMAD_DUMP_NL_ATTR_TYPE, 0)) {
         goto nla_put_failure;
     }
 
-    if (nla_put_u8(skb_new, SX_EMAD_DUMP_NL_ATTR_DIRECTION, direction)) {
+    if (nla_put_u8(skb_batch, SX_EMAD_DUMP_NL_ATTR_DIRECTION, direction)) {
         goto nla_put_failure;
     }
 
-    nlmsg_end(skb_new, nlh);
-
-    nlmsg_notify(__sx_emad_dump_nl_sk, skb_new, 0, SX_NL_GRP_EMAD_DUMP, 0, GFP_ATOMIC);
+    nlmsg_end(skb_batch, nlh);
     return 0;
 
 nla_put_failure:
-    nlmsg_free(skb_new);
+    nlmsg_cancel(skb_batch, nlh);
     return -EMSGSIZE;
 }
 
 
-static void __work_handler(struct work_struct *work)
+/* sends the batch, returns the number of netlink datagrams sent */
+static int __nl_batch_flush(struct sk_buff **skb_batch)
 {
-    struct skb_to_dump *skb_to_dump = container_of(work, struct skb_to_dump, work);
-    int                 err;
+    int sent = 0;
+
+    if (!*skb_batch) {
+        return 0;
+    }
 
-    err = __nl_hwmsg_notify(skb_to_dump->skb, skb_to_dump->direction);
-    if (err && net_ratelimit()) {
-        printk(KERN_ERR "__work_handler failed (err=%d)\n", err);
+    if ((*skb_batch)->len == 0) {
+        nlmsg_free(*skb_batch);
+    } else {
+        /* one datagram carries all the messages of the batch */
+        nlmsg_notify(__sx_emad_dump_nl_sk, *skb_batch, 0, SX_NL_GRP_EMAD_DUMP, 0, GFP_KERNEL);
+        sent = 1;
     }
 
-    kfree_skb(skb_to_dump->skb);
-    kfree(skb_to_dump);
+    *skb_batch = NULL;
+    return sent;
 }
 
 
-static void __queue_skb_to_worker_thread(struct sk_buff *skb, enum sx_emad_dump_nl_direction direction)
+static void __work_handler(struct work_struct *work)
 {
-    struct skb_to_dump *skb_to_dump = kmalloc(sizeof(struct skb_to_dump), GFP_ATOMIC);
+    struct sx_emad_dump_ring *ring = container_of(work, struct sx_emad_dump_ring, work);
+    struct sx_emad_dump_rec  *rec;
+    struct sk_buff           *skb_batch = NULL;
+    unsigned long             head, tail, flags;
+    u64                       dumped = 0, nl_failed = 0, nl_messages = 0;
+    int                       err;
+
+    spin_lock_irqsave(&ring->lock, flags);
+    head = ring->head;
+    tail = ring->tail;
+    spin_unlock_irqrestore(&ring->lock, flags);
+
+    /* the producer does not touch the records between tail and head until tail moves */
+    while (tail != head) {
+        rec = (struct sx_emad_dump_rec*)(ring->buf + (tail & (ring->size - 1)));
+        if (rec->flags & SX_EMAD_DUMP_REC_FLAG_PAD) {
+            tail += ring->size - (tail & (ring->size - 1));
+            continue;
+        }
 
-    if (!skb_to_dump) {
-        if (net_ratelimit()) {
-            printk(KERN_ERR "EMAD_DUMP [direction: %d]: failed to allocate skb to dump\n", direction);
+        if (!skb_batch) {
+            skb_batch = nlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
         }
 
-        return;
-    }
+        err = skb_batch ? __nl_hwmsg_put(skb_batch, (u8*)(rec + 1), rec->len, ring->direction) : -ENOMEM;
+        if ((err == -EMSGSIZE) && (skb_batch->len > 0)) {
+            /* batch is full - send it and put the record on a new one */
+            nl_messages += __nl_batch_flush(&skb_batch);
+            continue;
+        }
 
-    skb_to_dump->direction = direction;
-    skb_to_dump->skb = skb_clone(skb, GFP_ATOMIC);
-    if (!skb_to_dump->skb) {
-        if (net_ratelimit()) {
-            printk(KERN_ERR "EMAD_DUMP [direction: %d]: failed on skb_clone()\n", direction);
+        if (err) {
+            nl_failed++;
+            if (net_ratelimit()) {
+                printk(KERN_ERR "EMAD_DUMP [direction: %d]: failed to build netlink message (err=%d)\n",
+                       ring->direction, err);
+            }
+        } else {
+            dumped++;
         }
 
-        kfree(skb_to_dump);
-        return;
+        tail += ALIGN(sizeof(*rec) + rec->len, sizeof(u64));
+    }
+
+    nl_messages += __nl_batch_flush(&skb_batch);
+
+    spin_lock_irqsave(&ring->lock, flags);
+    ring->tail = tail;
+    ring->stats.dumped += dumped;
+    ring->stats.nl_failed += nl_failed;
+    ring->stats.nl_messages += nl_messages;
+    spin_unlock_irqrestore(&ring->lock, flags);
+}
+
+
+static void __ring_skb(struct sk_buff *skb, enum sx_emad_dump_nl_direction direction)
+{
+    struct sx_emad_dump_ring *ring = &__rings[direction];
+    struct sx_emad_dump_rec  *rec;
+    unsigned long             flags, pos, contig, need;
+    u32                       len, rec_size;
+    int                       ratio;
+
+    spin_lock_irqsave(&ring->lock, flags);
+
+    ring->stats.seen++;
+
+    ratio = READ_ONCE(emad_dump_sample_ratio);
+    if ((ratio > 1) && (++ring->sample_count < (u32)ratio)) {
+        goto out;
+    }
+    ring->sample_count = 0;
+    ring->stats.sampled++;
+
+    len = min_t(u32, skb->len, SX_EMAD_DUMP_MAX_PAYLOAD);
+    rec_size = ALIGN(sizeof(*rec) + len, sizeof(u64));
+
+    /* a record never wraps - the end of the ring is padded instead */
+    pos = ring->head & (ring->size - 1);
+    contig = ring->size - pos;
+    need = (rec_size > contig) ? rec_size + contig : rec_size;
+
+    if (ring->size - (ring->head - ring->tail) < need) {
+        ring->stats.overflow++;
+        goto out;
+    }
+
+    if (rec_size > contig) {
+        rec = (struct sx_emad_dump_rec*)(ring->buf + pos);
+        rec->len = 0;
+        rec->flags = SX_EMAD_DUMP_REC_FLAG_PAD;
+        ring->head += contig;
+        pos = 0;
+    }
+
+    rec = (struct sx_emad_dump_rec*)(ring->buf + pos);
+    rec->len = len;
+    rec->flags = 0;
+    if (len < skb->len) {
+        rec->flags |= SX_EMAD_DUMP_REC_FLAG_TRUNC;
+        ring->stats.truncated++;
+    }
+
+    /* skb may be non-linear */
+    if (skb_copy_bits(skb, 0, rec + 1, len)) {
+        goto out;
     }
 
-    INIT_WORK(&skb_to_dump->work, __work_handler);
-    queue_work(__work_queue, &skb_to_dump->work);
+    ring->head += rec_size;
+
+    /* does nothing if the worker is already pending */
+    queue_work(__work_queue, &ring->work);
+
+out:
+    spin_unlock_irqrestore(&ring->lock, flags);
 }
 
 
 static void __emad_dump_hook_rx(struct sx_dev *sx_dev, struct sk_buff *skb, void *context)
 {
-    __queue_skb_to_worker_thread(skb, SX_EMAD_DUMP_NL_DIRECTION_RX);
+    __ring_skb(skb, SX_EMAD_DUMP_NL_DIRECTION_RX);
 }
 
 
 static void __emad_dump_hook_tx(struct sx_dev *sx_dev, struct sk_buff *skb, void *context)
 {
-    __queue_skb_to_worker_thread(skb, SX_EMAD_DUMP_NL_DIRECTION_TX);
+    __ring_skb(skb, SX_EMAD_DUMP_NL_DIRECTION_TX);
+}
+
+
+static int __emad_dump_proc_show(struct seq_file *m, void *v)
+{
+    struct sx_emad_dump_ring_stats stats;
+    struct sx_emad_dump_ring      *ring;
+    unsigned long                  flags, used;
+    int                            i;
+
+    seq_printf(m, "sample ratio: 1/%d\n\n", max(emad_dump_sample_ratio, 1));
+
+    for (i = 0; i < ARRAY_SIZE(__rings); i++) {
+        ring = &__rings[i];
+        if (!ring->buf) {
+            continue;
+        }
+
+        spin_lock_irqsave(&ring->lock, flags);
+        memcpy(&stats, &ring->stats, sizeof(stats));
+        used = ring->head - ring->tail;
+        spin_unlock_irqrestore(&ring->lock, flags);
+
+        seq_printf(m, "%s: ring %u bytes, %lu used\n",
+                   (ring->direction == SX_EMAD_DUMP_NL_DIRECTION_TX) ? "TX" : "RX", ring->size, used);
+        seq_printf(m, "    seen ........... %llu\n", stats.seen);
+        seq_printf(m, "    sampled ........ %llu\n", stats.sampled);
+        seq_printf(m, "    overflow ....... %llu\n", stats.overflow);
+        seq_printf(m, "    truncated ...... %llu\n", stats.truncated);
+        seq_printf(m, "    dumped ......... %llu\n", stats.dumped);
+        seq_printf(m, "    netlink failed . %llu\n", stats.nl_failed);
+        seq_printf(m, "    netlink msgs ... %llu\n", stats.nl_messages);
+    }
+
+    return 0;
+}
+
+
+static int __emad_dump_proc_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, __emad_dump_proc_show, NULL);
+}
+
+
+static const struct file_operations __emad_dump_proc_fops = {
+    .owner = THIS_MODULE,
+    .open = __emad_dump_proc_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+static void __rings_deinit(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(__rings); i++) {
+        vfree(__rings[i].buf);
+        __rings[i].buf = NULL;
+    }
+}
+
+
+static int __rings_init(void)
+{
+    u32 size;
+    int i;
+
+    if (emad_dump_ring_size_kb <= 0) {
+        printk(KERN_ERR "invalid emad_dump_ring_size_kb (%d)\n", emad_dump_ring_size_kb);
+        return -EINVAL;
+    }
+
+    size = roundup_pow_of_two(max_t(u32, emad_dump_ring_size_kb * 1024, 2 * SX_EMAD_DUMP_MAX_PAYLOAD));
+
+    for (i = 0; i < ARRAY_SIZE(__rings); i++) {
+        memset(&__rings[i], 0, sizeof(__rings[i]));
+        spin_lock_init(&__rings[i].lock);
+        INIT_WORK(&__rings[i].work, __work_handler);
+        __rings[i].direction = i;
+        __rings[i].size = size;
+
+        __rings[i].buf = vmalloc(size);
+        if (!__rings[i].buf) {
+            printk(KERN_ERR "failed to allocate emad-dump ring (%u bytes)\n", size);
+            __rings_deinit();
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
 }
 
 
@@ -250,10 +480,16 @@ int __init sx_emad_dump_init(void)
     memset(&cfg, 0, sizeof(cfg));
     cfg.groups = SX_NL_GRP_MAX;
 
+    err = __rings_init();
+    if (err) {
+        return err;
+    }
+
     __work_queue = create_singlethread_workqueue("emad_dump_queue");
     if (!__work_queue) {
         printk(KERN_ERR "failed to create work queue for emad_dump\n");
-        return -ENOMEM;
+        err = -ENOMEM;
+        goto wq_create_failed;
     }
 
     __sx_emad_dump_nl_sk = netlink_kernel_create(&init_net, NETLINK_EMAD_DUMP, &cfg);
@@ -281,6 +517,10 @@ int __init sx_emad_dump_init(void)
 
     netdev_registered = 1;
 
+    if (!proc_create(SX_EMAD_DUMP_PROC_FILE, S_IRUGO, NULL, &__emad_dump_proc_fops)) {
+        printk(KERN_WARNING "failed to create proc file %s\n", SX_EMAD_DUMP_PROC_FILE);
+    }
+
     if (emad_dump_rx) {
         printk(KERN_INFO "start emad-dump on RX\n");
 
@@ -309,6 +549,7 @@ tx_skb_hook_failed:
     }
 
 rx_skb_hook_failed:
+    remove_proc_entry(SX_EMAD_DUMP_PROC_FILE, NULL);
     unregister_netdev(__nl_dev);
 
 reg_netdev_failed:
@@ -322,6 +563,9 @@ alloc_netdev_failed:
 nl_create_failed:
     destroy_workqueue(__work_queue);
 
+wq_create_failed:
+    __rings_deinit();
+
     return err;
 }
 
@@ -340,9 +584,15 @@ void sx_emad_dump_exit(void)
         sx_core_skb_hook_tx_unregister(__emad_dump_hook_tx);
     }
 
+    remove_proc_entry(SX_EMAD_DUMP_PROC_FILE, NULL);
+
+    /* hooks are gone - send what is left on the rings */
+    flush_workqueue(__work_queue);
+
     unregister_netdev(__nl_dev);
     netlink_kernel_release(__sx_emad_dump_nl_sk);
     destroy_workqueue(__work_queue);
+    __rings_deinit();
 }
 
 #else /* NETLINK_TAP_SUPPORTED */
@@ -209,6 +209,7 @@ static struct rtnl_link_ops sx_bridge_link_ops __read_mostly = {
     .policy = sx_bridge_policy,
     .priv_size = sizeof(struct sx_net_priv),
     .setup = sx_bridge_setup,
+    .get_num_tx_queues = sx_netdev_get_num_tx_queues,
     .validate = sx_bridge_validate,
     .newlink = sx_bridge_newlink,
     .dellink = sx_bridge_dellink,
@@ -46,6 +46,7 @@
 #include <linux/mlx_sx/driver.h>
 #include <linux/mlx_sx/kernel_user.h>
 #include <linux/net_tstamp.h>
+#include <linux/u64_stats_sync.h>
 
 #define DRV_NAME    "sx_netdev"
 #define PFX         DRV_NAME ": "
@@ -60,6 +61,7 @@
 #define SX_PACKET_DEFAULT_TC    5
 #define TX_HEADER_RP_RIF_TO_FID (15 * 1024)
 #define SX_VLAN_PRIO_MAX        7
+#define SX_NETDEV_NUM_TX_QUEUES (SX_VLAN_PRIO_MAX + 1) /* one TX queue per priority */
 
 
 static const char *net_port_vlan_type_str[] = {
@@ -83,14 +85,27 @@ struct net_port_vlan_info {
     u16                     lag_id;
     u16                     vlan;
 };
+/* Updated from the NAPI poll and the xmit path, both run with BH disabled */
+struct sx_netdev_pcpu_stats {
+    u64                   rx_packets;
+    u64                   rx_bytes;
+    u64                   tx_packets;
+    u64                   tx_bytes;
+    struct u64_stats_sync syncp;
+};
+
 struct sx_net_priv {
     u8                        swid;
     struct net_port_vlan_info trap_ids[NUM_OF_NET_DEV_TYPE][MAX_NUM_TRAPS_TO_REGISTER];
     u16                       num_of_traps[NUM_OF_NET_DEV_TYPE];
     struct sx_dev            *dev;
-    struct net_device_stats   stats;
+    struct net_device_stats   stats;          /* drop/error counters, packets and bytes are in pcpu_stats */
+    struct sx_netdev_pcpu_stats __percpu *pcpu_stats;
+    struct napi_struct        napi;
+    struct sk_buff_head       rx_queue;       /* packets handed by sx_core, drained by the NAPI poll */
     u64                       mac;
     unsigned long             active_vlans[BITS_TO_LONGS(VLAN_N_VID)];
+    u8                        vlan_child_exist; /* a VLAN other than 0 is set in active_vlans */
     u16                       port;
     u16                       mid;
     int                       is_lag;
@@ -129,6 +144,7 @@ u64 sx_netdev_mac_to_u64(u8 *addr);
 void sx_netdev_u64_to_mac(u8* addr, u64 mac);
 int sx_netdev_register_device(struct net_device *netdev, int should_rtnl_lock,
                               int admin_state);
+unsigned int sx_netdev_get_num_tx_queues(void);
 
 /* Global core context */
 extern struct net_device    *port_netdev_db[MAX_SYSPORT_NUM];
@@ -80,6 +80,14 @@ int carrier_set_on_pude_disable = 0;
 module_param_named(carrier_set_on_pude_disable, carrier_set_on_pude_disable, int, 0644);
 MODULE_PARM_DESC(carrier_set_on_pude_disable, "en/dis carrier set on pude event");
 
+int sx_netdev_napi_weight = NAPI_POLL_WEIGHT;
+module_param_named(sx_netdev_napi_weight, sx_netdev_napi_weight, int, 0444);
+MODULE_PARM_DESC(sx_netdev_napi_weight, "max number of packets a netdev passes to the stack per NAPI poll");
+
+int sx_netdev_rx_queue_len = 1000;
+module_param_named(sx_netdev_rx_queue_len, sx_netdev_rx_queue_len, int, 0644);
+MODULE_PARM_DESC(sx_netdev_rx_queue_len, "max number of RX packets waiting for the NAPI poll of a netdev");
+
 int offload_fwd_mark_en = 1;
 #ifdef CONFIG_NET_SWITCHDEV
 module_param_named(offload_fwd_mark_en, offload_fwd_mark_en, int, 0644);
@@ -256,12 +264,49 @@ static void sx_netdev_fix_sx_skb(struct completion_info *comp_info, struct sk_bu
 #endif
 }
 
+static int sx_netdev_napi_poll(struct napi_struct *napi, int budget)
+{
+    struct sx_net_priv          *net_priv = container_of(napi, struct sx_net_priv, napi);
+    struct sx_netdev_pcpu_stats *pcpu_stats;
+    struct sk_buff              *skb;
+    int                          work_done = 0;
+
+    pcpu_stats = this_cpu_ptr(net_priv->pcpu_stats);
+
+    while (work_done < budget) {
+        skb = skb_dequeue(&net_priv->rx_queue);
+        if (!skb) {
+            break;
+        }
+
+        u64_stats_update_begin(&pcpu_stats->syncp);
+        pcpu_stats->rx_packets++;
+        pcpu_stats->rx_bytes += skb->len;
+        u64_stats_update_end(&pcpu_stats->syncp);
+
+        napi_gro_receive(napi, skb);
+        work_done++;
+    }
+
+    if (work_done < budget) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 19, 0)
+        napi_complete_done(napi, work_done);
+#else
+        napi_complete(napi);
+#endif
+        /* a packet queued after the last dequeue could not schedule us */
+        if (!skb_queue_empty(&net_priv->rx_queue)) {
+            napi_reschedule(napi);
+        }
+    }
+
+    return work_done;
+}
+
 static void sx_netdev_handle_rx(struct completion_info *comp_info, struct net_device *netdev)
 {
     struct sx_net_priv         *net_priv = NULL;
     struct sk_buff             *skb;
-    unsigned long               last_bit = 0;
-    u8                          vlan_child_exist = 0;
     int                         ret = 0;
     struct skb_shared_hwtstamps hwts = *skb_hwtstamps(comp_info->skb);
 
@@ -287,9 +332,16 @@ static void sx_netdev_handle_rx(struct completion_info *comp_info, struct net_de
         return;
     }
 
-    last_bit = find_last_bit(net_priv->active_vlans, VLAN_N_VID);
-    vlan_child_exist = last_bit < VLAN_N_VID && last_bit != 0;
-    ret = sx_netdev_rx_apply_vlan_logic(vlan_child_exist, comp_info->is_tagged, comp_info->skb, &skb, comp_info->vid);
+    if (skb_queue_len(&net_priv->rx_queue) >= sx_netdev_rx_queue_len) {
+        net_priv->stats.rx_dropped++;
+        if (sx_netdev_rx_debug) {
+            printk(KERN_ERR PFX "%s: netdev %s RX queue is full! dropping packet!\n", __func__, netdev->name);
+        }
+        return;
+    }
+
+    ret = sx_netdev_rx_apply_vlan_logic(net_priv->vlan_child_exist, comp_info->is_tagged, comp_info->skb, &skb,
+                                        comp_info->vid);
     if (ret) {
         net_priv->stats.rx_dropped++;
         if (sx_netdev_rx_debug) {
@@ -302,10 +354,12 @@ static void sx_netdev_handle_rx(struct completion_info *comp_info, struct net_de
 
     skb_hwtstamps(skb)->hwtstamp = hwts.hwtstamp;
 
-    net_priv->stats.rx_packets++;
-    net_priv->stats.rx_bytes += skb->len;
+    skb_queue_tail(&net_priv->rx_queue, skb);
 
-    netif_rx(skb);
+    /* we may be called from the sx_core CQ thread, let the softirq run on local_bh_enable() */
+    local_bh_disable();
+    napi_schedule(&net_priv->napi);
+    local_bh_enable();
 }
 
 static void sx_netdev_log_port_rx_pkt(struct completion_info *comp_info, void *context)
@@ -666,6 +720,8 @@ static int sx_netdev_open(struct net_device *netdev)
 
     sx_timestamp_init_config(&net_priv->hwtstamp_config);
 
+    napi_enable(&net_priv->napi);
+
 out:
     printk(KERN_INFO PFX "%s: exit\n", __func__);
     return err;
@@ -703,6 +759,9 @@ static int sx_netdev_stop(struct net_device *netdev)
     netif_tx_disable(netdev);
     netif_carrier_off(netdev);
 
+    napi_disable(&net_priv->napi);
+    skb_queue_purge(&net_priv->rx_queue);
+
     printk(KERN_INFO PFX "%s: exit\n", __func__);
     return 0;
 }
@@ -769,6 +828,42 @@ static int sx_netdev_get_port_prio_to_tc(struct net_device *netdev, struct sk_bu
     return err;
 }
 
+/*
+ * Data traffic: the TX queue the stack picked is the priority (see sx_netdev_set_tx_queues()),
+ * so map it to the etclass whose SDQ the profile assigns to that TC. Port netdevs go through
+ * the port prio2tc table, swid and bridge netdevs have no port and use queue N as TC N.
+ * Frames that exceed SX_LIMITED_MTU_MAX_PKT_SIZE once the ISX header is added stay on
+ * etclass 0, since sx_core_post_send() refuses them on SDQs bound to a high cpu_tclass.
+ */
+static void sx_netdev_get_queue_tc(struct net_device *netdev, struct sk_buff *skb, uint8_t *tc)
+{
+    struct sx_net_priv *net_priv = netdev_priv(netdev);
+    u16                 queue = skb_get_queue_mapping(skb);
+    int                 err = 0;
+
+    *tc = 0;
+
+    if ((netdev_get_num_tc(netdev) == 0) || (queue > SX_VLAN_PRIO_MAX) ||
+        (skb->len + ISX_HDR_SIZE > SX_LIMITED_MTU_MAX_PKT_SIZE)) {
+        return;
+    }
+
+    if (!net_priv->is_port_netdev) {
+        *tc = queue;
+        return;
+    }
+
+    CALL_SX_CORE_FUNC_WITH_RET(sx_core_get_prio2tc, err, net_priv->dev,
+                               net_priv->port, net_priv->is_lag, queue, tc);
+    if (err) {
+        if (sx_netdev_tx_debug) {
+            printk(KERN_DEBUG PFX "%s: can't get prio2tc for queue %u, using etclass 0\n",
+                   netdev->name, queue);
+        }
+        *tc = 0;
+    }
+}
+
 static int sx_netdev_set_vlan_according_hw(struct net_device *netdev, struct sk_buff *skb)
 {
     struct sx_net_priv *net_priv = netdev_priv(netdev);
@@ -776,8 +871,6 @@ static int sx_netdev_set_vlan_according_hw(struct net_device *netdev, struct sk_
     uint8_t             is_tagged, is_prio_tagged;
     struct vlan_ethhdr *veth = NULL;
     int                 err = 0;
-    unsigned long       last_bit = 0;
-    u8                  vlan_child_exist = 0;
 
     veth = (struct vlan_ethhdr *)(skb->data);
     if (ntohs(veth->h_vlan_proto) != ETH_P_8021Q) {
@@ -788,11 +881,8 @@ static int sx_netdev_set_vlan_according_hw(struct net_device *netdev, struct sk_
         return 0;
     }
 
-    last_bit = find_last_bit(net_priv->active_vlans, VLAN_N_VID);
-    vlan_child_exist = last_bit < VLAN_N_VID && last_bit != 0;
-
     /* We apply vlan tagging logic only if netdev has vlan child */
-    if (!vlan_child_exist) {
+    if (!net_priv->vlan_child_exist) {
         if (sx_netdev_tx_debug) {
             printk(KERN_DEBUG PFX "%s: netdev (%s) No vlan child.\n", __func__, netdev->name);
         }
@@ -1080,16 +1170,17 @@ error:
 
 static int sx_netdev_hard_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 {
-    struct sx_net_priv *net_priv = netdev_priv(netdev);
-    int                 err = 0;
-    int                 len = 0;
-    struct isx_meta     meta;
-    struct sk_buff     *tmp_skb = NULL;
-    struct vlan_ethhdr *veth = NULL;
-    u8                  is_ptp_packet = 0;
-    u16                 pcp = 0;
-    uint16_t            ifc_vlan = 0;
-    u8                  is_ifc_rp = 0;
+    struct sx_net_priv          *net_priv = netdev_priv(netdev);
+    struct sx_netdev_pcpu_stats *pcpu_stats;
+    int                          err = 0;
+    int                          len = 0;
+    struct isx_meta              meta;
+    struct sk_buff              *tmp_skb = NULL;
+    struct vlan_ethhdr          *veth = NULL;
+    u8                           is_ptp_packet = 0;
+    u16                          pcp = 0;
+    uint16_t                     ifc_vlan = 0;
+    u8                           is_ifc_rp = 0;
 
     if (net_priv->dev == NULL) {
         if (printk_ratelimit()) {
@@ -1200,32 +1291,23 @@ static int sx_netdev_hard_start_xmit(struct sk_buff *skb, struct net_device *net
         veth->h_vlan_TCI = (veth->h_vlan_TCI & htons(~VLAN_PRIO_MASK)) | (htons(pcp << VLAN_PRIO_SHIFT));
     }
 
-    /* If there's no place for the ISX header
-     * need to alloc a new skb and use it instead */
+    /* The stack reserves needed_headroom for the ISX header, so this only
+     * reallocates the head of cloned skbs or skbs built without it */
     tmp_skb = skb;
     len = skb->len;
-    if (skb_headroom(skb) < ISX_HDR_SIZE) {
-        if (sx_netdev_tx_debug) {
-            printk(KERN_INFO PFX "sx_netdev_hard_start_xmit: "
-                   "No place for the ISX header, allocating a new "
-                   "SKB\n");
-        }
-        tmp_skb = alloc_skb(ISX_HDR_SIZE + len, GFP_ATOMIC);
-        if (!tmp_skb) {
-            if (printk_ratelimit()) {
-                printk(KERN_ERR PFX "sx_netdev_hard_start_"
-                       "xmit: Err: failed allocating "
-                       "SKB\n");
-            }
-            net_priv->stats.tx_dropped++;
-            kfree_skb(skb);
-            return -ENOMEM;
+    if (skb_cow_head(skb, ISX_HDR_SIZE)) {
+        if (printk_ratelimit()) {
+            printk(KERN_ERR PFX "sx_netdev_hard_start_"
+                   "xmit: Err: failed to make room for the ISX header\n");
         }
-
-        skb_reserve(tmp_skb, ISX_HDR_SIZE);
-        memcpy(skb_put(tmp_skb, len), skb->data, len);
+        net_priv->stats.tx_dropped++;
         kfree_skb(skb);
-        len += ISX_HDR_SIZE;
+        return NETDEV_TX_OK;
+    }
+
+    /* after any VLAN tag was added, so the length check sees the frame that is sent */
+    if (meta.type == SX_PKT_TYPE_ETH_DATA) {
+        sx_netdev_get_queue_tc(netdev, skb, &meta.etclass);
     }
 
     if (sx_netdev_sx_core_if_get_reference()) {
@@ -1255,17 +1337,80 @@ static int sx_netdev_hard_start_xmit(struct sk_buff *skb, struct net_device *net
         return NETDEV_TX_OK;
     }
 
-    net_priv->stats.tx_bytes += len;
-    net_priv->stats.tx_packets++;
+    pcpu_stats = this_cpu_ptr(net_priv->pcpu_stats);
+    u64_stats_update_begin(&pcpu_stats->syncp);
+    pcpu_stats->tx_bytes += len;
+    pcpu_stats->tx_packets++;
+    u64_stats_update_end(&pcpu_stats->syncp);
 
     return NETDEV_TX_OK;
 }
 
-static struct net_device_stats * sx_netdev_get_stats(struct net_device *netdev)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+static void sx_netdev_get_stats64(struct net_device *netdev, struct rtnl_link_stats64 *stats)
+#else
+static struct rtnl_link_stats64 * sx_netdev_get_stats64(struct net_device *netdev, struct rtnl_link_stats64 *stats)
+#endif
+{
+    struct sx_net_priv          *net_priv = netdev_priv(netdev);
+    struct sx_netdev_pcpu_stats *pcpu_stats;
+    u64                          rx_packets, rx_bytes, tx_packets, tx_bytes;
+    unsigned int                 start;
+    int                          cpu;
+
+    netdev_stats_to_stats64(stats, &net_priv->stats);
+
+    for_each_possible_cpu(cpu) {
+        pcpu_stats = per_cpu_ptr(net_priv->pcpu_stats, cpu);
+        do {
+            start = u64_stats_fetch_begin(&pcpu_stats->syncp);
+            rx_packets = pcpu_stats->rx_packets;
+            rx_bytes = pcpu_stats->rx_bytes;
+            tx_packets = pcpu_stats->tx_packets;
+            tx_bytes = pcpu_stats->tx_bytes;
+        } while (u64_stats_fetch_retry(&pcpu_stats->syncp, start));
+
+        stats->rx_packets += rx_packets;
+        stats->rx_bytes += rx_bytes;
+        stats->tx_packets += tx_packets;
+        stats->tx_bytes += tx_bytes;
+    }
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 11, 0)
+    return stats;
+#endif
+}
+
+/* Called by register_netdevice() for every sx netdev (swid, port/lag and bridge) */
+static int sx_netdev_init(struct net_device *netdev)
 {
     struct sx_net_priv *net_priv = netdev_priv(netdev);
+    int                 cpu;
+
+    net_priv->pcpu_stats = alloc_percpu(struct sx_netdev_pcpu_stats);
+    if (!net_priv->pcpu_stats) {
+        printk(KERN_ERR PFX "%s: failed to allocate stats for netdev %s\n", __func__, netdev->name);
+        return -ENOMEM;
+    }
+
+    for_each_possible_cpu(cpu) {
+        u64_stats_init(&per_cpu_ptr(net_priv->pcpu_stats, cpu)->syncp);
+    }
 
-    return &net_priv->stats;
+    skb_queue_head_init(&net_priv->rx_queue);
+    netif_napi_add(netdev, &net_priv->napi, sx_netdev_napi_poll, sx_netdev_napi_weight);
+
+    return 0;
+}
+
+static void sx_netdev_uninit(struct net_device *netdev)
+{
+    struct sx_net_priv *net_priv = netdev_priv(netdev);
+
+    netif_napi_del(&net_priv->napi);
+    skb_queue_purge(&net_priv->rx_queue);
+    free_percpu(net_priv->pcpu_stats);
+    net_priv->pcpu_stats = NULL;
 }
 
 static void sx_netdev_set_multicast(struct net_device *netdev)
@@ -1386,11 +1531,21 @@ static int sx_netdev_do_ioctl(struct net_device *netdev, struct ifreq *ifr, int
     }
 }
 
+/* Cache the active_vlans lookup done for every RX and TX packet */
+static void sx_netdev_update_vlan_child_exist(struct sx_net_priv *net_priv)
+{
+    unsigned long last_bit;
+
+    last_bit = find_last_bit(net_priv->active_vlans, VLAN_N_VID);
+    net_priv->vlan_child_exist = last_bit < VLAN_N_VID && last_bit != 0;
+}
+
 static int sx_netdev_vlan_rx_add_vid(struct net_device *netdev, __be16 proto, u16 vid)
 {
     struct sx_net_priv *net_priv = netdev_priv(netdev);
 
     set_bit(vid, net_priv->active_vlans);
+    sx_netdev_update_vlan_child_exist(net_priv);
 
     if (sx_netdev_rx_debug) {
         printk(KERN_INFO PFX "adding VLAN:%d on netdev %s\n", vid, netdev->name);
@@ -1406,10 +1561,13 @@ static int sx_netdev_vlan_rx_kill_vid(struct net_device *netdev, __be16 proto, u
         printk(KERN_INFO PFX "Killing VID:%d netdev %s\n", vid, netdev->name);
     }
     clear_bit(vid, net_priv->active_vlans);
+    sx_netdev_update_vlan_child_exist(net_priv);
     return 0;
 }
 
 static const struct net_device_ops sx_netdev_ops = {
+    .ndo_init = sx_netdev_init,
+    .ndo_uninit = sx_netdev_uninit,
     .ndo_open = sx_netdev_open,
     .ndo_stop = sx_netdev_stop,
     .ndo_start_xmit = sx_netdev_hard_start_xmit,
@@ -1417,7 +1575,7 @@ static const struct net_device_ops sx_netdev_ops = {
     .ndo_set_rx_mode = sx_netdev_set_multicast,
     .ndo_do_ioctl = sx_netdev_do_ioctl,
     .ndo_change_mtu = sx_netdev_change_mtu,
-    .ndo_get_stats = sx_netdev_get_stats,
+    .ndo_get_stats64 = sx_netdev_get_stats64,
     .ndo_vlan_rx_add_vid = sx_netdev_vlan_rx_add_vid,
     .ndo_vlan_rx_kill_vid = sx_netdev_vlan_rx_kill_vid,
     .ndo_tx_timeout = NULL, /* Disable the transmit timeout function.  */
@@ -1457,6 +1615,38 @@ const struct ethtool_ops sx_ethtool_ops = {
     .get_ts_info = sx_get_ts_info,
 };
 
+unsigned int sx_netdev_get_num_tx_queues(void)
+{
+    return SX_NETDEV_NUM_TX_QUEUES;
+}
+
+/*
+ * Map skb->priority to a TX queue: priorities 0-7 get their own queue (and so
+ * their own qdisc and xmit lock), higher priorities share the last one. Data
+ * traffic then takes the SDQ of the queue's TC (sx_netdev_get_queue_tc()),
+ * control traffic the one that prio2tc gives for the packet PCP.
+ */
+static void sx_netdev_set_tx_queues(struct net_device *netdev)
+{
+    int prio, tc;
+
+    if (netdev->real_num_tx_queues < SX_NETDEV_NUM_TX_QUEUES) {
+        return;
+    }
+
+    if (netdev_set_num_tc(netdev, SX_NETDEV_NUM_TX_QUEUES)) {
+        return;
+    }
+
+    for (tc = 0; tc < SX_NETDEV_NUM_TX_QUEUES; tc++) {
+        netdev_set_tc_queue(netdev, tc, 1, tc);
+    }
+
+    for (prio = 0; prio <= TC_BITMASK; prio++) {
+        netdev_set_prio_tc_map(netdev, prio, min(prio, SX_VLAN_PRIO_MAX));
+    }
+}
+
 int sx_netdev_register_device(struct net_device *netdev, int should_rtnl_lock, int admin_state)
 {
     int                 err = 0;
@@ -1473,6 +1663,10 @@ int sx_netdev_register_device(struct net_device *netdev, int should_rtnl_lock, i
     netdev->base_addr = 0;
     netdev->irq = 0;
     netdev->features |= NETIF_F_HW_VLAN_CTAG_FILTER;
+    netdev->hw_features |= NETIF_F_GRO;
+    netdev->features |= NETIF_F_GRO;
+    netdev->needed_headroom = ISX_HDR_SIZE;
+    sx_netdev_set_tx_queues(netdev);
 
     sx_netdev_u64_to_mac(netdev->dev_addr, net_priv->mac);
     netdev->mtu = DEFAULT_FRAME_SIZE;
@@ -1536,7 +1730,7 @@ static void  * __sx_netdev_init_one_netdev(struct sx_dev *dev, int swid, int syn
     }
 
     sprintf(name, "swid%d_eth", swid);
-    netdev = alloc_netdev(sizeof(*net_priv), name, ether_setup);
+    netdev = alloc_netdev_mq(sizeof(*net_priv), name, ether_setup, SX_NETDEV_NUM_TX_QUEUES);
     if (!netdev) {
         printk(KERN_ERR PFX  "Net Device struct %s alloc failed, "
                "aborting.\n", name);
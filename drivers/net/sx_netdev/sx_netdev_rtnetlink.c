@@ -461,6 +461,7 @@ static struct rtnl_link_ops sx_netdev_link_ops __read_mostly = {
     .policy = sx_netdev_policy,
     .priv_size = sizeof(struct sx_net_priv),
     .setup = sx_netdev_setup,
+    .get_num_tx_queues = sx_netdev_get_num_tx_queues,
     .validate = sx_netdev_validate,
     .newlink = sx_netdev_newlink,
     .dellink = sx_netdev_dellink,
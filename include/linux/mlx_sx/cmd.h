@@ -111,6 +111,16 @@ struct sx_cmd_mailbox {
     u8         is_in_param_imm;
     u8         is_out_param_imm;
 };
+/* one command of sx_cmd_box_batch() */
+struct sx_cmd_batch_entry {
+    struct sx_cmd_mailbox *in_param;
+    struct sx_cmd_mailbox *out_param;
+    u32                    in_modifier;
+    u8                     op_modifier;
+    u16                    op;
+    int                    in_mb_size;
+    int                    err;  /* OUT: result of the command */
+};
 struct sx_board {
     u16  vsd_vendor_id;
     char board_id[SX_BOARD_ID_LEN];
@@ -177,6 +187,11 @@ static inline int sx_cmd_imm(struct sx_dev         *dev,
                     in_modifier, op_modifier, op, timeout, in_mb_size);
 }
 
+/* Invoke a batch of commands with output mailboxes, keeping several of them in flight */
+int sx_cmd_box_batch(struct sx_dev *dev, int sx_dev_id,
+                     struct sx_cmd_batch_entry *entries, int count,
+                     unsigned long timeout);
+
 void sx_cmd_set_op_tlv(struct ku_operation_tlv *op_tlv, u32 reg_id, u8 method);
 struct sx_cmd_mailbox * sx_alloc_cmd_mailbox(struct sx_dev *dev, int sx_dev_id);
 void sx_free_cmd_mailbox(struct sx_dev *dev, struct sx_cmd_mailbox *mailbox);
@@ -267,6 +282,9 @@ int sx_ACCESS_REG_PCNR(struct sx_dev *dev, struct ku_access_pcnr_reg *reg_data);
 int sx_ACCESS_REG_MOGCR(struct sx_dev *dev, struct ku_access_mogcr_reg *reg_data);
 int sx_ACCESS_REG_MTPPPC(struct sx_dev *dev, struct ku_access_mtpppc_reg *reg_data);
 int sx_ACCESS_REG_MTPPTR(struct sx_dev *dev, struct ku_access_mtpptr_reg *reg_data, u8 to_host_order);
+int sx_ACCESS_REG_MTPPTR_batch(struct sx_dev *dev, struct ku_access_mtpptr_reg *reg_list, int *err_list,
+                               int count, u8 to_host_order);
+int sx_ACCESS_REG_MCDA_batch(struct sx_dev *dev, struct ku_access_mcda_reg *reg_list, int *err_list, int count);
 int sx_ACCESS_REG_MTPTPT(struct sx_dev *dev, struct ku_access_mtptpt_reg *reg_data);
 int sx_ACCESS_REG_MTPPS(struct sx_dev *dev, struct ku_access_mtpps_reg *reg_data);
 int sx_ACCESS_REG_SBCTC(struct sx_dev *dev, struct ku_access_sbctc_reg *reg_data);
@@ -283,6 +301,38 @@ int sx_ISSU_FW_STATUS_GET(struct sx_dev *dev, u8 *issu_fw_status);
 
 int sx_MAD_DEMUX(struct sx_dev *sx_dev, int dev_id, uint8_t enable);
 
+struct ku_operation_tlv;
+
+typedef int (*access_reg_encode_cb_t)(u8 *inbox, void *ku_reg, void *context);
+typedef int (*access_reg_decode_cb_t)(u8 *outbox, void *ku_reg, void *context);
+
+#define SX_ACCESS_REG_F_IGNORE_FW_RET_CODE (1 << 0)
+
+/* number of registers sx_ACCESS_REG_batch() keeps mailboxes for at a time */
+#define SX_ACCESS_REG_BATCH_CHUNK 32
+
+/*
+ * One register of sx_ACCESS_REG_batch(). With raw_size != 0 the register is raw:
+ * reg_encode_cb fills the whole inbox (TLVs included), raw_size bytes of it are sent
+ * and reg_decode_cb gets the whole outbox. op_tlv is not used in that case.
+ */
+struct sx_access_reg_op {
+    uint32_t                 flags;
+    struct ku_operation_tlv *op_tlv;
+    access_reg_encode_cb_t   reg_encode_cb;
+    access_reg_decode_cb_t   reg_decode_cb;
+    u16                      reg_len;
+    u16                      raw_size;
+    void                    *ku_reg;
+    void                    *context;
+    int                      err; /* OUT: result of this register */
+};
+
+int sx_ACCESS_REG_batch(struct sx_dev           *dev,
+                        uint8_t                  dev_id,
+                        struct sx_access_reg_op *ops,
+                        int                      count);
+
 #endif /* SX_CMD_H_ */
 
 /************************************************
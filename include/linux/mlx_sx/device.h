@@ -133,6 +133,11 @@ struct sx_stats {
     u64 rx_eventlist_by_synd[NUM_HW_SYNDROMES + 1];
     u64 rx_eventlist_drops_by_synd[NUM_HW_SYNDROMES + 1];
 };
+
+/* struct sx_stats kept per CPU, see sx_stats_pcpu_get() and SX_STATS_READ() */
+struct sx_stats_pcpu {
+    struct sx_stats **per_cpu;
+};
 struct sx_dev {
     struct sx_dev_cap     dev_cap;
     spinlock_t            profile_lock;   /* the profile's lock */
@@ -157,7 +162,7 @@ struct sx_dev {
     struct cdev           cdev;
 
     /* multi-dev support */
-    struct sx_stats          stats;
+    struct sx_stats_pcpu     stats;
     u64                      eventlist_drops_counter;
     u64                      unconsumed_packets_counter;
     u64                      filtered_lag_packets_counter;
@@ -262,6 +267,11 @@ struct sx_emad {
 };
 
 #define EMAD_TLV_TYPE_SHIFT (11)
+
+/* SDQs bound to a cpu_tclass above max_cpu_etclass_for_unlimited_mtu only send
+ * packets up to this size (ISX header included) */
+#define SX_LIMITED_MTU_MAX_PKT_SIZE (2048)
+
 struct sxd_emad_tlv_reg {
     __be16 type_len;
     __be16 reserved0;
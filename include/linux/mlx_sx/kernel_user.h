@@ -518,8 +518,14 @@ enum ku_ctrl_cmd {
     CTRL_CMD_SET_PCI_PROFILE_DRIVER_ONLY, /**< Set the PCI profile driver only */
     CTRL_CMD_FLUSH_EVLIST, /**< Flush the evlist associated with a file descriptor */
     CTRL_CMD_SET_SW_IB_NODE_DESC, /**< set SW IB node description */
+    CTRL_CMD_SET_RX_RING, /**< Set up/tear down the mmap RX ring of a file descriptor */
+    CTRL_CMD_WRITE_MULTI, /**< Send multiple packets with a per packet result */
+    CTRL_CMD_SET_RDQ_MODERATION, /**< Set the interrupt moderation and busy-poll of an RDQ */
+    CTRL_CMD_GET_RDQ_MODERATION, /**< Get the interrupt moderation state and counters of an RDQ */
+    CTRL_CMD_ACCESS_REG_BATCH, /**< Run a batch of RAW buffer access register commands */
+    CTRL_CMD_SEND_EMAD_BATCH, /**< Send a batch of EMADs through the EMAD pipeline and get their responses */
     CTRL_CMD_MIN_VAL = CTRL_CMD_GET_CAPABILITIES, /**< Minimum enum value */
-    CTRL_CMD_MAX_VAL = CTRL_CMD_SET_SW_IB_NODE_DESC /**< Maximum enum value */
+    CTRL_CMD_MAX_VAL = CTRL_CMD_SEND_EMAD_BATCH /**< Maximum enum value */
 };
 
 /**
@@ -1168,6 +1174,37 @@ struct ku_read {
     struct   ku_timespec __attribute__((aligned(8))) timestamp; /**< timestamp of packet */
 };
 
+#define KU_RX_RING_HDR_SIZE       4096 /**< offset of the first slot in the mmap RX ring */
+#define KU_RX_RING_SLOT_COUNT_MAX (1 << 16)
+#define KU_RX_RING_SLOT_SIZE_MAX  (64 * 1024)
+
+/**
+ * ku_rx_ring_params structure is used to set up (slot_count != 0) or tear down
+ * (slot_count == 0) the mmap RX ring of a file descriptor (CTRL_CMD_SET_RX_RING).
+ * While the ring is set, packets of the file's listeners are written to the ring
+ * instead of being queued for read(). The ring is mapped with mmap() at offset 0.
+ */
+struct ku_rx_ring_params {
+    uint32_t slot_count; /**< number of slots, a power of 2 */
+    uint32_t slot_size; /**< size of a slot (struct ku_read followed by the packet), a multiple of 8 */
+};
+
+/**
+ * ku_rx_ring_hdr structure is placed at the beginning of the mmap RX ring.
+ * The slots start at KU_RX_RING_HDR_SIZE. head and tail are free running counters,
+ * counter c refers to slot (c & (slot_count - 1)). The kernel produces at head,
+ * user space consumes at tail and advances it after it is done with the slot.
+ * ku_read.length of a slot is the number of packet bytes in the slot, the packet
+ * is truncated if it does not fit (see ku_read.original_packet_size).
+ */
+struct ku_rx_ring_hdr {
+    uint32_t                              slot_count; /**< number of slots */
+    uint32_t                              slot_size; /**< size of a slot */
+    uint32_t                              head; /**< next slot to be written by the kernel */
+    uint32_t                              tail; /**< next slot to be consumed by user space */
+    uint64_t __attribute__((aligned(8)))  drops; /**< packets dropped because the ring was full */
+};
+
 /**
  * loopback_data structure is used to store the data of a sent loopback packet.
  */
@@ -1227,6 +1264,46 @@ struct ku_write {
     struct ku_iovec * __attribute__((aligned(8))) iov;    /**< iov - an array of iovec, each one point to one of a packet buffer */
 };
 
+#define WRITE_MULTI_PKTS_MAX 1024
+
+/**
+ * ku_write_multi_params structure is used to send multiple packets in one
+ * CTRL_CMD_WRITE_MULTI call. Unlike write(), a failed packet does not stop the
+ * call, its error is returned in result_list and the next packets are sent.
+ */
+struct ku_write_multi_params {
+    struct ku_write * __attribute__((aligned(8))) write_list;  /**< IN: packets to send */
+    int32_t * __attribute__((aligned(8)))         result_list; /**< OUT: per packet result, 0 or -errno */
+    uint32_t                                      pkt_count;   /**< IN: number of entries in write_list and result_list (up to WRITE_MULTI_PKTS_MAX) */
+    uint32_t                                      sent_count;  /**< OUT: number of packets sent successfully */
+};
+
+#define EMAD_BATCH_MAX 1024
+
+/**
+ * ku_emad_frame structure is used to store one EMAD of CTRL_CMD_SEND_EMAD_BATCH
+ */
+struct ku_emad_frame {
+    uint8_t * __attribute__((aligned(8))) req_buff;  /**< IN: EMAD request frame, starting at the ETH header */
+    uint8_t * __attribute__((aligned(8))) resp_buff; /**< OUT: EMAD response frame */
+    uint16_t                              req_size;  /**< IN: size of the request frame */
+    uint16_t                              resp_size; /**< IN: size of resp_buff, OUT: size of the response frame */
+};
+
+/**
+ * ku_emad_batch structure is used to send multiple EMADs in one CTRL_CMD_SEND_EMAD_BATCH
+ * call. Up to the emad_window_size module parameter EMADs are kept in flight and the
+ * responses are matched to the requests by transaction ID, so every EMAD must have a
+ * unique TID. A failed EMAD does not stop the call, its error is returned in result_list.
+ */
+struct ku_emad_batch {
+    struct ku_emad_frame * __attribute__((aligned(8))) frame_list;   /**< IN/OUT: EMADs to send */
+    int32_t * __attribute__((aligned(8)))              result_list;  /**< OUT: per EMAD result, 0 or -errno */
+    uint32_t                                           frame_count;  /**< IN: number of entries in frame_list and result_list (up to EMAD_BATCH_MAX) */
+    uint32_t                                           timeout_msec; /**< IN: time to wait for the response of an EMAD, 0 for the default */
+    uint8_t                                            dev_id;       /**< IN: device ID */
+};
+
 /**
  * ku_filter_critireas union is used to store the filter critireas
  * info.
@@ -1310,6 +1387,7 @@ struct ku_monitor_trap_group_stat_ioctl {
     uint16_t      monitor_hw_trap_group;
     sxd_boolean_t clear_after_read;
     uint32_t      discarded_pkts_total_num;
+    uint32_t      drain_rate; /**< OUT: packets per second drained from the monitor RDQ lately */
 };
 
 /**
@@ -1378,6 +1456,26 @@ struct ku_rdq_timestamp_state {
     uint8_t enable; /**< enable - 0-disable, 1-enable */
 };
 
+/**
+ * ku_rdq_moderation structure is used to set (CTRL_CMD_SET_RDQ_MODERATION) and get
+ * (CTRL_CMD_GET_RDQ_MODERATION) the interrupt moderation of an RDQ. The interrupt of the
+ * RDQ is held back by up to max_usec, scaled by the RDQ packet rate between rate_low
+ * and rate_high packets per second. The counters are read only.
+ */
+struct ku_rdq_moderation {
+    int                                  rdq; /**< rdq - RDQ */
+    uint32_t                             max_usec; /**< latency target, longest interrupt hold back, 0 disables moderation */
+    uint32_t                             rate_low; /**< packets per second up to which the interrupt is not held back */
+    uint32_t                             rate_high; /**< packets per second from which the interrupt is held back by max_usec */
+    uint32_t                             busy_poll_usec; /**< time to poll an empty RDQ before re-arming its interrupt, 0 disables busy-poll */
+    uint32_t                             cur_usec; /**< OUT: current interrupt hold back */
+    uint32_t                             rate; /**< OUT: packets per second in the last sampling window */
+    uint64_t __attribute__((aligned(8))) arms; /**< OUT: interrupts re-armed right away */
+    uint64_t __attribute__((aligned(8))) deferred_arms; /**< OUT: interrupts re-armed after the hold back */
+    uint64_t __attribute__((aligned(8))) busy_poll_hits; /**< OUT: busy-poll rounds that found packets */
+    uint64_t __attribute__((aligned(8))) busy_poll_misses; /**< OUT: busy-poll rounds that timed out */
+};
+
 /**
  * ku_rdq_cpu_priority structure is used to set priority to LOW/HIGH depends on HW policer existence
  */
@@ -7323,6 +7421,21 @@ struct ku_access_reg_raw_buff {
     uint8_t           dev_id; /**< dev_id - device id */
 };
 
+#define ACCESS_REG_BATCH_MAX 256
+
+/**
+ * ku_access_reg_batch structure is used to run several RAW buffer access register
+ * commands (as in CTRL_CMD_ACCESS_REG_RAW_BUFF) in one CTRL_CMD_ACCESS_REG_BATCH call.
+ * The commands are kept in flight together. A failed command does not stop the call,
+ * its error is returned in result_list.
+ */
+struct ku_access_reg_batch {
+    struct ku_raw_reg * __attribute__((aligned(8))) reg_list;    /**< IN/OUT: request buffers, overwritten by the responses */
+    int32_t * __attribute__((aligned(8)))           result_list; /**< OUT: per command result, 0 or -errno */
+    uint32_t                                        reg_count;   /**< IN: number of entries in reg_list and result_list (up to ACCESS_REG_BATCH_MAX) */
+    uint8_t                                         dev_id;      /**< dev_id - device id */
+};
+
 /**
  * ku_access_hpkt_reg structure is used to store the access register HPKT command parameters
  */
@@ -106,6 +106,26 @@ enum sx_bfd_cmd {
      *  Message format is defined in struct bfd_stats_req.
      */
     SX_BFD_CMD_GET_AND_CLEAR_TX_STATS,
+
+    /*
+     *  Register an event ring for a BFD agent. Packet and timeout events of the agent
+     *  are queued on the ring instead of being sent as traps. The ring is unregistered
+     *  when the file it was registered through is closed.
+     *  Message format is defined in struct bfd_event_ring_params.
+     */
+    SX_BFD_CMD_REGISTER_EVENT_RING,
+
+    /*
+     *  Unregister the event ring of a BFD agent, events are sent as traps again.
+     *  Message format is defined in struct bfd_event_ring_params.
+     */
+    SX_BFD_CMD_UNREGISTER_EVENT_RING,
+
+    /*
+     *  Read a batch of events from the event ring of a BFD agent.
+     *  Message format is defined in struct bfd_event_batch.
+     */
+    SX_BFD_CMD_GET_EVENTS,
 };
 
 struct __attribute__((__packed__)) bfd_offload_info {
@@ -194,5 +214,39 @@ struct __attribute__((__packed__)) bfd_packet_event {
     char          packet[0];
 };
 
+#define BFD_EVENT_RING_DEFAULT_SIZE 1024
+#define BFD_EVENT_RING_MAX_SIZE     16384
+
+struct __attribute__((__packed__)) bfd_event_ring_params {
+    unsigned long bfd_pid;
+
+    /*
+     *  Number of events the ring holds, rounded up to a power of 2 (0 - default size).
+     *  Events that do not fit are dropped and counted.
+     */
+    uint32_t ring_size;
+};
+
+enum bfd_event_type {
+    BFD_EVENT_PACKET,  /* followed by struct bfd_packet_event */
+    BFD_EVENT_TIMEOUT, /* followed by struct bfd_timeout_event */
+};
+
+struct __attribute__((__packed__)) bfd_event_hdr {
+    uint16_t type;
+    uint16_t size; /* size of the event that follows the header */
+};
+
+struct __attribute__((__packed__)) bfd_event_batch {
+    unsigned long bfd_pid;
+    uint32_t      timeout_msec; /* time to wait for the first event (0 - return immediately) */
+    uint32_t      buf_size;
+    char         *buf;          /* OUT: sequence of bfd_event_hdr, each followed by its event */
+    uint32_t      event_count;  /* OUT: number of events in buf */
+    uint32_t      bytes;        /* OUT: bytes used in buf */
+    uint32_t      pending;      /* OUT: events left on the ring */
+    uint64_t      dropped;      /* OUT: events dropped on a full ring since it was registered */
+};
+
 
 #endif /* __SX_BFD_CTRL_CMDS_H_ */